@@ -16,6 +16,8 @@
 #include "freertos/task.h"
 #include "rwlock.h"
 #include "util.h"
+#include "lcd_module.h"
+#include "lcd_ui.h"
 
 /*work under progress*/
 #define ESP_INTR_FLAG_DEFAULT 0
@@ -58,7 +60,8 @@ void mcp_task(void* arg)
   
   
 
-    begin(0);
+    // no begin(0) here: it sets all expander pins to input, which
+    // would release the relay output (see relay_module.c)
 
     vTaskDelay(300/portTICK_PERIOD_MS);
 
@@ -69,66 +72,30 @@ void mcp_task(void* arg)
     // printf("%u \n", val );
      
      // Here either the button has been pushed or released.
+     // The keys go to the widget UI of the LCD, which edits the set point,
+     // mode and thresholds (see lcd_module.c).
     if ( pin == 0 && val == 0) 
         { //  Test for release - pin pulled high
-     
             button = 0;
-
-
-        rwlock_reader_lock(&system_state_lock);
-        get_system_state(&mystate);
-        rwlock_reader_unlock(&system_state_lock);
-
-          
-          if ( mystate.mode == 0)
-          {
-            rwlock_writer_lock(&system_state_lock);
-            get_system_state(&gb_system_state);
-            gb_system_state.set_point ++ ;
-            set_system_state(&gb_system_state);
-            rwlock_writer_unlock(&system_state_lock);
-          }
-
-
+            lcd_key(LCD_UI_KEY_UP);
         }
 
         if( pin == 2 && val == 0)
         {
             button = 0;
-
-          if ( mystate.mode == 0)
-          {
-                rwlock_writer_lock(&system_state_lock);
-                get_system_state(&gb_system_state);
-                gb_system_state.set_point -- ;
-                set_system_state(&gb_system_state);
-                rwlock_writer_unlock(&system_state_lock);
-           }
-
+            lcd_key(LCD_UI_KEY_DOWN);
         }
 
          if( pin == 1 && val == 0)
         {
             button = 0;
-            rwlock_writer_lock(&system_state_lock);
-        get_system_state(&gb_system_state);
-        gb_system_state.mode = 0;
-        set_system_state(&gb_system_state);
-        rwlock_writer_unlock(&system_state_lock);
-
+            lcd_key(LCD_UI_KEY_MENU);
         }
 
          if( pin == 3 && val == 0)
         {
             button = 0;
-
-          
-        rwlock_writer_lock(&system_state_lock);
-        get_system_state(&gb_system_state);
-        gb_system_state.mode = 1;
-        set_system_state(&gb_system_state);
-        rwlock_writer_unlock(&system_state_lock);
-
+            lcd_key(LCD_UI_KEY_SELECT);
         }
 
 
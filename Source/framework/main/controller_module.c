@@ -19,16 +19,116 @@
 #include "soc/uart_struct.h"
 #include "util.h"
 #include "rwlock.h"
+#include "policy_vm.h"
+#include "rs_485_module.h"
 
 
 const char * const controller_task_name = "controller_module_task";
 
 system_state_t mystate;
 
+/** @brief number of controller iterations between policy cost reports */
+#define POLICY_STATS_PERIOD 120
+
+/** @brief set point range a policy may request, the same as the LCD options */
+#define POLICY_SET_POINT_MIN 0
+#define POLICY_SET_POINT_MAX 200
+
+/** @brief DR event last signalled to the water heater */
+static cta2045_cmd_t dr_event = CTA2045_CMD_END_SHED;
+
 /*****************************************
  ************ MODULE FUNCTIONS ***********
  *****************************************/
 
+/**
+ * @brief signal grid events to the water heater as CTA-2045 basic DR
+ *        commands: Load Up on over frequency, Shed on under frequency and
+ *        End Shed once the frequency is back in band
+ *
+ * @param state - snapshot of the system state
+ *
+ * @return void
+ */
+static void signal_dr_event( const system_state_t *state )
+{
+    cta2045_cmd_t event = CTA2045_CMD_END_SHED;
+
+    /* without an SGD on the bus nobody would answer, keep the bus for the EC-100 */
+    if (!rs485_has_sgd()) {
+        return;
+    }
+
+    if (state->mode == 1) {
+        if (state->grid_freq > state->threshold_overfrq) {
+            event = CTA2045_CMD_LOAD_UP;
+        } else if (state->grid_freq < state->threshold_underfrq) {
+            event = CTA2045_CMD_SHED;
+        }
+    }
+
+    if (event != dr_event && rs485_submit_command(event, 0) == CTA2045_SUCCESS) {
+        dr_event = event;
+    }
+}
+
+/**
+ * @brief run the loaded control policy and apply its actuation requests
+ *
+ * Requests are held to what a user can enter on the LCD: the set point is
+ * clamped to POLICY_SET_POINT_MIN..POLICY_SET_POINT_MAX and only modes 0
+ * and 1 are accepted. Mode 0 means the unit is not grid responsive, so a
+ * set point request is dropped unless the same run also selects mode 1.
+ *
+ * @param state - snapshot of the system state
+ *
+ * @return void
+ */
+static void run_policy( const system_state_t *state )
+{
+    policy_vm_output_t out;
+    policy_vm_stats_t stats;
+    int err;
+
+    err = policy_vm_run(POLICY_EVENT_TICK, state, &out);
+    if (err != POLICY_VM_SUCCESS) {
+        printf("policy failed: %d\n", err);
+    }
+
+    if (out.mode_valid && out.mode != 0 && out.mode != 1) {
+        printf("policy: ignoring mode %d\n", out.mode);
+        out.mode_valid = 0;
+    }
+    if (out.set_point < POLICY_SET_POINT_MIN) {
+        out.set_point = POLICY_SET_POINT_MIN;
+    } else if (out.set_point > POLICY_SET_POINT_MAX) {
+        out.set_point = POLICY_SET_POINT_MAX;
+    }
+
+    if (out.set_point_valid || out.mode_valid) {
+        rwlock_writer_lock(&system_state_lock);
+        get_system_state(&gb_system_state);
+        if (out.mode_valid) {
+            gb_system_state.mode = out.mode;
+        }
+        if (out.set_point_valid && gb_system_state.mode != 0) {
+            gb_system_state.set_point = out.set_point;
+        }
+        set_system_state(&gb_system_state);
+        rwlock_writer_unlock(&system_state_lock);
+    }
+
+    policy_vm_get_stats(&stats);
+    /* runs is 0 if the wifi task loaded a new policy since the run above */
+    if (stats.runs != 0 && stats.runs % POLICY_STATS_PERIOD == 0) {
+        printf("policy: runs %u, last %u us / %u instr, max %u us / %u instr, avg %u us, errors %u (budget %u)\n",
+               stats.runs, stats.last_us, stats.last_instructions,
+               stats.max_us, stats.max_instructions,
+               (unsigned)(stats.total_us / stats.runs),
+               stats.errors, stats.budget_exceeded);
+    }
+}
+
 /**
  * @brief controller task logic
  *
@@ -46,6 +146,15 @@ static void controller_task_fn( void *pv_parameters )
     // set_system_state(&gb_system_state);
     rwlock_reader_unlock(&system_state_lock);
 
+    signal_dr_event(&mystate);
+
+    if (policy_vm_is_loaded())
+    {
+        run_policy(&mystate);
+        vTaskDelay(500/portTICK_PERIOD_MS);
+        continue;
+    }
+
     //if ( strcmp(mystate.mode,"E")== 0)
 
     //printf("bye...\n");
@@ -90,6 +199,9 @@ static void controller_task_fn( void *pv_parameters )
 void controller_init_task( void ) {
 
     printf("Intializing Controlling System...");
+    if (policy_vm_load_nvs() == POLICY_VM_SUCCESS) {
+        printf("loaded control policy from NVS...");
+    }
     xTaskCreatePinnedToCore(
                 controller_task_fn, /* task function */
                 "controller_task_fn", /* controller task name */
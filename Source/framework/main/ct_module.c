@@ -97,26 +97,6 @@ static void adc_task(void* arg) {
   }
 }
 
-static void relay_task(void* arg)
-{
-  while(1)
-  {
-     rwlock_reader_lock(&system_state_lock);
-    get_system_state(&mystate);
-    rwlock_reader_unlock(&system_state_lock);
-
-    if (mystate.set_point > 127)
-    {
-      rwlock_writer_lock(&i2c_lock);  
-      begin(0);
-      pinMode(4,GPIO_MODE_OUTPUT); 
-      digitalWrite(4,1);
-      rwlock_writer_unlock(&i2c_lock);  
-    }
-  }
-}
-
-
 void ct_init_task( void ) {
   adc1_config_width(ADC_WIDTH_9Bit);
   adc1_config_channel_atten(ADC1_CHANNEL_0,ADC_ATTEN_11db);
@@ -134,7 +114,5 @@ void ct_init_task( void ) {
   timer_start(timr_group, timr_idx);
   xTaskCreatePinnedToCore(adc_task, "adc_task", 1024, NULL, 10, NULL,0);
 
-  //xTaskCreate(relay_task, "adc_task", 1024, NULL, 10, NULL);
-
 
 }
@@ -0,0 +1,186 @@
+/**
+ * @file cta2045_app.c
+ *
+ * @brief CTA-2045 basic DR commands and the coalescing command queue
+ */
+
+#include <string.h>
+#include "cta2045_app.h"
+
+typedef struct {
+  const char *name;
+  uint8_t opcode;
+  uint8_t slot;
+} cta2045_cmd_info_t;
+
+static const cta2045_cmd_info_t cmd_info[CTA2045_CMD_CNT] = {
+  { "set point",      0,                          CTA2045_SLOT_SET_POINT },
+  { "shed",           CTA2045_OP_SHED,            CTA2045_SLOT_EVENT },
+  { "end shed",       CTA2045_OP_END_SHED,        CTA2045_SLOT_EVENT },
+  { "load up",        CTA2045_OP_LOAD_UP,         CTA2045_SLOT_EVENT },
+  { "critical peak",  CTA2045_OP_CRITICAL_PEAK,   CTA2045_SLOT_EVENT },
+  { "grid emergency", CTA2045_OP_GRID_EMERGENCY,  CTA2045_SLOT_EVENT },
+  { "outside comm",   CTA2045_OP_OUTSIDE_COMM,    CTA2045_SLOT_COMM },
+};
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static void app_complete( cta2045_app_t *app, const cta2045_slot_t *cmd, uint32_t now_ms ) {
+  cta2045_cmd_stats_t *stats = &app->stats[cmd->cmd];
+  uint32_t latency = now_ms - cmd->submit_ms;
+
+  stats->completed++;
+  stats->last_latency_ms = latency;
+  if ( latency > stats->max_latency_ms ) {
+    stats->max_latency_ms = latency;
+  }
+  stats->total_latency_ms += latency;
+}
+
+static void app_finish_inflight( cta2045_app_t *app, int success, uint32_t now_ms ) {
+  if ( success ) {
+    app_complete(app, &app->current, now_ms);
+  } else {
+    app->stats[app->current.cmd].failed++;
+  }
+  app->inflight = 0;
+  app->wait_app_ack = 0;
+}
+
+/**
+ * @brief find the oldest pending command that goes out as a CTA-2045
+ *        message (the set point waits for a poll instead)
+ *
+ * @return slot index, or -1 if there is none
+ */
+static int app_oldest_message( const cta2045_app_t *app ) {
+  int best = -1;
+  int i;
+
+  for ( i = 0; i < CTA2045_SLOT_CNT; i++ ) {
+    if ( i == CTA2045_SLOT_SET_POINT || !app->slot[i].pending ) {
+      continue;
+    }
+    if ( best < 0 || (int32_t)(app->slot[i].seq - app->slot[best].seq) < 0 ) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void cta2045_app_init( cta2045_app_t *app, cta2045_link_t *link ) {
+  memset(app, 0, sizeof(*app));
+  app->link = link;
+}
+
+int cta2045_app_submit( cta2045_app_t *app, cta2045_cmd_t cmd, uint8_t arg, uint32_t now_ms ) {
+  cta2045_slot_t *slot;
+
+  if ( (unsigned)cmd >= CTA2045_CMD_CNT ) {
+    return CTA2045_ERR_LENGTH;
+  }
+  slot = &app->slot[cmd_info[cmd].slot];
+  if ( slot->pending ) {
+    app->stats[slot->cmd].coalesced++;
+  }
+  slot->pending = 1;
+  slot->cmd = cmd;
+  slot->arg = arg;
+  slot->seq = app->seq++;
+  slot->submit_ms = now_ms;
+  app->stats[cmd].submitted++;
+  return CTA2045_SUCCESS;
+}
+
+void cta2045_app_poll( cta2045_app_t *app, uint32_t now_ms ) {
+  uint8_t payload[2];
+  int i;
+
+  if ( app->inflight ) {
+    if ( app->wait_app_ack && now_ms - app->sent_ms >= CTA2045_APP_ACK_TIMEOUT_MS ) {
+      app_finish_inflight(app, 0, now_ms);
+    }
+    return;
+  }
+
+  i = app_oldest_message(app);
+  if ( i < 0 || cta2045_link_busy(app->link) ) {
+    return;
+  }
+
+  payload[0] = cmd_info[app->slot[i].cmd].opcode;
+  payload[1] = app->slot[i].arg;
+  if ( cta2045_link_send(app->link, CTA2045_MSG_BASIC_DR, payload, sizeof(payload), now_ms) != CTA2045_SUCCESS ) {
+    return;
+  }
+  app->current = app->slot[i];
+  app->slot[i].pending = 0;
+  app->inflight = 1;
+  app->wait_app_ack = 0;
+  app->sent_ms = now_ms;
+}
+
+int cta2045_app_ready( const cta2045_app_t *app ) {
+  return !app->inflight && !cta2045_link_busy(app->link) && app_oldest_message(app) >= 0;
+}
+
+int cta2045_app_take_set_point( cta2045_app_t *app, uint8_t *set_point, uint32_t now_ms ) {
+  cta2045_slot_t *slot = &app->slot[CTA2045_SLOT_SET_POINT];
+
+  if ( !slot->pending ) {
+    return 0;
+  }
+  *set_point = slot->arg;
+  slot->pending = 0;
+  /* the vendor protocol has no acknowledgement, sending completes it */
+  app_complete(app, slot, now_ms);
+  return 1;
+}
+
+void cta2045_app_on_link_done( cta2045_app_t *app, int result, uint32_t now_ms ) {
+  if ( !app->inflight ) {
+    return;
+  }
+  if ( result != CTA2045_SUCCESS ) {
+    app_finish_inflight(app, 0, now_ms);
+    return;
+  }
+  app->wait_app_ack = 1;
+  app->sent_ms = now_ms;
+}
+
+void cta2045_app_on_message( cta2045_app_t *app, const cta2045_frame_t *frame, uint32_t now_ms ) {
+  uint8_t opcode;
+
+  if ( frame->msg_type != CTA2045_MSG_BASIC_DR || frame->len < 2 || !app->inflight ) {
+    return;
+  }
+  opcode = frame->payload[0];
+  if ( (opcode != CTA2045_OP_APP_ACK && opcode != CTA2045_OP_APP_NAK) ||
+       frame->payload[1] != cmd_info[app->current.cmd].opcode ) {
+    return;
+  }
+  /* the ACK may overtake the link ACK's done callback, accept it anyway */
+  app_finish_inflight(app, opcode == CTA2045_OP_APP_ACK, now_ms);
+}
+
+void cta2045_app_get_stats( const cta2045_app_t *app, cta2045_cmd_t cmd, cta2045_cmd_stats_t *dest ) {
+  if ( (unsigned)cmd >= CTA2045_CMD_CNT ) {
+    memset(dest, 0, sizeof(*dest));
+    return;
+  }
+  memcpy(dest, &app->stats[cmd], sizeof(*dest));
+}
+
+const char *cta2045_app_cmd_name( cta2045_cmd_t cmd ) {
+  if ( (unsigned)cmd >= CTA2045_CMD_CNT ) {
+    return "unknown";
+  }
+  return cmd_info[cmd].name;
+}
@@ -0,0 +1,378 @@
+/**
+ * @file cta2045_link.c
+ *
+ * @brief CTA-2045 data link layer: frame parser, ACK/NAK, retries, timeouts
+ */
+
+#include <string.h>
+#include "cta2045_link.h"
+
+/* receiver states */
+#define RX_IDLE 0     /* waiting for the first byte of a frame */
+#define RX_LINK 1     /* got ACK/NAK type byte, waiting for its argument */
+#define RX_HEADER 2   /* collecting message type and length */
+#define RX_BODY 3     /* collecting payload and checksum */
+#define RX_VENDOR 4   /* collecting a vendor frame until the line is idle */
+#define RX_DISCARD 5  /* dropping bytes until the line is idle */
+
+/* transmitter states */
+#define TX_IDLE 0
+#define TX_WAIT_ACK 1
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static void link_send_link_msg( cta2045_link_t *link, uint8_t type, uint8_t arg ) {
+  uint8_t msg[2];
+
+  msg[0] = type;
+  msg[1] = arg;
+  link->tx(msg, sizeof(msg), link->ctx);
+}
+
+static void link_tx_finish( cta2045_link_t *link, int result ) {
+  uint16_t msg_type = (link->tx_buf[0] << 8) | link->tx_buf[1];
+
+  link->tx_state = TX_IDLE;
+  if ( result != CTA2045_SUCCESS ) {
+    link->stats.tx_failed++;
+  }
+  if ( link->done != NULL ) {
+    link->done(result, msg_type, link->ctx);
+  }
+}
+
+/**
+ * @brief resend the pending message, or give up once the retries are spent
+ *
+ * @return void
+ */
+static void link_tx_retry( cta2045_link_t *link, int result, uint32_t now_ms ) {
+  if ( link->tx_attempts > CTA2045_MAX_RETRIES ) {
+    link_tx_finish(link, result);
+    return;
+  }
+  link->tx_attempts++;
+  link->tx_sent_ms = now_ms;
+  link->stats.retries++;
+  link->tx(link->tx_buf, link->tx_len, link->ctx);
+}
+
+static void link_rx_link_msg( cta2045_link_t *link, uint8_t type, uint32_t now_ms ) {
+  if ( type == CTA2045_LINK_ACK ) {
+    link->stats.acks_rx++;
+    if ( link->tx_state == TX_WAIT_ACK ) {
+      link_tx_finish(link, CTA2045_SUCCESS);
+    } else {
+      link->stats.stray_acks++;
+    }
+  } else {
+    link->stats.naks_rx++;
+    if ( link->tx_state == TX_WAIT_ACK ) {
+      link_tx_retry(link, CTA2045_ERR_NAK, now_ms);
+    } else {
+      link->stats.stray_acks++;
+    }
+  }
+}
+
+static void link_rx_message( cta2045_link_t *link ) {
+  cta2045_frame_t frame;
+  uint16_t payload_len = link->rx_len - CTA2045_HEADER_SIZE - CTA2045_CHECKSUM_SIZE;
+  uint16_t check = cta2045_checksum(link->rx_buf, CTA2045_HEADER_SIZE + payload_len);
+  const uint8_t *tail = link->rx_buf + CTA2045_HEADER_SIZE + payload_len;
+
+  if ( tail[0] != (check >> 8) || tail[1] != (check & 0xff) ) {
+    link->stats.checksum_errors++;
+    link_send_link_msg(link, CTA2045_LINK_NAK, CTA2045_NAK_CHECKSUM);
+    return;
+  }
+
+  frame.msg_type = (link->rx_buf[0] << 8) | link->rx_buf[1];
+  if ( frame.msg_type != CTA2045_MSG_BASIC_DR &&
+       frame.msg_type != CTA2045_MSG_INTERMEDIATE_DR &&
+       frame.msg_type != CTA2045_MSG_DATA_LINK ) {
+    link->stats.unsupported++;
+    link_send_link_msg(link, CTA2045_LINK_NAK, CTA2045_NAK_UNSUPPORTED);
+    return;
+  }
+
+  link->stats.messages_rx++;
+  link_send_link_msg(link, CTA2045_LINK_ACK, 0x00);
+
+  frame.kind = CTA2045_FRAME_MESSAGE;
+  frame.payload = link->rx_buf + CTA2045_HEADER_SIZE;
+  frame.len = payload_len;
+  link->rx(&frame, link->ctx);
+}
+
+static void link_rx_vendor( cta2045_link_t *link ) {
+  cta2045_frame_t frame;
+
+  link->stats.vendor_frames_rx++;
+  frame.kind = CTA2045_FRAME_VENDOR;
+  frame.msg_type = 0;
+  frame.payload = link->rx_buf;
+  frame.len = link->rx_len;
+  link->rx(&frame, link->ctx);
+}
+
+/**
+ * @brief handle the line going quiet in the middle of a frame
+ *
+ * A vendor frame ends after CTA2045_VENDOR_GAP_MS of silence, a CTA-2045
+ * frame is abandoned after CTA2045_INTERCHAR_TIMEOUT_MS.
+ *
+ * @return void
+ */
+static void link_rx_timeout( cta2045_link_t *link, uint32_t now_ms ) {
+  uint32_t gap = now_ms - link->rx_last_ms;
+
+  switch ( link->rx_state ) {
+    case RX_VENDOR:
+      if ( gap >= CTA2045_VENDOR_GAP_MS ) {
+        link->rx_state = RX_IDLE;
+        link_rx_vendor(link);
+      }
+      break;
+    case RX_DISCARD:
+      if ( gap >= CTA2045_VENDOR_GAP_MS ) {
+        link->rx_state = RX_IDLE;
+      }
+      break;
+    case RX_LINK:
+    case RX_HEADER:
+    case RX_BODY:
+      if ( gap >= CTA2045_INTERCHAR_TIMEOUT_MS ) {
+        link->stats.interchar_timeouts++;
+        if ( link->rx_state != RX_LINK ) {
+          link_send_link_msg(link, CTA2045_LINK_NAK, CTA2045_NAK_TIMEOUT);
+        }
+        link->rx_state = RX_IDLE;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void link_rx_byte( cta2045_link_t *link, uint8_t b, uint32_t now_ms ) {
+  switch ( link->rx_state ) {
+    case RX_IDLE:
+      link->rx_len = 0;
+      link->rx_buf[link->rx_len++] = b;
+      if ( b == CTA2045_LINK_ACK || b == CTA2045_LINK_NAK ) {
+        link->rx_state = RX_LINK;
+      } else if ( b == CTA2045_MSG_TYPE1_DR ) {
+        link->rx_state = RX_HEADER;
+      } else {
+        link->rx_state = RX_VENDOR;
+      }
+      break;
+
+    case RX_LINK:
+      link->rx_state = RX_IDLE;
+      link_rx_link_msg(link, link->rx_buf[0], now_ms);
+      break;
+
+    case RX_HEADER:
+      link->rx_buf[link->rx_len++] = b;
+      if ( link->rx_len == CTA2045_HEADER_SIZE ) {
+        link->rx_expected = (link->rx_buf[2] << 8) | link->rx_buf[3];
+        if ( link->rx_expected > CTA2045_MAX_PAYLOAD ) {
+          link->stats.overflows++;
+          link_send_link_msg(link, CTA2045_LINK_NAK, CTA2045_NAK_TOO_LONG);
+          link->rx_state = RX_DISCARD;
+          break;
+        }
+        link->rx_expected += CTA2045_HEADER_SIZE + CTA2045_CHECKSUM_SIZE;
+        link->rx_state = RX_BODY;
+      }
+      break;
+
+    case RX_BODY:
+      link->rx_buf[link->rx_len++] = b;
+      if ( link->rx_len == link->rx_expected ) {
+        link->rx_state = RX_IDLE;
+        link_rx_message(link);
+      }
+      break;
+
+    case RX_VENDOR:
+      if ( link->rx_len >= CTA2045_MAX_FRAME ) {
+        link->stats.overflows++;
+        link->rx_state = RX_DISCARD;
+        break;
+      }
+      link->rx_buf[link->rx_len++] = b;
+      break;
+
+    default:
+      break;
+  }
+  link->rx_last_ms = now_ms;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+uint16_t cta2045_checksum( const uint8_t *buf, size_t len ) {
+  uint16_t check1 = 0xAA;
+  uint16_t check2 = 0;
+  uint8_t msb, lsb;
+  size_t i;
+
+  for ( i = 0; i < len; i++ ) {
+    check1 = (check1 + buf[i]) % 255;
+    check2 = (check2 + check1) % 255;
+  }
+  msb = 255 - ((check1 + check2) % 255);
+  lsb = 255 - ((check1 + msb) % 255);
+  return (msb << 8) | lsb;
+}
+
+void cta2045_builder_begin( cta2045_builder_t *b, uint8_t *buf, size_t size, uint16_t msg_type ) {
+  b->buf = buf;
+  b->size = size > CTA2045_MAX_FRAME ? CTA2045_MAX_FRAME : size;
+  b->len = 0;
+  b->vendor = 0;
+  b->overflow = 0;
+  cta2045_builder_put(b, msg_type >> 8);
+  cta2045_builder_put(b, msg_type & 0xff);
+  /* length, patched in cta2045_builder_finish() */
+  cta2045_builder_put(b, 0);
+  cta2045_builder_put(b, 0);
+}
+
+void cta2045_builder_begin_vendor( cta2045_builder_t *b, uint8_t *buf, size_t size ) {
+  b->buf = buf;
+  b->size = size > CTA2045_MAX_FRAME ? CTA2045_MAX_FRAME : size;
+  b->len = 0;
+  b->vendor = 1;
+  b->overflow = 0;
+}
+
+void cta2045_builder_put( cta2045_builder_t *b, uint8_t val ) {
+  if ( b->len >= b->size ) {
+    b->overflow = 1;
+    return;
+  }
+  b->buf[b->len++] = val;
+}
+
+void cta2045_builder_put_bytes( cta2045_builder_t *b, const uint8_t *data, size_t len ) {
+  if ( len > (size_t)(b->size - b->len) ) {
+    b->overflow = 1;
+    return;
+  }
+  memcpy(b->buf + b->len, data, len);
+  b->len += len;
+}
+
+int cta2045_builder_finish( cta2045_builder_t *b ) {
+  uint16_t payload_len;
+  uint16_t check;
+  uint8_t sum;
+  uint16_t i;
+
+  if ( b->overflow ) {
+    return CTA2045_ERR_LENGTH;
+  }
+  if ( b->vendor ) {
+    for ( i = 0, sum = 0; i < b->len; i++ ) {
+      sum += b->buf[i];
+    }
+    cta2045_builder_put(b, sum);
+  } else {
+    payload_len = b->len - CTA2045_HEADER_SIZE;
+    b->buf[2] = payload_len >> 8;
+    b->buf[3] = payload_len & 0xff;
+    check = cta2045_checksum(b->buf, b->len);
+    cta2045_builder_put(b, check >> 8);
+    cta2045_builder_put(b, check & 0xff);
+  }
+  return b->overflow ? CTA2045_ERR_LENGTH : b->len;
+}
+
+int cta2045_build_message( uint8_t *dst, size_t size, uint16_t msg_type,
+                           const uint8_t *payload, uint16_t len ) {
+  cta2045_builder_t b;
+
+  cta2045_builder_begin(&b, dst, size, msg_type);
+  cta2045_builder_put_bytes(&b, payload, len);
+  return cta2045_builder_finish(&b);
+}
+
+void cta2045_link_init( cta2045_link_t *link, cta2045_tx_fn tx, cta2045_rx_fn rx,
+                        cta2045_done_fn done, void *ctx ) {
+  memset(link, 0, sizeof(*link));
+  link->rx_state = RX_IDLE;
+  link->tx_state = TX_IDLE;
+  link->tx = tx;
+  link->rx = rx;
+  link->done = done;
+  link->ctx = ctx;
+}
+
+void cta2045_link_rx( cta2045_link_t *link, const uint8_t *data, size_t len, uint32_t now_ms ) {
+  size_t i;
+
+  if ( len > 0 ) {
+    link_rx_timeout(link, now_ms);
+  }
+  for ( i = 0; i < len; i++ ) {
+    link_rx_byte(link, data[i], now_ms);
+  }
+}
+
+void cta2045_link_poll( cta2045_link_t *link, uint32_t now_ms ) {
+  link_rx_timeout(link, now_ms);
+
+  if ( link->tx_state == TX_WAIT_ACK &&
+       now_ms - link->tx_sent_ms >= CTA2045_ACK_TIMEOUT_MS ) {
+    link_tx_retry(link, CTA2045_ERR_TIMEOUT, now_ms);
+  }
+}
+
+void cta2045_link_idle( cta2045_link_t *link ) {
+  if ( link->rx_state == RX_VENDOR ) {
+    link->rx_state = RX_IDLE;
+    link_rx_vendor(link);
+  } else if ( link->rx_state == RX_DISCARD ) {
+    link->rx_state = RX_IDLE;
+  }
+}
+
+int cta2045_link_send( cta2045_link_t *link, uint16_t msg_type,
+                       const uint8_t *payload, uint16_t len, uint32_t now_ms ) {
+  int frame_len;
+
+  if ( link->tx_state != TX_IDLE ) {
+    return CTA2045_ERR_BUSY;
+  }
+  frame_len = cta2045_build_message(link->tx_buf, sizeof(link->tx_buf), msg_type, payload, len);
+  if ( frame_len < 0 ) {
+    return frame_len;
+  }
+  link->tx_len = frame_len;
+  link->tx_attempts = 1;
+  link->tx_sent_ms = now_ms;
+  link->tx_state = TX_WAIT_ACK;
+  link->stats.messages_tx++;
+  link->tx(link->tx_buf, link->tx_len, link->ctx);
+  return CTA2045_SUCCESS;
+}
+
+void cta2045_link_send_raw( cta2045_link_t *link, const uint8_t *data, size_t len ) {
+  link->tx(data, len, link->ctx);
+}
+
+int cta2045_link_busy( const cta2045_link_t *link ) {
+  return link->tx_state != TX_IDLE;
+}
+
+void cta2045_link_get_stats( const cta2045_link_t *link, cta2045_link_stats_t *dest ) {
+  memcpy(dest, &link->stats, sizeof(*dest));
+}
@@ -50,6 +50,24 @@ esp_err_t generic_i2c_master_init(int portnum, int sclpin, int sdapin, int i2c_f
 }
 
 
+/**
+ * Change the bus clock of an installed master, using the same timings
+ * i2c_param_config() derives from clk_speed
+ */
+esp_err_t generic_i2c_set_frequency(int portnum, int i2c_frequency)
+{
+    i2c_port_t i2c_master_port = (i2c_port_t)portnum;
+    int cycle = I2C_APB_CLK_FREQ / i2c_frequency;
+    int half_cycle = cycle / 2;
+
+    i2c_set_timeout(i2c_master_port, cycle * 8);
+    i2c_set_data_timing(i2c_master_port, half_cycle / 2, half_cycle / 2);
+    i2c_set_start_timing(i2c_master_port, half_cycle, half_cycle);
+    i2c_set_stop_timing(i2c_master_port, half_cycle, half_cycle);
+    return i2c_set_period(i2c_master_port, half_cycle, half_cycle);
+}
+
+
 /**
  * Read a register value from an i2c device
  */
@@ -26,9 +26,11 @@
 #include "lcd_module.h"
 #include "frq_module.h"
 #include "rs_485_module.h"
+#include "policy_vm.h"
 #include "button.h"
 #include "controller_module.h"
 #include "ct_module.h"
+#include "relay_module.h"
 #include "driver/timer.h"
 #include "util.h"
 #include "driver/adc.h"
@@ -48,7 +50,11 @@ rwlock_t i2c_lock;
 
 #define PIN_SDA 25                        /*i2c pins */
 #define PIN_SCL 26                       
-#define I2C_MASTER_FREQ_HZ     100000     /* I2C master clock frequency */
+/* I2C master clock frequency: 100000 (standard mode), 400000 (fast mode)
+ * or 1000000 (fast mode plus). The IO expander and the display both run at
+ * 400 kHz; 1 MHz is beyond the SSD1309 spec and needs short wiring and
+ * strong external pull-ups. */
+#define I2C_MASTER_FREQ_HZ     400000
 
 #define LEVEL_HIGH 1
 #define LEVEL_LOW 0
@@ -101,6 +107,9 @@ void init_task( void *pv_parameters ) {
 
     
      rs485_init_task();
+
+     printf("Initializing relay\n");
+     relay_init_task();
 // 
       
 
@@ -130,6 +139,7 @@ void app_main( void )
     memset(&gb_system_state, 0, sizeof(gb_system_state));
     rwlock_init(&system_state_lock);
     rwlock_init(&i2c_lock);
+    policy_vm_init();
     printf("Intializing GridBallast system...\n");
 
 
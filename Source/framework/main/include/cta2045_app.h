@@ -0,0 +1,194 @@
+/**
+ * @file cta2045_app.h
+ *
+ * @brief Defines the CTA-2045 application layer command queue
+ *
+ * Commands for the water heater are queued here and handed to the link
+ * layer one at a time. The queue holds at most one pending command per
+ * class, so a newer command supersedes an older one of the same class that
+ * has not been sent yet:
+ *
+ *   - set point (sent as the EC-100 vendor frame when the thermostat polls)
+ *   - DR event: Shed, End Shed, Load Up, Critical Peak, Grid Emergency
+ *   - Outside Communication Status
+ *
+ * Like the link layer this module takes time as an argument and never
+ * touches the UART.
+ */
+
+#ifndef __cta2045_app_h_
+#define __cta2045_app_h_
+
+#include <stdint.h>
+#include "cta2045_link.h"
+
+/** @brief time the SGD has to send the application ACK */
+#define CTA2045_APP_ACK_TIMEOUT_MS 1000
+
+/* basic DR opcodes (first payload byte of a CTA2045_MSG_BASIC_DR message) */
+#define CTA2045_OP_SHED 0x01
+#define CTA2045_OP_END_SHED 0x02
+#define CTA2045_OP_APP_ACK 0x03
+#define CTA2045_OP_APP_NAK 0x04
+#define CTA2045_OP_CRITICAL_PEAK 0x0A
+#define CTA2045_OP_GRID_EMERGENCY 0x0B
+#define CTA2045_OP_OUTSIDE_COMM 0x0E
+#define CTA2045_OP_OPER_STATE_REQ 0x12
+#define CTA2045_OP_OPER_STATE 0x13
+#define CTA2045_OP_LOAD_UP 0x17
+
+/* Outside Communication Status arguments */
+#define CTA2045_COMM_NONE 0x00
+#define CTA2045_COMM_FOUND 0x01
+
+/** @brief commands the queue accepts */
+typedef enum {
+  CTA2045_CMD_SET_POINT = 0,   /* arg: set point in degrees F */
+  CTA2045_CMD_SHED,            /* arg: event duration code, 0 = unknown */
+  CTA2045_CMD_END_SHED,
+  CTA2045_CMD_LOAD_UP,         /* arg: event duration code, 0 = unknown */
+  CTA2045_CMD_CRITICAL_PEAK,   /* arg: event duration code, 0 = unknown */
+  CTA2045_CMD_GRID_EMERGENCY,  /* arg: event duration code, 0 = unknown */
+  CTA2045_CMD_OUTSIDE_COMM,    /* arg: CTA2045_COMM_* */
+  CTA2045_CMD_CNT
+} cta2045_cmd_t;
+
+/** @brief per command type counters */
+typedef struct {
+  uint32_t submitted;
+  uint32_t coalesced;       /* superseded before they were sent */
+  uint32_t completed;       /* application ACK received (set point: sent) */
+  uint32_t failed;          /* link failure, NAK or ACK timeout */
+  uint32_t last_latency_ms; /* submit to application ACK */
+  uint32_t max_latency_ms;
+  uint64_t total_latency_ms;
+} cta2045_cmd_stats_t;
+
+#define CTA2045_SLOT_SET_POINT 0
+#define CTA2045_SLOT_EVENT 1
+#define CTA2045_SLOT_COMM 2
+#define CTA2045_SLOT_CNT 3
+
+/** @brief one pending command */
+typedef struct {
+  uint8_t pending;
+  uint8_t cmd;
+  uint8_t arg;
+  uint32_t seq;
+  uint32_t submit_ms;
+} cta2045_slot_t;
+
+/** @brief command queue state, treat as opaque */
+typedef struct {
+  cta2045_link_t *link;
+  uint32_t seq;
+  cta2045_slot_t slot[CTA2045_SLOT_CNT];
+
+  /* command sent and waiting for its link and application ACKs */
+  uint8_t inflight;
+  uint8_t wait_app_ack;
+  cta2045_slot_t current;
+  uint32_t sent_ms;
+
+  cta2045_cmd_stats_t stats[CTA2045_CMD_CNT];
+} cta2045_app_t;
+
+/**
+ * @brief initialize a command queue on top of a link
+ *
+ * The link's done callback must forward to cta2045_app_on_link_done()
+ * and its receive callback must pass messages to cta2045_app_on_message().
+ *
+ * @param app - the command queue
+ * @param link - link the commands are sent on
+ *
+ * @return void
+ */
+void cta2045_app_init( cta2045_app_t *app, cta2045_link_t *link );
+
+/**
+ * @brief queue a command, superseding a pending one of the same class
+ *
+ * @param app - the command queue
+ * @param cmd - command to queue
+ * @param arg - command argument
+ * @param now_ms - current time in milliseconds
+ *
+ * @return CTA2045_SUCCESS, CTA2045_ERR_LENGTH for an unknown command
+ */
+int cta2045_app_submit( cta2045_app_t *app, cta2045_cmd_t cmd, uint8_t arg, uint32_t now_ms );
+
+/**
+ * @brief send the oldest pending DR command if the link is free and check
+ *        the application ACK timeout
+ *
+ * @param app - the command queue
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void cta2045_app_poll( cta2045_app_t *app, uint32_t now_ms );
+
+/**
+ * @brief check whether cta2045_app_poll() would send a DR command now
+ *
+ * @param app - the command queue
+ *
+ * @return 1 if a command is waiting and nothing is in flight, 0 otherwise
+ */
+int cta2045_app_ready( const cta2045_app_t *app );
+
+/**
+ * @brief take the pending set point, called when the thermostat polls
+ *
+ * @param app - the command queue
+ * @param set_point - the set point to send
+ * @param now_ms - current time in milliseconds
+ *
+ * @return 1 if a set point was pending, 0 otherwise
+ */
+int cta2045_app_take_set_point( cta2045_app_t *app, uint8_t *set_point, uint32_t now_ms );
+
+/**
+ * @brief link layer completion of the message in flight
+ *
+ * @param app - the command queue
+ * @param result - result passed to the link's done callback
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void cta2045_app_on_link_done( cta2045_app_t *app, int result, uint32_t now_ms );
+
+/**
+ * @brief handle a received CTA-2045 message (application ACK/NAK)
+ *
+ * @param app - the command queue
+ * @param frame - message received by the link
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void cta2045_app_on_message( cta2045_app_t *app, const cta2045_frame_t *frame, uint32_t now_ms );
+
+/**
+ * @brief get a copy of the counters of one command type
+ *
+ * @param app - the command queue
+ * @param cmd - command type
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void cta2045_app_get_stats( const cta2045_app_t *app, cta2045_cmd_t cmd, cta2045_cmd_stats_t *dest );
+
+/**
+ * @brief name of a command type, for logs
+ *
+ * @param cmd - command type
+ *
+ * @return command name
+ */
+const char *cta2045_app_cmd_name( cta2045_cmd_t cmd );
+
+#endif /* __cta2045_app_h_ */
@@ -0,0 +1,310 @@
+/**
+ * @file cta2045_link.h
+ *
+ * @brief Defines the CTA-2045 data link layer API
+ *
+ * The link layer turns the raw byte stream of the RS485 port into frames
+ * and back. It is written as an explicit state machine driven by three
+ * inputs: received bytes (cta2045_link_rx), the passage of time
+ * (cta2045_link_poll) and send requests (cta2045_link_send). It does not
+ * touch the UART or read a clock itself, so the same code runs on the
+ * target and in host programs.
+ *
+ * Two kinds of frames share the bus:
+ *   - CTA-2045 frames: link ACK/NAK (2 bytes) and messages
+ *     (type, length, payload, Fletcher checksum)
+ *   - vendor frames of the EC-100 thermostat, which carry no length and are
+ *     delimited by a gap on the line
+ */
+
+#ifndef __cta2045_link_h_
+#define __cta2045_link_h_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief success code */
+#define CTA2045_SUCCESS 0
+/** @brief a message is still waiting for its link ACK */
+#define CTA2045_ERR_BUSY (-1)
+/** @brief message does not fit in a frame */
+#define CTA2045_ERR_LENGTH (-2)
+/** @brief the peer NAKed the message on every attempt */
+#define CTA2045_ERR_NAK (-3)
+/** @brief no link ACK was received on any attempt */
+#define CTA2045_ERR_TIMEOUT (-4)
+
+/** @brief largest frame handled, header and checksum included */
+#define CTA2045_MAX_FRAME 128
+#define CTA2045_HEADER_SIZE 4
+#define CTA2045_CHECKSUM_SIZE 2
+#define CTA2045_MAX_PAYLOAD (CTA2045_MAX_FRAME - CTA2045_HEADER_SIZE - CTA2045_CHECKSUM_SIZE)
+
+/** @brief time the peer has to acknowledge a message */
+#define CTA2045_ACK_TIMEOUT_MS 200
+/** @brief maximum gap between two bytes of a CTA-2045 frame */
+#define CTA2045_INTERCHAR_TIMEOUT_MS 100
+/** @brief line idle time that terminates a vendor frame */
+#define CTA2045_VENDOR_GAP_MS 10
+/** @brief number of times a message is resent after a NAK or timeout */
+#define CTA2045_MAX_RETRIES 2
+
+/* link layer messages */
+#define CTA2045_LINK_ACK 0x06
+#define CTA2045_LINK_NAK 0x15
+
+/* NAK reason codes */
+#define CTA2045_NAK_NO_REASON 0x00
+#define CTA2045_NAK_TIMEOUT 0x01
+#define CTA2045_NAK_TOO_LONG 0x02
+#define CTA2045_NAK_CHECKSUM 0x03
+#define CTA2045_NAK_UNSUPPORTED 0x04
+
+/* first byte of the message types this device handles */
+#define CTA2045_MSG_TYPE1_DR 0x08
+
+/* message types */
+#define CTA2045_MSG_BASIC_DR 0x0801
+#define CTA2045_MSG_INTERMEDIATE_DR 0x0802
+#define CTA2045_MSG_DATA_LINK 0x0803
+
+/** @brief kinds of frames delivered to the receive callback */
+typedef enum {
+  CTA2045_FRAME_MESSAGE = 0, /* checksum verified, already ACKed */
+  CTA2045_FRAME_VENDOR       /* vendor frame, delimited by line idle */
+} cta2045_frame_kind_t;
+
+/** @brief a received frame */
+typedef struct {
+  cta2045_frame_kind_t kind;
+  uint16_t msg_type;       /* CTA2045_FRAME_MESSAGE only */
+  const uint8_t *payload;  /* message payload, or the whole vendor frame */
+  uint16_t len;
+} cta2045_frame_t;
+
+/** @brief link layer counters */
+typedef struct {
+  uint32_t messages_rx;
+  uint32_t vendor_frames_rx;
+  uint32_t checksum_errors;
+  uint32_t interchar_timeouts;
+  uint32_t overflows;
+  uint32_t unsupported;
+  uint32_t acks_rx;
+  uint32_t naks_rx;
+  uint32_t stray_acks;
+  uint32_t messages_tx;
+  uint32_t retries;
+  uint32_t tx_failed;
+} cta2045_link_stats_t;
+
+/** @brief assembles one frame in place in a caller owned buffer */
+typedef struct {
+  uint8_t *buf;
+  uint16_t size;
+  uint16_t len;
+  uint8_t vendor;   /* vendor frame: additive checksum, no header */
+  uint8_t overflow;
+} cta2045_builder_t;
+
+/** @brief writes bytes to the line */
+typedef void (*cta2045_tx_fn)(const uint8_t *data, size_t len, void *ctx);
+/** @brief called for every received frame */
+typedef void (*cta2045_rx_fn)(const cta2045_frame_t *frame, void *ctx);
+/** @brief called once a sent message is ACKed (CTA2045_SUCCESS) or failed */
+typedef void (*cta2045_done_fn)(int result, uint16_t msg_type, void *ctx);
+
+/** @brief link layer state, treat as opaque */
+typedef struct cta2045_link {
+  uint8_t rx_state;
+  uint16_t rx_len;
+  uint16_t rx_expected;
+  uint32_t rx_last_ms;
+  uint8_t rx_buf[CTA2045_MAX_FRAME];
+
+  uint8_t tx_state;
+  uint8_t tx_attempts;
+  uint16_t tx_len;
+  uint32_t tx_sent_ms;
+  uint8_t tx_buf[CTA2045_MAX_FRAME];
+
+  cta2045_tx_fn tx;
+  cta2045_rx_fn rx;
+  cta2045_done_fn done;
+  void *ctx;
+
+  cta2045_link_stats_t stats;
+} cta2045_link_t;
+
+/**
+ * @brief compute the CTA-2045 Fletcher checksum
+ *
+ * @param buf - header and payload of a message
+ * @param len - number of bytes
+ *
+ * @return checksum, MSB first on the wire
+ */
+uint16_t cta2045_checksum( const uint8_t *buf, size_t len );
+
+/**
+ * @brief start a CTA-2045 message in buf; the length and checksum are
+ *        filled in by cta2045_builder_finish()
+ *
+ * @param b - the builder
+ * @param buf - buffer the frame is assembled in
+ * @param size - size of the buffer
+ * @param msg_type - CTA2045_MSG_*
+ *
+ * @return void
+ */
+void cta2045_builder_begin( cta2045_builder_t *b, uint8_t *buf, size_t size, uint16_t msg_type );
+
+/**
+ * @brief start an EC-100 vendor frame in buf; cta2045_builder_finish()
+ *        appends the one byte additive checksum
+ *
+ * @param b - the builder
+ * @param buf - buffer the frame is assembled in
+ * @param size - size of the buffer
+ *
+ * @return void
+ */
+void cta2045_builder_begin_vendor( cta2045_builder_t *b, uint8_t *buf, size_t size );
+
+/**
+ * @brief append one byte to the frame
+ *
+ * @param b - the builder
+ * @param val - byte to append
+ *
+ * @return void
+ */
+void cta2045_builder_put( cta2045_builder_t *b, uint8_t val );
+
+/**
+ * @brief append bytes to the frame
+ *
+ * @param b - the builder
+ * @param data - bytes to append
+ * @param len - number of bytes
+ *
+ * @return void
+ */
+void cta2045_builder_put_bytes( cta2045_builder_t *b, const uint8_t *data, size_t len );
+
+/**
+ * @brief complete the frame: fill in the length and append the checksum
+ *
+ * @param b - the builder
+ *
+ * @return frame length on success, CTA2045_ERR_LENGTH if it did not fit
+ */
+int cta2045_builder_finish( cta2045_builder_t *b );
+
+/**
+ * @brief build a complete message frame
+ *
+ * @param dst - destination buffer
+ * @param size - size of the destination buffer
+ * @param msg_type - CTA2045_MSG_*
+ * @param payload - message payload
+ * @param len - payload length
+ *
+ * @return frame length on success, CTA2045_ERR_LENGTH otherwise
+ */
+int cta2045_build_message( uint8_t *dst, size_t size, uint16_t msg_type,
+                           const uint8_t *payload, uint16_t len );
+
+/**
+ * @brief initialize a link
+ *
+ * @param link - link to initialize
+ * @param tx - line output
+ * @param rx - receive callback
+ * @param done - send completion callback, may be NULL
+ * @param ctx - passed to the callbacks
+ *
+ * @return void
+ */
+void cta2045_link_init( cta2045_link_t *link, cta2045_tx_fn tx, cta2045_rx_fn rx,
+                        cta2045_done_fn done, void *ctx );
+
+/**
+ * @brief feed received bytes into the link, in any fragmentation
+ *
+ * @param link - the link
+ * @param data - received bytes
+ * @param len - number of bytes
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void cta2045_link_rx( cta2045_link_t *link, const uint8_t *data, size_t len, uint32_t now_ms );
+
+/**
+ * @brief advance the link timers: vendor frame gaps, inter-character and
+ *        ACK timeouts, retries
+ *
+ * @param link - the link
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void cta2045_link_poll( cta2045_link_t *link, uint32_t now_ms );
+
+/**
+ * @brief report that the line went idle, e.g. from the UART receive
+ *        timeout interrupt; ends a vendor frame without waiting for
+ *        CTA2045_VENDOR_GAP_MS
+ *
+ * @param link - the link
+ *
+ * @return void
+ */
+void cta2045_link_idle( cta2045_link_t *link );
+
+/**
+ * @brief send a CTA-2045 message and track its link ACK
+ *
+ * @param link - the link
+ * @param msg_type - CTA2045_MSG_*
+ * @param payload - message payload
+ * @param len - payload length
+ * @param now_ms - current time in milliseconds
+ *
+ * @return CTA2045_SUCCESS if the message was sent, an error code otherwise
+ */
+int cta2045_link_send( cta2045_link_t *link, uint16_t msg_type,
+                       const uint8_t *payload, uint16_t len, uint32_t now_ms );
+
+/**
+ * @brief send a vendor frame as is, no ACK is expected
+ *
+ * @param link - the link
+ * @param data - frame bytes
+ * @param len - frame length
+ *
+ * @return void
+ */
+void cta2045_link_send_raw( cta2045_link_t *link, const uint8_t *data, size_t len );
+
+/**
+ * @brief check whether a message is waiting for its link ACK
+ *
+ * @param link - the link
+ *
+ * @return 1 if busy, 0 otherwise
+ */
+int cta2045_link_busy( const cta2045_link_t *link );
+
+/**
+ * @brief get a copy of the link counters
+ *
+ * @param link - the link
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void cta2045_link_get_stats( const cta2045_link_t *link, cta2045_link_stats_t *dest );
+
+#endif /* __cta2045_link_h_ */
@@ -48,7 +48,7 @@
  * @param portnum - Either I2C_NUM_0 or I2C_NUM_1
  * @param sclpin  - GPIO pin number for the SCL signal
  * @param stapin  - GPIO pin number for the SDA signal
- * @param i2c_frequency - Frequency of the I2C buss (100000 or 400000)
+ * @param i2c_frequency - Frequency of the I2C buss (100000, 400000 or 1000000)
  *
  * returns:
  *    ESP_OK - Driver initialized
@@ -57,6 +57,19 @@
 esp_err_t generic_i2c_master_init(int portnum, int sclpin, int sdapin, int i2c_frequency);
 
 
+/**
+ * @brief change the clock of an initialized i2c master
+ *
+ * @param portnum - Either I2C_NUM_0 or I2C_NUM_1
+ * @param i2c_frequency - Frequency of the I2C buss (100000, 400000 or 1000000)
+ *
+ * returns:
+ *    ESP_OK - clock changed
+ *    ESP_ERR_INVALID_ARG - problem occurred
+ */
+esp_err_t generic_i2c_set_frequency(int portnum, int i2c_frequency);
+
+
 /**
  * @brief Read a register value from an i2c device
  *
@@ -9,11 +9,34 @@
 #ifndef __lcd_module_h_
 #define __lcd_module_h_
 
+#include <stdint.h>
+#include "u8x8.h"
+
 /** @brief depth of the controller stack */
 #define lcdUSStackDepth ((unsigned short) 2048) /* bytes */
 /** @brief priority of the controller stack */
 #define lcdUXPriority (2)
 
+/** @brief display service counters, readable with lcd_get_stats() */
+typedef struct {
+  uint32_t frames;          /* frames sent to the display */
+  uint32_t fps_x100;        /* frames per second over the last window, times 100 */
+  uint32_t events;          /* UI events received with lcd_notify() */
+  uint32_t idle_checks;     /* wakeups that found nothing to redraw */
+  uint32_t deferred;        /* frames delayed to stay within the frame budget */
+  uint32_t tx_waits;        /* frames that waited for the previous transfer */
+  uint64_t total_tx_wait_us;
+  uint32_t widgets_drawn;   /* widgets redrawn, the rest of a frame is kept */
+  uint32_t last_render_us;  /* drawing into the frame buffer */
+  uint32_t max_render_us;
+  uint64_t total_render_us;
+  uint32_t last_bus_us;     /* transfer to the display, overlaps the next render */
+  uint32_t max_bus_us;
+  uint64_t total_bus_us;
+  uint32_t last_send_bytes; /* tile bytes transferred */
+  uint64_t total_send_bytes;
+} lcd_stats_t;
+
 /** @brief name of the controller task */
 extern const char * const lcd_task_name;
 
@@ -24,4 +47,42 @@ extern const char * const lcd_task_name;
  */
 void lcd_init_task( void );
 
+/**
+ * @brief ask for a redraw, e.g. after a button press; redraws are still
+ *        limited to the frame budget
+ *
+ * @return void
+ */
+void lcd_notify( void );
+
+/**
+ * @brief queue a button key for the widget UI and ask for a redraw
+ *
+ * @param key - LCD_UI_KEY_* of lcd_ui.h
+ *
+ * @return void
+ */
+void lcd_key( int key );
+
+/**
+ * @brief get a copy of the display service counters
+ *
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void lcd_get_stats( lcd_stats_t *dest );
+
+#ifdef U8X8_WITH_PROFILE
+/**
+ * @brief get a copy of the u8g2 counters of the last frame
+ *
+ * @param draw - memory region for the drawing counters (glyph, hvline, box, bitmap)
+ * @param bus - memory region for the transfer counters (bus, data bytes)
+ *
+ * @return void
+ */
+void lcd_get_profile( u8x8_profile_t *draw, u8x8_profile_t *bus );
+#endif
+
 #endif /* __lcd_module_h_ */
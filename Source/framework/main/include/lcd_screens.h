@@ -0,0 +1,33 @@
+/**
+ * @file lcd_screens.h
+ *
+ * @brief Defines the screens of the LCD
+ *
+ * The widget tables of all screens, see lcd_ui.h. lcd_module.c shows them
+ * on the display; the host tool tools/lcd_golden renders them for a set of
+ * system state fixtures and compares the result with golden images.
+ */
+
+#ifndef __lcd_screens_h_
+#define __lcd_screens_h_
+
+#include "lcd_ui.h"
+
+/* screens, in the order of the MENU key */
+#define LCD_SCREEN_VITALS 0
+#define LCD_SCREEN_OPTIONS 1
+#define LCD_SCREEN_NETWORK 2
+#define LCD_SCREENS 3
+
+/**
+ * @brief initialize a widget tree with the screens, the vitals screen is shown
+ *
+ * The widget tables are static, so there is one tree per program.
+ *
+ * @param ui - the tree
+ *
+ * @return void
+ */
+void lcd_screens_init( lcd_ui_t *ui );
+
+#endif /* __lcd_screens_h_ */
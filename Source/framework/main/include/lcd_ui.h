@@ -0,0 +1,154 @@
+/**
+ * @file lcd_ui.h
+ *
+ * @brief Defines the retained-mode widget tree of the LCD
+ *
+ * A screen is a table of widgets. Each widget has a bounding box and is
+ * either fixed text or bound to a field of lcd_ui_model_t, a snapshot of
+ * the system state and the wifi status. lcd_ui_update() formats the bound
+ * values and marks the widgets whose text changed; lcd_ui_draw() clears and
+ * redraws only those boxes, the rest of the frame buffer is kept.
+ *
+ * The display is double buffered (see lcd_module.c), so a widget keeps one
+ * stale bit per frame buffer: a change has to be drawn into both.
+ *
+ * Keys from the buttons move between screens, move the cursor of a list
+ * and change the focused value. Like the protocol modules this code does
+ * no locking and no I/O, lcd_module.c owns the tree.
+ */
+
+#ifndef __lcd_ui_h_
+#define __lcd_ui_h_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "u8g2.h"
+#include "system_state.h"
+#include "wifi_module.h"
+
+/** @brief number of frame buffers the stale bits are kept for */
+#define LCD_UI_BUFFERS 2
+#define LCD_UI_ALL_BUFFERS ((1 << LCD_UI_BUFFERS) - 1)
+
+/** @brief longest widget text including the terminating zero */
+#define LCD_UI_TEXT_SIZE 24
+
+/** @brief width of the cursor column in front of list rows */
+#define LCD_UI_CURSOR_W 8
+
+/* keys */
+#define LCD_UI_KEY_UP 0       /* increase the focused value */
+#define LCD_UI_KEY_DOWN 1     /* decrease the focused value */
+#define LCD_UI_KEY_MENU 2     /* next screen */
+#define LCD_UI_KEY_SELECT 3   /* next row of the list */
+
+/* widget types */
+#define LCD_UI_LABEL 0        /* fixed text in format */
+#define LCD_UI_INT 1          /* int field of lcd_ui_model_t */
+#define LCD_UI_FLOAT 2        /* float field of lcd_ui_model_t */
+#define LCD_UI_STR 3          /* char array field of lcd_ui_model_t */
+#define LCD_UI_LIST 4         /* rows of child widgets with a cursor */
+
+/* widget flags */
+#define LCD_UI_MANUAL 0x01    /* only editable in manual mode (mode 0) */
+
+/** @brief everything the widgets can be bound to */
+typedef struct {
+  system_state_t state;
+  wifi_status_t net;
+} lcd_ui_model_t;
+
+typedef struct lcd_ui_widget lcd_ui_widget_t;
+
+/** @brief a widget, the fields up to children are the definition */
+struct lcd_ui_widget {
+  uint8_t type;
+  uint8_t flags;
+  u8g2_uint_t x, y, w, h;     /* bounding box, y is the top edge */
+  const char *format;         /* printf format of the bound value, or the label */
+  size_t offset;              /* offsetof(lcd_ui_model_t, ...) of the bound value */
+  float step;                 /* change per UP/DOWN key, 0 for read only */
+  float min, max;
+  lcd_ui_widget_t *children;  /* LCD_UI_LIST rows */
+  uint8_t count;
+
+  /* state */
+  char text[LCD_UI_TEXT_SIZE];
+  uint8_t stale;              /* bit per frame buffer not showing text yet */
+  uint8_t cursor;             /* LCD_UI_LIST: selected row */
+};
+
+/** @brief a screen: widgets drawn on a cleared frame buffer */
+typedef struct {
+  const char *name;
+  lcd_ui_widget_t *widgets;
+  uint8_t count;
+} lcd_ui_screen_t;
+
+/** @brief the widget tree */
+typedef struct {
+  lcd_ui_screen_t *screens;
+  uint8_t count;
+  uint8_t current;
+  uint8_t clear;              /* bit per frame buffer still showing another screen */
+  const uint8_t *font;
+} lcd_ui_t;
+
+/**
+ * @brief initialize the tree, the first screen is shown
+ *
+ * @param ui - the tree
+ * @param screens - screen table, the widgets are modified
+ * @param count - number of screens
+ * @param font - u8g2 font of all widgets
+ *
+ * @return void
+ */
+void lcd_ui_init( lcd_ui_t *ui, lcd_ui_screen_t *screens, uint8_t count, const uint8_t *font );
+
+/**
+ * @brief format the widgets of the current screen, marking changed ones
+ *
+ * @param ui - the tree
+ * @param model - values to show
+ *
+ * @return number of widgets whose text changed
+ */
+int lcd_ui_update( lcd_ui_t *ui, const lcd_ui_model_t *model );
+
+/**
+ * @brief check whether a frame buffer has to be redrawn
+ *
+ * @param ui - the tree
+ * @param buf - frame buffer index
+ *
+ * @return 1 if the buffer does not show the current screen and values
+ */
+int lcd_ui_is_stale( const lcd_ui_t *ui, uint8_t buf );
+
+/**
+ * @brief handle a key
+ *
+ * UP/DOWN change the focused value of the model: the selected row of a
+ * list, otherwise the first editable widget of the screen.
+ *
+ * @param ui - the tree
+ * @param key - LCD_UI_KEY_*
+ * @param model - values, modified by UP/DOWN
+ *
+ * @return 1 if the model was changed and has to be stored
+ */
+int lcd_ui_key( lcd_ui_t *ui, uint8_t key, lcd_ui_model_t *model );
+
+/**
+ * @brief redraw the stale widgets of the current screen into a frame buffer
+ *
+ * @param ui - the tree
+ * @param u8g2 - display, its buffer is frame buffer buf
+ * @param buf - frame buffer index
+ *
+ * @return number of widgets drawn
+ */
+int lcd_ui_draw( lcd_ui_t *ui, u8g2_t *u8g2, uint8_t buf );
+
+#endif /* __lcd_ui_h_ */
@@ -0,0 +1,272 @@
+/**
+ * @file modbus_rtu.h
+ *
+ * @brief Defines the Modbus RTU master API
+ *
+ * Frame helpers (CRC16, request builders, response parser), the
+ * register-to-system_state mapping table and a master engine that polls a
+ * slave's register blocks back to back: while one response is awaited the
+ * next request is already assembled, so it goes out as soon as the
+ * response is in and the line has been quiet for t3.5.
+ *
+ * Like the CTA-2045 modules this code takes time as an argument and never
+ * touches the UART, so it also builds on the host.
+ */
+
+#ifndef __modbus_rtu_h_
+#define __modbus_rtu_h_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "system_state.h"
+
+/** @brief success code */
+#define MODBUS_SUCCESS 0
+/** @brief response CRC mismatch */
+#define MODBUS_ERR_CRC (-1)
+/** @brief frame too short, too long or with the wrong byte count */
+#define MODBUS_ERR_LENGTH (-2)
+/** @brief response from another slave or for another function */
+#define MODBUS_ERR_UNEXPECTED (-3)
+/** @brief slave answered with an exception response */
+#define MODBUS_ERR_EXCEPTION (-4)
+/** @brief no response before the timeout */
+#define MODBUS_ERR_TIMEOUT (-5)
+/** @brief a transaction is already running or nothing to poll */
+#define MODBUS_ERR_BUSY (-6)
+
+/** @brief largest RTU frame */
+#define MODBUS_MAX_FRAME 256
+/** @brief largest register count of one read request */
+#define MODBUS_MAX_REGS 125
+/** @brief registers of a read response of frame_len bytes (address, function, byte count, CRC) */
+#define MODBUS_READ_REGS(frame_len) (((frame_len) - 5) / 2)
+/** @brief time a slave has to answer one request */
+#define MODBUS_RESPONSE_TIMEOUT_MS 200
+
+/* function codes */
+#define MODBUS_READ_HOLDING 0x03
+#define MODBUS_READ_INPUT 0x04
+#define MODBUS_WRITE_SINGLE 0x06
+
+/** @brief a block of registers read with one request */
+typedef struct {
+  uint8_t slave;
+  uint8_t function;   /* MODBUS_READ_HOLDING or MODBUS_READ_INPUT */
+  uint16_t start;
+  uint16_t count;
+} modbus_block_t;
+
+/** @brief system_state_t fields a register can be mapped to */
+typedef enum {
+  MODBUS_FIELD_TEMP_TOP = 0,
+  MODBUS_FIELD_TEMP_BOTTOM,
+  MODBUS_FIELD_SET_POINT,
+  MODBUS_FIELD_HEATING,
+  MODBUS_FIELD_POWER,
+  MODBUS_FIELD_CNT
+} modbus_field_t;
+
+/**
+ * @brief maps one register to a system_state_t field:
+ *        field = (int16_t or uint16_t)reg * num / den + offset
+ */
+typedef struct {
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  uint8_t field;       /* modbus_field_t */
+  uint8_t is_signed;   /* register holds a two's complement value */
+  int16_t num;
+  int16_t den;
+  int16_t offset;
+} modbus_map_t;
+
+/** @brief master counters */
+typedef struct {
+  uint32_t requests;
+  uint32_t responses;
+  uint32_t crc_errors;
+  uint32_t length_errors;
+  uint32_t unexpected;
+  uint32_t exceptions;
+  uint32_t timeouts;
+  uint32_t last_latency_ms; /* request sent to response */
+  uint32_t max_latency_ms;
+  uint64_t total_latency_ms;
+} modbus_stats_t;
+
+/** @brief writes a frame to the line */
+typedef void (*modbus_tx_fn)(const uint8_t *data, size_t len, void *ctx);
+/** @brief called with the registers of every block read */
+typedef void (*modbus_block_fn)(const modbus_block_t *block, const uint16_t *regs, void *ctx);
+
+/** @brief master state, treat as opaque */
+typedef struct {
+  const modbus_block_t *blocks;
+  size_t block_cnt;
+  modbus_tx_fn tx;
+  modbus_block_fn on_block;
+  void *ctx;
+  uint16_t max_regs;   /* largest block the receive path can deliver */
+
+  /* running transaction: all blocks of one slave */
+  uint8_t active;
+  uint8_t waiting;
+  uint8_t finished;
+  uint8_t slave;
+  int result;
+  size_t block;        /* block the outstanding request belongs to */
+  size_t next_block;   /* block of the prepared request, block_cnt if none */
+  uint32_t sent_ms;
+
+  /* request on the line and the one prepared behind it */
+  uint8_t req[2][8];
+  uint8_t req_cur;
+  uint16_t regs[MODBUS_MAX_REGS];
+
+  modbus_stats_t stats;
+} modbus_master_t;
+
+/**
+ * @brief compute the Modbus CRC16 (table driven)
+ *
+ * @param buf - frame bytes
+ * @param len - number of bytes
+ *
+ * @return CRC, sent low byte first
+ */
+uint16_t modbus_crc16( const uint8_t *buf, size_t len );
+
+/**
+ * @brief length of the t3.5 inter-frame gap
+ *
+ * @param baud - line speed
+ * @param bits_per_char - start, data, parity and stop bits
+ *
+ * @return gap in microseconds (fixed 1750 us above 19200 baud)
+ */
+uint32_t modbus_t35_us( uint32_t baud, uint32_t bits_per_char );
+
+/**
+ * @brief build a read holding/input registers request
+ *
+ * @param dst - destination buffer, at least 8 bytes
+ * @param block - registers to read
+ *
+ * @return frame length on success, MODBUS_ERR_LENGTH for a bad count
+ */
+int modbus_build_read( uint8_t *dst, const modbus_block_t *block );
+
+/**
+ * @brief build a write single register request
+ *
+ * @param dst - destination buffer, at least 8 bytes
+ * @param slave - slave address
+ * @param reg - register address
+ * @param value - value to write
+ *
+ * @return frame length
+ */
+int modbus_build_write_single( uint8_t *dst, uint8_t slave, uint16_t reg, uint16_t value );
+
+/**
+ * @brief validate a read response and extract its registers
+ *
+ * @param frame - response frame, CRC included
+ * @param len - frame length
+ * @param block - the request it answers
+ * @param regs - destination for block->count registers
+ *
+ * @return MODBUS_SUCCESS or an error code
+ */
+int modbus_parse_read( const uint8_t *frame, size_t len, const modbus_block_t *block, uint16_t *regs );
+
+/**
+ * @brief apply the mapping table to the registers of one block
+ *
+ * @param map - mapping table
+ * @param map_cnt - number of entries
+ * @param block - the block that was read
+ * @param regs - its registers
+ * @param state - system state to update
+ *
+ * @return number of fields updated
+ */
+int modbus_map_apply( const modbus_map_t *map, size_t map_cnt, const modbus_block_t *block,
+                      const uint16_t *regs, system_state_t *state );
+
+/**
+ * @brief initialize a master
+ *
+ * @param m - the master
+ * @param blocks - register blocks to poll, grouped by slave
+ * @param block_cnt - number of blocks
+ * @param max_frame - largest frame the receive path delivers, blocks
+ *                    whose response does not fit are skipped
+ * @param tx - line output
+ * @param on_block - called for every block read
+ * @param ctx - passed to the callbacks
+ *
+ * @return void
+ */
+void modbus_master_init( modbus_master_t *m, const modbus_block_t *blocks, size_t block_cnt,
+                         size_t max_frame, modbus_tx_fn tx, modbus_block_fn on_block, void *ctx );
+
+/**
+ * @brief start polling all blocks of one slave
+ *
+ * @param m - the master
+ * @param slave - slave address
+ * @param now_ms - current time in milliseconds
+ *
+ * @return MODBUS_SUCCESS, or MODBUS_ERR_BUSY if a transaction is running
+ *         or the slave has no blocks
+ */
+int modbus_master_start( modbus_master_t *m, uint8_t slave, uint32_t now_ms );
+
+/**
+ * @brief feed a complete received frame (delimited by t3.5 of silence)
+ *
+ * @param m - the master
+ * @param frame - frame bytes
+ * @param len - frame length
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void modbus_master_rx( modbus_master_t *m, const uint8_t *frame, size_t len, uint32_t now_ms );
+
+/**
+ * @brief send the prepared request once the line has been quiet for t3.5
+ *        and check the response timeout
+ *
+ * @param m - the master
+ * @param line_quiet - 1 if t3.5 has passed since the last byte on the line
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void modbus_master_poll( modbus_master_t *m, int line_quiet, uint32_t now_ms );
+
+/**
+ * @brief check whether the transaction started last has finished
+ *
+ * @param m - the master
+ * @param result - MODBUS_SUCCESS or the first error of the transaction
+ *
+ * @return 1 if finished (and not yet collected), 0 otherwise
+ */
+int modbus_master_done( modbus_master_t *m, int *result );
+
+/**
+ * @brief get a copy of the master counters
+ *
+ * @param m - the master
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void modbus_master_get_stats( const modbus_master_t *m, modbus_stats_t *dest );
+
+#endif /* __modbus_rtu_h_ */
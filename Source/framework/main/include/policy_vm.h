@@ -0,0 +1,199 @@
+/**
+ * @file policy_vm.h
+ *
+ * @brief Defines the control policy interpreter API
+ *
+ * A control policy is a small bytecode program produced by the ugl compiler
+ * (u8g2/tools/ugl). The interpreter is a bounded version of bc_exec() from
+ * ugl_bc.c: every invocation runs with a fixed instruction budget and reads
+ * and writes the system state only through the builtins listed below.
+ */
+
+#ifndef __policy_vm_h_
+#define __policy_vm_h_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "system_state.h"
+
+/** @brief success code */
+#define POLICY_VM_SUCCESS 0
+/** @brief no policy is loaded */
+#define POLICY_VM_ERR_NO_POLICY (-1)
+/** @brief policy image is malformed */
+#define POLICY_VM_ERR_IMAGE (-2)
+/** @brief instruction budget exhausted before the policy returned */
+#define POLICY_VM_ERR_BUDGET (-3)
+/** @brief arg or return stack overflow/underflow */
+#define POLICY_VM_ERR_STACK (-4)
+/** @brief invalid opcode, builtin index or jump target */
+#define POLICY_VM_ERR_CODE (-5)
+/** @brief storage (NVS) access failed */
+#define POLICY_VM_ERR_STORAGE (-6)
+
+/** @brief maximum size of the bytecode section of a policy image */
+#define POLICY_VM_MAX_CODE 1024
+/** @brief default number of instructions one invocation may execute */
+#define POLICY_VM_DEFAULT_BUDGET 2000
+
+#define POLICY_VM_STACK_SIZE 32
+#define POLICY_VM_RETURN_STACK_SIZE 8
+
+/*
+ * Policy image layout (all values big endian, like the ugl bytecode):
+ *
+ *   offset 0  'G' 'P'      magic
+ *   offset 2  version      POLICY_VM_IMAGE_VERSION
+ *   offset 3  reserved     0
+ *   offset 4  entry        bytecode position of the policy procedure
+ *   offset 6  code_len     number of bytecode bytes that follow
+ *   offset 8  bytecode
+ */
+#define POLICY_VM_IMAGE_VERSION 1
+#define POLICY_VM_IMAGE_HEADER_SIZE 8
+
+/*
+ * Builtin procedures. Indices 0..7 match the stock ugl builtin list so the
+ * compiler output stays compatible; 6 and 7 are game specific and are
+ * accepted but ignored here.
+ *
+ * Frequencies are passed in mHz, temperatures in degrees F and power in
+ * the raw units of system_state_t.power. All values are unsigned 16 bit.
+ */
+#define POLICY_BUILTIN_NOP           0
+#define POLICY_BUILTIN_RETURN        1
+#define POLICY_BUILTIN_ARG_GET       2
+#define POLICY_BUILTIN_ARG_SET       3
+#define POLICY_BUILTIN_ADD           4
+#define POLICY_BUILTIN_PRINT         5
+#define POLICY_BUILTIN_SUB           8  /* sub(a, b) */
+#define POLICY_BUILTIN_LT            9  /* lt(a, b) */
+#define POLICY_BUILTIN_GT            10 /* gt(a, b) */
+#define POLICY_BUILTIN_EQ            11 /* eq(a, b) */
+#define POLICY_BUILTIN_AND           12 /* and(a, b) */
+#define POLICY_BUILTIN_OR            13 /* or(a, b) */
+#define POLICY_BUILTIN_NOT           14 /* not(a) */
+#define POLICY_BUILTIN_FREQ          15 /* freq() */
+#define POLICY_BUILTIN_OVER_FREQ     16 /* overFreq() */
+#define POLICY_BUILTIN_UNDER_FREQ    17 /* underFreq() */
+#define POLICY_BUILTIN_TEMP_TOP      18 /* tempTop() */
+#define POLICY_BUILTIN_TEMP_BOTTOM   19 /* tempBottom() */
+#define POLICY_BUILTIN_SET_POINT     20 /* setPoint() */
+#define POLICY_BUILTIN_MODE          21 /* mode() */
+#define POLICY_BUILTIN_HEATING       22 /* heating() */
+#define POLICY_BUILTIN_POWER         23 /* power() */
+#define POLICY_BUILTIN_SET_SET_POINT 24 /* setSetPoint(v) */
+#define POLICY_BUILTIN_SET_MODE      25 /* setMode(v) */
+#define POLICY_BUILTIN_CNT           26
+
+/** @brief events a policy is invoked for, passed as the first argument */
+#define POLICY_EVENT_TICK 0
+
+/** @brief actuation requests collected while a policy runs */
+typedef struct {
+  int set_point_valid;
+  int set_point;
+  int mode_valid;
+  int mode;
+} policy_vm_output_t;
+
+/** @brief execution cost counters, readable with policy_vm_get_stats() */
+typedef struct {
+  uint32_t runs;
+  uint32_t errors;
+  uint32_t budget_exceeded;
+  uint32_t last_instructions;
+  uint32_t max_instructions;
+  uint32_t last_us;
+  uint32_t max_us;
+  uint64_t total_us;
+} policy_vm_stats_t;
+
+/**
+ * @brief initialize the lock that guards the loaded policy, call once
+ *        before any task uses the interpreter
+ *
+ * @return void
+ */
+void policy_vm_init( void );
+
+/**
+ * @brief load a policy image from memory
+ *
+ * The image is validated and copied, so the caller may free it afterwards.
+ *
+ * @param image - pointer to the policy image
+ * @param len - length of the image in bytes
+ *
+ * @return POLICY_VM_SUCCESS on success, POLICY_VM_ERR_IMAGE otherwise
+ */
+int policy_vm_load( const uint8_t *image, size_t len );
+
+/**
+ * @brief load a policy image encoded as a hex string (cloud transport)
+ *
+ * @param hex - NUL terminated string of hex digits
+ *
+ * @return POLICY_VM_SUCCESS on success, POLICY_VM_ERR_IMAGE otherwise
+ */
+int policy_vm_load_hex( const char *hex );
+
+/**
+ * @brief unload the current policy, the controller falls back to its
+ *        built-in logic
+ *
+ * @return void
+ */
+void policy_vm_unload( void );
+
+/**
+ * @brief check whether a policy is loaded
+ *
+ * @return 1 if a policy is loaded, 0 otherwise
+ */
+int policy_vm_is_loaded( void );
+
+/**
+ * @brief load the policy stored in NVS, if any
+ *
+ * @return POLICY_VM_SUCCESS on success, an error code otherwise
+ */
+int policy_vm_load_nvs( void );
+
+/**
+ * @brief persist the currently loaded policy to NVS
+ *
+ * @return POLICY_VM_SUCCESS on success, an error code otherwise
+ */
+int policy_vm_store_nvs( void );
+
+/**
+ * @brief set the number of instructions one invocation may execute
+ *
+ * @param budget - instruction budget
+ *
+ * @return void
+ */
+void policy_vm_set_budget( uint32_t budget );
+
+/**
+ * @brief run the loaded policy for one event
+ *
+ * @param event - one of POLICY_EVENT_*
+ * @param state - snapshot of the system state the builtins read from
+ * @param out - actuation requests made by the policy
+ *
+ * @return POLICY_VM_SUCCESS on success, an error code otherwise
+ */
+int policy_vm_run( uint16_t event, const system_state_t *state, policy_vm_output_t *out );
+
+/**
+ * @brief get a copy of the execution cost counters
+ *
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void policy_vm_get_stats( policy_vm_stats_t *dest );
+
+#endif /* __policy_vm_h_ */
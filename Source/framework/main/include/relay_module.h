@@ -0,0 +1,91 @@
+/**
+ * @file relay_module.h
+ *
+ * @brief Defines the relay actuator API
+ *
+ * All writes to the load relay go through this module. It enforces a
+ * minimum on and off time, counts every switch operation (persisted in NVS)
+ * and spends a daily switching budget, keeping part of it in reserve for
+ * demand response requests.
+ */
+
+#ifndef __relay_module_h_
+#define __relay_module_h_
+
+#include <stdint.h>
+
+/** @brief the relay was switched (or already was in the requested state) */
+#define RELAY_SUCCESS 0
+/** @brief request deferred: minimum on/off time has not elapsed */
+#define RELAY_ERR_MIN_TIME (-1)
+/** @brief request denied: daily switching budget is spent */
+#define RELAY_ERR_BUDGET (-2)
+
+/** @brief MCP23017 pin driving the relay */
+#define RELAY_MCP_PIN 4
+
+/** @brief minimum time the relay stays closed once switched on */
+#define RELAY_MIN_ON_S 120
+/** @brief minimum time the relay stays open once switched off */
+#define RELAY_MIN_OFF_S 120
+
+/*
+ * The relay board is rated for 100,000 operations. Spread over a ten year
+ * service life that is ~27 operations a day; the budget below stays under
+ * that and keeps RELAY_DR_RESERVE of it for demand response.
+ */
+#define RELAY_DAILY_BUDGET 24
+#define RELAY_DR_RESERVE 8
+#define RELAY_BUDGET_PERIOD_S (24 * 60 * 60)
+
+/** @brief set points above this value close the relay */
+#define RELAY_SET_POINT_THRESHOLD 127
+
+/** @brief priority of a switch request */
+typedef enum {
+  RELAY_PRIORITY_NORMAL = 0, /* local comfort / user control */
+  RELAY_PRIORITY_DR          /* demand response (grid mode) */
+} relay_priority_t;
+
+/** @brief switching counters, readable with relay_get_stats() */
+typedef struct {
+  uint32_t lifetime_switches;  /* persisted in NVS */
+  uint32_t period_switches;    /* switches in the current budget period */
+  uint32_t dr_switches;        /* switches made for DR since boot */
+  uint32_t deferred_min_time;  /* requests held back by min on/off time */
+  uint32_t denied_budget;      /* requests denied by the daily budget */
+  uint32_t budget_periods;     /* budget periods elapsed since boot */
+  int state;                   /* current relay state, 1 = closed */
+} relay_stats_t;
+
+/**
+ * @brief request a relay state
+ *
+ * The request is applied immediately when the minimum on/off time has
+ * elapsed and the budget for its priority allows it. Requesting the state
+ * the relay is already in always succeeds and costs nothing.
+ *
+ * @param on - 1 to close the relay, 0 to open it
+ * @param priority - priority of the request
+ *
+ * @return RELAY_SUCCESS, RELAY_ERR_MIN_TIME or RELAY_ERR_BUDGET
+ */
+int relay_request( int on, relay_priority_t priority );
+
+/**
+ * @brief get a copy of the switching counters
+ *
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void relay_get_stats( relay_stats_t *dest );
+
+/**
+ * @brief initializes the relay output and starts the relay task
+ *
+ * @return void
+ */
+void relay_init_task( void );
+
+#endif /* __relay_module_h_ */
@@ -0,0 +1,229 @@
+/**
+ * @file rs485_bus.h
+ *
+ * @brief Defines the RS485 bus scheduler API
+ *
+ * The scheduler owns the half-duplex bus. Devices are described by a table
+ * (address, protocol, poll period, priority); each period a device is
+ * released for one poll that has to complete before the next release. The
+ * scheduler grants the bus to the released device with the earliest
+ * deadline (priority breaks ties) and lets other traffic, such as queued
+ * commands, use the bus only when it does not push a poll past its
+ * deadline.
+ *
+ * Devices with a poll period of 0 are passive: they poll us (the EC-100
+ * thermostat does). Their traffic is reported with rs485_bus_activity() so
+ * the scheduler stays off the bus while they talk.
+ *
+ * The scheduler does not touch the UART or read a clock itself.
+ */
+
+#ifndef __rs485_bus_h_
+#define __rs485_bus_h_
+
+#include <stdint.h>
+#include "cta2045_link.h"
+
+/** @brief success code */
+#define RS485_BUS_SUCCESS 0
+/** @brief device table is full */
+#define RS485_BUS_ERR_FULL (-1)
+/** @brief invalid device configuration or index */
+#define RS485_BUS_ERR_ARG (-2)
+
+#define RS485_BUS_MAX_DEVICES 8
+/** @brief line quiet time required between two transactions */
+#define RS485_BUS_GUARD_MS 5
+/**
+ * @brief bus time reserved for one command transaction: a CTA-2045 message
+ *        holds the link until it is acknowledged or the last retry timed out
+ */
+#define RS485_BUS_CMD_SLOT_MS \
+  (CTA2045_ACK_TIMEOUT_MS * (1 + CTA2045_MAX_RETRIES) + RS485_BUS_GUARD_MS)
+
+/** @brief protocols spoken on the bus */
+typedef enum {
+  RS485_PROTO_EC100 = 0,  /* EC-100 vendor frames, the thermostat polls us */
+  RS485_PROTO_CTA2045,    /* CTA-2045 SGD, polled with an operational state request */
+  RS485_PROTO_MODBUS      /* Modbus RTU slave */
+} rs485_proto_t;
+
+/** @brief static description of one device */
+typedef struct {
+  uint8_t address;
+  uint8_t protocol;     /* rs485_proto_t */
+  uint8_t priority;     /* higher wins when deadlines are equal */
+  uint32_t period_ms;   /* poll period, 0 for passive devices */
+  uint32_t timeout_ms;  /* response timeout of one poll */
+} rs485_bus_device_cfg_t;
+
+/** @brief per device counters */
+typedef struct {
+  uint32_t polls;
+  uint32_t responses;
+  uint32_t timeouts;
+  uint32_t errors;          /* responses reported as bad by the protocol */
+  uint32_t deadline_misses; /* poll completed, or still waiting, after its deadline */
+  uint32_t last_latency_ms; /* poll sent to response */
+  uint32_t max_latency_ms;
+  uint64_t total_latency_ms;
+} rs485_bus_device_stats_t;
+
+/** @brief bus wide counters */
+typedef struct {
+  uint32_t transactions;
+  uint32_t commands;
+  uint32_t busy_ms;     /* time the bus was in use by us or passive devices */
+  uint32_t elapsed_ms;  /* time since the first call to rs485_bus_poll() */
+} rs485_bus_stats_t;
+
+/** @brief one entry of the device table */
+typedef struct {
+  rs485_bus_device_cfg_t cfg;
+  uint32_t release_ms;   /* start of the current period */
+  uint8_t polled;        /* polled in the current period */
+  rs485_bus_device_stats_t stats;
+} rs485_bus_device_t;
+
+/** @brief scheduler state, treat as opaque */
+typedef struct {
+  rs485_bus_device_t dev[RS485_BUS_MAX_DEVICES];
+  uint8_t count;
+
+  /* transaction in flight: device index, RS485_BUS_COMMAND or -1 */
+  int8_t current;
+  uint32_t start_ms;
+  uint32_t timeout_ms;
+  /* the line must be quiet until this time */
+  uint32_t quiet_until_ms;
+
+  uint8_t started;
+  uint32_t first_ms;
+  rs485_bus_stats_t stats;
+} rs485_bus_t;
+
+/** @brief value of rs485_bus_t.current while a command is in flight */
+#define RS485_BUS_COMMAND (-2)
+
+/**
+ * @brief initialize an empty scheduler
+ *
+ * @param bus - the scheduler
+ *
+ * @return void
+ */
+void rs485_bus_init( rs485_bus_t *bus );
+
+/**
+ * @brief add a device to the table
+ *
+ * @param bus - the scheduler
+ * @param cfg - device description
+ * @param now_ms - current time in milliseconds, the first period starts now
+ *
+ * @return device index on success, an error code otherwise
+ */
+int rs485_bus_add( rs485_bus_t *bus, const rs485_bus_device_cfg_t *cfg, uint32_t now_ms );
+
+/**
+ * @brief pick the device to poll now
+ *
+ * On success the bus is marked busy until rs485_bus_complete() or the
+ * response timeout; the caller sends the poll right away.
+ *
+ * @param bus - the scheduler
+ * @param now_ms - current time in milliseconds
+ *
+ * @return device index, or -1 if nothing is due or the bus is busy
+ */
+int rs485_bus_schedule( rs485_bus_t *bus, uint32_t now_ms );
+
+/**
+ * @brief ask for the bus to send a command
+ *
+ * Granted when the bus is free and a RS485_BUS_CMD_SLOT_MS transaction
+ * would not make a released poll miss its deadline. The bus is then busy
+ * until rs485_bus_complete() or RS485_BUS_CMD_SLOT_MS.
+ *
+ * @param bus - the scheduler
+ * @param now_ms - current time in milliseconds
+ *
+ * @return 1 if the bus was granted, 0 otherwise
+ */
+int rs485_bus_acquire( rs485_bus_t *bus, uint32_t now_ms );
+
+/**
+ * @brief end the transaction in flight
+ *
+ * @param bus - the scheduler
+ * @param ok - 1 if the response was valid, 0 if the protocol rejected it
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void rs485_bus_complete( rs485_bus_t *bus, int ok, uint32_t now_ms );
+
+/**
+ * @brief report traffic we did not start (a passive device talking)
+ *
+ * @param bus - the scheduler
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void rs485_bus_activity( rs485_bus_t *bus, uint32_t now_ms );
+
+/**
+ * @brief record a poll from a passive device that we answered
+ *
+ * @param bus - the scheduler
+ * @param index - index of the passive device
+ * @param latency_ms - time from its poll to our response
+ *
+ * @return void
+ */
+void rs485_bus_served( rs485_bus_t *bus, int index, uint32_t latency_ms );
+
+/**
+ * @brief advance the scheduler timers: response timeouts and deadlines
+ *
+ * @param bus - the scheduler
+ * @param now_ms - current time in milliseconds
+ *
+ * @return void
+ */
+void rs485_bus_poll( rs485_bus_t *bus, uint32_t now_ms );
+
+/**
+ * @brief find a device by protocol and address
+ *
+ * @param bus - the scheduler
+ * @param protocol - rs485_proto_t
+ * @param address - device address
+ *
+ * @return device index, or -1 if there is no such device
+ */
+int rs485_bus_find( const rs485_bus_t *bus, uint8_t protocol, uint8_t address );
+
+/**
+ * @brief get a copy of one device's counters
+ *
+ * @param bus - the scheduler
+ * @param index - device index
+ * @param dest - memory region to copy the counters to
+ *
+ * @return RS485_BUS_SUCCESS, or RS485_BUS_ERR_ARG for a bad index
+ */
+int rs485_bus_get_device_stats( const rs485_bus_t *bus, int index, rs485_bus_device_stats_t *dest );
+
+/**
+ * @brief get a copy of the bus wide counters
+ *
+ * @param bus - the scheduler
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void rs485_bus_get_stats( const rs485_bus_t *bus, rs485_bus_stats_t *dest );
+
+#endif /* __rs485_bus_h_ */
@@ -0,0 +1,133 @@
+/**
+ * @file rs485_trace.h
+ *
+ * @brief Defines the RS485 protocol trace ring
+ *
+ * Every chunk of bytes read from or written to the line is appended to a
+ * byte ring as a record: a microsecond timestamp, a direction and the raw
+ * bytes. Recording is a bounds check and a copy; when the ring is full the
+ * oldest records are overwritten.
+ *
+ * A snapshot serializes the ring oldest record first:
+ *
+ *   "R4T1"                         magic
+ *   then per record:
+ *   t_us (4 bytes, little endian)  low 32 bits of esp_timer_get_time()
+ *   dir  (1 byte)                  RS485_TRACE_RX/TX/EVENT
+ *   len  (1 byte)
+ *   data (len bytes)
+ *
+ * tools/rs485_trace decodes snapshots into annotated CTA-2045, EC-100 and
+ * Modbus frames with timing statistics.
+ *
+ * Like the protocol modules this code takes time as an argument, locking
+ * is up to the caller.
+ */
+
+#ifndef __rs485_trace_h_
+#define __rs485_trace_h_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @brief ring size in bytes */
+#define RS485_TRACE_SIZE 4096
+/** @brief bytes of a record in front of its data */
+#define RS485_TRACE_HEADER_SIZE 6
+/** @brief longest data of one record, longer chunks are split */
+#define RS485_TRACE_MAX_DATA 255
+
+#define RS485_TRACE_MAGIC "R4T1"
+#define RS485_TRACE_MAGIC_SIZE 4
+
+/* record directions */
+#define RS485_TRACE_RX 0
+#define RS485_TRACE_TX 1
+#define RS485_TRACE_EVENT 2   /* one byte: RS485_TRACE_EV_* */
+
+/* line events */
+#define RS485_TRACE_EV_FIFO_OVF 1
+#define RS485_TRACE_EV_BUFFER_FULL 2
+#define RS485_TRACE_EV_PARITY 3
+#define RS485_TRACE_EV_FRAME 4
+
+/** @brief trace counters */
+typedef struct {
+  uint32_t records;
+  uint32_t bytes;          /* data bytes recorded */
+  uint32_t overwritten;    /* records lost to wrap around */
+} rs485_trace_stats_t;
+
+/** @brief trace ring, treat as opaque */
+typedef struct {
+  uint8_t buf[RS485_TRACE_SIZE];
+  uint32_t head;   /* byte counters, the ring index is counter % size */
+  uint32_t tail;
+  uint8_t enabled;
+  rs485_trace_stats_t stats;
+} rs485_trace_t;
+
+/**
+ * @brief initialize an empty, enabled trace
+ *
+ * @param t - the trace
+ *
+ * @return void
+ */
+void rs485_trace_init( rs485_trace_t *t );
+
+/**
+ * @brief stop or resume recording, e.g. to freeze the trace after an error
+ *
+ * @param t - the trace
+ * @param enabled - 1 to record, 0 to ignore new records
+ *
+ * @return void
+ */
+void rs485_trace_enable( rs485_trace_t *t, int enabled );
+
+/**
+ * @brief append a record, overwriting the oldest records if needed
+ *
+ * @param t - the trace
+ * @param time_us - timestamp in microseconds
+ * @param dir - RS485_TRACE_RX, RS485_TRACE_TX or RS485_TRACE_EVENT
+ * @param data - bytes to record
+ * @param len - number of bytes
+ *
+ * @return void
+ */
+void rs485_trace_record( rs485_trace_t *t, uint32_t time_us, uint8_t dir,
+                         const uint8_t *data, size_t len );
+
+/**
+ * @brief serialize the newest records that fit into a buffer
+ *
+ * @param t - the trace
+ * @param dst - destination buffer
+ * @param size - its size, at least RS485_TRACE_MAGIC_SIZE
+ *
+ * @return number of bytes written, 0 if the buffer is too small
+ */
+size_t rs485_trace_snapshot( const rs485_trace_t *t, uint8_t *dst, size_t size );
+
+/**
+ * @brief drop all records
+ *
+ * @param t - the trace
+ *
+ * @return void
+ */
+void rs485_trace_clear( rs485_trace_t *t );
+
+/**
+ * @brief get a copy of the trace counters
+ *
+ * @param t - the trace
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void rs485_trace_get_stats( const rs485_trace_t *t, rs485_trace_stats_t *dest );
+
+#endif /* __rs485_trace_h_ */
@@ -10,13 +10,35 @@
 #ifndef __rs_485_module_h_
 #define __rs_485_module_h_
 
+#include <stdint.h>
+#include <stddef.h>
+#include "cta2045_app.h"
+#include "rs485_bus.h"
+
 /** @brief depth of the controller stack */
 #define frqUSStackDepth ((unsigned short) 2048) /* bytes */
 /** @brief priority of the controller stack */
 #define frqUXPriority (3)
 
+/** @brief receive path counters, readable with rs485_get_stats() */
+typedef struct {
+  uint32_t bytes_rx;
+  uint32_t bytes_dropped;   /* flushed after a FIFO or ring buffer overflow */
+  uint32_t fifo_overflows;
+  uint32_t buffer_full;
+  uint32_t line_errors;     /* parity and framing errors */
+  uint32_t frames;          /* frames delivered by the link layer */
+  uint32_t last_latency_us; /* UART event to frame handled */
+  uint32_t max_latency_us;
+  uint64_t total_latency_us;
+  uint32_t responses;       /* responses sent to thermostat polls */
+  uint32_t last_turnaround_us; /* poll received to response handed to the driver */
+  uint32_t max_turnaround_us;
+  uint64_t total_turnaround_us;
+} rs485_stats_t;
+
 /** @brief name of the controller task */
-extern const char * const rs485_task;
+extern const char * const rs485_task_name;
 
 /**
  * @brief function that initializes that controller task
@@ -25,5 +47,63 @@ extern const char * const rs485_task;
  */
 void rs485_init_task( void );
 
+/**
+ * @brief queue a command for the water heater; a pending command of the
+ *        same class that has not been sent yet is superseded
+ *
+ * @param cmd - command to send
+ * @param arg - command argument, see cta2045_cmd_t
+ *
+ * @return CTA2045_SUCCESS, or an error code if the module is not running
+ *         or, for commands other than CTA2045_CMD_SET_POINT, there is no
+ *         CTA-2045 device on the bus
+ */
+int rs485_submit_command( cta2045_cmd_t cmd, uint8_t arg );
+
+/**
+ * @brief check whether a CTA-2045 device is configured on the bus, i.e.
+ *        whether DR commands can be answered
+ * @return 1 if DR commands can be submitted, 0 otherwise
+ */
+int rs485_has_sgd( void );
+
+/**
+ * @brief get a copy of the counters of one device in the bus device table
+ *
+ * @param index - device index
+ * @param dest - memory region to copy the counters to
+ *
+ * @return RS485_BUS_SUCCESS, or RS485_BUS_ERR_ARG for a bad index
+ */
+int rs485_get_device_stats( int index, rs485_bus_device_stats_t *dest );
+
+/**
+ * @brief serialize the newest protocol trace records that fit into a
+ *        buffer, see rs485_trace.h for the format
+ *
+ * @param dst - destination buffer
+ * @param size - its size
+ *
+ * @return number of bytes written
+ */
+size_t rs485_get_trace( uint8_t *dst, size_t size );
+
+/**
+ * @brief print the protocol trace to the console as hex lines, for
+ *        tools/rs485_trace
+ *
+ * @return void
+ */
+void rs485_trace_print( void );
+
+/**
+ * @brief get a copy of the receive path counters
+ *
+ * @param dest - memory region to copy the counters to
+ *
+ * @return void
+ */
+void rs485_get_stats( rs485_stats_t *dest );
+
 
 #endif /* __frq_module_h_ */
\ No newline at end of file
@@ -14,6 +14,15 @@
 /** @brief priority of the wifi stack */
 #define wifiUXPriority (2)
 
+/** @brief wifi connection state, see wifi_get_status() */
+typedef struct {
+  int started;       /* wifi_init_task() has run */
+  int connected;     /* associated and got an IP address */
+  char ssid[33];
+  char ip[16];       /* dotted quad, empty while not connected */
+  char mac[18];
+} wifi_status_t;
+
 /** @brief name of the wifi task */
 extern const char * const wifi_task_name;
 
@@ -24,4 +33,14 @@ extern const char * const wifi_task_name;
  */
 void wifi_init_task( void );
 
+/**
+ * @brief get a copy of the wifi connection state
+ *
+ * @param dest - memory region to copy the state to, all zero if the wifi
+ *               module has not been started
+ *
+ * @return void
+ */
+void wifi_get_status( wifi_status_t *dest );
+
 #endif /* __wifi_module_h_ */
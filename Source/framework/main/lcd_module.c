@@ -10,8 +10,10 @@
 #include "esp_log.h"
 #include "esp_spi_flash.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "rwlock.h"
 #include "u8g2.h" // LCD driver library
@@ -19,114 +21,452 @@
 #include "util.h"  
 
 #include "button.h"
+#include "lcd_module.h"
+#include "lcd_screens.h"
+#include "lcd_ui.h"
+#include "wifi_module.h"
 
 #define PIN_MCP_RESET 2
 #define PIN_SDA 25
 #define PIN_SCL 26
 #define LEVEL_HIGH 1
-#define _I2C_MASTER_FREQ_HZ     100000     /* I2C master clock frequency */
+#define _I2C_MASTER_FREQ_HZ     400000     /* I2C master clock frequency, as set up in grid_ballast_main.c */
 #define TAG "gridballast"
-
-system_state_t mystate;
+/** @brief number of frames between counter reports */
+#define LCD_STATS_PERIOD 100
+/** @brief shortest time between two frames, i.e. the frame rate cap */
+#define LCD_FRAME_BUDGET_MS 200
+/** @brief how often the displayed fields are checked for changes */
+#define LCD_POLL_MS 250
+
+/** @brief core of the transfer task, rendering runs wherever task_lcd is scheduled */
+#define LCD_TX_CORE 0
+
+/* time full frame transfers at several bus clocks once at startup */
+//#define LCD_BUS_BENCHMARK
+/** @brief frames per benchmark configuration */
+#define LCD_BENCH_FRAMES 10
+
+/** @brief keys waiting for task_lcd */
+#define LCD_KEY_QUEUE_LEN 8
+
+const char * const lcd_task_name = "lcd_task";
+
+/** @brief display RAM as last sent, lets u8g2 transfer only changed tiles */
+static uint8_t lcd_shadow[128 * 64 / 8];
+/** @brief frame buffers: task_lcd draws into the back one while
+ *  task_lcd_tx sends the front one */
+static uint8_t lcd_frame[2][128 * 64 / 8];
+/** @brief drawing instance, owned by task_lcd */
+static u8g2_t lcd_draw;
+/** @brief decoded glyphs of lcd_draw, the screen text uses few distinct characters */
+static u8g2_glyph_cache_t lcd_glyph_cache;
+/** @brief glyph index of the lcd_draw font, the screens are ASCII only */
+static u8g2_font_index_t lcd_font_index;
+/** @brief bus instance, owned by task_lcd_tx; holds the display state and shadow */
+static u8g2_t lcd_bus;
+/** @brief given by task_lcd_tx when the front buffer may be replaced */
+static SemaphoreHandle_t lcd_tx_free;
+static TaskHandle_t lcd_task_handle = NULL;
+static TaskHandle_t lcd_tx_task_handle = NULL;
+static rwlock_t lcd_stats_lock;
+static lcd_stats_t lcd_stats;
+static QueueHandle_t lcd_key_queue;
+#ifdef U8X8_WITH_PROFILE
+/** @brief counters of the frame being drawn and sent */
+static u8x8_profile_t lcd_draw_profile;
+static u8x8_profile_t lcd_bus_profile;
+/** @brief counters of the last frame, under lcd_stats_lock */
+static u8x8_profile_t lcd_last_draw_profile;
+static u8x8_profile_t lcd_last_bus_profile;
+#endif
+
+/** @brief widget tree, owned by task_lcd */
+static lcd_ui_t lcd_ui;
 
 
 // uint8_t temprature_sens_read(); 
 
-static void task_lcd(void *arg) 
-{
+/**
+ * @brief reads everything the widgets are bound to
+ *
+ * @param model - the snapshot
+ *
+ * @return void
+ */
+static void lcd_read_model(lcd_ui_model_t *model) {
+    rwlock_reader_lock(&system_state_lock);
+    get_system_state(&model->state);
+    rwlock_reader_unlock(&system_state_lock);
+
+    wifi_get_status(&model->net);
+}
 
+/**
+ * @brief applies the queued button keys, storing edited values
+ *
+ * @param model - the snapshot, updated with the edits
+ *
+ * @return number of keys
+ */
+static int lcd_handle_keys(lcd_ui_model_t *model) {
+    uint8_t key;
+    int keys = 0;
+
+    while (xQueueReceive(lcd_key_queue, &key, 0) == pdTRUE) {
+        rwlock_writer_lock(&system_state_lock);
+        get_system_state(&model->state);
+        if (lcd_ui_key(&lcd_ui, key, model)) {
+            set_system_state(&model->state);
+        }
+        rwlock_writer_unlock(&system_state_lock);
+        keys++;
+    }
+    return keys;
+}
 
-        float freq = 0;
-        float pwr = 0;
-        int t1 = 0;
-        int t2 = 0;
-        int m =0;
-        int ht;
-        int heating_status;
-        char str [32];
+static void lcd_account_render(uint32_t render_us, uint32_t wait_us, int widgets) {
+    rwlock_writer_lock(&lcd_stats_lock);
+    lcd_stats.widgets_drawn += widgets;
+    lcd_stats.last_render_us = render_us;
+    if (render_us > lcd_stats.max_render_us) {
+        lcd_stats.max_render_us = render_us;
+    }
+    lcd_stats.total_render_us += render_us;
+    if (wait_us > 0) {
+        lcd_stats.tx_waits++;
+        lcd_stats.total_tx_wait_us += wait_us;
+    }
+    rwlock_writer_unlock(&lcd_stats_lock);
+}
 
+static void lcd_account_bus(uint32_t bus_us, uint16_t send_bytes) {
+    rwlock_writer_lock(&lcd_stats_lock);
+    lcd_stats.frames++;
+    lcd_stats.last_bus_us = bus_us;
+    if (bus_us > lcd_stats.max_bus_us) {
+        lcd_stats.max_bus_us = bus_us;
+    }
+    lcd_stats.total_bus_us += bus_us;
+    lcd_stats.last_send_bytes = send_bytes;
+    lcd_stats.total_send_bytes += send_bytes;
+    rwlock_writer_unlock(&lcd_stats_lock);
+}
 
-        // a structure which will contain all the data for one display
-        u8g2_t u8g2;
+#ifdef U8X8_WITH_PROFILE
+static const char * const lcd_profile_names[U8X8_PROFILE_CNT] = {
+    "glyph", "hvline", "box", "bitmap", "bus"
+};
+
+/**
+ * @brief prints the u8g2 counters of the last frame, ticks are CPU cycles
+ *
+ * @return void
+ */
+static void lcd_print_profile(void) {
+    u8x8_profile_t draw;
+    u8x8_profile_t bus;
+    int i;
+
+    lcd_get_profile(&draw, &bus);
+    printf("lcd profile:");
+    for (i = 0; i < U8X8_PROFILE_BUS; i++) {
+        printf(" %s %u/%u cycles,", lcd_profile_names[i], draw.count[i], draw.ticks[i]);
+    }
+    printf(" %s %u/%u cycles, %u data bytes\n", lcd_profile_names[U8X8_PROFILE_BUS],
+           bus.count[U8X8_PROFILE_BUS], bus.ticks[U8X8_PROFILE_BUS], bus.data_bytes);
+}
+#endif /* U8X8_WITH_PROFILE */
+
+static void lcd_print_stats(void) {
+    lcd_stats_t stats;
+
+    lcd_get_stats(&stats);
+    printf("lcd: %u frames, %u.%02u frames/s, %u events, %u idle checks, %u deferred, %u waits for bus (%u us), %u widgets drawn, render last %u us max %u us avg %u us, bus last %u us max %u us avg %u us, %u bytes/frame\n",
+           stats.frames, stats.fps_x100 / 100, stats.fps_x100 % 100, stats.events,
+           stats.idle_checks, stats.deferred,
+           stats.tx_waits, (unsigned)stats.total_tx_wait_us, stats.widgets_drawn,
+           stats.last_render_us, stats.max_render_us,
+           stats.frames ? (unsigned)(stats.total_render_us / stats.frames) : 0,
+           stats.last_bus_us, stats.max_bus_us,
+           stats.frames ? (unsigned)(stats.total_bus_us / stats.frames) : 0,
+           stats.frames ? (unsigned)(stats.total_send_bytes / stats.frames) : 0);
+#ifdef U8X8_WITH_PROFILE
+    lcd_print_profile();
+#endif
+}
+
+#ifdef LCD_BUS_BENCHMARK
+static const int lcd_bench_hz[] = { 100000, 400000, 1000000 };
+
+/**
+ * @brief times full frame transfers with bytewise and batched I2C writes
+ *        at each bus clock in lcd_bench_hz
+ *
+ * The bytewise run at 100 kHz is the transfer as it was before batching
+ * and the faster bus; rebuild with U8X8_I2C_DATA_CHUNK 24 for the old
+ * transfer size as well.
+ *
+ * @param u8g2 - the display, set up
+ *
+ * @return void
+ */
+static void lcd_bus_benchmark(u8g2_t *u8g2) {
+    int i;
+    int batch;
+    int n;
+    int64_t start_us;
+    uint32_t frame_us;
+
+    u8g2_ClearBuffer(u8g2);
+    u8g2_SetFont(u8g2, u8g2_font_t0_13_te);
+    u8g2_DrawStr(u8g2, 10, 10, "I2C benchmark");
+
+    rwlock_writer_lock(&i2c_lock);
+    for (i = 0; i < sizeof(lcd_bench_hz) / sizeof(lcd_bench_hz[0]); i++) {
+        generic_i2c_set_frequency(I2C_NUM_1, lcd_bench_hz[i]);
+        for (batch = 0; batch <= 1; batch++) {
+            u8g2_esp32_i2c_set_batch(batch);
+            start_us = esp_timer_get_time();
+            for (n = 0; n < LCD_BENCH_FRAMES; n++) {
+                u8g2_InvalidateShadowBuffer(u8g2);
+                u8g2_SendBuffer(u8g2);
+            }
+            frame_us = (uint32_t)((esp_timer_get_time() - start_us) / LCD_BENCH_FRAMES);
+            printf("lcd bench: %7d Hz, %s writes, chunk %d: %u us/frame, %u bytes/frame\n",
+                   lcd_bench_hz[i], batch ? "batched" : "bytewise", U8X8_I2C_DATA_CHUNK,
+                   frame_us, u8g2_GetSendBytes(u8g2));
+        }
+    }
+    generic_i2c_set_frequency(I2C_NUM_1, _I2C_MASTER_FREQ_HZ);
+    rwlock_writer_unlock(&i2c_lock);
+}
+#endif /* LCD_BUS_BENCHMARK */
+
+/**
+ * @brief LCD transfer task: initializes the display, then sends the front
+ *        buffer each time task_lcd hands one over
+ *
+ * @param arg - unused
+ *
+ * @return void
+ */
+static void task_lcd_tx(void *arg)
+{
+        int64_t start_us;
+        uint32_t bus_us;
 
         // initialize u8g2 structure
-        u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
-        u8x8_SetI2CAddress(&u8g2.u8x8, 0x78);
+        u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&lcd_bus, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+        u8g2_SetBufferPtr(&lcd_bus, lcd_frame[0]);
+        u8x8_SetI2CAddress(&lcd_bus.u8x8, 0x78);
 
-        
+        rwlock_writer_lock(&i2c_lock);
         // send init sequence to the display, display is in sleep mode after this,
-        u8g2_InitDisplay(&u8g2);
+        u8g2_InitDisplay(&lcd_bus);
         //wake up display
-        u8g2_SetPowerSave(&u8g2, 0);
-        u8g2_SetContrast(&u8g2, 100);
-        u8g2_SetFlipMode(&u8g2, 1);
-
-      while(1)
+        u8g2_SetPowerSave(&lcd_bus, 0);
+        u8g2_SetContrast(&lcd_bus, 100);
+        u8g2_SetFlipMode(&lcd_bus, 1);
+        rwlock_writer_unlock(&i2c_lock);
+        u8g2_SetShadowBuffer(&lcd_bus, lcd_shadow);
+#ifdef U8X8_WITH_PROFILE
+        u8x8_SetProfile(u8g2_GetU8x8(&lcd_bus), &lcd_bus_profile);
+#endif
+
+#ifdef LCD_BUS_BENCHMARK
+        lcd_bus_benchmark(&lcd_bus);
+#endif
+
+        xSemaphoreGive(lcd_tx_free);
+
+        while(1)
         {
-          // read system state to access state variables for display
-
-          rwlock_reader_lock(&system_state_lock);
-          get_system_state(&mystate);
-          rwlock_reader_unlock(&system_state_lock);
-
-          freq = mystate.grid_freq;
-          t1 = mystate.temp_top;
-          t2 = mystate.temp_bottom;
-          pwr = mystate.power;
-
-          m = mystate.mode;
-
-          ht = mystate.heating_status;
-
-          int sp = mystate.set_point;
-        //ESP_LOGI("lcd", "the t bottom is %d\n",t2);
-        rwlock_writer_lock(&i2c_lock);
-
-        // 
-         u8x8_SetI2CAddress(&u8g2.u8x8, 0x78);
-
-          u8g2_ClearBuffer(&u8g2);
+          ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+#ifdef U8X8_WITH_PROFILE
+          u8x8_ResetProfile(u8g2_GetU8x8(&lcd_bus));
+#endif
+          start_us = esp_timer_get_time();
+          rwlock_writer_lock(&i2c_lock);
+          u8x8_SetI2CAddress(&lcd_bus.u8x8, 0x78);
+          u8g2_SendBuffer(&lcd_bus);
+          rwlock_writer_unlock(&i2c_lock);
+          bus_us = (uint32_t)(esp_timer_get_time() - start_us);
+#ifdef U8X8_WITH_PROFILE
+          rwlock_writer_lock(&lcd_stats_lock);
+          lcd_last_bus_profile = lcd_bus_profile;
+          rwlock_writer_unlock(&lcd_stats_lock);
+#endif
+
+          lcd_account_bus(bus_us, u8g2_GetSendBytes(&lcd_bus));
+          xSemaphoreGive(lcd_tx_free);
+        }
+}
 
+/**
+ * @brief LCD task: renders a frame only when a displayed value changed or
+ *        a key changed the screen, at most once per LCD_FRAME_BUDGET_MS
+ *
+ * Only the widgets whose text changed are redrawn into the back buffer,
+ * which is then handed to task_lcd_tx, so the next frame can be drawn
+ * while the previous one is still on the bus.
+ *
+ * @param arg - unused
+ *
+ * @return void
+ */
+static void task_lcd(void *arg) 
+{
+        lcd_ui_model_t model;
+        int64_t last_frame_us = 0;
+        int64_t fps_start_us;
+        uint32_t fps_frames = 0;
+        uint32_t reported = 0;
+        int64_t start_us;
+        int64_t wait_us;
+        uint32_t render_us;
+        uint32_t tx_wait_us;
+        int widgets;
+        int back = 1;
+        int idle;
+        uint32_t event;
+
+        // the drawing instance never talks to the display
+        u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&lcd_draw, U8G2_R0, u8g2_esp32_i2c_byte_cb, u8g2_esp32_gpio_and_delay_cb);
+        u8g2_SetBufferPtr(&lcd_draw, lcd_frame[back]);
+        u8g2_SetGlyphCache(&lcd_draw, &lcd_glyph_cache);
+        u8g2_SetFontIndex(&lcd_draw, &lcd_font_index, NULL, 0);
+#ifdef U8X8_WITH_PROFILE
+        u8x8_SetProfile(u8g2_GetU8x8(&lcd_draw), &lcd_draw_profile);
+#endif
+
+        fps_start_us = esp_timer_get_time();
 
-          u8g2_SetFont(&u8g2,u8g2_font_t0_13_te);
-            sprintf(str, "Freq: %2.4fHz", freq);
+      while(1)
+        {
+          /* sleep until a key or other UI event, checking the values now and then */
+          event = ulTaskNotifyTake(pdTRUE, LCD_POLL_MS / portTICK_PERIOD_MS);
+          lcd_read_model(&model);
+          lcd_handle_keys(&model);
+          lcd_ui_update(&lcd_ui, &model);
+
+          /* the front buffer is the one on the display */
+          idle = !lcd_ui_is_stale(&lcd_ui, back ^ 1);
+
+          rwlock_writer_lock(&lcd_stats_lock);
+          if (event) {
+              lcd_stats.events++;
+          } else if (idle) {
+              lcd_stats.idle_checks++;
+          }
+          rwlock_writer_unlock(&lcd_stats_lock);
+
+          if (idle) {
+              continue;
+          }
+
+          /* stay within the frame budget, whatever changes meanwhile goes
+           * into the same frame */
+          wait_us = last_frame_us + LCD_FRAME_BUDGET_MS * 1000LL - esp_timer_get_time();
+          if (last_frame_us != 0 && wait_us > 0) {
+              rwlock_writer_lock(&lcd_stats_lock);
+              lcd_stats.deferred++;
+              rwlock_writer_unlock(&lcd_stats_lock);
+              vTaskDelay(wait_us / 1000 / portTICK_PERIOD_MS + 1);
+              ulTaskNotifyTake(pdTRUE, 0);
+              lcd_read_model(&model);
+              lcd_handle_keys(&model);
+              lcd_ui_update(&lcd_ui, &model);
+          }
+
+#ifdef U8X8_WITH_PROFILE
+          u8x8_ResetProfile(u8g2_GetU8x8(&lcd_draw));
+#endif
+          start_us = esp_timer_get_time();
+          widgets = lcd_ui_draw(&lcd_ui, &lcd_draw, back);
+          render_us = (uint32_t)(esp_timer_get_time() - start_us);
+#ifdef U8X8_WITH_PROFILE
+          rwlock_writer_lock(&lcd_stats_lock);
+          lcd_last_draw_profile = lcd_draw_profile;
+          rwlock_writer_unlock(&lcd_stats_lock);
+#endif
+
+          /* the previous frame must be off the bus before its buffer is reused */
+          start_us = esp_timer_get_time();
+          xSemaphoreTake(lcd_tx_free, portMAX_DELAY);
+          tx_wait_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+          u8g2_SetBufferPtr(&lcd_bus, lcd_frame[back]);
+          back ^= 1;
+          u8g2_SetBufferPtr(&lcd_draw, lcd_frame[back]);
+          xTaskNotifyGive(lcd_tx_task_handle);
+
+          last_frame_us = esp_timer_get_time();
+          lcd_account_render(render_us, tx_wait_us, widgets);
+
+          /* frames/s over windows of at least a second */
+          fps_frames++;
+          if (last_frame_us - fps_start_us >= 1000000) {
+              rwlock_writer_lock(&lcd_stats_lock);
+              lcd_stats.fps_x100 = (uint32_t)(fps_frames * 100000000LL / (last_frame_us - fps_start_us));
+              rwlock_writer_unlock(&lcd_stats_lock);
+              fps_frames = 0;
+              fps_start_us = last_frame_us;
+          }
+
+          if (++reported >= LCD_STATS_PERIOD) {
+              reported = 0;
+              lcd_print_stats();
+          }
 
-          u8g2_DrawStr(&u8g2, 10, 10, str);
-        
-          sprintf(str,"Tt:%dF",t1);
-          u8g2_DrawStr(&u8g2, 10, 60, str);
-        
-          sprintf(str,"Tb:%dF",t2);
-          u8g2_DrawStr(&u8g2, 70, 60, str);
-        
-          sprintf(str,"Ts:%dF",sp);
-          u8g2_DrawStr(&u8g2, 10, 40, str);
+           //printf("ESP32 onchip Temperature = %d\n", temprature_sens_read());
 
-         
-          sprintf(str,"Mode:%d ",m);
-          u8g2_DrawStr(&u8g2, 70, 40, str);
-          
+        }
+}
 
-          sprintf(str,"Power: %2.2f", pwr);
-          u8g2_DrawStr(&u8g2, 10, 25, str);
 
-          sprintf(str, "Heat:%d", ht);
-          u8g2_DrawStr(&u8g2,70, 25,str);
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
 
+void lcd_notify( void ) {
+    if (lcd_task_handle != NULL) {
+        xTaskNotifyGive(lcd_task_handle);
+    }
+}
 
-          
-          u8g2_SendBuffer(&u8g2);
+void lcd_key( int key ) {
+    uint8_t k = key;
 
-          rwlock_writer_unlock(&i2c_lock);
+    if (lcd_key_queue != NULL) {
+        xQueueSend(lcd_key_queue, &k, 0);
+        lcd_notify();
+    }
+}
 
-           //printf("ESP32 onchip Temperature = %d\n", temprature_sens_read());
+void lcd_get_stats( lcd_stats_t *dest ) {
+    rwlock_reader_lock(&lcd_stats_lock);
+    memcpy(dest, &lcd_stats, sizeof(lcd_stats));
+    rwlock_reader_unlock(&lcd_stats_lock);
+}
 
-        }
+#ifdef U8X8_WITH_PROFILE
+void lcd_get_profile( u8x8_profile_t *draw, u8x8_profile_t *bus ) {
+    rwlock_reader_lock(&lcd_stats_lock);
+    memcpy(draw, &lcd_last_draw_profile, sizeof(u8x8_profile_t));
+    memcpy(bus, &lcd_last_bus_profile, sizeof(u8x8_profile_t));
+    rwlock_reader_unlock(&lcd_stats_lock);
 }
+#endif
 
 void lcd_init_task( void ) 
 {
+	rwlock_init(&lcd_stats_lock);
+	lcd_tx_free = xSemaphoreCreateBinary();
+	lcd_key_queue = xQueueCreate(LCD_KEY_QUEUE_LEN, sizeof(uint8_t));
+	lcd_screens_init(&lcd_ui);
 
-
-	xTaskCreate(task_lcd, "lcd_task", 4096, NULL, 10, NULL);
+	xTaskCreatePinnedToCore(task_lcd_tx, "lcd_tx_task", 3072, NULL, 10, &lcd_tx_task_handle, LCD_TX_CORE);
+	xTaskCreate(task_lcd, lcd_task_name, 4096, NULL, 10, &lcd_task_handle);
 }
@@ -0,0 +1,81 @@
+/**
+ * @file lcd_screens.c
+ *
+ * @brief screen definitions of the LCD
+ *
+ * Kept apart from lcd_module.c, which owns the tasks and the display,
+ * so the screens can also be rendered by a host build (tools/lcd_golden).
+ */
+
+#include <stddef.h>
+#include "u8g2.h"
+#include "lcd_screens.h"
+
+/** @brief height of a text row */
+#define LCD_ROW_H 14
+
+/*
+ * The screens of the User Guide: vitals, user options, network.
+ * Boxes are x, y (top), w, h; values are bound with offsetof(lcd_ui_model_t, ...).
+ */
+static lcd_ui_widget_t lcd_vitals[] = {
+  { .type = LCD_UI_FLOAT, .x = 10, .y = 0, .w = 118, .h = LCD_ROW_H,
+    .format = "Freq: %2.4fHz", .offset = offsetof(lcd_ui_model_t, state.grid_freq) },
+  { .type = LCD_UI_FLOAT, .x = 10, .y = 16, .w = 76, .h = LCD_ROW_H,
+    .format = "Power: %2.2f", .offset = offsetof(lcd_ui_model_t, state.power) },
+  { .type = LCD_UI_INT, .x = 88, .y = 16, .w = 40, .h = LCD_ROW_H,
+    .format = "Heat:%d", .offset = offsetof(lcd_ui_model_t, state.heating_status) },
+  { .type = LCD_UI_INT, .flags = LCD_UI_MANUAL, .x = 10, .y = 32, .w = 60, .h = LCD_ROW_H,
+    .format = "Ts:%dF", .offset = offsetof(lcd_ui_model_t, state.set_point),
+    .step = 1, .min = 0, .max = 200 },
+  { .type = LCD_UI_INT, .x = 70, .y = 32, .w = 58, .h = LCD_ROW_H,
+    .format = "Mode:%d", .offset = offsetof(lcd_ui_model_t, state.mode) },
+  { .type = LCD_UI_INT, .x = 10, .y = 48, .w = 60, .h = LCD_ROW_H,
+    .format = "Tt:%dF", .offset = offsetof(lcd_ui_model_t, state.temp_top) },
+  { .type = LCD_UI_INT, .x = 70, .y = 48, .w = 58, .h = LCD_ROW_H,
+    .format = "Tb:%dF", .offset = offsetof(lcd_ui_model_t, state.temp_bottom) },
+};
+
+static lcd_ui_widget_t lcd_option_rows[] = {
+  { .type = LCD_UI_INT, .flags = LCD_UI_MANUAL, .x = 0, .y = 0, .w = 128, .h = LCD_ROW_H,
+    .format = "Set point: %dF", .offset = offsetof(lcd_ui_model_t, state.set_point),
+    .step = 1, .min = 0, .max = 200 },
+  { .type = LCD_UI_INT, .x = 0, .y = 16, .w = 128, .h = LCD_ROW_H,
+    .format = "Mode: %d", .offset = offsetof(lcd_ui_model_t, state.mode),
+    .step = 1, .min = 0, .max = 1 },
+  { .type = LCD_UI_FLOAT, .x = 0, .y = 32, .w = 128, .h = LCD_ROW_H,
+    .format = "Over: %.2fHz", .offset = offsetof(lcd_ui_model_t, state.threshold_overfrq),
+    .step = 0.01, .min = 60, .max = 61 },
+  { .type = LCD_UI_FLOAT, .x = 0, .y = 48, .w = 128, .h = LCD_ROW_H,
+    .format = "Under: %.2fHz", .offset = offsetof(lcd_ui_model_t, state.threshold_underfrq),
+    .step = 0.01, .min = 59, .max = 60 },
+};
+
+static lcd_ui_widget_t lcd_options[] = {
+  { .type = LCD_UI_LIST, .x = 0, .y = 0, .w = 128, .h = 64,
+    .children = lcd_option_rows, .count = sizeof(lcd_option_rows) / sizeof(lcd_option_rows[0]) },
+};
+
+static lcd_ui_widget_t lcd_network[] = {
+  { .type = LCD_UI_LABEL, .x = 0, .y = 0, .w = 128, .h = LCD_ROW_H, .format = "Network" },
+  { .type = LCD_UI_STR, .x = 0, .y = 16, .w = 128, .h = LCD_ROW_H,
+    .format = "SSID: %s", .offset = offsetof(lcd_ui_model_t, net.ssid) },
+  { .type = LCD_UI_STR, .x = 0, .y = 32, .w = 128, .h = LCD_ROW_H,
+    .format = "IP: %s", .offset = offsetof(lcd_ui_model_t, net.ip) },
+  { .type = LCD_UI_STR, .x = 0, .y = 48, .w = 128, .h = LCD_ROW_H,
+    .format = "%s", .offset = offsetof(lcd_ui_model_t, net.mac) },
+};
+
+static lcd_ui_screen_t lcd_screens[LCD_SCREENS] = {
+  { "vitals", lcd_vitals, sizeof(lcd_vitals) / sizeof(lcd_vitals[0]) },
+  { "options", lcd_options, sizeof(lcd_options) / sizeof(lcd_options[0]) },
+  { "network", lcd_network, sizeof(lcd_network) / sizeof(lcd_network[0]) },
+};
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void lcd_screens_init( lcd_ui_t *ui ) {
+  lcd_ui_init(ui, lcd_screens, LCD_SCREENS, u8g2_font_t0_13_te);
+}
@@ -0,0 +1,279 @@
+/**
+ * @file lcd_ui.c
+ *
+ * @brief retained-mode widget tree of the LCD
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "lcd_ui.h"
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+/* forget the shown text and the list cursors */
+static void reset_screen( lcd_ui_screen_t *screen ) {
+  lcd_ui_widget_t *w;
+  uint8_t i, j;
+
+  for ( i = 0; i < screen->count; i++ ) {
+    w = &screen->widgets[i];
+    w->text[0] = '\0';
+    w->cursor = 0;
+    for ( j = 0; j < w->count; j++ ) {
+      w->children[j].text[0] = '\0';
+    }
+  }
+}
+
+static void mark_screen( lcd_ui_screen_t *screen ) {
+  lcd_ui_widget_t *w;
+  uint8_t i, j;
+
+  for ( i = 0; i < screen->count; i++ ) {
+    w = &screen->widgets[i];
+    w->stale = LCD_UI_ALL_BUFFERS;
+    for ( j = 0; j < w->count; j++ ) {
+      w->children[j].stale = LCD_UI_ALL_BUFFERS;
+    }
+  }
+}
+
+static void format_widget( const lcd_ui_widget_t *w, const lcd_ui_model_t *model, char *text ) {
+  const uint8_t *field = (const uint8_t *)model + w->offset;
+
+  switch ( w->type ) {
+  case LCD_UI_INT:
+    snprintf(text, LCD_UI_TEXT_SIZE, w->format, *(const int *)field);
+    break;
+  case LCD_UI_FLOAT:
+    snprintf(text, LCD_UI_TEXT_SIZE, w->format, (double)*(const float *)field);
+    break;
+  case LCD_UI_STR:
+    snprintf(text, LCD_UI_TEXT_SIZE, w->format, (const char *)field);
+    break;
+  default:
+    snprintf(text, LCD_UI_TEXT_SIZE, "%s", w->format);
+    break;
+  }
+}
+
+static int update_widget( lcd_ui_widget_t *w, const lcd_ui_model_t *model ) {
+  char text[LCD_UI_TEXT_SIZE];
+  int changed = 0;
+  uint8_t i;
+
+  if ( w->type == LCD_UI_LIST ) {
+    for ( i = 0; i < w->count; i++ ) {
+      changed += update_widget(&w->children[i], model);
+    }
+    return changed;
+  }
+
+  format_widget(w, model, text);
+  if ( strcmp(text, w->text) != 0 ) {
+    strcpy(w->text, text);
+    w->stale = LCD_UI_ALL_BUFFERS;
+    changed = 1;
+  }
+  return changed;
+}
+
+static int is_editable( const lcd_ui_widget_t *w, const lcd_ui_model_t *model ) {
+  if ( w->step == 0 || (w->type != LCD_UI_INT && w->type != LCD_UI_FLOAT) ) {
+    return 0;
+  }
+  return !(w->flags & LCD_UI_MANUAL) || model->state.mode == 0;
+}
+
+/* the widget UP/DOWN act on */
+static lcd_ui_widget_t *focused_widget( lcd_ui_screen_t *screen ) {
+  lcd_ui_widget_t *w;
+  uint8_t i;
+
+  for ( i = 0; i < screen->count; i++ ) {
+    w = &screen->widgets[i];
+    if ( w->type == LCD_UI_LIST && w->count > 0 ) {
+      return &w->children[w->cursor];
+    }
+    if ( w->step != 0 ) {
+      return w;
+    }
+  }
+  return NULL;
+}
+
+static int edit_widget( const lcd_ui_widget_t *w, lcd_ui_model_t *model, int dir ) {
+  uint8_t *field = (uint8_t *)model + w->offset;
+  float value;
+
+  if ( !is_editable(w, model) ) {
+    return 0;
+  }
+
+  if ( w->type == LCD_UI_INT ) {
+    value = *(int *)field + dir * w->step;
+  } else {
+    value = *(float *)field + dir * w->step;
+  }
+  if ( value < w->min ) {
+    value = w->min;
+  }
+  if ( value > w->max ) {
+    value = w->max;
+  }
+
+  if ( w->type == LCD_UI_INT ) {
+    if ( *(int *)field == (int)value ) {
+      return 0;
+    }
+    *(int *)field = (int)value;
+  } else {
+    if ( *(float *)field == value ) {
+      return 0;
+    }
+    *(float *)field = value;
+  }
+  return 1;
+}
+
+static void draw_widget( lcd_ui_widget_t *w, u8g2_t *u8g2, uint8_t bit, int selected ) {
+  u8g2_SetDrawColor(u8g2, 0);
+  u8g2_DrawBox(u8g2, w->x, w->y, w->w, w->h);
+  u8g2_SetDrawColor(u8g2, 1);
+
+  if ( selected < 0 ) {
+    u8g2_DrawStr(u8g2, w->x, w->y, w->text);
+  } else {
+    if ( selected ) {
+      u8g2_DrawStr(u8g2, w->x, w->y, ">");
+    }
+    u8g2_DrawStr(u8g2, w->x + LCD_UI_CURSOR_W, w->y, w->text);
+  }
+  w->stale &= ~bit;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void lcd_ui_init( lcd_ui_t *ui, lcd_ui_screen_t *screens, uint8_t count, const uint8_t *font ) {
+  uint8_t i;
+
+  memset(ui, 0, sizeof(*ui));
+  ui->screens = screens;
+  ui->count = count;
+  ui->font = font;
+  ui->clear = LCD_UI_ALL_BUFFERS;
+  for ( i = 0; i < count; i++ ) {
+    reset_screen(&screens[i]);
+    mark_screen(&screens[i]);
+  }
+}
+
+int lcd_ui_update( lcd_ui_t *ui, const lcd_ui_model_t *model ) {
+  lcd_ui_screen_t *screen = &ui->screens[ui->current];
+  int changed = 0;
+  uint8_t i;
+
+  for ( i = 0; i < screen->count; i++ ) {
+    changed += update_widget(&screen->widgets[i], model);
+  }
+  return changed;
+}
+
+int lcd_ui_is_stale( const lcd_ui_t *ui, uint8_t buf ) {
+  const lcd_ui_screen_t *screen = &ui->screens[ui->current];
+  const lcd_ui_widget_t *w;
+  uint8_t bit = 1 << buf;
+  uint8_t i, j;
+
+  if ( ui->clear & bit ) {
+    return 1;
+  }
+  for ( i = 0; i < screen->count; i++ ) {
+    w = &screen->widgets[i];
+    if ( w->stale & bit ) {
+      return 1;
+    }
+    for ( j = 0; j < w->count; j++ ) {
+      if ( w->children[j].stale & bit ) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+int lcd_ui_key( lcd_ui_t *ui, uint8_t key, lcd_ui_model_t *model ) {
+  lcd_ui_screen_t *screen = &ui->screens[ui->current];
+  lcd_ui_widget_t *w;
+  uint8_t i;
+
+  switch ( key ) {
+  case LCD_UI_KEY_MENU:
+    ui->current = (ui->current + 1) % ui->count;
+    ui->clear = LCD_UI_ALL_BUFFERS;
+    mark_screen(&ui->screens[ui->current]);
+    return 0;
+
+  case LCD_UI_KEY_SELECT:
+    for ( i = 0; i < screen->count; i++ ) {
+      w = &screen->widgets[i];
+      if ( w->type == LCD_UI_LIST && w->count > 0 ) {
+        /* the cursor is part of the old and the new row */
+        w->children[w->cursor].stale = LCD_UI_ALL_BUFFERS;
+        w->cursor = (w->cursor + 1) % w->count;
+        w->children[w->cursor].stale = LCD_UI_ALL_BUFFERS;
+        break;
+      }
+    }
+    return 0;
+
+  case LCD_UI_KEY_UP:
+  case LCD_UI_KEY_DOWN:
+    w = focused_widget(screen);
+    if ( w == NULL ) {
+      return 0;
+    }
+    return edit_widget(w, model, key == LCD_UI_KEY_UP ? 1 : -1);
+
+  default:
+    return 0;
+  }
+}
+
+int lcd_ui_draw( lcd_ui_t *ui, u8g2_t *u8g2, uint8_t buf ) {
+  lcd_ui_screen_t *screen = &ui->screens[ui->current];
+  lcd_ui_widget_t *w;
+  uint8_t bit = 1 << buf;
+  uint8_t i, j;
+  int drawn = 0;
+
+  if ( ui->clear & bit ) {
+    u8g2_ClearBuffer(u8g2);
+    ui->clear &= ~bit;
+  }
+
+  u8g2_SetFont(u8g2, ui->font);
+  u8g2_SetFontPosTop(u8g2);
+  u8g2_SetFontMode(u8g2, 1);
+
+  for ( i = 0; i < screen->count; i++ ) {
+    w = &screen->widgets[i];
+    if ( w->type == LCD_UI_LIST ) {
+      for ( j = 0; j < w->count; j++ ) {
+        if ( w->children[j].stale & bit ) {
+          draw_widget(&w->children[j], u8g2, bit, j == w->cursor);
+          drawn++;
+        }
+      }
+      w->stale &= ~bit;
+    } else if ( w->stale & bit ) {
+      draw_widget(w, u8g2, bit, -1);
+      drawn++;
+    }
+  }
+  return drawn;
+}
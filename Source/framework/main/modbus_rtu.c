@@ -0,0 +1,306 @@
+/**
+ * @file modbus_rtu.c
+ *
+ * @brief Modbus RTU master: framing, CRC16, register mapping and block
+ *        polling engine
+ */
+
+#include <string.h>
+#include "modbus_rtu.h"
+
+/** @brief CRC16 (polynomial 0xA001, reflected) of every byte value */
+static const uint16_t modbus_crc_table[256] = {
+  0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+  0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+  0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+  0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+  0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+  0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+  0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+  0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+  0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+  0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+  0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+  0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+  0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+  0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+  0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+  0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+  0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+  0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+  0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+  0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+  0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+  0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+  0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+  0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+  0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+  0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+  0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+  0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+  0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+  0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+  0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+  0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static void put_crc( uint8_t *dst, size_t len ) {
+  uint16_t crc = modbus_crc16(dst, len);
+
+  dst[len] = crc & 0xff;
+  dst[len + 1] = crc >> 8;
+}
+
+/**
+ * @brief find the next block of the running slave, starting at index from,
+ *        that fits the receive path
+ *
+ * @return block index, or m->block_cnt if there is none
+ */
+static size_t master_find_block( const modbus_master_t *m, size_t from ) {
+  while ( from < m->block_cnt &&
+          (m->blocks[from].slave != m->slave || m->blocks[from].count > m->max_regs) ) {
+    from++;
+  }
+  return from;
+}
+
+/** @brief assemble the request of the next block behind the one in flight */
+static void master_prepare( modbus_master_t *m ) {
+  m->next_block = master_find_block(m, m->block + 1);
+  if ( m->next_block < m->block_cnt ) {
+    modbus_build_read(m->req[m->req_cur ^ 1], &m->blocks[m->next_block]);
+  }
+}
+
+static void master_send( modbus_master_t *m, uint32_t now_ms ) {
+  m->waiting = 1;
+  m->sent_ms = now_ms;
+  m->stats.requests++;
+  m->tx(m->req[m->req_cur], 8, m->ctx);
+}
+
+/** @brief the outstanding request is over, move on or finish */
+static void master_advance( modbus_master_t *m, int result ) {
+  m->waiting = 0;
+  if ( result != MODBUS_SUCCESS && m->result == MODBUS_SUCCESS ) {
+    m->result = result;
+  }
+  if ( m->next_block >= m->block_cnt ) {
+    m->active = 0;
+    m->finished = 1;
+  }
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+uint16_t modbus_crc16( const uint8_t *buf, size_t len ) {
+  uint16_t crc = 0xFFFF;
+  size_t i;
+
+  for ( i = 0; i < len; i++ ) {
+    crc = (crc >> 8) ^ modbus_crc_table[(crc ^ buf[i]) & 0xff];
+  }
+  return crc;
+}
+
+uint32_t modbus_t35_us( uint32_t baud, uint32_t bits_per_char ) {
+  if ( baud > 19200 ) {
+    return 1750;
+  }
+  return (uint32_t)(3500000ULL * bits_per_char / baud);
+}
+
+int modbus_build_read( uint8_t *dst, const modbus_block_t *block ) {
+  if ( block->count == 0 || block->count > MODBUS_MAX_REGS ) {
+    return MODBUS_ERR_LENGTH;
+  }
+  dst[0] = block->slave;
+  dst[1] = block->function;
+  dst[2] = block->start >> 8;
+  dst[3] = block->start & 0xff;
+  dst[4] = block->count >> 8;
+  dst[5] = block->count & 0xff;
+  put_crc(dst, 6);
+  return 8;
+}
+
+int modbus_build_write_single( uint8_t *dst, uint8_t slave, uint16_t reg, uint16_t value ) {
+  dst[0] = slave;
+  dst[1] = MODBUS_WRITE_SINGLE;
+  dst[2] = reg >> 8;
+  dst[3] = reg & 0xff;
+  dst[4] = value >> 8;
+  dst[5] = value & 0xff;
+  put_crc(dst, 6);
+  return 8;
+}
+
+int modbus_parse_read( const uint8_t *frame, size_t len, const modbus_block_t *block, uint16_t *regs ) {
+  uint16_t i;
+
+  if ( len < 5 ) {
+    return MODBUS_ERR_LENGTH;
+  }
+  if ( modbus_crc16(frame, len - 2) != (frame[len - 2] | (frame[len - 1] << 8)) ) {
+    return MODBUS_ERR_CRC;
+  }
+  if ( frame[0] != block->slave ) {
+    return MODBUS_ERR_UNEXPECTED;
+  }
+  if ( frame[1] == (block->function | 0x80) ) {
+    return MODBUS_ERR_EXCEPTION;
+  }
+  if ( frame[1] != block->function ) {
+    return MODBUS_ERR_UNEXPECTED;
+  }
+  if ( frame[2] != block->count * 2 || len != (size_t)(3 + frame[2] + 2) ) {
+    return MODBUS_ERR_LENGTH;
+  }
+  for ( i = 0; i < block->count; i++ ) {
+    regs[i] = (frame[3 + 2 * i] << 8) | frame[4 + 2 * i];
+  }
+  return MODBUS_SUCCESS;
+}
+
+int modbus_map_apply( const modbus_map_t *map, size_t map_cnt, const modbus_block_t *block,
+                      const uint16_t *regs, system_state_t *state ) {
+  int32_t val;
+  int applied = 0;
+  size_t i;
+
+  for ( i = 0; i < map_cnt; i++ ) {
+    if ( map[i].slave != block->slave || map[i].function != block->function ||
+         map[i].reg < block->start || map[i].reg >= block->start + block->count ||
+         map[i].den == 0 ) {
+      continue;
+    }
+    val = regs[map[i].reg - block->start];
+    if ( map[i].is_signed ) {
+      val = (int16_t)val;
+    }
+    val = val * map[i].num / map[i].den + map[i].offset;
+
+    switch ( map[i].field ) {
+      case MODBUS_FIELD_TEMP_TOP:    state->temp_top = val; break;
+      case MODBUS_FIELD_TEMP_BOTTOM: state->temp_bottom = val; break;
+      case MODBUS_FIELD_SET_POINT:   state->set_point = val; break;
+      case MODBUS_FIELD_HEATING:     state->heating_status = val != 0; break;
+      case MODBUS_FIELD_POWER:       state->power = val; break;
+      default: continue;
+    }
+    applied++;
+  }
+  return applied;
+}
+
+void modbus_master_init( modbus_master_t *m, const modbus_block_t *blocks, size_t block_cnt,
+                         size_t max_frame, modbus_tx_fn tx, modbus_block_fn on_block, void *ctx ) {
+  memset(m, 0, sizeof(*m));
+  m->blocks = blocks;
+  m->block_cnt = block_cnt;
+  m->max_regs = MODBUS_MAX_REGS;
+  if ( max_frame < MODBUS_MAX_FRAME ) {
+    m->max_regs = max_frame < 5 ? 0 : MODBUS_READ_REGS(max_frame);
+  }
+  m->tx = tx;
+  m->on_block = on_block;
+  m->ctx = ctx;
+}
+
+int modbus_master_start( modbus_master_t *m, uint8_t slave, uint32_t now_ms ) {
+  size_t first;
+
+  if ( m->active ) {
+    return MODBUS_ERR_BUSY;
+  }
+  m->slave = slave;
+  first = master_find_block(m, 0);
+  if ( first >= m->block_cnt || modbus_build_read(m->req[m->req_cur], &m->blocks[first]) < 0 ) {
+    return MODBUS_ERR_BUSY;
+  }
+  m->active = 1;
+  m->finished = 0;
+  m->result = MODBUS_SUCCESS;
+  m->block = first;
+  master_send(m, now_ms);
+  master_prepare(m);
+  return MODBUS_SUCCESS;
+}
+
+void modbus_master_rx( modbus_master_t *m, const uint8_t *frame, size_t len, uint32_t now_ms ) {
+  const modbus_block_t *block;
+  uint32_t latency;
+  int err;
+
+  if ( !m->waiting ) {
+    m->stats.unexpected++;
+    return;
+  }
+  block = &m->blocks[m->block];
+  err = modbus_parse_read(frame, len, block, m->regs);
+  switch ( err ) {
+    case MODBUS_SUCCESS:
+      latency = now_ms - m->sent_ms;
+      m->stats.responses++;
+      m->stats.last_latency_ms = latency;
+      if ( latency > m->stats.max_latency_ms ) {
+        m->stats.max_latency_ms = latency;
+      }
+      m->stats.total_latency_ms += latency;
+      m->on_block(block, m->regs, m->ctx);
+      break;
+    case MODBUS_ERR_CRC:
+      m->stats.crc_errors++;
+      break;
+    case MODBUS_ERR_LENGTH:
+      m->stats.length_errors++;
+      break;
+    case MODBUS_ERR_EXCEPTION:
+      m->stats.exceptions++;
+      break;
+    default:
+      /* somebody else's traffic, keep waiting for ours */
+      m->stats.unexpected++;
+      return;
+  }
+  master_advance(m, err);
+}
+
+void modbus_master_poll( modbus_master_t *m, int line_quiet, uint32_t now_ms ) {
+  if ( !m->active ) {
+    return;
+  }
+  if ( m->waiting ) {
+    if ( now_ms - m->sent_ms >= MODBUS_RESPONSE_TIMEOUT_MS ) {
+      m->stats.timeouts++;
+      master_advance(m, MODBUS_ERR_TIMEOUT);
+    }
+    return;
+  }
+  if ( line_quiet && m->next_block < m->block_cnt ) {
+    m->req_cur ^= 1;
+    m->block = m->next_block;
+    master_send(m, now_ms);
+    master_prepare(m);
+  }
+}
+
+int modbus_master_done( modbus_master_t *m, int *result ) {
+  if ( !m->finished ) {
+    return 0;
+  }
+  m->finished = 0;
+  *result = m->result;
+  return 1;
+}
+
+void modbus_master_get_stats( const modbus_master_t *m, modbus_stats_t *dest ) {
+  memcpy(dest, &m->stats, sizeof(*dest));
+}
@@ -0,0 +1,663 @@
+/**
+ * @file policy_vm.c
+ *
+ * @brief control policy bytecode interpreter
+ *
+ * The instruction encoding is the one emitted by the ugl compiler and
+ * executed by bc_exec() in u8g2/tools/ugl/ugl_bc.c. Compared to bc_exec()
+ * this version never trusts the bytecode: every stack access, jump target
+ * and builtin index is checked, and each invocation stops after a fixed
+ * number of instructions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "policy_vm.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_timer.h"
+#include "nvs.h"
+#include "rwlock.h"
+#else
+#include <time.h>
+#endif
+
+/* opcodes, see ugl_bc.h */
+#define BC_CMD_LOAD_12BIT (0x00)
+#define BC_CMD_CALL_BUILDIN (0x01)
+#define BC_CMD_CALL_BUILDIN_POP_STACK (0x02)
+#define BC_CMD_BRANCH (0x03)
+#define BC_CMD_POP_ARG_STACK (0x04)
+#define BC_CMD_PUSH_ARG_STACK (0x05)
+#define BC_CMD_CALL_PROCEDURE (0x06)
+#define BC_CMD_LOAD_0 (0x0f)
+#define BC_CMD_LOAD_1 (0x1f)
+#define BC_CMD_LOAD_16BIT (0x2f)
+#define BC_CMD_RETURN_FROM_PROCEDURE (0x3f)
+#define BC_CMD_JUMP_NOT_ZERO (0x4f)
+#define BC_CMD_JUMP_ZERO (0x5f)
+
+#define POLICY_NVS_NAMESPACE "policy"
+#define POLICY_NVS_KEY "image"
+
+typedef struct policy_vm {
+  const uint8_t *code;
+  uint16_t code_len;
+  uint16_t code_pos;
+
+  uint8_t arg_stack_pointer;
+  uint8_t return_stack_pointer;
+  uint16_t arg_stack[POLICY_VM_STACK_SIZE];
+  uint16_t return_stack[POLICY_VM_RETURN_STACK_SIZE];
+
+  int err;
+  const system_state_t *state;
+  policy_vm_output_t *out;
+} policy_vm_t;
+
+typedef void (*policy_builtin_fn)(policy_vm_t *vm);
+
+/** @brief the loaded image, header included */
+static uint8_t policy_image[POLICY_VM_IMAGE_HEADER_SIZE + POLICY_VM_MAX_CODE];
+static size_t policy_image_len = 0;
+static uint16_t policy_entry = 0;
+static uint32_t policy_budget = POLICY_VM_DEFAULT_BUDGET;
+static policy_vm_stats_t policy_stats;
+
+/*
+ * The image is replaced from the wifi task while the controller task runs
+ * it, so everything above is guarded by policy_lock. The host tools have a
+ * single thread and no FreeRTOS, there the lock is a no-op.
+ */
+#ifdef ESP_PLATFORM
+static rwlock_t policy_lock;
+#define POLICY_READER_LOCK() rwlock_reader_lock(&policy_lock)
+#define POLICY_READER_UNLOCK() rwlock_reader_unlock(&policy_lock)
+#define POLICY_WRITER_LOCK() rwlock_writer_lock(&policy_lock)
+#define POLICY_WRITER_UNLOCK() rwlock_writer_unlock(&policy_lock)
+#else
+#define POLICY_READER_LOCK()
+#define POLICY_READER_UNLOCK()
+#define POLICY_WRITER_LOCK()
+#define POLICY_WRITER_UNLOCK()
+#endif
+
+/*****************************************
+ ************ STACK HANDLING *************
+ *****************************************/
+
+static void vm_push( policy_vm_t *vm, uint16_t val ) {
+  if ( vm->arg_stack_pointer >= POLICY_VM_STACK_SIZE ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return;
+  }
+  vm->arg_stack[vm->arg_stack_pointer++] = val;
+}
+
+static uint16_t vm_pop( policy_vm_t *vm ) {
+  if ( vm->arg_stack_pointer == 0 ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return 0;
+  }
+  return vm->arg_stack[--vm->arg_stack_pointer];
+}
+
+static void vm_push_return( policy_vm_t *vm, uint16_t val ) {
+  if ( vm->return_stack_pointer >= POLICY_VM_RETURN_STACK_SIZE ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return;
+  }
+  vm->return_stack[vm->return_stack_pointer++] = val;
+}
+
+static uint16_t vm_pop_return( policy_vm_t *vm ) {
+  if ( vm->return_stack_pointer == 0 ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return 0;
+  }
+  return vm->return_stack[--vm->return_stack_pointer];
+}
+
+/* pos = 0 is the return value of the current procedure, 1.. are its args and locals */
+static uint16_t *vm_frame( policy_vm_t *vm, uint16_t pos ) {
+  uint16_t idx;
+  if ( vm->return_stack_pointer == 0 ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return NULL;
+  }
+  idx = vm->return_stack[vm->return_stack_pointer-1] + pos;
+  if ( idx >= vm->arg_stack_pointer ) {
+    vm->err = POLICY_VM_ERR_STACK;
+    return NULL;
+  }
+  return vm->arg_stack + idx;
+}
+
+static uint8_t vm_fetch( policy_vm_t *vm ) {
+  if ( vm->code_pos >= vm->code_len ) {
+    vm->err = POLICY_VM_ERR_CODE;
+    return BC_CMD_RETURN_FROM_PROCEDURE;
+  }
+  return vm->code[vm->code_pos++];
+}
+
+static uint16_t vm_fetch16( policy_vm_t *vm ) {
+  uint16_t val = vm_fetch(vm);
+  val <<= 8;
+  val |= vm_fetch(vm);
+  return val;
+}
+
+/*****************************************
+ *************** BUILTINS ****************
+ *****************************************/
+
+static uint16_t clamp_u16( float v ) {
+  if ( v <= 0 ) {
+    return 0;
+  }
+  if ( v >= 65535.0f ) {
+    return 65535;
+  }
+  return (uint16_t)(v + 0.5f);
+}
+
+static void fn_nop( policy_vm_t *vm ) {
+  vm_push(vm, 0);
+}
+
+static void fn_return( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  uint16_t *ret = vm_frame(vm, 0);
+  if ( ret != NULL ) {
+    *ret = v;
+  }
+  vm_push(vm, v);
+}
+
+static void fn_arg_get( policy_vm_t *vm ) {
+  uint16_t *arg = vm_frame(vm, vm_pop(vm));
+  vm_push(vm, arg != NULL ? *arg : 0);
+}
+
+static void fn_arg_set( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  uint16_t *arg = vm_frame(vm, vm_pop(vm));
+  if ( arg != NULL ) {
+    *arg = v;
+  }
+  vm_push(vm, v);
+}
+
+static void fn_add( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm_push(vm, vm_pop(vm) + v);
+}
+
+static void fn_print( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  printf("policy: %u\n", v);
+  vm_push(vm, v);
+}
+
+/* ugl game builtins setPos(x, y) and setItemPos(i), not used by policies */
+static void fn_unused2( policy_vm_t *vm ) {
+  vm_pop(vm);
+  vm_pop(vm);
+  vm_push(vm, 0);
+}
+
+static void fn_unused1( policy_vm_t *vm ) {
+  vm_push(vm, vm_pop(vm));
+}
+
+static void fn_sub( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm_push(vm, vm_pop(vm) - v);
+}
+
+static void fn_lt( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm_push(vm, vm_pop(vm) < v);
+}
+
+static void fn_gt( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm_push(vm, vm_pop(vm) > v);
+}
+
+static void fn_eq( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm_push(vm, vm_pop(vm) == v);
+}
+
+static void fn_and( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  uint16_t w = vm_pop(vm);
+  vm_push(vm, v != 0 && w != 0);
+}
+
+static void fn_or( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  uint16_t w = vm_pop(vm);
+  vm_push(vm, v != 0 || w != 0);
+}
+
+static void fn_not( policy_vm_t *vm ) {
+  vm_push(vm, vm_pop(vm) == 0);
+}
+
+static void fn_freq( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->grid_freq * 1000.0f));
+}
+
+static void fn_over_freq( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->threshold_overfrq * 1000.0f));
+}
+
+static void fn_under_freq( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->threshold_underfrq * 1000.0f));
+}
+
+static void fn_temp_top( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->temp_top));
+}
+
+static void fn_temp_bottom( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->temp_bottom));
+}
+
+static void fn_set_point( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->set_point));
+}
+
+static void fn_mode( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->mode));
+}
+
+static void fn_heating( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->heating_status));
+}
+
+static void fn_power( policy_vm_t *vm ) {
+  vm_push(vm, clamp_u16(vm->state->power));
+}
+
+static void fn_set_set_point( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm->out->set_point_valid = 1;
+  vm->out->set_point = v;
+  vm_push(vm, v);
+}
+
+static void fn_set_mode( policy_vm_t *vm ) {
+  uint16_t v = vm_pop(vm);
+  vm->out->mode_valid = 1;
+  vm->out->mode = v;
+  vm_push(vm, v);
+}
+
+static const policy_builtin_fn policy_builtin_list[POLICY_BUILTIN_CNT] = {
+  /* 0 */ fn_nop,
+  /* 1 */ fn_return,
+  /* 2 */ fn_arg_get,
+  /* 3 */ fn_arg_set,
+  /* 4 */ fn_add,
+  /* 5 */ fn_print,
+  /* 6 */ fn_unused2,
+  /* 7 */ fn_unused1,
+  /* 8 */ fn_sub,
+  /* 9 */ fn_lt,
+  /* 10 */ fn_gt,
+  /* 11 */ fn_eq,
+  /* 12 */ fn_and,
+  /* 13 */ fn_or,
+  /* 14 */ fn_not,
+  /* 15 */ fn_freq,
+  /* 16 */ fn_over_freq,
+  /* 17 */ fn_under_freq,
+  /* 18 */ fn_temp_top,
+  /* 19 */ fn_temp_bottom,
+  /* 20 */ fn_set_point,
+  /* 21 */ fn_mode,
+  /* 22 */ fn_heating,
+  /* 23 */ fn_power,
+  /* 24 */ fn_set_set_point,
+  /* 25 */ fn_set_mode,
+};
+
+/*****************************************
+ ************* INTERPRETER ***************
+ *****************************************/
+
+/**
+ * @brief execute bytecode until the outermost procedure returns
+ *
+ * @return number of executed instructions
+ */
+static uint32_t vm_exec( policy_vm_t *vm, uint32_t budget ) {
+  uint32_t executed = 0;
+  uint16_t val;
+  uint8_t cmd;
+  uint8_t cnt;
+
+  while ( vm->err == POLICY_VM_SUCCESS ) {
+    if ( executed >= budget ) {
+      vm->err = POLICY_VM_ERR_BUDGET;
+      break;
+    }
+    executed++;
+
+    cmd = vm_fetch(vm);
+    val = cmd;
+    val &= 0x0f0;  /* upper four bit are the upper 4 bit of a 12 bit value */
+    val <<= 4;
+
+    switch ( cmd & 15 ) {
+      case BC_CMD_LOAD_12BIT:
+        val |= vm_fetch(vm);
+        vm_push(vm, val);
+        break;
+      case BC_CMD_CALL_BUILDIN:
+      case BC_CMD_CALL_BUILDIN_POP_STACK:
+        val |= vm_fetch(vm);
+        if ( val >= POLICY_BUILTIN_CNT ) {
+          vm->err = POLICY_VM_ERR_CODE;
+          break;
+        }
+        policy_builtin_list[val](vm);
+        if ( (cmd & 15) == BC_CMD_CALL_BUILDIN_POP_STACK ) {
+          vm_pop(vm);
+        }
+        break;
+      case BC_CMD_BRANCH:
+        val |= vm_fetch(vm);
+        if ( val < 0x0800 ) {
+          val = vm->code_pos + val;
+        } else {
+          val = vm->code_pos - (0x1000 - val);
+        }
+        if ( val >= vm->code_len ) {
+          vm->err = POLICY_VM_ERR_CODE;
+          break;
+        }
+        vm->code_pos = val;
+        break;
+      case BC_CMD_POP_ARG_STACK:
+        for ( cnt = (cmd >> 4) + 1; cnt > 0; cnt-- ) {
+          vm_pop(vm);
+        }
+        break;
+      case BC_CMD_PUSH_ARG_STACK:
+        for ( cnt = (cmd >> 4) + 1; cnt > 0; cnt-- ) {
+          vm_push(vm, 0);
+        }
+        break;
+      case BC_CMD_CALL_PROCEDURE:
+        cnt = cmd >> 4;  /* number of args */
+        val = vm_fetch16(vm);
+        if ( val >= vm->code_len || vm->arg_stack_pointer < cnt + 1 ) {
+          vm->err = POLICY_VM_ERR_CODE;
+          break;
+        }
+        vm_push_return(vm, vm->code_pos);
+        vm_push_return(vm, vm->arg_stack_pointer - cnt - 1);
+        vm->code_pos = val;
+        break;
+      case 0x0f:
+        switch ( cmd ) {
+          case BC_CMD_LOAD_0:
+            vm_push(vm, 0);
+            break;
+          case BC_CMD_LOAD_1:
+            vm_push(vm, 1);
+            break;
+          case BC_CMD_LOAD_16BIT:
+            vm_push(vm, vm_fetch16(vm));
+            break;
+          case BC_CMD_RETURN_FROM_PROCEDURE:
+            if ( vm->return_stack_pointer == 0 ) {
+              return executed;
+            }
+            /* restore the arg stack pointer, leave the return value on the stack */
+            vm->arg_stack_pointer = vm_pop_return(vm) + 1;
+            vm->code_pos = vm_pop_return(vm);
+            break;
+          case BC_CMD_JUMP_NOT_ZERO:
+          case BC_CMD_JUMP_ZERO:
+            val = vm_fetch16(vm);
+            if ( val >= vm->code_len ) {
+              vm->err = POLICY_VM_ERR_CODE;
+              break;
+            }
+            if ( (vm_pop(vm) != 0) == (cmd == BC_CMD_JUMP_NOT_ZERO) ) {
+              vm->code_pos = val;
+            }
+            break;
+          default:
+            vm->err = POLICY_VM_ERR_CODE;
+            break;
+        }
+        break;
+      default:
+        vm->err = POLICY_VM_ERR_CODE;
+        break;
+    }
+  }
+  return executed;
+}
+
+static uint64_t policy_time_us( void ) {
+#ifdef ESP_PLATFORM
+  return esp_timer_get_time();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void policy_vm_init( void ) {
+#ifdef ESP_PLATFORM
+  rwlock_init(&policy_lock);
+#endif
+}
+
+int policy_vm_load( const uint8_t *image, size_t len ) {
+  uint16_t entry;
+  uint16_t code_len;
+
+  if ( image == NULL || len < POLICY_VM_IMAGE_HEADER_SIZE ) {
+    return POLICY_VM_ERR_IMAGE;
+  }
+  if ( image[0] != 'G' || image[1] != 'P' || image[2] != POLICY_VM_IMAGE_VERSION ) {
+    return POLICY_VM_ERR_IMAGE;
+  }
+  entry = (image[4] << 8) | image[5];
+  code_len = (image[6] << 8) | image[7];
+  if ( code_len == 0 || code_len > POLICY_VM_MAX_CODE
+       || len != (size_t)(POLICY_VM_IMAGE_HEADER_SIZE + code_len) || entry >= code_len ) {
+    return POLICY_VM_ERR_IMAGE;
+  }
+
+  POLICY_WRITER_LOCK();
+  memcpy(policy_image, image, len);
+  policy_image_len = len;
+  policy_entry = entry;
+  memset(&policy_stats, 0, sizeof(policy_stats));
+  POLICY_WRITER_UNLOCK();
+  return POLICY_VM_SUCCESS;
+}
+
+static int hex_digit( char c ) {
+  if ( c >= '0' && c <= '9' ) {
+    return c - '0';
+  }
+  if ( c >= 'a' && c <= 'f' ) {
+    return c - 'a' + 10;
+  }
+  if ( c >= 'A' && c <= 'F' ) {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+int policy_vm_load_hex( const char *hex ) {
+  static uint8_t buf[POLICY_VM_IMAGE_HEADER_SIZE + POLICY_VM_MAX_CODE];
+  size_t len = 0;
+  int hi;
+  int lo;
+
+  if ( hex == NULL ) {
+    return POLICY_VM_ERR_IMAGE;
+  }
+  while ( hex[0] != '\0' ) {
+    hi = hex_digit(hex[0]);
+    lo = hex_digit(hex[1]);
+    if ( hi < 0 || lo < 0 || len >= sizeof(buf) ) {
+      return POLICY_VM_ERR_IMAGE;
+    }
+    buf[len++] = (hi << 4) | lo;
+    hex += 2;
+  }
+  return policy_vm_load(buf, len);
+}
+
+void policy_vm_unload( void ) {
+  POLICY_WRITER_LOCK();
+  policy_image_len = 0;
+  POLICY_WRITER_UNLOCK();
+}
+
+int policy_vm_is_loaded( void ) {
+  int loaded;
+
+  POLICY_READER_LOCK();
+  loaded = policy_image_len != 0;
+  POLICY_READER_UNLOCK();
+  return loaded;
+}
+
+int policy_vm_load_nvs( void ) {
+#ifdef ESP_PLATFORM
+  static uint8_t buf[POLICY_VM_IMAGE_HEADER_SIZE + POLICY_VM_MAX_CODE];
+  nvs_handle handle;
+  size_t len = sizeof(buf);
+  esp_err_t err;
+
+  if ( nvs_open(POLICY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK ) {
+    return POLICY_VM_ERR_STORAGE;
+  }
+  err = nvs_get_blob(handle, POLICY_NVS_KEY, buf, &len);
+  nvs_close(handle);
+  if ( err != ESP_OK ) {
+    return POLICY_VM_ERR_STORAGE;
+  }
+  return policy_vm_load(buf, len);
+#else
+  return POLICY_VM_ERR_STORAGE;
+#endif
+}
+
+int policy_vm_store_nvs( void ) {
+#ifdef ESP_PLATFORM
+  nvs_handle handle;
+  esp_err_t err;
+
+  if ( nvs_open(POLICY_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK ) {
+    return POLICY_VM_ERR_STORAGE;
+  }
+  POLICY_READER_LOCK();
+  if ( policy_image_len == 0 ) {
+    POLICY_READER_UNLOCK();
+    nvs_close(handle);
+    return POLICY_VM_ERR_NO_POLICY;
+  }
+  err = nvs_set_blob(handle, POLICY_NVS_KEY, policy_image, policy_image_len);
+  POLICY_READER_UNLOCK();
+  if ( err == ESP_OK ) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK ? POLICY_VM_SUCCESS : POLICY_VM_ERR_STORAGE;
+#else
+  return POLICY_VM_ERR_STORAGE;
+#endif
+}
+
+void policy_vm_set_budget( uint32_t budget ) {
+  POLICY_WRITER_LOCK();
+  policy_budget = budget;
+  POLICY_WRITER_UNLOCK();
+}
+
+int policy_vm_run( uint16_t event, const system_state_t *state, policy_vm_output_t *out ) {
+  policy_vm_t vm;
+  uint64_t start;
+  uint32_t elapsed;
+  uint32_t executed;
+
+  memset(out, 0, sizeof(*out));
+  /* a writer: the run updates policy_stats */
+  POLICY_WRITER_LOCK();
+  if ( policy_image_len == 0 ) {
+    POLICY_WRITER_UNLOCK();
+    return POLICY_VM_ERR_NO_POLICY;
+  }
+
+  vm.code = policy_image + POLICY_VM_IMAGE_HEADER_SIZE;
+  vm.code_len = policy_image_len - POLICY_VM_IMAGE_HEADER_SIZE;
+  vm.arg_stack_pointer = 0;
+  vm.return_stack_pointer = 0;
+  vm.err = POLICY_VM_SUCCESS;
+  vm.state = state;
+  vm.out = out;
+
+  /*
+   * Enter the policy procedure as if it was called from position 0 with
+   * one argument: ugl places a RETURN at position 0, so returning from the
+   * policy ends the invocation.
+   */
+  vm_push(&vm, 0);      /* return value */
+  vm_push(&vm, event);  /* a(1) */
+  vm_push_return(&vm, 0);
+  vm_push_return(&vm, 0);
+  vm.code_pos = policy_entry;
+
+  start = policy_time_us();
+  executed = vm_exec(&vm, policy_budget);
+  elapsed = (uint32_t)(policy_time_us() - start);
+
+  policy_stats.runs++;
+  policy_stats.last_instructions = executed;
+  if ( executed > policy_stats.max_instructions ) {
+    policy_stats.max_instructions = executed;
+  }
+  policy_stats.last_us = elapsed;
+  if ( elapsed > policy_stats.max_us ) {
+    policy_stats.max_us = elapsed;
+  }
+  policy_stats.total_us += elapsed;
+
+  if ( vm.err != POLICY_VM_SUCCESS ) {
+    policy_stats.errors++;
+    if ( vm.err == POLICY_VM_ERR_BUDGET ) {
+      policy_stats.budget_exceeded++;
+    }
+    /* a failed run must not actuate anything */
+    memset(out, 0, sizeof(*out));
+  }
+  POLICY_WRITER_UNLOCK();
+  return vm.err;
+}
+
+void policy_vm_get_stats( policy_vm_stats_t *dest ) {
+  POLICY_READER_LOCK();
+  memcpy(dest, &policy_stats, sizeof(policy_stats));
+  POLICY_READER_UNLOCK();
+}
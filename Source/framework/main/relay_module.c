@@ -0,0 +1,228 @@
+/**
+ * @file relay_module.c
+ *
+ * @brief relay actuator with short-cycle protection and a wear budget
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "Ada_MCP.h" // IO Expander Library
+#include "driver/gpio.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "relay_module.h"
+#include "rwlock.h"
+#include "util.h"
+
+#define RELAY_NVS_NAMESPACE "relay"
+#define RELAY_NVS_KEY "switches"
+
+/** @brief period of the relay task */
+#define RELAY_TASK_PERIOD_MS 1000
+/** @brief number of relay task iterations between counter reports */
+#define RELAY_STATS_PERIOD 600
+
+static rwlock_t relay_lock;
+static relay_stats_t relay_stats;
+
+/** @brief time of the last switch operation, seconds since boot */
+static uint32_t relay_last_switch_s = 0;
+/** @brief start of the current budget period, seconds since boot */
+static uint32_t relay_period_start_s = 0;
+
+static system_state_t relay_state;
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static uint32_t relay_now_s( void ) {
+  return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+/**
+ * @brief persist the lifetime switch count
+ *
+ * With the daily budget this is at most RELAY_DAILY_BUDGET writes a day,
+ * well within the flash endurance NVS is designed for.
+ *
+ * @return void
+ */
+static void relay_store_count( uint32_t count ) {
+  nvs_handle handle;
+
+  if ( nvs_open(RELAY_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK ) {
+    printf("relay: failed to open NVS\n");
+    return;
+  }
+  if ( nvs_set_u32(handle, RELAY_NVS_KEY, count) == ESP_OK ) {
+    nvs_commit(handle);
+  }
+  nvs_close(handle);
+}
+
+static uint32_t relay_load_count( void ) {
+  nvs_handle handle;
+  uint32_t count = 0;
+
+  if ( nvs_open(RELAY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK ) {
+    return 0;
+  }
+  if ( nvs_get_u32(handle, RELAY_NVS_KEY, &count) != ESP_OK ) {
+    count = 0;
+  }
+  nvs_close(handle);
+  return count;
+}
+
+/**
+ * @brief drive the relay pin
+ *
+ * begin() sets every expander pin back to input, so the pin is made an
+ * output again on each write.
+ *
+ * @param on - 1 to close the relay, 0 to open it
+ *
+ * @return void
+ */
+static void relay_write( int on ) {
+  rwlock_writer_lock(&i2c_lock);
+  pinMode(RELAY_MCP_PIN, GPIO_MODE_OUTPUT);
+  digitalWrite(RELAY_MCP_PIN, on ? 1 : 0);
+  rwlock_writer_unlock(&i2c_lock);
+}
+
+/**
+ * @brief re-apply the stored relay state, in case the expander has been
+ *        reset or re-initialized since the last switch operation; this is
+ *        not a switch operation and is not counted
+ *
+ * @return void
+ */
+static void relay_refresh( void ) {
+  rwlock_writer_lock(&relay_lock);
+  relay_write(relay_stats.state);
+  rwlock_writer_unlock(&relay_lock);
+}
+
+/**
+ * @brief relay task logic, maps the system state to relay requests
+ *
+ * @param pv_parameters - parameters for task being create (should be NULL)
+ *
+ * @return void
+ */
+static void relay_task_fn( void *pv_parameters ) {
+  uint32_t iterations = 0;
+  relay_stats_t stats;
+
+  while(1) {
+    rwlock_reader_lock(&system_state_lock);
+    get_system_state(&relay_state);
+    rwlock_reader_unlock(&system_state_lock);
+
+    relay_request(relay_state.set_point > RELAY_SET_POINT_THRESHOLD,
+                  relay_state.mode == 1 ? RELAY_PRIORITY_DR : RELAY_PRIORITY_NORMAL);
+    relay_refresh();
+
+    if ( ++iterations % RELAY_STATS_PERIOD == 0 ) {
+      relay_get_stats(&stats);
+      printf("relay: state %d, lifetime %u, today %u/%u, dr %u, deferred %u, denied %u\n",
+             stats.state, stats.lifetime_switches, stats.period_switches,
+             RELAY_DAILY_BUDGET, stats.dr_switches, stats.deferred_min_time,
+             stats.denied_budget);
+    }
+    vTaskDelay(RELAY_TASK_PERIOD_MS/portTICK_PERIOD_MS);
+  }
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int relay_request( int on, relay_priority_t priority ) {
+  uint32_t now = relay_now_s();
+  uint32_t min_time;
+  uint32_t limit;
+  uint32_t count;
+
+  on = on ? 1 : 0;
+
+  rwlock_writer_lock(&relay_lock);
+
+  while ( now - relay_period_start_s >= RELAY_BUDGET_PERIOD_S ) {
+    relay_period_start_s += RELAY_BUDGET_PERIOD_S;
+    relay_stats.period_switches = 0;
+    relay_stats.budget_periods++;
+  }
+
+  if ( on == relay_stats.state ) {
+    rwlock_writer_unlock(&relay_lock);
+    return RELAY_SUCCESS;
+  }
+
+  min_time = relay_stats.state ? RELAY_MIN_ON_S : RELAY_MIN_OFF_S;
+  if ( now - relay_last_switch_s < min_time ) {
+    relay_stats.deferred_min_time++;
+    rwlock_writer_unlock(&relay_lock);
+    return RELAY_ERR_MIN_TIME;
+  }
+
+  /* opening the relay is always allowed, so a stuck-on load is impossible */
+  limit = priority == RELAY_PRIORITY_DR ?
+      RELAY_DAILY_BUDGET : RELAY_DAILY_BUDGET - RELAY_DR_RESERVE;
+  if ( on && relay_stats.period_switches >= limit ) {
+    relay_stats.denied_budget++;
+    rwlock_writer_unlock(&relay_lock);
+    return RELAY_ERR_BUDGET;
+  }
+
+  relay_write(on);
+  relay_stats.state = on;
+  relay_stats.lifetime_switches++;
+  relay_stats.period_switches++;
+  if ( priority == RELAY_PRIORITY_DR ) {
+    relay_stats.dr_switches++;
+  }
+  relay_last_switch_s = now;
+  count = relay_stats.lifetime_switches;
+  rwlock_writer_unlock(&relay_lock);
+
+  relay_store_count(count);
+  return RELAY_SUCCESS;
+}
+
+void relay_get_stats( relay_stats_t *dest ) {
+  rwlock_reader_lock(&relay_lock);
+  memcpy(dest, &relay_stats, sizeof(relay_stats));
+  rwlock_reader_unlock(&relay_lock);
+}
+
+/**
+ * @brief intializes the relay output and starts the relay task
+ *
+ * @return void
+ */
+void relay_init_task( void ) {
+  rwlock_init(&relay_lock);
+  memset(&relay_stats, 0, sizeof(relay_stats));
+  relay_stats.lifetime_switches = relay_load_count();
+  /* the relay is opened below, which starts its minimum off time */
+  relay_period_start_s = relay_now_s();
+  relay_last_switch_s = relay_period_start_s;
+
+  rwlock_writer_lock(&i2c_lock);
+  begin(0);
+  pinMode(RELAY_MCP_PIN, GPIO_MODE_OUTPUT);
+  digitalWrite(RELAY_MCP_PIN, 0);
+  rwlock_writer_unlock(&i2c_lock);
+
+  printf("relay: %u lifetime switch operations\n", relay_stats.lifetime_switches);
+
+  xTaskCreate(relay_task_fn, "relay_task", 2048, NULL, 5, NULL);
+}
@@ -0,0 +1,235 @@
+/**
+ * @file rs485_bus.c
+ *
+ * @brief RS485 bus scheduler: earliest deadline first polling with
+ *        command slots fitted into the slack
+ */
+
+#include <string.h>
+#include "rs485_bus.h"
+
+#define BUS_IDLE (-1)
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+/** @brief a is before b, robust to the millisecond counter wrapping */
+static int before( uint32_t a, uint32_t b ) {
+  return (int32_t)(a - b) < 0;
+}
+
+static uint32_t deadline( const rs485_bus_device_t *dev ) {
+  return dev->release_ms + dev->cfg.period_ms;
+}
+
+static int bus_free( const rs485_bus_t *bus, uint32_t now_ms ) {
+  return bus->current == BUS_IDLE && !before(now_ms, bus->quiet_until_ms);
+}
+
+static void bus_end( rs485_bus_t *bus, uint32_t now_ms ) {
+  bus->stats.busy_ms += now_ms - bus->start_ms;
+  bus->current = BUS_IDLE;
+  bus->quiet_until_ms = now_ms + RS485_BUS_GUARD_MS;
+}
+
+static void device_latency( rs485_bus_device_t *dev, uint32_t latency ) {
+  dev->stats.last_latency_ms = latency;
+  if ( latency > dev->stats.max_latency_ms ) {
+    dev->stats.max_latency_ms = latency;
+  }
+  dev->stats.total_latency_ms += latency;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void rs485_bus_init( rs485_bus_t *bus ) {
+  memset(bus, 0, sizeof(*bus));
+  bus->current = BUS_IDLE;
+}
+
+int rs485_bus_add( rs485_bus_t *bus, const rs485_bus_device_cfg_t *cfg, uint32_t now_ms ) {
+  rs485_bus_device_t *dev;
+
+  if ( bus->count >= RS485_BUS_MAX_DEVICES ) {
+    return RS485_BUS_ERR_FULL;
+  }
+  if ( cfg->period_ms > 0 && cfg->timeout_ms >= cfg->period_ms ) {
+    return RS485_BUS_ERR_ARG;
+  }
+  dev = &bus->dev[bus->count];
+  memset(dev, 0, sizeof(*dev));
+  dev->cfg = *cfg;
+  dev->release_ms = now_ms;
+  return bus->count++;
+}
+
+int rs485_bus_schedule( rs485_bus_t *bus, uint32_t now_ms ) {
+  rs485_bus_device_t *dev;
+  int best = -1;
+  int i;
+
+  if ( !bus_free(bus, now_ms) ) {
+    return -1;
+  }
+
+  for ( i = 0; i < bus->count; i++ ) {
+    dev = &bus->dev[i];
+    if ( dev->cfg.period_ms == 0 || dev->polled || before(now_ms, dev->release_ms) ) {
+      continue;
+    }
+    if ( best < 0 || before(deadline(dev), deadline(&bus->dev[best])) ||
+         (deadline(dev) == deadline(&bus->dev[best]) &&
+          dev->cfg.priority > bus->dev[best].cfg.priority) ) {
+      best = i;
+    }
+  }
+  if ( best < 0 ) {
+    return -1;
+  }
+
+  dev = &bus->dev[best];
+  dev->polled = 1;
+  dev->stats.polls++;
+  bus->current = best;
+  bus->start_ms = now_ms;
+  bus->timeout_ms = dev->cfg.timeout_ms;
+  bus->stats.transactions++;
+  return best;
+}
+
+int rs485_bus_acquire( rs485_bus_t *bus, uint32_t now_ms ) {
+  const rs485_bus_device_t *dev;
+  uint32_t end = now_ms + RS485_BUS_CMD_SLOT_MS;
+  int i;
+
+  if ( !bus_free(bus, now_ms) ) {
+    return 0;
+  }
+
+  /* every poll due before the command would finish must still fit
+   * between the command and its deadline */
+  for ( i = 0; i < bus->count; i++ ) {
+    dev = &bus->dev[i];
+    if ( dev->cfg.period_ms == 0 || dev->polled || before(end, dev->release_ms) ) {
+      continue;
+    }
+    if ( before(deadline(dev), end + RS485_BUS_GUARD_MS + dev->cfg.timeout_ms) ) {
+      return 0;
+    }
+  }
+
+  bus->current = RS485_BUS_COMMAND;
+  bus->start_ms = now_ms;
+  bus->timeout_ms = RS485_BUS_CMD_SLOT_MS;
+  bus->stats.transactions++;
+  bus->stats.commands++;
+  return 1;
+}
+
+void rs485_bus_complete( rs485_bus_t *bus, int ok, uint32_t now_ms ) {
+  rs485_bus_device_t *dev;
+
+  if ( bus->current == BUS_IDLE ) {
+    return;
+  }
+  if ( bus->current >= 0 ) {
+    dev = &bus->dev[bus->current];
+    device_latency(dev, now_ms - bus->start_ms);
+    if ( ok ) {
+      dev->stats.responses++;
+    } else {
+      dev->stats.errors++;
+    }
+    if ( before(deadline(dev), now_ms) ) {
+      dev->stats.deadline_misses++;
+    }
+  }
+  bus_end(bus, now_ms);
+}
+
+void rs485_bus_activity( rs485_bus_t *bus, uint32_t now_ms ) {
+  /* count the quiet time up to now as used, the line was not ours */
+  if ( bus->current == BUS_IDLE ) {
+    if ( before(bus->quiet_until_ms, now_ms) ) {
+      bus->stats.busy_ms += RS485_BUS_GUARD_MS;
+    } else {
+      bus->stats.busy_ms += now_ms + RS485_BUS_GUARD_MS - bus->quiet_until_ms;
+    }
+    bus->quiet_until_ms = now_ms + RS485_BUS_GUARD_MS;
+  }
+}
+
+void rs485_bus_served( rs485_bus_t *bus, int index, uint32_t latency_ms ) {
+  rs485_bus_device_t *dev;
+
+  if ( index < 0 || index >= bus->count ) {
+    return;
+  }
+  dev = &bus->dev[index];
+  dev->stats.polls++;
+  dev->stats.responses++;
+  device_latency(dev, latency_ms);
+}
+
+void rs485_bus_poll( rs485_bus_t *bus, uint32_t now_ms ) {
+  rs485_bus_device_t *dev;
+  int i;
+
+  if ( !bus->started ) {
+    bus->started = 1;
+    bus->first_ms = now_ms;
+  }
+  bus->stats.elapsed_ms = now_ms - bus->first_ms;
+
+  if ( bus->current != BUS_IDLE && !before(now_ms, bus->start_ms + bus->timeout_ms) ) {
+    if ( bus->current >= 0 ) {
+      dev = &bus->dev[bus->current];
+      dev->stats.timeouts++;
+      if ( before(deadline(dev), now_ms) ) {
+        dev->stats.deadline_misses++;
+      }
+    }
+    bus_end(bus, now_ms);
+  }
+
+  for ( i = 0; i < bus->count; i++ ) {
+    dev = &bus->dev[i];
+    if ( dev->cfg.period_ms == 0 ) {
+      continue;
+    }
+    while ( !before(now_ms, deadline(dev)) ) {
+      if ( !dev->polled || bus->current == i ) {
+        dev->stats.deadline_misses++;
+      }
+      dev->release_ms += dev->cfg.period_ms;
+      /* a poll still in flight belongs to the period that just ended */
+      dev->polled = 0;
+    }
+  }
+}
+
+int rs485_bus_find( const rs485_bus_t *bus, uint8_t protocol, uint8_t address ) {
+  int i;
+
+  for ( i = 0; i < bus->count; i++ ) {
+    if ( bus->dev[i].cfg.protocol == protocol && bus->dev[i].cfg.address == address ) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int rs485_bus_get_device_stats( const rs485_bus_t *bus, int index, rs485_bus_device_stats_t *dest ) {
+  if ( index < 0 || index >= bus->count ) {
+    return RS485_BUS_ERR_ARG;
+  }
+  memcpy(dest, &bus->dev[index].stats, sizeof(*dest));
+  return RS485_BUS_SUCCESS;
+}
+
+void rs485_bus_get_stats( const rs485_bus_t *bus, rs485_bus_stats_t *dest ) {
+  memcpy(dest, &bus->stats, sizeof(*dest));
+}
@@ -0,0 +1,118 @@
+/**
+ * @file rs485_trace.c
+ *
+ * @brief RS485 protocol trace ring
+ */
+
+#include <string.h>
+#include "rs485_trace.h"
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static uint8_t ring_get( const rs485_trace_t *t, uint32_t pos ) {
+  return t->buf[pos % RS485_TRACE_SIZE];
+}
+
+static void ring_put( rs485_trace_t *t, const uint8_t *data, size_t len ) {
+  size_t at = t->head % RS485_TRACE_SIZE;
+  size_t first = RS485_TRACE_SIZE - at;
+
+  if ( first > len ) {
+    first = len;
+  }
+  memcpy(&t->buf[at], data, first);
+  memcpy(t->buf, data + first, len - first);
+  t->head += len;
+}
+
+static void ring_copy( const rs485_trace_t *t, uint32_t pos, uint8_t *dst, size_t len ) {
+  size_t at = pos % RS485_TRACE_SIZE;
+  size_t first = RS485_TRACE_SIZE - at;
+
+  if ( first > len ) {
+    first = len;
+  }
+  memcpy(dst, &t->buf[at], first);
+  memcpy(dst + first, t->buf, len - first);
+}
+
+static uint32_t record_size( const rs485_trace_t *t, uint32_t pos ) {
+  return RS485_TRACE_HEADER_SIZE + ring_get(t, pos + RS485_TRACE_HEADER_SIZE - 1);
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+void rs485_trace_init( rs485_trace_t *t ) {
+  memset(t, 0, sizeof(*t));
+  t->enabled = 1;
+}
+
+void rs485_trace_enable( rs485_trace_t *t, int enabled ) {
+  t->enabled = enabled != 0;
+}
+
+void rs485_trace_record( rs485_trace_t *t, uint32_t time_us, uint8_t dir,
+                         const uint8_t *data, size_t len ) {
+  uint8_t header[RS485_TRACE_HEADER_SIZE];
+  size_t chunk;
+
+  if ( !t->enabled ) {
+    return;
+  }
+
+  do {
+    chunk = len > RS485_TRACE_MAX_DATA ? RS485_TRACE_MAX_DATA : len;
+
+    /* make room by dropping whole records from the tail */
+    while ( t->head - t->tail + RS485_TRACE_HEADER_SIZE + chunk > RS485_TRACE_SIZE ) {
+      t->tail += record_size(t, t->tail);
+      t->stats.overwritten++;
+    }
+
+    header[0] = time_us & 0xff;
+    header[1] = (time_us >> 8) & 0xff;
+    header[2] = (time_us >> 16) & 0xff;
+    header[3] = time_us >> 24;
+    header[4] = dir;
+    header[5] = chunk;
+    ring_put(t, header, sizeof(header));
+    ring_put(t, data, chunk);
+
+    t->stats.records++;
+    t->stats.bytes += chunk;
+    data += chunk;
+    len -= chunk;
+  } while ( len > 0 );
+}
+
+size_t rs485_trace_snapshot( const rs485_trace_t *t, uint8_t *dst, size_t size ) {
+  uint32_t pos = t->tail;
+  uint32_t used = t->head - t->tail;
+
+  if ( size < RS485_TRACE_MAGIC_SIZE ) {
+    return 0;
+  }
+  size -= RS485_TRACE_MAGIC_SIZE;
+
+  /* skip the oldest records until the rest fits */
+  while ( used > size ) {
+    used -= record_size(t, pos);
+    pos += record_size(t, pos);
+  }
+
+  memcpy(dst, RS485_TRACE_MAGIC, RS485_TRACE_MAGIC_SIZE);
+  ring_copy(t, pos, dst + RS485_TRACE_MAGIC_SIZE, used);
+  return RS485_TRACE_MAGIC_SIZE + used;
+}
+
+void rs485_trace_clear( rs485_trace_t *t ) {
+  t->tail = t->head;
+}
+
+void rs485_trace_get_stats( const rs485_trace_t *t, rs485_trace_stats_t *dest ) {
+  memcpy(dest, &t->stats, sizeof(*dest));
+}
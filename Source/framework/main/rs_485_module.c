@@ -5,14 +5,19 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "driver/uart.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
 #include "soc/uart_struct.h"
 #include "util.h"
-
-/* contains commented code which may be needed for further testing*/
+#include "cta2045_link.h"
+#include "cta2045_app.h"
+#include "rs485_bus.h"
+#include "modbus_rtu.h"
+#include "rs485_trace.h"
+#include "rs_485_module.h"
 
 
 #define ECHO_TEST_TXD  (17)
@@ -22,40 +27,564 @@
 
 #define BUF_SIZE (512)
 
+/* define to write short frames directly into the hardware TX FIFO */
+//#define RS485_TX_DIRECT_FIFO
+
+/** @brief depth of the UART driver event queue */
+#define RS485_QUEUE_SIZE 20
+/** @brief longest wait for a UART event before the link timers run */
+#define RS485_EVENT_TIMEOUT_MS 10
+/** @brief RX FIFO level at which the driver posts UART_DATA (driver default) */
+#define RS485_RX_FULL_THRESH 120
+/** @brief number of UART events between counter reports */
+#define RS485_STATS_PERIOD 1000
+/** @brief trace bytes printed per console line */
+#define RS485_TRACE_LINE 32
+
+/* define to print the protocol trace every RS485_TRACE_PERIOD_MS */
+//#define RS485_TRACE_CONSOLE
+/** @brief time between two console trace dumps */
+#define RS485_TRACE_PERIOD_MS 10000
+/** @brief priority of the trace dump task, below everything on the bus */
+#define RS485_TRACE_PRIORITY 1
+
+/* offsets into the EC-100 vendor frames */
+#define MTYPE2_TEMP_TOP 15
+#define MTYPE2_TEMP_BOTTOM 16
+#define MTYPE1_HEATING 14
+
 
 system_state_t mystate;
 
-int ret;
 int currentSetpoint = 0;
 
 const char * const rs485_task_name = "rs485_module_task";
 
+static cta2045_link_t rs485_link;
+static QueueHandle_t rs485_queue;
+static rwlock_t rs485_stats_lock;
+static rs485_stats_t rs485_stats;
+/** @brief vendor responses are assembled here */
+static uint8_t rs485_tx_buf[CTA2045_MAX_FRAME];
+/** @brief time the UART event being handled was dequeued */
+static int64_t rs485_event_us;
+static rs485_trace_t rs485_trace;
+static rwlock_t rs485_trace_lock;
+static rs485_bus_t rs485_bus;
+/** @brief bus index of the EC-100 thermostat */
+static int rs485_ec100 = -1;
+/** @brief bus index of the CTA-2045 SGD that receives commands */
+static int rs485_sgd = -1;
+
+/*
+ * Modbus RTU appliance (heat pump water heater, pool heater). Define
+ * RS485_MODBUS_SLAVE to its address and adjust the register map below to
+ * the appliance's documentation. Addresses 6, 8 and 21 cannot be used:
+ * their first byte reads as a CTA-2045 frame type.
+ */
+//#define RS485_MODBUS_SLAVE 1
+
+/*
+ * Devices on the bus. The EC-100 is passive (it polls us); CTA-2045 SGDs
+ * are polled with an operational state request.
+ */
+static const rs485_bus_device_cfg_t rs485_devices[] = {
+    /* address, protocol, priority, period_ms, timeout_ms */
+    { 0, RS485_PROTO_EC100, 0, 0, 0 },
+    // { 0, RS485_PROTO_CTA2045, 1, 5000, 500 },
+#ifdef RS485_MODBUS_SLAVE
+    /* the timeout covers all blocks of the slave */
+    { RS485_MODBUS_SLAVE, RS485_PROTO_MODBUS, 2, 2000, 1000 },
+#endif
+};
+
+#ifdef RS485_MODBUS_SLAVE
+static const modbus_block_t rs485_modbus_blocks[] = {
+    /* slave, function, start, count */
+    { RS485_MODBUS_SLAVE, MODBUS_READ_INPUT, 0, 4 },
+    { RS485_MODBUS_SLAVE, MODBUS_READ_HOLDING, 100, 2 },
+};
+
+static const modbus_map_t rs485_modbus_map[] = {
+    /* slave, function, reg, field, signed, num, den, offset */
+    { RS485_MODBUS_SLAVE, MODBUS_READ_INPUT, 0, MODBUS_FIELD_TEMP_TOP, 1, 9, 50, 32 },    /* 0.1 C -> F */
+    { RS485_MODBUS_SLAVE, MODBUS_READ_INPUT, 1, MODBUS_FIELD_TEMP_BOTTOM, 1, 9, 50, 32 }, /* 0.1 C -> F */
+    { RS485_MODBUS_SLAVE, MODBUS_READ_INPUT, 2, MODBUS_FIELD_HEATING, 0, 1, 1, 0 },
+    { RS485_MODBUS_SLAVE, MODBUS_READ_INPUT, 3, MODBUS_FIELD_POWER, 0, 1, 1, 0 },         /* W */
+    { RS485_MODBUS_SLAVE, MODBUS_READ_HOLDING, 100, MODBUS_FIELD_SET_POINT, 0, 1, 1, 0 }, /* F */
+};
+#else
+static const modbus_block_t rs485_modbus_blocks[] = { { 0, 0, 0, 0 } };
+static const modbus_map_t rs485_modbus_map[] = { { 0, 0, 0, 0, 0, 0, 0, 0 } };
+#endif
+
+static modbus_master_t rs485_modbus;
+/** @brief time the last byte was received, for the Modbus t3.5 gap */
+static uint32_t rs485_last_rx_ms;
+/** @brief t3.5 at 19200 8E1, rounded up to whole milliseconds */
+static uint32_t rs485_t35_ms;
+
+static cta2045_app_t rs485_app;
+static rwlock_t rs485_cmd_lock;
+static int rs485_ready = 0;
+
+//Message headers received by ELectronic Thermostat
+static const unsigned char msg_poll_slave[2] = {0x87,0x00};
+static const unsigned char mtype2[4] = {0x40,0x09,0x14,0x00};
+static const unsigned char mtype1[4] = {0x40,0x0B,0x0A,0x01};
+
+
+/**
+ * @brief appends a record to the protocol trace
+ *
+ * @param time_us - timestamp in microseconds
+ * @param dir - RS485_TRACE_RX, RS485_TRACE_TX or RS485_TRACE_EVENT
+ * @param data - bytes to record
+ * @param len - number of bytes
+ *
+ * @return void
+ */
+static void rs485_trace_add(uint32_t time_us, uint8_t dir, const uint8_t *data, size_t len) {
+    rwlock_writer_lock(&rs485_trace_lock);
+    rs485_trace_record(&rs485_trace, time_us, dir, data, len);
+    rwlock_writer_unlock(&rs485_trace_lock);
+}
+
+static void rs485_trace_event(uint8_t event) {
+    rs485_trace_add((uint32_t)rs485_event_us, RS485_TRACE_EVENT, &event, 1);
+}
+
+/**
+ * @brief hands a complete frame to the driver in one call
+ *
+ * With RS485_TX_DIRECT_FIFO defined, frames that fit are written straight
+ * into the hardware TX FIFO instead of being copied into the driver's ring
+ * buffer first. The UART driver has no DMA path, this is the closest to
+ * zero-copy it offers.
+ *
+ * @param bytes - frame to send
+ * @param len - frame length
+ *
+ * @return void
+ */
+void sendData(const unsigned char* bytes, int len) {
+    rs485_trace_add((uint32_t)esp_timer_get_time(), RS485_TRACE_TX, bytes, len);
+#ifdef RS485_TX_DIRECT_FIFO
+    if (len <= UART_FIFO_LEN && uart_tx_chars(UART_NUM_2, (const char*)bytes, len) == len) {
+        return;
+    }
+#endif
+    uart_write_bytes(UART_NUM_2, (const char*)bytes, len);
+}
+
+static uint32_t rs485_now_ms( void ) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
+static void rs485_link_tx(const uint8_t *data, size_t len, void *ctx) {
+    sendData(data, len);
+}
 
+/**
+ * @brief check that a vendor frame starts with a header and is long enough
+ *        to hold the field at offset min_len - 1
+ */
+static int vendor_frame_is(const cta2045_frame_t *frame, const unsigned char *header,
+                           size_t header_len, size_t min_len) {
+    return frame->len >= min_len && memcmp(frame->payload, header, header_len) == 0;
+}
 
-unsigned char calculate_checksum(unsigned char* buf, int len) {
-    unsigned char sum = 0;
-    size_t index = 0;
-    for (; (len>0) && (index < (len)); index++) {
-        sum += buf[index];
+/**
+ * @brief records the processing latency of one frame, measured from the
+ *        moment its UART event was dequeued
+ *
+ * @return void
+ */
+static void rs485_account_frame(void) {
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - rs485_event_us);
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    rs485_stats.frames++;
+    rs485_stats.last_latency_us = latency;
+    if (latency > rs485_stats.max_latency_us) {
+        rs485_stats.max_latency_us = latency;
     }
-    return sum;
+    rs485_stats.total_latency_us += latency;
+    rwlock_writer_unlock(&rs485_stats_lock);
 }
 
+/**
+ * @brief records the time from a poll being received to the response
+ *        being handed to the driver
+ *
+ * @return void
+ */
+static void rs485_account_turnaround(void) {
+    uint32_t turnaround = (uint32_t)(esp_timer_get_time() - rs485_event_us);
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    rs485_bus_served(&rs485_bus, rs485_ec100, turnaround / 1000);
+    rs485_stats.responses++;
+    rs485_stats.last_turnaround_us = turnaround;
+    if (turnaround > rs485_stats.max_turnaround_us) {
+        rs485_stats.max_turnaround_us = turnaround;
+    }
+    rs485_stats.total_turnaround_us += turnaround;
+    rwlock_writer_unlock(&rs485_stats_lock);
+}
 
-void sendData(unsigned char* bytes, int len) {
-    // int parity = checkParity(bytes);
-    int uart_num = UART_NUM_2;
+/**
+ * @brief acts on a received frame
+ *
+ * @param frame - the received frame
+ *
+ * @return void
+ */
+static void rs485_handle_frame(const cta2045_frame_t *frame) {
+    cta2045_builder_t b;
+    int len;
+
+    uint8_t setpoint;
+    int pending;
+    int modbus;
+
+    if (frame->kind == CTA2045_FRAME_MESSAGE) {
+        rwlock_writer_lock(&rs485_stats_lock);
+        if (rs485_bus.current >= 0 && frame->msg_type == CTA2045_MSG_BASIC_DR &&
+            frame->len >= 1 && frame->payload[0] == CTA2045_OP_OPER_STATE) {
+            rs485_bus_complete(&rs485_bus, 1, rs485_now_ms());
+        }
+        rwlock_writer_unlock(&rs485_stats_lock);
+
+        rwlock_writer_lock(&rs485_cmd_lock);
+        cta2045_app_on_message(&rs485_app, frame, rs485_now_ms());
+        rwlock_writer_unlock(&rs485_cmd_lock);
+        return;
+    }
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    modbus = rs485_bus.current >= 0 &&
+             rs485_bus.dev[rs485_bus.current].cfg.protocol == RS485_PROTO_MODBUS;
+    if (!modbus) {
+        rs485_bus_activity(&rs485_bus, rs485_now_ms());
+    }
+    rwlock_writer_unlock(&rs485_stats_lock);
+
+    /* while a Modbus slave is being polled the idle delimited frames are
+     * its responses */
+    if (modbus) {
+        modbus_master_rx(&rs485_modbus, frame->payload, frame->len, rs485_now_ms());
+        return;
+    }
+
+    //Send Set Point when the thermostat polls
+    if (vendor_frame_is(frame, msg_poll_slave, sizeof(msg_poll_slave), sizeof(msg_poll_slave))) {
+        rwlock_writer_lock(&rs485_cmd_lock);
+        pending = cta2045_app_take_set_point(&rs485_app, &setpoint, rs485_now_ms());
+        rwlock_writer_unlock(&rs485_cmd_lock);
+
+        if (pending) {
+            cta2045_builder_begin_vendor(&b, rs485_tx_buf, sizeof(rs485_tx_buf));
+            cta2045_builder_put(&b, 0x87);
+            cta2045_builder_put(&b, 0x09);
+            cta2045_builder_put(&b, 0x03);
+            cta2045_builder_put(&b, setpoint);
+            cta2045_builder_put(&b, setpoint);
+            len = cta2045_builder_finish(&b);
+            if (len > 0) {
+                cta2045_link_send_raw(&rs485_link, rs485_tx_buf, len);
+                rs485_account_turnaround();
+            }
+        }
+    }
+    //receieve top and bottom temperatures
+    else if (vendor_frame_is(frame, mtype2, sizeof(mtype2), MTYPE2_TEMP_BOTTOM + 1)) {
+        rwlock_writer_lock(&system_state_lock);
+        get_system_state(&mystate);
+        mystate.temp_top = frame->payload[MTYPE2_TEMP_TOP];
+        mystate.temp_bottom = frame->payload[MTYPE2_TEMP_BOTTOM];
+        set_system_state(&mystate);
+        rwlock_writer_unlock(&system_state_lock);
+    }
+    // receive heating status information
+    else if (vendor_frame_is(frame, mtype1, sizeof(mtype1), MTYPE1_HEATING + 1)) {
+        rwlock_writer_lock(&system_state_lock);
+        get_system_state(&mystate);
+        mystate.heating_status = frame->payload[MTYPE1_HEATING] > 0 ? 1 : 0;
+        set_system_state(&mystate);
+        rwlock_writer_unlock(&system_state_lock);
+    }
+}
+
+/**
+ * @brief link layer receive callback
+ *
+ * @param frame - the received frame
+ * @param ctx - unused
+ *
+ * @return void
+ */
+static void rs485_link_rx(const cta2045_frame_t *frame, void *ctx) {
+    rs485_handle_frame(frame);
+    rs485_account_frame();
+}
+
+/**
+ * @brief link layer completion callback for CTA-2045 messages
+ *
+ * @param result - CTA2045_SUCCESS or the link error
+ * @param msg_type - type of the completed message
+ * @param ctx - unused
+ *
+ * @return void
+ */
+static void rs485_link_done(int result, uint16_t msg_type, void *ctx) {
+    /* a command's bus slot ends with its link ACK; a poll that failed on
+     * the link ends here too, a poll that got through waits for the reply */
+    int poll;
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    poll = rs485_bus.current >= 0;
+    if (!poll || result != CTA2045_SUCCESS) {
+        rs485_bus_complete(&rs485_bus, result == CTA2045_SUCCESS, rs485_now_ms());
+    }
+    rwlock_writer_unlock(&rs485_stats_lock);
+
+    if (poll) {
+        return;
+    }
+    rwlock_writer_lock(&rs485_cmd_lock);
+    cta2045_app_on_link_done(&rs485_app, result, rs485_now_ms());
+    rwlock_writer_unlock(&rs485_cmd_lock);
+}
+
+static void rs485_modbus_tx(const uint8_t *data, size_t len, void *ctx) {
+    sendData(data, len);
+}
+
+/**
+ * @brief copies the registers of a block read from a Modbus slave into the
+ *        system state, as described by the register map
+ *
+ * @param block - the block that was read
+ * @param regs - its registers
+ * @param ctx - unused
+ *
+ * @return void
+ */
+static void rs485_modbus_block(const modbus_block_t *block, const uint16_t *regs, void *ctx) {
+    rwlock_writer_lock(&system_state_lock);
+    get_system_state(&mystate);
+    modbus_map_apply(rs485_modbus_map, sizeof(rs485_modbus_map) / sizeof(rs485_modbus_map[0]),
+                     block, regs, &mystate);
+    set_system_state(&mystate);
+    rwlock_writer_unlock(&system_state_lock);
+}
+
+/**
+ * @brief sends the poll of a scheduled device
+ *
+ * @param index - bus index of the device
+ *
+ * @return void
+ */
+static void rs485_send_poll(int index) {
+    /* bus indices differ from rs485_devices[] when an entry was skipped */
+    const rs485_bus_device_cfg_t *cfg = &rs485_bus.dev[index].cfg;
+    uint8_t payload[2] = { CTA2045_OP_OPER_STATE_REQ, 0x00 };
+    int err = CTA2045_ERR_BUSY;
+
+    switch (cfg->protocol) {
+        case RS485_PROTO_CTA2045:
+            err = cta2045_link_send(&rs485_link, CTA2045_MSG_BASIC_DR, payload,
+                                    sizeof(payload), rs485_now_ms());
+            break;
+        case RS485_PROTO_MODBUS:
+            err = modbus_master_start(&rs485_modbus, cfg->address,
+                                      rs485_now_ms()) == MODBUS_SUCCESS ? CTA2045_SUCCESS : CTA2045_ERR_BUSY;
+            break;
+        default:
+            break;
+    }
+    if (err != CTA2045_SUCCESS) {
+        rwlock_writer_lock(&rs485_stats_lock);
+        rs485_bus_complete(&rs485_bus, 0, rs485_now_ms());
+        rwlock_writer_unlock(&rs485_stats_lock);
+    }
+}
+
+/**
+ * @brief runs the bus scheduler: device polls first, queued commands in
+ *        the slack between them
+ *
+ * @return void
+ */
+static void rs485_schedule(void) {
+    int index;
+    int ready;
+    int result;
+
+    /* Modbus requests after the first go out back to back, each as soon as
+     * the line has been quiet for t3.5 */
+    modbus_master_poll(&rs485_modbus, rs485_now_ms() - rs485_last_rx_ms >= rs485_t35_ms,
+                       rs485_now_ms());
+    if (modbus_master_done(&rs485_modbus, &result)) {
+        rwlock_writer_lock(&rs485_stats_lock);
+        if (rs485_bus.current >= 0) {
+            rs485_bus_complete(&rs485_bus, result == MODBUS_SUCCESS, rs485_now_ms());
+        }
+        rwlock_writer_unlock(&rs485_stats_lock);
+    }
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    rs485_bus_poll(&rs485_bus, rs485_now_ms());
+    index = cta2045_link_busy(&rs485_link) || rs485_modbus.active ?
+        -1 : rs485_bus_schedule(&rs485_bus, rs485_now_ms());
+    rwlock_writer_unlock(&rs485_stats_lock);
+
+    if (index >= 0) {
+        rs485_send_poll(index);
+    }
+
+    rwlock_writer_lock(&rs485_cmd_lock);
+    ready = cta2045_app_ready(&rs485_app);
+    rwlock_writer_unlock(&rs485_cmd_lock);
+
+    if (ready) {
+        rwlock_writer_lock(&rs485_stats_lock);
+        ready = rs485_bus_acquire(&rs485_bus, rs485_now_ms());
+        rwlock_writer_unlock(&rs485_stats_lock);
+        if (!ready) {
+            return;
+        }
+    }
 
-    uart_write_bytes(uart_num, (const char*)bytes, 1);
+    /* also runs the application ACK timeout when nothing is sent */
+    rwlock_writer_lock(&rs485_cmd_lock);
+    cta2045_app_poll(&rs485_app, rs485_now_ms());
+    rwlock_writer_unlock(&rs485_cmd_lock);
+}
 
+/**
+ * @brief prints the per device counters
+ *
+ * @return void
+ */
+static void rs485_print_devices(void) {
+    rs485_bus_device_stats_t stats;
+    rs485_bus_stats_t bus;
+    int count;
+    int i;
+
+    rwlock_reader_lock(&rs485_stats_lock);
+    rs485_bus_get_stats(&rs485_bus, &bus);
+    count = rs485_bus.count;
+    rwlock_reader_unlock(&rs485_stats_lock);
+    printf("rs485: bus utilization %u%%, %u transactions, %u commands\n",
+           bus.elapsed_ms ? (unsigned)((uint64_t)bus.busy_ms * 100 / bus.elapsed_ms) : 0,
+           bus.transactions, bus.commands);
+
+    for (i = 0; i < count; i++) {
+        if (rs485_get_device_stats(i, &stats) != RS485_BUS_SUCCESS) {
+            continue;
+        }
+        printf("rs485: device %d (proto %u addr %u): polls %u, responses %u, timeouts %u, errors %u, missed %u, latency last %u ms max %u ms avg %u ms\n",
+               i, rs485_bus.dev[i].cfg.protocol, rs485_bus.dev[i].cfg.address,
+               stats.polls, stats.responses, stats.timeouts, stats.errors,
+               stats.deadline_misses, stats.last_latency_ms, stats.max_latency_ms,
+               stats.responses ? (unsigned)(stats.total_latency_ms / stats.responses) : 0);
+    }
+}
 
-    for(int i = 1; i < len; i++) {
+/**
+ * @brief prints the Modbus master counters
+ *
+ * @return void
+ */
+static void rs485_print_modbus(void) {
+    modbus_stats_t stats;
+
+    modbus_master_get_stats(&rs485_modbus, &stats);
+    if (stats.requests == 0) {
+        return;
+    }
+    printf("rs485: modbus: requests %u, responses %u, crc %u, length %u, exceptions %u, timeouts %u, latency last %u ms max %u ms avg %u ms\n",
+           stats.requests, stats.responses, stats.crc_errors, stats.length_errors,
+           stats.exceptions, stats.timeouts, stats.last_latency_ms, stats.max_latency_ms,
+           stats.responses ? (unsigned)(stats.total_latency_ms / stats.responses) : 0);
+}
 
-        uart_write_bytes(uart_num, (const char*)bytes+i, 1);
+/**
+ * @brief prints the per command counters
+ *
+ * @return void
+ */
+static void rs485_print_commands(void) {
+    cta2045_cmd_stats_t stats;
+    int cmd;
+
+    for (cmd = 0; cmd < CTA2045_CMD_CNT; cmd++) {
+        rwlock_reader_lock(&rs485_cmd_lock);
+        cta2045_app_get_stats(&rs485_app, cmd, &stats);
+        rwlock_reader_unlock(&rs485_cmd_lock);
+        if (stats.submitted == 0) {
+            continue;
+        }
+        printf("rs485: %s: submitted %u, coalesced %u, acked %u, failed %u, latency last %u ms max %u ms avg %u ms\n",
+               cta2045_app_cmd_name(cmd), stats.submitted, stats.coalesced,
+               stats.completed, stats.failed, stats.last_latency_ms,
+               stats.max_latency_ms,
+               stats.completed ? (unsigned)(stats.total_latency_ms / stats.completed) : 0);
+    }
+}
 
+/**
+ * @brief reads everything the driver has buffered and feeds it to the link
+ *
+ * @param uart_num - UART to read from
+ * @param data - read buffer of BUF_SIZE bytes
+ * @param size - number of bytes the event reported
+ *
+ * @return void
+ */
+static void rs485_receive(int uart_num, uint8_t *data, size_t size) {
+    int len;
+
+    while (size > 0) {
+        len = uart_read_bytes(uart_num, data, size > BUF_SIZE ? BUF_SIZE : size, 0);
+        if (len <= 0) {
+            break;
+        }
+        rwlock_writer_lock(&rs485_stats_lock);
+        rs485_stats.bytes_rx += len;
+        rwlock_writer_unlock(&rs485_stats_lock);
+        rs485_trace_add((uint32_t)rs485_event_us, RS485_TRACE_RX, data, len);
+        rs485_last_rx_ms = rs485_now_ms();
+        cta2045_link_rx(&rs485_link, data, len, rs485_last_rx_ms);
+        size -= len;
     }
+}
 
+/**
+ * @brief drops everything the driver has buffered after an overflow
+ *
+ * @param uart_num - UART to flush
+ *
+ * @return void
+ */
+static void rs485_drop(int uart_num) {
+    size_t buffered = 0;
+
+    uart_get_buffered_data_len(uart_num, &buffered);
+    uart_flush_input(uart_num);
+    xQueueReset(rs485_queue);
+
+    rwlock_writer_lock(&rs485_stats_lock);
+    rs485_stats.bytes_dropped += buffered;
+    rwlock_writer_unlock(&rs485_stats_lock);
+
+    /* whatever was being assembled is incomplete now */
+    cta2045_link_idle(&rs485_link);
 }
 
 static void rs485_task()
@@ -78,124 +607,224 @@ static void rs485_task()
 
     uart_set_rs485_hd_mode(uart_num, true);
 
-    uart_driver_install(uart_num, BUF_SIZE * 2, 0, 0, NULL, 0);
-
-    
-    rwlock_reader_lock(&system_state_lock);
-    get_system_state(&mystate);
-    rwlock_reader_unlock(&system_state_lock);
+    uart_driver_install(uart_num, BUF_SIZE * 2, 0, RS485_QUEUE_SIZE, &rs485_queue, 0);
 
-    uint8_t setpoint = mystate.set_point;
+    cta2045_link_init(&rs485_link, rs485_link_tx, rs485_link_rx, rs485_link_done, NULL);
 
-
-    unsigned char slave_ok[5] = {0x07,0x01,0x03,0x04,0x0F};
     uint8_t* data = (uint8_t*) malloc(BUF_SIZE);
+    uart_event_t event;
+    cta2045_link_stats_t link_stats;
+    rs485_stats_t stats;
+    uint32_t events = 0;
 
-
-    //Message headers received by ELectronic Thermostat
-    unsigned char msg_poll_slave[2] = {0x87,0x00};
-    unsigned char mtype2[4] = {0x40,0x09,0x14,0x00};
-    unsigned char mtype1[4] = {0x40,0x0B,0x0A,0x01};
-
-    unsigned char toptemp;
-    unsigned char bottemp;
-    int element;
-    int flag=0;
-    unsigned char bytes[6] = { 0x87, 0x09, 0x03, setpoint, setpoint, 0x00};
-    bytes[5] = calculate_checksum(bytes, 5);
-
-    size_t buf_len;
-    int len = 0;
-    // int ret = 1;
-    int breakFlag = 1;
      while(1)
      {
-        //printf("temperature is %d\n",gb_system_state.temp_top);
-        //uart_get_buffered_data_len(uart_num, &buf_len);
-        //if(buf_len > 0) printf("-----buflen%d\n", buf_len);
-
-        //Send Set Point
-        if(currentSetpoint != setpoint) {
-            uart_flush(uart_num);
-            len = uart_read_bytes(uart_num, data, BUF_SIZE, 20 / portTICK_RATE_MS);
-            if (len > 0 && memcmp(msg_poll_slave, data, 2) == 0 && flag == 0) {
-                sendData(bytes,6);
-
-                flag = 1;
-                currentSetpoint = setpoint;
-            } else if(len > 0 && memcmp(msg_poll_slave, data, 2) == 0 && flag == 1){
-                sendData(slave_ok,5);
-            // printf("%s\n", );
-            } 
-        } 
-        
-        //receieve top and bottom temperatures
-        else {
-            uart_flush(uart_num);
-            len = uart_read_bytes(uart_num, data, BUF_SIZE, 40 / portTICK_RATE_MS);
-            // for(int i = 0; i < len; i++) {
-            //     printf("%02x ", data[i]);
-
-            // }
-
-            if (len > 0 && memcmp(mtype2,data, 4) == 0){
-                toptemp = data[15];
-                bottemp = data[16];
-
-                
-                
-                rwlock_writer_lock(&system_state_lock);
-                get_system_state(&mystate);
-                mystate.temp_top = (uint8_t)toptemp;
-                mystate.temp_bottom = (uint8_t)bottemp;
-                set_system_state(&mystate);
-                rwlock_writer_unlock(&system_state_lock);
-            
-
-    
-            //breakFlag = 0;
-
-            }
-            // receive heating status information
-            else{
-                uart_flush(uart_num);
-                len = uart_read_bytes(uart_num, data, BUF_SIZE, 30 / portTICK_RATE_MS);
-                if (len > 0 && memcmp(mtype1,data, 4) == 0)
-                {
-                    if(data[14]>0){
-                        element = 1;
+        /* sleep until the driver has something, waking up anyway often
+         * enough to run the link timers */
+        if (xQueueReceive(rs485_queue, &event, RS485_EVENT_TIMEOUT_MS / portTICK_RATE_MS) == pdTRUE) {
+            rs485_event_us = esp_timer_get_time();
+
+            switch (event.type) {
+                case UART_DATA:
+                    rs485_receive(uart_num, data, event.size);
+                    /* the driver posts short reads from the receive timeout
+                     * interrupt, i.e. once the line has gone quiet */
+                    if (event.size < RS485_RX_FULL_THRESH) {
+                        cta2045_link_idle(&rs485_link);
                     }
-                    else
-                        element = 0;
-                rwlock_writer_lock(&system_state_lock);
-                get_system_state(&mystate);
-                mystate.heating_status = element;
-                set_system_state(&mystate);
-                rwlock_writer_unlock(&system_state_lock);
-
-                }
-
+                    break;
+                case UART_FIFO_OVF:
+                    rwlock_writer_lock(&rs485_stats_lock);
+                    rs485_stats.fifo_overflows++;
+                    rwlock_writer_unlock(&rs485_stats_lock);
+                    rs485_trace_event(RS485_TRACE_EV_FIFO_OVF);
+                    rs485_drop(uart_num);
+                    break;
+                case UART_BUFFER_FULL:
+                    rwlock_writer_lock(&rs485_stats_lock);
+                    rs485_stats.buffer_full++;
+                    rwlock_writer_unlock(&rs485_stats_lock);
+                    rs485_trace_event(RS485_TRACE_EV_BUFFER_FULL);
+                    rs485_drop(uart_num);
+                    break;
+                case UART_PARITY_ERR:
+                case UART_FRAME_ERR:
+                    rwlock_writer_lock(&rs485_stats_lock);
+                    rs485_stats.line_errors++;
+                    rwlock_writer_unlock(&rs485_stats_lock);
+                    rs485_trace_event(event.type == UART_PARITY_ERR ?
+                                      RS485_TRACE_EV_PARITY : RS485_TRACE_EV_FRAME);
+                    break;
+                default:
+                    break;
             }
+            events++;
+        }
+        cta2045_link_poll(&rs485_link, rs485_now_ms());
+
+        /* live set point changes, from buttons, controller or cloud */
+        rwlock_reader_lock(&system_state_lock);
+        get_system_state(&mystate);
+        rwlock_reader_unlock(&system_state_lock);
+        if (mystate.set_point != currentSetpoint &&
+            rs485_submit_command(CTA2045_CMD_SET_POINT, mystate.set_point) == CTA2045_SUCCESS) {
+            currentSetpoint = mystate.set_point;
         }
 
-        
-        // else if(len > 0) {
-        //for(int i = 0; i < len && data[i] != NULL; i++) {
-            //printf("%02x", data[i]);
-        
-        // 
-        memset(data,0,BUF_SIZE);
-        //ret = 0;
+        rs485_schedule();
+
+        if (events >= RS485_STATS_PERIOD) {
+            events = 0;
+            rs485_get_stats(&stats);
+            cta2045_link_get_stats(&rs485_link, &link_stats);
+            printf("rs485: rx %u, dropped %u, frames %u, latency last %u us max %u us avg %u us, turnaround last %u us max %u us avg %u us, checksum %u, timeouts %u, retries %u\n",
+                   stats.bytes_rx, stats.bytes_dropped, stats.frames,
+                   stats.last_latency_us, stats.max_latency_us,
+                   stats.frames ? (unsigned)(stats.total_latency_us / stats.frames) : 0,
+                   stats.last_turnaround_us, stats.max_turnaround_us,
+                   stats.responses ? (unsigned)(stats.total_turnaround_us / stats.responses) : 0,
+                   link_stats.checksum_errors, link_stats.interchar_timeouts,
+                   link_stats.retries);
+            rs485_print_devices();
+            rs485_print_commands();
+            rs485_print_modbus();
+        }
+    }
+}
 
+#ifdef RS485_TRACE_CONSOLE
+/**
+ * @brief dumps the protocol trace to the console; a task of its own so the
+ *        slow console output never delays the UART event loop
+ *
+ * @param pv_parameters - parameters for task being create (should be NULL)
+ *
+ * @return void
+ */
+static void rs485_trace_task( void *pv_parameters ) {
+    while (1) {
+        vTaskDelay(RS485_TRACE_PERIOD_MS / portTICK_PERIOD_MS);
+        rs485_trace_print();
+    }
+}
+#endif
+
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int rs485_submit_command( cta2045_cmd_t cmd, uint8_t arg ) {
+    int err;
 
+    if (!rs485_ready) {
+        return CTA2045_ERR_BUSY;
     }
+    /* the set point goes to the EC-100 when it polls, everything else
+     * needs an SGD to answer it */
+    if (cmd != CTA2045_CMD_SET_POINT && rs485_sgd < 0) {
+        return CTA2045_ERR_BUSY;
+    }
+    rwlock_writer_lock(&rs485_cmd_lock);
+    err = cta2045_app_submit(&rs485_app, cmd, arg, rs485_now_ms());
+    rwlock_writer_unlock(&rs485_cmd_lock);
+    return err;
 }
 
+int rs485_has_sgd( void ) {
+    return rs485_ready && rs485_sgd >= 0;
+}
 
-void rs485_init_task()
-{
+int rs485_get_device_stats( int index, rs485_bus_device_stats_t *dest ) {
+    int err;
+
+    rwlock_reader_lock(&rs485_stats_lock);
+    err = rs485_bus_get_device_stats(&rs485_bus, index, dest);
+    rwlock_reader_unlock(&rs485_stats_lock);
+    return err;
+}
+
+void rs485_get_stats( rs485_stats_t *dest ) {
+    rwlock_reader_lock(&rs485_stats_lock);
+    memcpy(dest, &rs485_stats, sizeof(rs485_stats));
+    rwlock_reader_unlock(&rs485_stats_lock);
+}
+
+size_t rs485_get_trace( uint8_t *dst, size_t size ) {
+    size_t len;
 
-    xTaskCreate(rs485_task, "rs485_task", 1024, NULL, 10, NULL);
+    rwlock_reader_lock(&rs485_trace_lock);
+    len = rs485_trace_snapshot(&rs485_trace, dst, size);
+    rwlock_reader_unlock(&rs485_trace_lock);
+    return len;
 }
 
+void rs485_trace_print( void ) {
+    uint8_t *snapshot = malloc(RS485_TRACE_SIZE + RS485_TRACE_MAGIC_SIZE);
+    size_t len;
 
+    if (snapshot == NULL) {
+        return;
+    }
+    len = rs485_get_trace(snapshot, RS485_TRACE_SIZE + RS485_TRACE_MAGIC_SIZE);
+
+    /* one prefixed hex line per chunk, tools/rs485_trace reads the console log */
+    printf("rs485 trace: begin %u\n", (unsigned)len);
+    for (size_t i = 0; i < len; i += RS485_TRACE_LINE) {
+        printf("rs485 trace: ");
+        for (size_t j = i; j < len && j < i + RS485_TRACE_LINE; j++) {
+            printf("%02x", snapshot[j]);
+        }
+        printf("\n");
+    }
+    printf("rs485 trace: end\n");
+    free(snapshot);
+}
+
+void rs485_init_task()
+{
+    rwlock_init(&rs485_stats_lock);
+    rwlock_init(&rs485_trace_lock);
+    rs485_trace_init(&rs485_trace);
+    rwlock_init(&rs485_cmd_lock);
+    cta2045_app_init(&rs485_app, &rs485_link);
+
+    rs485_bus_init(&rs485_bus);
+    for (int i = 0; i < sizeof(rs485_devices) / sizeof(rs485_devices[0]); i++) {
+        if (rs485_devices[i].protocol == RS485_PROTO_MODBUS &&
+            (rs485_devices[i].address == CTA2045_LINK_ACK ||
+             rs485_devices[i].address == CTA2045_MSG_TYPE1_DR ||
+             rs485_devices[i].address == CTA2045_LINK_NAK)) {
+            printf("rs485: Modbus address %u is reserved\n", rs485_devices[i].address);
+            continue;
+        }
+        if (rs485_bus_add(&rs485_bus, &rs485_devices[i], rs485_now_ms()) < 0) {
+            printf("rs485: bad device table entry %d\n", i);
+        }
+    }
+    rs485_ec100 = rs485_bus_find(&rs485_bus, RS485_PROTO_EC100, 0);
+    rs485_sgd = rs485_bus_find(&rs485_bus, RS485_PROTO_CTA2045, 0);
+
+    /* responses are received into the link's frame buffer */
+    modbus_master_init(&rs485_modbus, rs485_modbus_blocks,
+#ifdef RS485_MODBUS_SLAVE
+                       sizeof(rs485_modbus_blocks) / sizeof(rs485_modbus_blocks[0]),
+#else
+                       0,
+#endif
+                       CTA2045_MAX_FRAME, rs485_modbus_tx, rs485_modbus_block, NULL);
+#ifdef RS485_MODBUS_SLAVE
+    for (int i = 0; i < sizeof(rs485_modbus_blocks) / sizeof(rs485_modbus_blocks[0]); i++) {
+        if (rs485_modbus_blocks[i].count > rs485_modbus.max_regs) {
+            printf("rs485: Modbus block %d exceeds %u registers, skipped\n", i, rs485_modbus.max_regs);
+        }
+    }
+#endif
+    rs485_t35_ms = (modbus_t35_us(19200, 11) + 999) / 1000;
+    rs485_ready = 1;
+
+    xTaskCreate(rs485_task, "rs485_task", 2048, NULL, 10, NULL);
+#ifdef RS485_TRACE_CONSOLE
+    xTaskCreate(rs485_trace_task, "rs485_trace_task", 2048, NULL, RS485_TRACE_PRIORITY, NULL);
+#endif
+}
@@ -88,6 +88,34 @@
 */
 #define U8G2_HVLINE_SPEED_OPTIMIZATION
 
+/*
+  The following macro enables the span decoder for glyphs. A glyph, which is drawn
+  with U8G2_R0 and font direction 0 into a vertical_top_lsb buffer (SSD13xx) and is
+  completely inside the display, is decoded directly into the buffer: each run of the
+  glyph sets its bits in the tile bytes instead of calling u8g2_DrawHVLine().
+  All other glyphs are drawn with u8g2_DrawHVLine() as before.
+*/
+#define U8G2_FONT_SPEED_OPTIMIZATION
+
+/*
+  The following macro enables the blit engine for bitmaps. u8g2_DrawXBM(), u8g2_DrawXBMP(),
+  u8g2_DrawBitmap() and u8g2_DrawTileBitmap() with U8G2_R0 into a vertical_top_lsb buffer
+  (SSD13xx) transpose blocks of 8x8 pixels into the tile bytes and merge them with a mask,
+  if the bitmap is completely inside the display. Tile bitmaps at a multiple of 8 in y are
+  copied with memcpy() for draw color 1 and solid bitmap mode.
+  All other bitmaps are drawn pixel by pixel as before.
+*/
+#define U8G2_BITMAP_SPEED_OPTIMIZATION
+
+/*
+  The following macro enables the span procedures for circles and discs. u8g2_DrawCircle()
+  draws each run of pixels with the same y of the midpoint algorithm as one line,
+  u8g2_DrawDisc() draws one horizontal line per scan line. Scan lines outside the current
+  page are skipped. Draw color 2 (XOR) uses the pixel and vline procedures as before,
+  because they draw some pixels twice.
+*/
+#define U8G2_CIRCLE_SPEED_OPTIMIZATION
+
 /*
   The following macro enables all four drawing directions for glyphs and strings.
   If this macro is not defined, than a string can be drawn only in horizontal direction.
@@ -136,6 +164,11 @@
 */
 //#define U8G2_WITH_HVLINE_COUNT
 
+/*
+  Counts and timing per drawing primitive and of the bus transfer are
+  available with U8X8_WITH_PROFILE in u8x8.h, see u8x8_SetProfile().
+*/
+
 /*
   Defining the following variable adds the clipping and check procedures agains the display boundaries.
   Clipping procedures are mandatory for the picture loop (u8g2_FirstPage/NextPage).
@@ -147,6 +180,39 @@
 */
 #define U8G2_WITH_CLIPPING
 
+/*
+  The following macro adds an optional shadow of the display RAM, see u8g2_SetShadowBuffer().
+  With a shadow buffer assigned, u8g2_SendBuffer() and u8g2_NextPage() only transfer the
+  tiles which differ from the content already sent to the display. This saves bus time
+  for slow interfaces (I2C) if only parts of the screen change between two frames.
+  Each u8g2_t object requires some more bytes in RAM, the shadow itself is provided by the user.
+  Only displays with the vertical_top_lsb buffer layout (u8g2_ll_hvline_vertical_top_lsb,
+  e.g. SSD1306/SSD1309) use the shadow, for other layouts all tiles are sent as before.
+*/
+#define U8G2_WITH_SHADOW_BUFFER
+
+/*
+  The following macro adds an optional cache of decoded glyphs, see u8g2_SetGlyphCache().
+  Recently drawn glyphs are kept as bitmaps in the vertical tile byte format and are
+  copied into the buffer instead of being searched and run length decoded again.
+  This applies to U8G2_R0, font direction 0 and the vertical_top_lsb buffer layout
+  (SSD13xx); all other cases and glyphs which do not fit into a cache slot or not
+  completely into the display use the normal font decoder.
+  The cache itself is provided by the user.
+*/
+#define U8G2_WITH_GLYPH_CACHE
+
+/*
+  The following macro adds an optional index of the glyphs of the current font, see
+  u8g2_SetFontIndex(). Without it, every glyph is searched by walking the glyph list
+  of the font, starting at 'A', 'a' or the first Unicode glyph. With an index assigned,
+  u8g2_SetFont() builds it once per font change: a table of all 256 ASCII glyphs and
+  a sorted table of (every n-th) Unicode glyph, which is binary searched. This makes
+  large Unicode fonts (CJK) usable, switching between fonts costs one walk through
+  the glyph list of the new font. The index itself is provided by the user.
+*/
+#define U8G2_WITH_FONT_INDEX
+
 
 
 
@@ -237,6 +303,10 @@ struct _u8g2_font_info_t
 };
 typedef struct _u8g2_font_info_t u8g2_font_info_t;
 
+/* size of the font data structure, there is no struct or class... */
+/* this is the size for the new font format, the first glyph follows it */
+#define U8G2_FONT_DATA_STRUCT_SIZE 23
+
 /* from ucglib... */
 struct _u8g2_font_decode_t
 {
@@ -272,6 +342,66 @@ struct _u8g2_kerning_t
 typedef struct _u8g2_kerning_t u8g2_kerning_t;
 
 
+#ifdef U8G2_WITH_GLYPH_CACHE
+/* number of glyphs in a u8g2_glyph_cache_t */
+#ifndef U8G2_GLYPH_CACHE_ENTRIES
+#define U8G2_GLYPH_CACHE_ENTRIES 32
+#endif
+/* bytes per cached glyph: width * ((height+7)/8), 32 fits glyphs up to 16x16 */
+#ifndef U8G2_GLYPH_CACHE_SLOT_SIZE
+#define U8G2_GLYPH_CACHE_SLOT_SIZE 32
+#endif
+
+struct _u8g2_glyph_cache_entry_t
+{
+  const uint8_t *font;		/* NULL: unused entry */
+  uint32_t last_use;		/* value of the cache clock at the last hit */
+  uint16_t encoding;
+  uint8_t glyph_width;
+  uint8_t glyph_height;
+  int8_t x_offset;
+  int8_t y_offset;
+  int8_t delta_x;
+};
+typedef struct _u8g2_glyph_cache_entry_t u8g2_glyph_cache_entry_t;
+
+struct _u8g2_glyph_cache_t
+{
+  u8g2_glyph_cache_entry_t entry[U8G2_GLYPH_CACHE_ENTRIES];
+  /* glyph bitmaps: tile rows of glyph_width bytes, lsb on top */
+  uint8_t bitmap[U8G2_GLYPH_CACHE_ENTRIES][U8G2_GLYPH_CACHE_SLOT_SIZE];
+  uint32_t clock;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t bypassed;		/* glyphs drawn by the font decoder */
+};
+typedef struct _u8g2_glyph_cache_t u8g2_glyph_cache_t;
+#endif /* U8G2_WITH_GLYPH_CACHE */
+
+
+#ifdef U8G2_WITH_FONT_INDEX
+struct _u8g2_font_index_entry_t
+{
+  uint16_t encoding;
+  const uint8_t *glyph;		/* the Unicode glyph record: encoding, size, data */
+};
+typedef struct _u8g2_font_index_entry_t u8g2_font_index_entry_t;
+
+struct _u8g2_font_index_t
+{
+  const uint8_t *font;		/* the font the index has been built for, NULL: none */
+  /* glyph data offset + 2 from the first glyph of the font, 0: glyph not available */
+  uint16_t ascii[256];
+  u8g2_font_index_entry_t *unicode;	/* user provided table of unicode_size entries */
+  uint16_t unicode_size;
+  uint16_t unicode_cnt;		/* used entries, 0: Unicode glyphs are searched linearly */
+  uint16_t unicode_step;		/* glyphs of the font per entry */
+  uint16_t unicode_glyphs;	/* Unicode glyphs of the font */
+};
+typedef struct _u8g2_font_index_t u8g2_font_index_t;
+#endif /* U8G2_WITH_FONT_INDEX */
+
+
 struct u8g2_cb_struct
 {
   u8g2_update_dimension_cb update;
@@ -342,6 +472,18 @@ struct u8g2_struct
 #ifdef U8G2_WITH_HVLINE_COUNT
   unsigned long hv_cnt;
 #endif /* U8G2_WITH_HVLINE_COUNT */   
+#ifdef U8G2_WITH_SHADOW_BUFFER
+  uint8_t *shadow_buf_ptr;	/* NULL or tile_width * 8 * tile_height bytes: the display RAM as last sent */
+  uint8_t is_shadow_valid;	/* 0: the next transfer sends all tiles */
+#endif /* U8G2_WITH_SHADOW_BUFFER */
+  uint16_t send_bytes;		/* tile bytes sent since u8g2_FirstPage or by the last u8g2_SendBuffer */
+  uint16_t send_runs;		/* number of u8x8_DrawTile calls for this */
+#ifdef U8G2_WITH_GLYPH_CACHE
+  u8g2_glyph_cache_t *glyph_cache;	/* NULL or the cache used by the text procedures */
+#endif /* U8G2_WITH_GLYPH_CACHE */
+#ifdef U8G2_WITH_FONT_INDEX
+  u8g2_font_index_t *font_index;	/* NULL or the glyph index of the current font */
+#endif /* U8G2_WITH_FONT_INDEX */
 #ifdef __unix__
   uint16_t last_unicode;
   const uint8_t *last_font_data;
@@ -870,6 +1012,8 @@ void u8g2_FirstPage(u8g2_t *u8g2);
 uint8_t u8g2_NextPage(u8g2_t *u8g2);
 
 #define u8g2_GetBufferPtr(u8g2) ((u8g2)->tile_buf_ptr)
+/* switch between several tile buffers of the same size, e.g. for double buffering */
+#define u8g2_SetBufferPtr(u8g2, buf) ((u8g2)->tile_buf_ptr = (buf))
 #define u8g2_GetBufferTileHeight(u8g2)	((u8g2)->tile_buf_height)
 #define u8g2_GetBufferTileWidth(u8g2)	(u8g2_GetU8x8(u8g2)->display_info->tile_width)
 /* the following variable is only valid after calling u8g2_FirstPage */
@@ -877,6 +1021,38 @@ uint8_t u8g2_NextPage(u8g2_t *u8g2);
 #define u8g2_GetPageCurrTileRow(u8g2) ((u8g2)->tile_curr_row)
 #define u8g2_GetBufferCurrTileRow(u8g2) ((u8g2)->tile_curr_row)
 
+/* number of tile bytes and tile runs transfered by the last frame (SendBuffer or picture loop) */
+#define u8g2_GetSendBytes(u8g2) ((u8g2)->send_bytes)
+#define u8g2_GetSendRuns(u8g2) ((u8g2)->send_runs)
+
+#ifdef U8G2_WITH_SHADOW_BUFFER
+/* buf must hold the full display: u8g2_GetBufferTileWidth(u8g2) * 8 * display tile height bytes, NULL disables; */
+/* call after the setup procedure, ignored unless the buffer layout is vertical_top_lsb */
+void u8g2_SetShadowBuffer(u8g2_t *u8g2, uint8_t *buf);
+/* force the next transfer to send all tiles, e.g. after the display has been reset */
+#define u8g2_InvalidateShadowBuffer(u8g2) ((u8g2)->is_shadow_valid = 0)
+#endif /* U8G2_WITH_SHADOW_BUFFER */
+
+/*==========================================*/
+/* u8g2_glyph_cache.c */
+#ifdef U8G2_WITH_GLYPH_CACHE
+/* assign and clear a glyph cache, NULL disables the cache */
+void u8g2_SetGlyphCache(u8g2_t *u8g2, u8g2_glyph_cache_t *cache);
+/* draw a glyph from the cache, returns 0 if the font decoder has to draw it */
+uint8_t u8g2_DrawCachedGlyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding, u8g2_uint_t *dx);
+#endif /* U8G2_WITH_GLYPH_CACHE */
+
+/*==========================================*/
+/* u8g2_font_index.c */
+#ifdef U8G2_WITH_FONT_INDEX
+/* assign an index and build it for the current font, unicode may be NULL (ASCII only), index NULL disables */
+void u8g2_SetFontIndex(u8g2_t *u8g2, u8g2_font_index_t *index, u8g2_font_index_entry_t *unicode, uint16_t unicode_size);
+/* build the assigned index for the current font, called by u8g2_SetFont() */
+void u8g2_font_index_build(u8g2_t *u8g2);
+/* glyph data of encoding through the index, see u8g2_font_get_glyph_data() */
+const uint8_t *u8g2_font_index_get_glyph_data(u8g2_t *u8g2, uint16_t encoding);
+#endif /* U8G2_WITH_FONT_INDEX */
+
 /*==========================================*/
 /* u8g2_ll_hvline.c */
 /*
@@ -914,6 +1090,10 @@ void u8g2_DrawHorizontalBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_
 void u8g2_DrawBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t cnt, u8g2_uint_t h, const uint8_t *bitmap);
 void u8g2_DrawXBM(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap);
 void u8g2_DrawXBMP(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap);	/* assumes bitmap in PROGMEM */
+/* tile bitmap: (h+7)/8 rows of w bytes, each byte 8 vertical pixels, lsb on top (vertical_top_lsb buffer format) */
+void u8g2_DrawTileBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *tiles);
+/* convert an XBM into a tile bitmap of (h+7)/8*w bytes, e.g. once for a splash screen */
+void u8g2_ConvertXBMToTileBitmap(u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap, uint8_t *tiles);
 
 
 /*==========================================*/
@@ -951,6 +1131,26 @@ void u8g2_DrawRFrame(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w,
 
 /*==========================================*/
 /* u8g2_polygon.c */
+/* a polygon point and the state of the edge from it to the next point */
+struct _u8g2_pg_point_t
+{
+  int16_t x;
+  int16_t y;
+  /* edge state of u8g2_DrawPolygon() */
+  int16_t min_y;
+  int16_t max_y;
+  int16_t height;
+  int16_t current_x;
+  int16_t current_y;
+  int16_t current_x_offset;
+  int16_t error;
+  int16_t error_offset;
+  int16_t x_direction;
+  uint16_t next;
+};
+typedef struct _u8g2_pg_point_t u8g2_pg_point_t;
+/* points for u8g2_AddPolygonXY(), NULL selects the built-in buffer of 6 points, also clears the polygon */
+void u8g2_SetPolygonBuffer(u8g2_pg_point_t *points, uint16_t size);
 void u8g2_ClearPolygonXY(void);
 void u8g2_AddPolygonXY(u8g2_t *u8g2, int16_t x, int16_t y);
 void u8g2_DrawPolygon(u8g2_t *u8g2);
@@ -970,6 +1170,11 @@ uint8_t u8g2_GetKerningByTable(u8g2_t *u8g2, const uint16_t *kt, uint16_t e1, ui
 
 size_t u8g2_GetFontSize(const uint8_t *font_arg);
 
+/* glyph decoder internals, also used by u8g2_glyph_cache.c */
+uint8_t u8g2_font_decode_get_unsigned_bits(u8g2_font_decode_t *f, uint8_t cnt);
+int8_t u8g2_font_decode_get_signed_bits(u8g2_font_decode_t *f, uint8_t cnt);
+const uint8_t *u8g2_font_get_glyph_data(u8g2_t *u8g2, uint16_t encoding);
+
 #define U8G2_FONT_HEIGHT_MODE_TEXT 0
 #define U8G2_FONT_HEIGHT_MODE_XTEXT 1
 #define U8G2_FONT_HEIGHT_MODE_ALL 2
@@ -34,12 +34,173 @@
 */
 
 #include "u8g2.h"
+#include <string.h>
 
 
 void u8g2_SetBitmapMode(u8g2_t *u8g2, uint8_t is_transparent) {
   u8g2->bitmap_transparency = is_transparent;
 }
 
+#ifdef U8G2_BITMAP_SPEED_OPTIMIZATION
+
+/*
+  Blit engine, see U8G2_BITMAP_SPEED_OPTIMIZATION in u8g2.h
+
+  The bitmap is drawn tile row by tile row of the current page. For each
+  tile row, the (up to) 8 bitmap rows in it are combined into the tile
+  bytes: XBM and u8glib bitmaps by transposing 8x8 pixel blocks, tile
+  bitmaps by shifting the two tile rows of the bitmap, which overlap the
+  tile row of the buffer. The result is merged into the buffer with the
+  mask of the bitmap rows.
+*/
+
+/* source formats of u8g2_blit() */
+#define U8G2_BLIT_XBM 0		/* rows of (w+7)/8 bytes, lsb is the left pixel */
+#define U8G2_BLIT_BITMAP 1	/* rows of (w+7)/8 bytes, msb is the left pixel */
+#define U8G2_BLIT_TILE 2	/* (h+7)/8 tile rows of w bytes, lsb is the top pixel */
+
+/* apply a color to the pixels in mask, see u8g2_ll_hvline.c */
+static void u8g2_blit_apply(uint8_t *ptr, uint8_t mask, uint8_t color)
+{
+  if ( color <= 1 )
+    *ptr |= mask;
+  if ( color != 1 )
+    *ptr ^= mask;
+}
+
+/* bits in mask are drawn with color, the other pixels of mask with ncolor if is_solid */
+static void u8g2_blit_merge(uint8_t *ptr, uint8_t bits, uint8_t mask, uint8_t color, uint8_t ncolor, uint8_t is_solid)
+{
+  if ( color == 1 && is_solid )
+  {
+    *ptr = (*ptr & ~mask) | (bits & mask);
+    return;
+  }
+  u8g2_blit_apply(ptr, bits & mask, color);
+  if ( is_solid )
+    u8g2_blit_apply(ptr, mask & ~bits, ncolor);
+}
+
+/*
+  transpose 8x8 pixels: src[b] is the bitmap byte for bit b of the tile
+  bytes, bit b of col[j] becomes bit 7-j of src[b] (transpose8 of Hacker's
+  Delight, with the rows in reverse order)
+*/
+static void u8g2_blit_transpose(const uint8_t *src, uint8_t *col)
+{
+  uint32_t x, y, t;
+
+  x = ((uint32_t)src[7] << 24) | ((uint32_t)src[6] << 16) | ((uint32_t)src[5] << 8) | src[4];
+  y = ((uint32_t)src[3] << 24) | ((uint32_t)src[2] << 16) | ((uint32_t)src[1] << 8) | src[0];
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC;  x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC;  y = y ^ t ^ (t << 14);
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  col[0] = x >> 24; col[1] = x >> 16; col[2] = x >> 8; col[3] = x;
+  col[4] = y >> 24; col[5] = y >> 16; col[6] = y >> 8; col[7] = y;
+}
+
+/*
+  Draw a bitmap with the blit engine.
+  Return:
+    0 if the bitmap has to be drawn pixel by pixel: other rotation or
+    buffer layout, or not completely inside the display.
+*/
+static uint8_t u8g2_blit(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap, uint8_t format)
+{
+  uint8_t color = u8g2->draw_color;
+  uint8_t ncolor = (color == 0 ? 1 : 0);
+  uint8_t is_solid = (u8g2->bitmap_transparency == 0);
+  uint16_t blen = ((uint16_t)w + 7) >> 3;
+  uint16_t tiles = ((uint16_t)h + 7) >> 3;
+  uint16_t row, first_row, last_row;
+  uint16_t c, c0, n;
+  int16_t s;		/* bitmap row at bit 0 of the tile row */
+  uint8_t mask, bits, b;
+  uint8_t src[8], col[8];
+  uint8_t *ptr;
+  const uint8_t *p;
+
+  if ( u8g2->cb != U8G2_R0 || u8g2->ll_hvline != u8g2_ll_hvline_vertical_top_lsb )
+    return 0;
+  /* coordinates left or above the display have wrapped around */
+  if ( (uint16_t)x + w > u8g2->pixel_buf_width || (uint16_t)y + h > u8g2->height )
+    return 0;
+  if ( w == 0 || h == 0 )
+    return 1;
+
+  /* tile rows of the bitmap within the current page */
+  first_row = u8g2->tile_curr_row;
+  last_row = first_row + u8g2->tile_buf_height;
+  if ( last_row > ((uint16_t)y + h + 7) >> 3 )
+    last_row = ((uint16_t)y + h + 7) >> 3;
+  row = y >> 3;
+  if ( row < first_row )
+    row = first_row;
+
+  for( ; row < last_row; row++ )
+  {
+    s = (int16_t)(row * 8) - (int16_t)y;
+    mask = 0xff;
+    if ( s < 0 )
+      mask <<= -s;
+    if ( s + 8 > (int16_t)h )
+      mask &= 0xff >> (s + 8 - h);
+    ptr = u8g2->tile_buf_ptr + (row - first_row) * u8g2->pixel_buf_width + x;
+
+    if ( format == U8G2_BLIT_TILE )
+    {
+      if ( s >= 0 && (s & 7) == 0 && mask == 0xff && color == 1 && is_solid )
+      {
+	memcpy(ptr, bitmap + (s >> 3) * w, w);
+	continue;
+      }
+      for( c = 0; c < w; c++ )
+      {
+	if ( s < 0 )
+	{
+	  bits = u8x8_pgm_read(bitmap + c) << -s;
+	}
+	else
+	{
+	  p = bitmap + (s >> 3) * w + c;
+	  bits = u8x8_pgm_read(p) >> (s & 7);
+	  if ( (s & 7) != 0 && (s >> 3) + 1 < tiles )
+	    bits |= u8x8_pgm_read(p + w) << (8 - (s & 7));
+	}
+	u8g2_blit_merge(ptr + c, bits, mask, color, ncolor, is_solid);
+      }
+    }
+    else
+    {
+      for( c0 = 0; c0 < w; c0 += 8 )
+      {
+	p = bitmap + (c0 >> 3);
+	for( b = 0; b < 8; b++ )
+	{
+	  src[b] = 0;
+	  if ( mask & (1 << b) )
+	    src[b] = u8x8_pgm_read(p + (uint16_t)(s + b) * blen);
+	}
+	u8g2_blit_transpose(src, col);
+	n = w - c0;
+	if ( n > 8 )
+	  n = 8;
+	for( c = 0; c < n; c++ )
+	  u8g2_blit_merge(ptr + c0 + c, format == U8G2_BLIT_XBM ? col[7 - c] : col[c], mask, color, ncolor, is_solid);
+      }
+    }
+  }
+  return 1;
+}
+
+#endif /* U8G2_BITMAP_SPEED_OPTIMIZATION */
+
 /*
   x,y 	Position on the display
   len		Length of bitmap line in pixel. Note: This differs from u8glib which had a bytecount here.
@@ -85,6 +246,7 @@ void u8g2_DrawHorizontalBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_
 /* u8glib compatible bitmap draw function */
 void u8g2_DrawBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t cnt, u8g2_uint_t h, const uint8_t *bitmap)
 {
+  U8X8_PROFILE_VAR
   u8g2_uint_t w;
   w = cnt;
   w *= 8;
@@ -93,6 +255,11 @@ void u8g2_DrawBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t cnt
     return;
 #endif /* U8G2_WITH_INTERSECTION */
   
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
+#ifdef U8G2_BITMAP_SPEED_OPTIMIZATION
+  if ( u8g2_blit(u8g2, x, y, w, h, bitmap, U8G2_BLIT_BITMAP) != 0 )
+    h = 0;
+#endif
   while( h > 0 )
   {
     u8g2_DrawHorizontalBitmap(u8g2, x, y, w, bitmap);
@@ -100,6 +267,7 @@ void u8g2_DrawBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t cnt
     y++;
     h--;
   }
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_BITMAP);
 }
 
 
@@ -138,6 +306,7 @@ void u8g2_DrawHXBM(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len,
 
 void u8g2_DrawXBM(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap)
 {
+  U8X8_PROFILE_VAR
   u8g2_uint_t blen;
   blen = w;
   blen += 7;
@@ -147,6 +316,11 @@ void u8g2_DrawXBM(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g
     return;
 #endif /* U8G2_WITH_INTERSECTION */
   
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
+#ifdef U8G2_BITMAP_SPEED_OPTIMIZATION
+  if ( u8g2_blit(u8g2, x, y, w, h, bitmap, U8G2_BLIT_XBM) != 0 )
+    h = 0;
+#endif
   while( h > 0 )
   {
     u8g2_DrawHXBM(u8g2, x, y, w, bitmap);
@@ -154,6 +328,7 @@ void u8g2_DrawXBM(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g
     y++;
     h--;
   }
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_BITMAP);
 }
 
 
@@ -197,6 +372,7 @@ void u8g2_DrawHXBMP(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len,
 
 void u8g2_DrawXBMP(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap)
 {
+  U8X8_PROFILE_VAR
   u8g2_uint_t blen;
   blen = w;
   blen += 7;
@@ -206,6 +382,11 @@ void u8g2_DrawXBMP(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8
     return;
 #endif /* U8G2_WITH_INTERSECTION */
   
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
+#ifdef U8G2_BITMAP_SPEED_OPTIMIZATION
+  if ( u8g2_blit(u8g2, x, y, w, h, bitmap, U8G2_BLIT_XBM) != 0 )
+    h = 0;
+#endif
   while( h > 0 )
   {
     u8g2_DrawHXBMP(u8g2, x, y, w, bitmap);
@@ -213,6 +394,52 @@ void u8g2_DrawXBMP(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8
     y++;
     h--;
   }
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_BITMAP);
 }
 
 
+/* tile bitmap, see u8g2.h */
+void u8g2_DrawTileBitmap(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h, const uint8_t *tiles)
+{
+  U8X8_PROFILE_VAR
+  uint8_t color = u8g2->draw_color;
+  uint8_t ncolor = (color == 0 ? 1 : 0);
+  u8g2_uint_t i, j;
+#ifdef U8G2_WITH_INTERSECTION
+  if ( u8g2_IsIntersection(u8g2, x, y, x+w, y+h) == 0 ) 
+    return;
+#endif /* U8G2_WITH_INTERSECTION */
+
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
+#ifdef U8G2_BITMAP_SPEED_OPTIMIZATION
+  if ( u8g2_blit(u8g2, x, y, w, h, tiles, U8G2_BLIT_TILE) != 0 )
+    h = 0;
+#endif
+  for( j = 0; j < h; j++ )
+  {
+    for( i = 0; i < w; i++ )
+    {
+      if ( u8x8_pgm_read(tiles + (uint16_t)(j >> 3) * w + i) & (1 << (j & 7)) ) {
+	u8g2->draw_color = color;
+	u8g2_DrawHVLine(u8g2, x + i, y + j, 1, 0);
+      } else if ( u8g2->bitmap_transparency == 0 ) {
+	u8g2->draw_color = ncolor;
+	u8g2_DrawHVLine(u8g2, x + i, y + j, 1, 0);
+      }
+    }
+  }
+  u8g2->draw_color = color;
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_BITMAP);
+}
+
+void u8g2_ConvertXBMToTileBitmap(u8g2_uint_t w, u8g2_uint_t h, const uint8_t *bitmap, uint8_t *tiles)
+{
+  uint16_t blen = ((uint16_t)w + 7) >> 3;
+  u8g2_uint_t i, j;
+
+  memset(tiles, 0, (((uint16_t)h + 7) >> 3) * w);
+  for( j = 0; j < h; j++ )
+    for( i = 0; i < w; i++ )
+      if ( u8x8_pgm_read(bitmap + (uint16_t)j * blen + (i >> 3)) & (1 << (i & 7)) )
+	tiles[(uint16_t)(j >> 3) * w + i] |= 1 << (j & 7);
+}
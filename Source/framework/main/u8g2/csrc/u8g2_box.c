@@ -41,16 +41,19 @@
 */
 void u8g2_DrawBox(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h)
 {
+  U8X8_PROFILE_VAR
 #ifdef U8G2_WITH_INTERSECTION
   if ( u8g2_IsIntersection(u8g2, x, y, x+w, y+h) == 0 ) 
     return;
 #endif /* U8G2_WITH_INTERSECTION */
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
   while( h != 0 )
   { 
     u8g2_DrawHVLine(u8g2, x, y, w, 0);
     y++;    
     h--;
   }
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_BOX);
 }
 
 
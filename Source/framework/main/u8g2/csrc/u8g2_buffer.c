@@ -48,6 +48,74 @@ void u8g2_ClearBuffer(u8g2_t *u8g2)
 
 /*============================================*/
 
+#ifdef U8G2_WITH_SHADOW_BUFFER
+/*
+  the tile diff compares and sends 8 byte tiles, which is the buffer layout of
+  u8g2_ll_hvline_vertical_top_lsb only: for other layouts the shadow is not used
+*/
+void u8g2_SetShadowBuffer(u8g2_t *u8g2, uint8_t *buf)
+{
+  if ( u8g2->ll_hvline != u8g2_ll_hvline_vertical_top_lsb )
+    buf = NULL;
+  u8g2->shadow_buf_ptr = buf;
+  u8g2->is_shadow_valid = 0;
+}
+
+/*
+  send only the runs of tiles which differ from the shadow, then update the shadow.
+  Two runs separated by a single unchanged tile are merged: the 8 extra bytes cost
+  less than the addressing commands and the extra transfer of another u8x8_DrawTile.
+*/
+static void u8g2_send_tile_row_diff(u8g2_t *u8g2, uint8_t *ptr, uint8_t dest_tile_row, uint8_t w)
+{
+  uint8_t *shadow;
+  uint16_t offset;
+  uint8_t x;
+  uint8_t start;
+  uint8_t end;
+  
+  offset = dest_tile_row;
+  offset *= w;
+  offset *= 8;
+  shadow = u8g2->shadow_buf_ptr + offset;
+  
+  x = 0;
+  for(;;)
+  {
+    /* skip unchanged tiles */
+    while( x < w && memcmp(ptr + x*8, shadow + x*8, 8) == 0 )
+      x++;
+    if ( x >= w )
+      break;
+    start = x;
+    end = x+1;
+    x++;
+    /* extend the run, accepting gaps of one unchanged tile */
+    while( x < w )
+    {
+      if ( memcmp(ptr + x*8, shadow + x*8, 8) != 0 )
+      {
+	x++;
+	end = x;
+      }
+      else if ( x+1 < w && memcmp(ptr + (x+1)*8, shadow + (x+1)*8, 8) != 0 )
+      {
+	x += 2;
+	end = x;
+      }
+      else
+      {
+	break;
+      }
+    }
+    memcpy(shadow + start*8, ptr + start*8, (end-start)*8);
+    u8x8_DrawTile(u8g2_GetU8x8(u8g2), start, dest_tile_row, end-start, ptr + start*8);
+    u8g2->send_bytes += (end-start)*8;
+    u8g2->send_runs++;
+  }
+}
+#endif /* U8G2_WITH_SHADOW_BUFFER */
+
 static void u8g2_send_tile_row(u8g2_t *u8g2, uint8_t src_tile_row, uint8_t dest_tile_row)
 {
   uint8_t *ptr;
@@ -60,7 +128,20 @@ static void u8g2_send_tile_row(u8g2_t *u8g2, uint8_t src_tile_row, uint8_t dest_
   offset *= w;
   offset *= 8;
   ptr += offset;
+#ifdef U8G2_WITH_SHADOW_BUFFER
+  if ( u8g2->shadow_buf_ptr != NULL )
+  {
+    if ( u8g2->is_shadow_valid )
+    {
+      u8g2_send_tile_row_diff(u8g2, ptr, dest_tile_row, w);
+      return;
+    }
+    memcpy(u8g2->shadow_buf_ptr + (uint16_t)dest_tile_row*w*8, ptr, (uint16_t)w*8);
+  }
+#endif /* U8G2_WITH_SHADOW_BUFFER */
   u8x8_DrawTile(u8g2_GetU8x8(u8g2), 0, dest_tile_row, w, ptr);
+  u8g2->send_bytes += (uint16_t)w*8;
+  u8g2->send_runs++;
 }
 
 /* 
@@ -87,11 +168,19 @@ static void u8g2_send_buffer(u8g2_t *u8g2)
     src_row++;
     dest_row++;
   } while( src_row < src_max && dest_row < dest_max );
+  
+#ifdef U8G2_WITH_SHADOW_BUFFER
+  /* the shadow is complete once the last tile row has been sent */
+  if ( u8g2->shadow_buf_ptr != NULL && dest_row >= dest_max )
+    u8g2->is_shadow_valid = 1;
+#endif /* U8G2_WITH_SHADOW_BUFFER */
 }
 
 /* same as u8g2_send_buffer but also send the DISPLAY_REFRESH message (used by SSD1606) */
 void u8g2_SendBuffer(u8g2_t *u8g2)
 {
+  u8g2->send_bytes = 0;
+  u8g2->send_runs = 0;
   u8g2_send_buffer(u8g2);
   u8x8_RefreshDisplay( u8g2_GetU8x8(u8g2) );  
 }
@@ -105,6 +194,8 @@ void u8g2_SetBufferCurrTileRow(u8g2_t *u8g2, uint8_t row)
 
 void u8g2_FirstPage(u8g2_t *u8g2)
 {
+  u8g2->send_bytes = 0;
+  u8g2->send_runs = 0;
   if ( u8g2->is_auto_page_clear )
   {
     u8g2_ClearBuffer(u8g2);
@@ -35,6 +35,76 @@
 
 #include "u8g2.h"
 
+#ifdef U8G2_CIRCLE_SPEED_OPTIMIZATION
+
+/*==============================================*/
+/*
+  Span procedures, see U8G2_CIRCLE_SPEED_OPTIMIZATION in u8g2.h
+
+  The midpoint algorithm below visits the points (x,y) of one octant.
+  Consecutive points with the same y are a run, which is drawn as one
+  horizontal line in the octants next to the vertical axis and as one
+  vertical line in the octants next to the horizontal axis. A disc is
+  drawn as one horizontal line per scan line. Scan lines outside the
+  current page are skipped.
+
+  The lines cover the same pixels as the pixel and vline procedures,
+  but a pixel on the border of two octants or quadrants may be drawn
+  once instead of twice. This is only visible with XOR, so draw color 2
+  keeps the original procedures.
+*/
+
+/* 1, if the lines of a circle at x0, y0 cover the pixels of the original procedures */
+static uint8_t u8g2_is_circle_span(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad)
+{
+  if ( u8g2->draw_color > 1 )
+    return 0;
+  /* the right and lower end must not wrap around */
+  if ( (u8g2_uint_t)(x0 + rad + 1) <= x0 )
+    return 0;
+  if ( (u8g2_uint_t)(y0 + rad + 1) <= y0 )
+    return 0;
+  /* the left and upper end are cut at 0, the original pixels must wrap around outside the display */
+  if ( rad > x0 && (u8g2_uint_t)(x0 - rad) < u8g2->width )
+    return 0;
+  if ( rad > y0 && (u8g2_uint_t)(y0 - rad) < u8g2->height )
+    return 0;
+  return 1;
+}
+
+/* the pixels c+a..c+b, a <= b, at pos in direction dir, the caller checks the scan line of a horizontal line */
+static void u8g2_draw_circle_fwd(u8g2_t *u8g2, u8g2_uint_t c, u8g2_uint_t a, u8g2_uint_t b, u8g2_uint_t pos, uint8_t dir)
+{
+  if ( dir == 0 )
+    u8g2_DrawHVLine(u8g2, c + a, pos, b - a + 1, 0);
+  else
+    u8g2_DrawVLine(u8g2, pos, c + a, b - a + 1);
+}
+
+/* the pixels c-b..c-a, a <= b, at pos in direction dir, without the part before 0 */
+static void u8g2_draw_circle_back(u8g2_t *u8g2, u8g2_uint_t c, u8g2_uint_t a, u8g2_uint_t b, u8g2_uint_t pos, uint8_t dir)
+{
+  u8g2_uint_t start;
+
+  if ( a > c )
+    return;
+  start = 0;
+  if ( b <= c )
+    start = c - b;
+  if ( dir == 0 )
+    u8g2_DrawHVLine(u8g2, start, pos, c - a - start + 1, 0);
+  else
+    u8g2_DrawVLine(u8g2, pos, start, c - a - start + 1);
+}
+
+/* 1, if scan line y is on the current page */
+static uint8_t u8g2_is_circle_row(u8g2_t *u8g2, u8g2_uint_t y)
+{
+  return y >= u8g2->user_y0 && y < u8g2->user_y1;
+}
+
+#endif /* U8G2_CIRCLE_SPEED_OPTIMIZATION */
+
 /*==============================================*/
 /* Circle */
 
@@ -106,6 +176,94 @@ static void u8g2_draw_circle(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_
     }
 }
 
+#ifdef U8G2_CIRCLE_SPEED_OPTIMIZATION
+
+/* the run of points x_start..x with the same y, see u8g2_draw_circle_section() */
+static void u8g2_draw_circle_run(u8g2_t *u8g2, u8g2_uint_t x_start, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t x0, u8g2_uint_t y0, uint8_t option) U8G2_NOINLINE;
+
+static void u8g2_draw_circle_run(u8g2_t *u8g2, u8g2_uint_t x_start, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t x0, u8g2_uint_t y0, uint8_t option)
+{
+    uint8_t upper = 0;
+    uint8_t lower;
+
+    /* the horizontal run above the center is off the page, if y > y0 */
+    if ( y <= y0 )
+      upper = u8g2_is_circle_row(u8g2, y0 - y);
+    lower = u8g2_is_circle_row(u8g2, y0 + y);
+
+    /* upper right */
+    if ( option & U8G2_DRAW_UPPER_RIGHT )
+    {
+      if ( upper )
+        u8g2_draw_circle_fwd(u8g2, x0, x_start, x, y0 - y, 0);
+      u8g2_draw_circle_back(u8g2, y0, x_start, x, x0 + y, 1);
+    }
+
+    /* upper left */
+    if ( option & U8G2_DRAW_UPPER_LEFT )
+    {
+      if ( upper )
+        u8g2_draw_circle_back(u8g2, x0, x_start, x, y0 - y, 0);
+      if ( y <= x0 )
+        u8g2_draw_circle_back(u8g2, y0, x_start, x, x0 - y, 1);
+    }
+
+    /* lower right */
+    if ( option & U8G2_DRAW_LOWER_RIGHT )
+    {
+      if ( lower )
+        u8g2_draw_circle_fwd(u8g2, x0, x_start, x, y0 + y, 0);
+      u8g2_draw_circle_fwd(u8g2, y0, x_start, x, x0 + y, 1);
+    }
+
+    /* lower left */
+    if ( option & U8G2_DRAW_LOWER_LEFT )
+    {
+      if ( lower )
+        u8g2_draw_circle_back(u8g2, x0, x_start, x, y0 + y, 0);
+      if ( y <= x0 )
+        u8g2_draw_circle_fwd(u8g2, y0, x_start, x, x0 - y, 1);
+    }
+}
+
+static void u8g2_draw_circle_span(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option)
+{
+    u8g2_int_t f;
+    u8g2_int_t ddF_x;
+    u8g2_int_t ddF_y;
+    u8g2_uint_t x;
+    u8g2_uint_t y;
+    u8g2_uint_t x_start;
+
+    f = 1;
+    f -= rad;
+    ddF_x = 1;
+    ddF_y = 0;
+    ddF_y -= rad;
+    ddF_y *= 2;
+    x = 0;
+    y = rad;
+    x_start = 0;
+
+    while ( x < y )
+    {
+      if (f >= 0) 
+      {
+        u8g2_draw_circle_run(u8g2, x_start, x, y, x0, y0, option);
+        x_start = x + 1;
+        y--;
+        ddF_y += 2;
+        f += ddF_y;
+      }
+      x++;
+      ddF_x += 2;
+      f += ddF_x;
+    }
+    u8g2_draw_circle_run(u8g2, x_start, x, y, x0, y0, option);
+}
+
+#endif /* U8G2_CIRCLE_SPEED_OPTIMIZATION */
+
 void u8g2_DrawCircle(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option)
 {
   /* check for bounding box */
@@ -118,6 +276,13 @@ void u8g2_DrawCircle(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t r
   
   
   /* draw circle */
+#ifdef U8G2_CIRCLE_SPEED_OPTIMIZATION
+  if ( u8g2_is_circle_span(u8g2, x0, y0, rad) )
+  {
+    u8g2_draw_circle_span(u8g2, x0, y0, rad, option);
+    return;
+  }
+#endif /* U8G2_CIRCLE_SPEED_OPTIMIZATION */
   u8g2_draw_circle(u8g2, x0, y0, rad, option);
 }
 
@@ -192,6 +357,97 @@ static void u8g2_draw_disc(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_ui
   }
 }
 
+#ifdef U8G2_CIRCLE_SPEED_OPTIMIZATION
+
+/* the scan lines dy above and below the center, w pixels to each side, see u8g2_draw_disc_section() */
+static void u8g2_draw_disc_row(u8g2_t *u8g2, u8g2_uint_t dy, u8g2_uint_t w, u8g2_uint_t x0, u8g2_uint_t y0, uint8_t option) U8G2_NOINLINE;
+
+static void u8g2_draw_disc_row(u8g2_t *u8g2, u8g2_uint_t dy, u8g2_uint_t w, u8g2_uint_t x0, u8g2_uint_t y0, uint8_t option)
+{
+  u8g2_uint_t start;
+  u8g2_uint_t end;
+  uint8_t left;
+  uint8_t right;
+  uint8_t i;
+
+  for( i = 0; i < 2; i++ )
+  {
+    /* the center line belongs to the upper and the lower quadrants */
+    if ( i == 0 )
+    {
+      if ( dy > y0 || u8g2_is_circle_row(u8g2, y0 - dy) == 0 )
+        continue;
+      left = option & U8G2_DRAW_UPPER_LEFT;
+      right = option & U8G2_DRAW_UPPER_RIGHT;
+      if ( dy == 0 )
+      {
+        left |= option & U8G2_DRAW_LOWER_LEFT;
+        right |= option & U8G2_DRAW_LOWER_RIGHT;
+      }
+    }
+    else
+    {
+      if ( dy == 0 || u8g2_is_circle_row(u8g2, y0 + dy) == 0 )
+        continue;
+      left = option & U8G2_DRAW_LOWER_LEFT;
+      right = option & U8G2_DRAW_LOWER_RIGHT;
+    }
+    if ( left == 0 && right == 0 )
+      continue;
+
+    start = x0;
+    if ( left )
+      start = w <= x0 ? x0 - w : 0;
+    end = x0;
+    if ( right )
+      end += w;
+    u8g2_DrawHVLine(u8g2, start, i == 0 ? y0 - dy : y0 + dy, end - start + 1, 0);
+  }
+}
+
+/*
+  The scan line y of a run of points with the same y ends at the last x
+  of the run, the scan line x of each point ends at its y.
+*/
+static void u8g2_draw_disc_span(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option)
+{
+  u8g2_int_t f;
+  u8g2_int_t ddF_x;
+  u8g2_int_t ddF_y;
+  u8g2_uint_t x;
+  u8g2_uint_t y;
+
+  f = 1;
+  f -= rad;
+  ddF_x = 1;
+  ddF_y = 0;
+  ddF_y -= rad;
+  ddF_y *= 2;
+  x = 0;
+  y = rad;
+
+  u8g2_draw_disc_row(u8g2, x, y, x0, y0, option);
+  
+  while ( x < y )
+  {
+    if (f >= 0) 
+    {
+      u8g2_draw_disc_row(u8g2, y, x, x0, y0, option);
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+
+    u8g2_draw_disc_row(u8g2, x, y, x0, y0, option);
+  }
+  u8g2_draw_disc_row(u8g2, y, x, x0, y0, option);
+}
+
+#endif /* U8G2_CIRCLE_SPEED_OPTIMIZATION */
+
 void u8g2_DrawDisc(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option)
 {
   /* check for bounding box */
@@ -203,6 +459,13 @@ void u8g2_DrawDisc(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad
 #endif /* U8G2_WITH_INTERSECTION */
   
   /* draw disc */
+#ifdef U8G2_CIRCLE_SPEED_OPTIMIZATION
+  if ( u8g2_is_circle_span(u8g2, x0, y0, rad) )
+  {
+    u8g2_draw_disc_span(u8g2, x0, y0, rad, option);
+    return;
+  }
+#endif /* U8G2_CIRCLE_SPEED_OPTIMIZATION */
   u8g2_draw_disc(u8g2, x0, y0, rad, option);
 }
 
@@ -15,6 +15,10 @@ static const unsigned int I2C_TIMEOUT_MS = 1000;
 static spi_device_handle_t handle_spi;      // SPI handle.
 static i2c_cmd_handle_t    handle_i2c;      // I2C handle.
 static u8g2_esp32_hal_t    u8g2_esp32_hal;  // HAL state data.
+static uint8_t i2c_buf[U8G2_ESP32_I2C_BUF_SIZE]; // Bytes of the current I2C transfer.
+static size_t  i2c_len;                         // Number of bytes in i2c_buf.
+static uint8_t i2c_overflow;                    // Transfer did not fit, rest is queued bytewise.
+static uint8_t i2c_batch = 1;                   // Queue whole transfers instead of single bytes.
 
 #undef ESP_ERROR_CHECK
 #define ESP_ERROR_CHECK(x)   do { esp_err_t rc = (x); if (rc != ESP_OK) { ESP_LOGE("err", "esp_err_t = %d", rc); assert(0 && #x);} } while(0);
@@ -26,6 +30,14 @@ void u8g2_esp32_hal_init(u8g2_esp32_hal_t u8g2_esp32_hal_param) {
 	u8g2_esp32_hal = u8g2_esp32_hal_param;
 } // u8g2_esp32_hal_init
 
+/*
+ * Select between queueing each transfer as one write command (default) and
+ * one command per byte, the latter is kept for benchmarking.
+ */
+void u8g2_esp32_i2c_set_batch(int enabled) {
+	i2c_batch = enabled != 0;
+} // u8g2_esp32_i2c_set_batch
+
 /*
  * HAL callback function as prescribed by the U8G2 library.  This callback is invoked
  * to handle SPI communications.
@@ -116,6 +128,18 @@ uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
 			uint8_t* data_ptr = (uint8_t*)arg_ptr;
 			ESP_LOG_BUFFER_HEXDUMP(TAG, data_ptr, arg_int, ESP_LOG_VERBOSE);
 
+			// i2c_master_write() keeps the pointer until the command runs, while
+			// u8x8 passes e.g. the control byte from the stack, so the bytes are
+			// collected here and queued as one write at the end of the transfer.
+			if (i2c_batch && !i2c_overflow && i2c_len + arg_int <= sizeof(i2c_buf)) {
+				memcpy(&i2c_buf[i2c_len], data_ptr, arg_int);
+				i2c_len += arg_int;
+				break;
+			}
+			if (i2c_len > 0 && !i2c_overflow) {
+				ESP_ERROR_CHECK(i2c_master_write(handle_i2c, i2c_buf, i2c_len, ACK_CHECK_EN));
+			}
+			i2c_overflow = 1;
 			while( arg_int > 0 ) {
 			   ESP_ERROR_CHECK(i2c_master_write_byte(handle_i2c, *data_ptr, ACK_CHECK_EN));
 			   data_ptr++;
@@ -127,6 +151,8 @@ uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
 		case U8X8_MSG_BYTE_START_TRANSFER: {
 			uint8_t i2c_address = u8x8_GetI2CAddress(u8x8);
 			handle_i2c = i2c_cmd_link_create();
+			i2c_len = 0;
+			i2c_overflow = 0;
 			ESP_LOGD(TAG, "Start I2C transfer to %02X.", i2c_address>>1);
 			ESP_ERROR_CHECK(i2c_master_start(handle_i2c));
 			ESP_ERROR_CHECK(i2c_master_write_byte(handle_i2c, i2c_address | I2C_MASTER_WRITE, ACK_CHECK_EN));
@@ -135,6 +161,9 @@ uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void
 
 		case U8X8_MSG_BYTE_END_TRANSFER: {
 			ESP_LOGD(TAG, "End I2C transfer.");
+			if (i2c_len > 0 && !i2c_overflow) {
+				ESP_ERROR_CHECK(i2c_master_write(handle_i2c, i2c_buf, i2c_len, ACK_CHECK_EN));
+			}
 			ESP_ERROR_CHECK(i2c_master_stop(handle_i2c));
 			ESP_ERROR_CHECK(i2c_master_cmd_begin(I2C_MASTER_NUM, handle_i2c, I2C_TIMEOUT_MS / portTICK_RATE_MS));
 			i2c_cmd_link_delete(handle_i2c);
@@ -21,6 +21,7 @@
 #define I2C_MASTER_FREQ_HZ          50000  //  I2C master clock frequency
 #define ACK_CHECK_EN   0x1                 //  I2C master will check ack from slave
 #define ACK_CHECK_DIS  0x0                 //  I2C master will not check ack from slave
+#define U8G2_ESP32_I2C_BUF_SIZE 256         //  Largest I2C transfer queued as a single write
 
 typedef struct {
 	gpio_num_t clk;
@@ -36,6 +37,7 @@ typedef struct {
 
 void u8g2_esp32_hal_init(u8g2_esp32_hal_t u8g2_esp32_hal_param);
 uint8_t u8g2_esp32_spi_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+void u8g2_esp32_i2c_set_batch(int enabled);
 uint8_t u8g2_esp32_i2c_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
 uint8_t u8g2_esp32_gpio_and_delay_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
 #endif /* U8G2_ESP32_HAL_H_ */
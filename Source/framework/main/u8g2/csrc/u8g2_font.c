@@ -35,9 +35,7 @@
 
 #include "u8g2.h"
 
-/* size of the font data structure, there is no struct or class... */
-/* this is the size for the new font format */
-#define U8G2_FONT_DATA_STRUCT_SIZE 23
+/* U8G2_FONT_DATA_STRUCT_SIZE is defined in u8g2.h, u8g2_font_index.c needs it as well */
 
 /*
   font data:
@@ -447,6 +445,96 @@ void u8g2_font_decode_len(u8g2_t *u8g2, uint8_t len, uint8_t is_foreground)
   
 }
 
+#ifdef U8G2_FONT_SPEED_OPTIMIZATION
+/*
+  Description:
+    Same as u8g2_font_decode_len(), but the pixels are written directly
+    into the vertical_top_lsb buffer: one byte per pixel of the run, the
+    bit of the pixel row selected by a mask. Rows outside of the current
+    page are skipped.
+    The glyph must be inside the display, font direction 0, U8G2_R0,
+    see u8g2_font_is_span_decode().
+*/
+static void u8g2_font_decode_len_span(u8g2_t *u8g2, uint8_t len, uint8_t is_foreground)
+{
+  uint8_t cnt;	/* total number of remaining pixels, which have to be drawn */
+  uint8_t rem; 	/* remaining pixel to the right edge of the glyph */
+  uint8_t current;	/* number of pixels, which need to be drawn for the draw procedure */
+  uint8_t lx,ly;
+  uint8_t color;
+  uint8_t mask;
+  uint8_t *ptr;
+  int16_t y;
+  u8g2_font_decode_t *decode = &(u8g2->font_decode);
+
+  color = is_foreground ? decode->fg_color : decode->bg_color;
+  cnt = len;
+  lx = decode->x;
+  ly = decode->y;
+
+  for(;;)
+  {
+    rem = decode->glyph_width;
+    rem -= lx;
+    current = rem;
+    if ( cnt < rem )
+      current = cnt;
+
+    /* row within the buffer */
+    y = (int16_t)decode->target_y + ly - (int16_t)u8g2->pixel_curr_row;
+    if ( current > 0 && ( is_foreground || decode->is_transparent == 0 ) && y >= 0 && y < (int16_t)u8g2->pixel_buf_height )
+    {
+      ptr = u8g2->tile_buf_ptr;
+      ptr += (uint16_t)(y >> 3) * u8g2->pixel_buf_width;
+      ptr += decode->target_x + lx;
+      mask = 1 << (y & 7);
+      if ( color == 1 )
+      {
+	do { *ptr++ |= mask; } while( --current > 0 );
+      }
+      else if ( color == 0 )
+      {
+	mask = ~mask;
+	do { *ptr++ &= mask; } while( --current > 0 );
+      }
+      else
+      {
+	do { *ptr++ ^= mask; } while( --current > 0 );
+      }
+    }
+
+    if ( cnt < rem )
+      break;
+    cnt -= rem;
+    lx = 0;
+    ly++;
+  }
+  lx += cnt;
+
+  decode->x = lx;
+  decode->y = ly;
+}
+
+/* whether the glyph at target_x/target_y can be decoded by u8g2_font_decode_len_span() */
+static uint8_t u8g2_font_is_span_decode(u8g2_t *u8g2)
+{
+  u8g2_font_decode_t *decode = &(u8g2->font_decode);
+
+  if ( u8g2->cb != U8G2_R0 || u8g2->ll_hvline != u8g2_ll_hvline_vertical_top_lsb )
+    return 0;
+#ifdef U8G2_WITH_FONT_ROTATION
+  if ( decode->dir != 0 )
+    return 0;
+#endif
+  /* coordinates left or above the display have wrapped around */
+  if ( (uint16_t)decode->target_x + (uint8_t)decode->glyph_width > u8g2->pixel_buf_width )
+    return 0;
+  if ( (uint16_t)decode->target_y + (uint8_t)decode->glyph_height > u8g2->height )
+    return 0;
+  return 1;
+}
+#endif /* U8G2_FONT_SPEED_OPTIMIZATION */
+
 static void u8g2_font_setup_decode(u8g2_t *u8g2, const uint8_t *glyph_data)
 {
   u8g2_font_decode_t *decode = &(u8g2->font_decode);
@@ -488,6 +576,7 @@ int8_t u8g2_font_decode_glyph(u8g2_t *u8g2, const uint8_t *glyph_data)
   int8_t d;
   int8_t h;
   u8g2_font_decode_t *decode = &(u8g2->font_decode);
+  void (*decode_len)(u8g2_t *u8g2, uint8_t len, uint8_t is_foreground) = u8g2_font_decode_len;
     
   u8g2_font_setup_decode(u8g2, glyph_data);
   h = u8g2->font_decode.glyph_height;
@@ -556,6 +645,11 @@ int8_t u8g2_font_decode_glyph(u8g2_t *u8g2, const uint8_t *glyph_data)
     /* reset local x/y position */
     decode->x = 0;
     decode->y = 0;
+
+#ifdef U8G2_FONT_SPEED_OPTIMIZATION
+    if ( u8g2_font_is_span_decode(u8g2) )
+      decode_len = u8g2_font_decode_len_span;
+#endif
     
     /* decode glyph */
     for(;;)
@@ -564,8 +658,8 @@ int8_t u8g2_font_decode_glyph(u8g2_t *u8g2, const uint8_t *glyph_data)
       b = u8g2_font_decode_get_unsigned_bits(decode, u8g2->font_info.bits_per_1);
       do
       {
-	u8g2_font_decode_len(u8g2, a, 0);
-	u8g2_font_decode_len(u8g2, b, 1);
+	decode_len(u8g2, a, 0);
+	decode_len(u8g2, b, 1);
       } while( u8g2_font_decode_get_unsigned_bits(decode, 1) != 0 );
 
       if ( decode->y >= h )
@@ -591,7 +685,13 @@ const uint8_t *u8g2_font_get_glyph_data(u8g2_t *u8g2, uint16_t encoding)
   const uint8_t *font = u8g2->font;
   font += U8G2_FONT_DATA_STRUCT_SIZE;
 
-  
+#ifdef U8G2_WITH_FONT_INDEX
+  /* Unicode glyphs without index entries are searched below */
+  if ( u8g2->font_index != NULL && u8g2->font_index->font == u8g2->font )
+    if ( encoding <= 255 || u8g2->font_index->unicode_cnt > 0 )
+      return u8g2_font_index_get_glyph_data(u8g2, encoding);
+#endif
+
   if ( encoding <= 255 )
   {
     if ( encoding >= 'a' )
@@ -663,6 +763,17 @@ const uint8_t *u8g2_font_get_glyph_data(u8g2_t *u8g2, uint16_t encoding)
 static u8g2_uint_t u8g2_font_draw_glyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding)
 {
   u8g2_uint_t dx = 0;
+  U8X8_PROFILE_VAR
+
+  U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
+#ifdef U8G2_WITH_GLYPH_CACHE
+  if ( u8g2->glyph_cache != NULL )
+    if ( u8g2_DrawCachedGlyph(u8g2, x, y, encoding, &dx) != 0 )
+    {
+      U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_GLYPH);
+      return dx;
+    }
+#endif
   u8g2->font_decode.target_x = x;
   u8g2->font_decode.target_y = y;
   //u8g2->font_decode.is_transparent = is_transparent; this is already set
@@ -672,6 +783,7 @@ static u8g2_uint_t u8g2_font_draw_glyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t
   {
     dx = u8g2_font_decode_glyph(u8g2, glyph_data);
   }
+  U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_GLYPH);
   return dx;
 }
 
@@ -1013,6 +1125,10 @@ void u8g2_SetFont(u8g2_t *u8g2, const uint8_t  *font)
 #endif 
     u8g2->font = font;
     u8g2_read_font_info(&(u8g2->font_info), font);
+#ifdef U8G2_WITH_FONT_INDEX
+    if ( u8g2->font_index != NULL )
+      u8g2_font_index_build(u8g2);
+#endif
     u8g2_UpdateRefHeight(u8g2);
     /* u8g2_SetFontPosBaseline(u8g2); */ /* removed with issue 195 */
   }
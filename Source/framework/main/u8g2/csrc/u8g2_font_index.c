@@ -0,0 +1,172 @@
+/*
+
+  u8g2_font_index.c
+
+  Glyph index of the current font, see U8G2_WITH_FONT_INDEX in u8g2.h
+
+  The glyphs of a font are a list of variable sized records, which
+  u8g2_font_get_glyph_data() walks from 'A', 'a' or the first Unicode
+  glyph on every lookup. The index is built by one walk through the list
+  whenever u8g2_SetFont() changes the font:
+
+  - ascii[] holds the offset of every glyph 0..255, a lookup is one
+    table access.
+  - unicode[] holds encoding and address of every unicode_step-th Unicode
+    glyph, unicode_step = glyphs / unicode_size rounded up. A lookup is a
+    binary search for the last entry not above the encoding, followed by
+    a walk of at most unicode_step glyphs. With unicode_size >= glyphs of
+    the font every glyph has its own entry.
+
+  The Unicode glyphs of a font are sorted by bdfconv. A font which is not
+  gets no Unicode entries and is searched linearly.
+
+*/
+
+#include "u8g2.h"
+#include <string.h>
+
+#ifdef U8G2_WITH_FONT_INDEX
+
+#ifdef U8G2_WITH_UNICODE
+static uint16_t u8g2_font_index_get_encoding(const uint8_t *glyph)
+{
+  uint16_t e;
+  e = u8x8_pgm_read( glyph );
+  e <<= 8;
+  e |= u8x8_pgm_read( glyph + 1 );
+  return e;
+}
+
+static void u8g2_font_index_build_unicode(u8g2_t *u8g2, const uint8_t *first)
+{
+  u8g2_font_index_t *index = u8g2->font_index;
+  const uint8_t *glyph;
+  uint16_t e;
+  uint16_t last = 0;
+  uint16_t n = 0;
+
+  /* count the glyphs and check that they are sorted */
+  glyph = first + u8g2->font_info.start_pos_unicode;
+  for(;;)
+  {
+    e = u8g2_font_index_get_encoding(glyph);
+    if ( e == 0 )
+      break;
+    if ( e <= last )
+      return;
+    last = e;
+    n++;
+    glyph += u8x8_pgm_read( glyph + 2 );
+  }
+  index->unicode_glyphs = n;
+  if ( n == 0 || index->unicode == NULL || index->unicode_size == 0 )
+    return;
+
+  index->unicode_step = (n + index->unicode_size - 1) / index->unicode_size;
+  glyph = first + u8g2->font_info.start_pos_unicode;
+  for( n = 0; n < index->unicode_glyphs; n++ )
+  {
+    if ( n % index->unicode_step == 0 )
+    {
+      index->unicode[index->unicode_cnt].encoding = u8g2_font_index_get_encoding(glyph);
+      index->unicode[index->unicode_cnt].glyph = glyph;
+      index->unicode_cnt++;
+    }
+    glyph += u8x8_pgm_read( glyph + 2 );
+  }
+}
+#endif /* U8G2_WITH_UNICODE */
+
+void u8g2_font_index_build(u8g2_t *u8g2)
+{
+  u8g2_font_index_t *index = u8g2->font_index;
+  const uint8_t *first;
+  const uint8_t *glyph;
+  uint8_t e;
+
+  index->font = u8g2->font;
+  memset(index->ascii, 0, sizeof(index->ascii));
+  index->unicode_cnt = 0;
+  index->unicode_step = 0;
+  index->unicode_glyphs = 0;
+  if ( u8g2->font == NULL )
+    return;
+
+  /* the first glyph of an encoding is found, as by the linear search */
+  first = u8g2->font + U8G2_FONT_DATA_STRUCT_SIZE;
+  glyph = first;
+  while ( u8x8_pgm_read( glyph + 1 ) != 0 )
+  {
+    e = u8x8_pgm_read( glyph );
+    if ( index->ascii[e] == 0 )
+      index->ascii[e] = (uint16_t)(glyph - first) + 2;
+    glyph += u8x8_pgm_read( glyph + 1 );
+  }
+
+#ifdef U8G2_WITH_UNICODE
+  u8g2_font_index_build_unicode(u8g2, first);
+#endif
+}
+
+const uint8_t *u8g2_font_index_get_glyph_data(u8g2_t *u8g2, uint16_t encoding)
+{
+  const u8g2_font_index_t *index = u8g2->font_index;
+
+  if ( encoding <= 255 )
+  {
+    if ( index->ascii[encoding] == 0 )
+      return NULL;
+    return u8g2->font + U8G2_FONT_DATA_STRUCT_SIZE + index->ascii[encoding];
+  }
+#ifdef U8G2_WITH_UNICODE
+  else
+  {
+    const uint8_t *glyph;
+    uint16_t lo = 0;
+    uint16_t hi = index->unicode_cnt;
+    uint16_t mid;
+    uint16_t e;
+    uint16_t i;
+
+    if ( hi == 0 )
+      return NULL;
+
+    /* last entry with an encoding not above the searched one */
+    while ( hi - lo > 1 )
+    {
+      mid = (lo + hi) / 2;
+      if ( index->unicode[mid].encoding <= encoding )
+	lo = mid;
+      else
+	hi = mid;
+    }
+    if ( index->unicode[lo].encoding > encoding )
+      return NULL;
+
+    glyph = index->unicode[lo].glyph;
+    for( i = 0; i < index->unicode_step; i++ )
+    {
+      e = u8g2_font_index_get_encoding(glyph);
+      if ( e == encoding )
+	return glyph + 3;	/* skip encoding and glyph size */
+      if ( e == 0 || e > encoding )
+	break;
+      glyph += u8x8_pgm_read( glyph + 2 );
+    }
+  }
+#endif
+
+  return NULL;
+}
+
+void u8g2_SetFontIndex(u8g2_t *u8g2, u8g2_font_index_t *index, u8g2_font_index_entry_t *unicode, uint16_t unicode_size)
+{
+  u8g2->font_index = index;
+  if ( index == NULL )
+    return;
+  index->unicode = unicode;
+  index->unicode_size = unicode == NULL ? 0 : unicode_size;
+  u8g2_font_index_build(u8g2);
+}
+
+#endif /* U8G2_WITH_FONT_INDEX */
@@ -0,0 +1,259 @@
+/*
+
+  u8g2_glyph_cache.c
+
+  Cache of decoded glyphs, see U8G2_WITH_GLYPH_CACHE in u8g2.h
+
+  A glyph is decoded once into a slot of the cache: tile rows of
+  glyph_width bytes, each byte holds 8 vertical pixels, lsb on top, which
+  is the layout of u8g2_ll_hvline_vertical_top_lsb. Drawing a cached glyph
+  shifts these bytes to the target row and merges them into the buffer,
+  a few byte operations per glyph column instead of one u8g2_DrawHVLine()
+  per run length.
+
+  Slots are replaced least recently used first.
+
+*/
+
+#include "u8g2.h"
+#include <string.h>
+
+#ifdef U8G2_WITH_GLYPH_CACHE
+
+void u8g2_SetGlyphCache(u8g2_t *u8g2, u8g2_glyph_cache_t *cache)
+{
+  if ( cache != NULL )
+    memset(cache, 0, sizeof(u8g2_glyph_cache_t));
+  u8g2->glyph_cache = cache;
+}
+
+/* apply a color to the pixels in mask, see u8g2_ll_hvline.c */
+static void u8g2_glyph_cache_apply(uint8_t *ptr, uint8_t mask, uint8_t color)
+{
+  if ( color <= 1 )
+    *ptr |= mask;
+  if ( color != 1 )
+    *ptr ^= mask;
+}
+
+/* same as u8g2_font_decode_len(), but into the bitmap of a cache slot */
+static void u8g2_glyph_cache_decode_len(u8g2_font_decode_t *decode, uint8_t *bitmap, uint8_t len, uint8_t is_foreground)
+{
+  uint8_t cnt = len;
+  uint8_t rem;
+  uint8_t current;
+  uint8_t lx = decode->x;
+  uint8_t ly = decode->y;
+  uint8_t *ptr;
+  uint8_t mask;
+
+  for(;;)
+  {
+    rem = decode->glyph_width;
+    rem -= lx;
+    current = rem;
+    if ( cnt < rem )
+      current = cnt;
+
+    if ( is_foreground && ly < (uint8_t)decode->glyph_height )
+    {
+      ptr = bitmap + (ly >> 3) * decode->glyph_width + lx;
+      mask = 1 << (ly & 7);
+      while( current > 0 )
+      {
+        *ptr++ |= mask;
+        current--;
+      }
+    }
+
+    if ( cnt < rem )
+      break;
+    cnt -= rem;
+    lx = 0;
+    ly++;
+  }
+  lx += cnt;
+
+  decode->x = lx;
+  decode->y = ly;
+}
+
+/* decode a glyph into a free or the least recently used slot, NULL if it does not fit */
+static u8g2_glyph_cache_entry_t *u8g2_glyph_cache_load(u8g2_t *u8g2, u8g2_glyph_cache_t *cache, uint16_t encoding, uint8_t **bitmap)
+{
+  u8g2_font_decode_t *decode = &(u8g2->font_decode);
+  u8g2_glyph_cache_entry_t *e;
+  const uint8_t *glyph_data;
+  uint8_t i, victim;
+  uint8_t a, b;
+
+  glyph_data = u8g2_font_get_glyph_data(u8g2, encoding);
+  if ( glyph_data == NULL )
+    return NULL;
+
+  /* header of the glyph, see u8g2_font_decode_glyph() */
+  decode->decode_ptr = glyph_data;
+  decode->decode_bit_pos = 0;
+  decode->glyph_width = u8g2_font_decode_get_unsigned_bits(decode, u8g2->font_info.bits_per_char_width);
+  decode->glyph_height = u8g2_font_decode_get_unsigned_bits(decode, u8g2->font_info.bits_per_char_height);
+  if ( (uint16_t)(uint8_t)decode->glyph_width * (((uint8_t)decode->glyph_height + 7) >> 3) > U8G2_GLYPH_CACHE_SLOT_SIZE )
+    return NULL;
+
+  victim = 0;
+  for( i = 0; i < U8G2_GLYPH_CACHE_ENTRIES; i++ )
+  {
+    if ( cache->entry[i].font == NULL )
+    {
+      victim = i;
+      break;
+    }
+    if ( cache->entry[i].last_use < cache->entry[victim].last_use )
+      victim = i;
+  }
+
+  e = &(cache->entry[victim]);
+  *bitmap = cache->bitmap[victim];
+  memset(*bitmap, 0, U8G2_GLYPH_CACHE_SLOT_SIZE);
+
+  e->font = u8g2->font;
+  e->encoding = encoding;
+  e->glyph_width = decode->glyph_width;
+  e->glyph_height = decode->glyph_height;
+  e->x_offset = u8g2_font_decode_get_signed_bits(decode, u8g2->font_info.bits_per_char_x);
+  e->y_offset = u8g2_font_decode_get_signed_bits(decode, u8g2->font_info.bits_per_char_y);
+  e->delta_x = u8g2_font_decode_get_signed_bits(decode, u8g2->font_info.bits_per_delta_x);
+
+  if ( decode->glyph_width > 0 )
+  {
+    decode->x = 0;
+    decode->y = 0;
+    for(;;)
+    {
+      a = u8g2_font_decode_get_unsigned_bits(decode, u8g2->font_info.bits_per_0);
+      b = u8g2_font_decode_get_unsigned_bits(decode, u8g2->font_info.bits_per_1);
+      do
+      {
+        u8g2_glyph_cache_decode_len(decode, *bitmap, a, 0);
+        u8g2_glyph_cache_decode_len(decode, *bitmap, b, 1);
+      } while( u8g2_font_decode_get_unsigned_bits(decode, 1) != 0 );
+
+      if ( decode->y >= decode->glyph_height )
+        break;
+    }
+  }
+  return e;
+}
+
+/*
+  Description:
+    Draw a glyph from the glyph cache, decode it into the cache first if
+    required. x/y are the same as for u8g2_font_draw_glyph().
+  Return:
+    0 if the glyph can not be drawn from the cache, otherwise 1 with the
+    delta x advance in dx.
+*/
+uint8_t u8g2_DrawCachedGlyph(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, uint16_t encoding, u8g2_uint_t *dx)
+{
+  u8g2_glyph_cache_t *cache = u8g2->glyph_cache;
+  u8g2_glyph_cache_entry_t *e = NULL;
+  uint8_t *bitmap = NULL;
+  uint8_t *ptr;
+  uint8_t i, col, page, pages, half;
+  uint8_t fg_color, bg_color;
+  uint8_t bits, mask, shift, m;
+  uint16_t stride;
+  int16_t x0, y0;
+  int16_t row, first_row, last_row;
+
+  if ( u8g2->cb != U8G2_R0 || u8g2->ll_hvline != u8g2_ll_hvline_vertical_top_lsb )
+  {
+    cache->bypassed++;
+    return 0;
+  }
+#ifdef U8G2_WITH_FONT_ROTATION
+  if ( u8g2->font_decode.dir != 0 )
+  {
+    cache->bypassed++;
+    return 0;
+  }
+#endif
+
+  for( i = 0; i < U8G2_GLYPH_CACHE_ENTRIES; i++ )
+  {
+    if ( cache->entry[i].encoding == encoding && cache->entry[i].font == u8g2->font && u8g2->font != NULL )
+    {
+      e = &(cache->entry[i]);
+      bitmap = cache->bitmap[i];
+      cache->hits++;
+      break;
+    }
+  }
+  if ( e == NULL )
+  {
+    e = u8g2_glyph_cache_load(u8g2, cache, encoding, &bitmap);
+    if ( e == NULL )
+    {
+      cache->bypassed++;
+      return 0;
+    }
+    cache->misses++;
+  }
+  e->last_use = ++cache->clock;
+
+  *dx = e->delta_x;
+  if ( e->glyph_width == 0 )
+    return 1;
+
+  /* upper left corner, see u8g2_font_decode_glyph() */
+  x0 = (int16_t)x + e->x_offset;
+  y0 = (int16_t)y - (e->glyph_height + e->y_offset);
+
+  /* partly visible glyphs are clipped by the font decoder */
+  if ( x0 < 0 || x0 + e->glyph_width > u8g2->pixel_buf_width || y0 < 0 || y0 + e->glyph_height > u8g2->height )
+  {
+    cache->bypassed++;
+    return 0;
+  }
+
+  fg_color = u8g2->draw_color;
+  bg_color = (fg_color == 0 ? 1 : 0);
+  stride = u8g2_GetU8x8(u8g2)->display_info->tile_width * 8;
+  shift = y0 & 7;
+  pages = (e->glyph_height + 7) >> 3;
+
+  /* tile rows of the buffer, relative to the display */
+  first_row = u8g2->buf_y0 >> 3;
+  last_row = (u8g2->buf_y1 + 7) >> 3;
+
+  for( page = 0; page < pages; page++ )
+  {
+    mask = 0xff;
+    if ( e->glyph_height - page * 8 < 8 )
+      mask = (1 << (e->glyph_height - page * 8)) - 1;
+
+    row = (y0 >> 3) + page;
+    /* a glyph page covers one tile row, or two if not aligned */
+    for( half = 0; half < 2; half++, row++ )
+    {
+      if ( half == 1 && shift == 0 )
+        break;
+      if ( row < first_row || row >= last_row )
+        continue;
+
+      m = (half == 0) ? (uint8_t)(mask << shift) : (uint8_t)(mask >> (8 - shift));
+      ptr = u8g2->tile_buf_ptr + (row - first_row) * stride + x0;
+      for( col = 0; col < e->glyph_width; col++ )
+      {
+        bits = bitmap[page * e->glyph_width + col];
+        bits = (half == 0) ? (uint8_t)(bits << shift) : (uint8_t)(bits >> (8 - shift));
+        u8g2_glyph_cache_apply(ptr, bits, fg_color);
+        if ( u8g2->font_decode.is_transparent == 0 )
+          u8g2_glyph_cache_apply(ptr, m & ~bits, bg_color);
+        ptr++;
+      }
+    }
+  }
+  return 1;
+}
+
+#endif /* U8G2_WITH_GLYPH_CACHE */
@@ -205,11 +205,17 @@ void u8g2_draw_hv_line_4dir(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uin
 */
 void u8g2_DrawHVLine(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir)
 {
+  U8X8_PROFILE_VAR
+
   /* Make a call to the callback function (e.g. u8g2_draw_l90_r0). */
   /* The callback may rotate the hv line */
   /* after rotation this will call u8g2_draw_hv_line_4dir() */
   if ( len != 0 )
+  {
+    U8X8_PROFILE_BEGIN(u8g2_GetU8x8(u8g2));
     u8g2->cb->draw_l90(u8g2, x, y, len, dir);
+    U8X8_PROFILE_END(u8g2_GetU8x8(u8g2), U8X8_PROFILE_HVLINE);
+  }
 }
 
 void u8g2_DrawHLine(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len)
@@ -50,6 +50,115 @@
 
 #include "u8g2.h"
 #include <assert.h>
+#include <string.h>
+
+#ifdef U8G2_HVLINE_SPEED_OPTIMIZATION
+
+/*=================================================*/
+/*
+  Span kernels, shared by both buffer layouts
+
+  A line covers a run of bytes with the same mask (the bit of a
+  horizontal line in vertical_top_lsb, the full bytes of a horizontal
+  line in horizontal_right_lsb) or a column of bytes one row apart.
+  The color is applied with one operation per byte instead of an OR
+  and an XOR: color 0 clears, 1 sets and 2 inverts the mask.
+  Runs of full bytes are filled with memset(), other runs of at least
+  U8G2_SPAN_WORD_MIN bytes are processed as aligned 32 bit words.
+*/
+
+#if defined(__GNUC__)
+typedef uint32_t u8g2_span_word_t __attribute__((__may_alias__));
+#define U8G2_SPAN_WORDS
+#define U8G2_SPAN_WORD_MIN 8
+#endif
+
+static void u8g2_span_byte(uint8_t *ptr, uint8_t mask, uint8_t color)
+{
+  if ( color == 0 )
+    *ptr &= ~mask;
+  else if ( color == 1 )
+    *ptr |= mask;
+  else
+    *ptr ^= mask;
+}
+
+/* apply mask to cnt consecutive bytes */
+static void u8g2_span_row(uint8_t *ptr, uint8_t mask, uint16_t cnt, uint8_t color)
+{
+#ifdef U8G2_SPAN_WORDS
+  u8g2_span_word_t *wptr;
+  uint32_t wmask;
+#endif
+
+  if ( mask == 0xff && color <= 1 )
+  {
+    memset(ptr, color == 0 ? 0x00 : 0xff, cnt);
+    return;
+  }
+
+#ifdef U8G2_SPAN_WORDS
+  if ( cnt >= U8G2_SPAN_WORD_MIN )
+  {
+    while( ((uintptr_t)ptr & 3) != 0 )
+    {
+      u8g2_span_byte(ptr, mask, color);
+      ptr++;
+      cnt--;
+    }
+    wptr = (u8g2_span_word_t *)ptr;
+    wmask = mask * 0x01010101UL;
+    if ( color == 0 )
+    {
+      wmask = ~wmask;
+      do { *wptr++ &= wmask; cnt -= 4; } while( cnt >= 4 );
+    }
+    else if ( color == 1 )
+    {
+      do { *wptr++ |= wmask; cnt -= 4; } while( cnt >= 4 );
+    }
+    else
+    {
+      do { *wptr++ ^= wmask; cnt -= 4; } while( cnt >= 4 );
+    }
+    ptr = (uint8_t *)wptr;
+  }
+#endif
+
+  if ( color == 0 )
+  {
+    mask = ~mask;
+    while( cnt != 0 ) { *ptr++ &= mask; cnt--; }
+  }
+  else if ( color == 1 )
+  {
+    while( cnt != 0 ) { *ptr++ |= mask; cnt--; }
+  }
+  else
+  {
+    while( cnt != 0 ) { *ptr++ ^= mask; cnt--; }
+  }
+}
+
+/* apply mask to cnt bytes, stride bytes apart */
+static void u8g2_span_column(uint8_t *ptr, uint8_t mask, uint16_t cnt, uint16_t stride, uint8_t color)
+{
+  if ( color == 0 )
+  {
+    mask = ~mask;
+    do { *ptr &= mask; ptr += stride; cnt--; } while( cnt != 0 );
+  }
+  else if ( color == 1 )
+  {
+    do { *ptr |= mask; ptr += stride; cnt--; } while( cnt != 0 );
+  }
+  else
+  {
+    do { *ptr ^= mask; ptr += stride; cnt--; } while( cnt != 0 );
+  }
+}
+
+#endif /* U8G2_HVLINE_SPEED_OPTIMIZATION */
 
 /*=================================================*/
 /*
@@ -72,9 +181,12 @@
 void u8g2_ll_hvline_vertical_top_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir)
 {
   uint16_t offset;
+  uint16_t cnt;
+  uint16_t full;
+  uint16_t stride;
   uint8_t *ptr;
-  uint8_t bit_pos, mask;
-  uint8_t or_mask, xor_mask;
+  uint8_t bit_pos;
+  uint8_t color = u8g2->draw_color;
 
   //assert(x >= u8g2->buf_x0);
   //assert(x < u8g2_GetU8x8(u8g2)->display_info->tile_width*8);
@@ -84,16 +196,6 @@ void u8g2_ll_hvline_vertical_top_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y,
   /* bytes are vertical, lsb on top (y=0), msb at bottom (y=7) */
   bit_pos = y;		/* overflow truncate is ok here... */
   bit_pos &= 7; 	/* ... because only the lowest 3 bits are needed */
-  mask = 1;
-  mask <<= bit_pos;
-
-  or_mask = 0;
-  xor_mask = 0;
-  if ( u8g2->draw_color <= 1 )
-    or_mask  = mask;
-  if ( u8g2->draw_color != 1 )
-    xor_mask = mask;
-
 
   offset = y;		/* y might be 8 or 16 bit, but we need 16 bit, so use a 16 bit variable */
   offset &= ~7;
@@ -102,43 +204,38 @@ void u8g2_ll_hvline_vertical_top_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y,
   ptr += offset;
   ptr += x;
   
-  if ( dir == 0 )
+  if ( len == 1 )
+  {
+    /* single pixels are frequent in glyphs */
+    u8g2_span_byte(ptr, 1 << bit_pos, color);
+  }
+  else if ( dir == 0 )
   {
-      do
-      {
-	*ptr |= or_mask;
-	*ptr ^= xor_mask;
-	ptr++;
-	len--;
-      } while( len != 0 );
+    /* the same bit in len neighbouring bytes */
+    u8g2_span_row(ptr, 1 << bit_pos, len, color);
   }
   else
-  {    
-    do
+  {
+    /* a partial byte, full bytes one tile row apart, a partial byte */
+    cnt = len;
+    if ( bit_pos + cnt < 8 )
     {
-      *ptr |= or_mask;
-      *ptr ^= xor_mask;
-      
-      bit_pos++;
-      bit_pos &= 7;
-
-      len--;
-
-      if ( bit_pos == 0 )
-      {
-	ptr+=u8g2->pixel_buf_width;	/* 6 Jan 17: Changed u8g2->width to u8g2->pixel_buf_width, issue #148 */
-		
-	if ( u8g2->draw_color <= 1 )
-	  or_mask  = 1;
-	if ( u8g2->draw_color != 1 )
-	  xor_mask = 1;
-      }
-      else
-      {
-	or_mask <<= 1;
-	xor_mask <<= 1;
-      }
-    } while( len != 0 );
+      u8g2_span_byte(ptr, ((1 << cnt) - 1) << bit_pos, color);
+      return;
+    }
+    stride = u8g2->pixel_buf_width;	/* 6 Jan 17: Changed u8g2->width to u8g2->pixel_buf_width, issue #148 */
+    u8g2_span_byte(ptr, 0xff << bit_pos, color);
+    ptr += stride;
+    cnt -= 8 - bit_pos;
+    full = cnt >> 3;
+    if ( full != 0 )
+    {
+      u8g2_span_column(ptr, 0xff, full, stride, color);
+      ptr += full * stride;
+    }
+    cnt &= 7;
+    if ( cnt != 0 )
+      u8g2_span_byte(ptr, (1 << cnt) - 1, color);
   }
 }
 
@@ -234,15 +331,15 @@ void u8g2_ll_hvline_vertical_top_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y,
 void u8g2_ll_hvline_horizontal_right_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir)
 {
   uint16_t offset;
+  uint16_t cnt;
+  uint16_t full;
   uint8_t *ptr;
   uint8_t bit_pos;
-  uint8_t mask;
+  uint8_t color = u8g2->draw_color;
   uint8_t tile_width = u8g2_GetU8x8(u8g2)->display_info->tile_width;
 
   bit_pos = x;		/* overflow truncate is ok here... */
   bit_pos &= 7; 	/* ... because only the lowest 3 bits are needed */
-  mask = 128;
-  mask >>= bit_pos;
 
   offset = y;		/* y might be 8 or 16 bit, but we need 16 bit, so use a 16 bit variable */
   offset *= tile_width;
@@ -252,39 +349,33 @@ void u8g2_ll_hvline_horizontal_right_lsb(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_
   
   if ( dir == 0 )
   {
-      
-    do
+    /* a partial byte, full bytes, a partial byte; msb is the left pixel */
+    cnt = len;
+    if ( bit_pos + cnt <= 8 )
     {
-
-      if ( u8g2->draw_color <= 1 )
-	*ptr |= mask;
-      if ( u8g2->draw_color != 1 )
-	*ptr ^= mask;
-      
-      mask >>= 1;
-      if ( mask == 0 )
-      {
-	mask = 128;
-        ptr++;
-      }
-      
-      //x++;
-      len--;
-    } while( len != 0 );
+      u8g2_span_byte(ptr, (0xff >> bit_pos) & (0xff << (8 - bit_pos - cnt)), color);
+      return;
+    }
+    if ( bit_pos != 0 )
+    {
+      u8g2_span_byte(ptr, 0xff >> bit_pos, color);
+      ptr++;
+      cnt -= 8 - bit_pos;
+    }
+    full = cnt >> 3;
+    if ( full != 0 )
+    {
+      u8g2_span_row(ptr, 0xff, full, color);
+      ptr += full;
+    }
+    cnt &= 7;
+    if ( cnt != 0 )
+      u8g2_span_byte(ptr, 0xff << (8 - cnt), color);
   }
   else
   {
-    do
-    {
-      if ( u8g2->draw_color <= 1 )
-	*ptr |= mask;
-      if ( u8g2->draw_color != 1 )
-	*ptr ^= mask;
-      
-      ptr += tile_width;
-      //y++;
-      len--;
-    } while( len != 0 );
+    /* the same bit in len bytes one pixel row apart */
+    u8g2_span_column(ptr, 128 >> bit_pos, len, tile_width, color);
   }
 }
 
@@ -2,7 +2,27 @@
 
   u8g22_polygon.c
 
-*/	
+  Scan line polygon fill with an active edge table.
+
+  Every edge of the polygon, except horizontal ones, is stepped from its
+  upper to its lower end with the integer line algorithm of the former
+  convex polygon procedure, so convex polygons get the same pixels as
+  before. Scan line y covers the edges with y1 < y <= y2, the first scan
+  line of the polygon also the edges which start there (a flat top). The
+  last scan line of the polygon is not drawn. Spans are filled between
+  pairs of edges ordered by x (even-odd rule), from the left x up to, but
+  not including, the right x.
+
+  Edges wait in a list sorted by y1 until they become active, the active
+  edges are kept sorted by their current x. Scan lines outside the current
+  page are not processed at all: the edges, which are active at the first
+  scan line of the page, are advanced to it with one calculation.
+
+  The points are stored in a buffer provided with u8g2_SetPolygonBuffer(),
+  which also holds the state of the edge from each point to the next one.
+  Without it, a built-in buffer of PG_MAX_POINTS points is used.
+
+*/
 
 
 #include "u8g2.h"
@@ -15,49 +35,22 @@
 
 typedef int16_t pg_word_t;
 
-
-struct pg_point_struct
-{
-  pg_word_t x;
-  pg_word_t y;
-};
-
 typedef struct _pg_struct pg_struct;	/* forward declaration */
 
-struct pg_edge_struct
-{
-  pg_word_t x_direction;	/* 1, if x2 is greater than x1, -1 otherwise */
-  pg_word_t height;
-  pg_word_t current_x_offset;
-  pg_word_t error_offset;
-  
-  /* --- line loop --- */
-  pg_word_t current_y;
-  pg_word_t max_y;
-  pg_word_t current_x;
-  pg_word_t error;
-
-  /* --- outer loop --- */
-  uint8_t (*next_idx_fn)(pg_struct *pg, uint8_t i);
-  uint8_t curr_idx;
-};
-
-/* maximum number of points in the polygon */
-/* can be redefined, but highest possible value is 254 */
+/* size of the built-in point buffer */
 #define PG_MAX_POINTS 6
 
-/* index numbers for the pge structures below */
-#define PG_LEFT 0
-#define PG_RIGHT 1
-
+/* end of the pending and active edge lists */
+#define PG_NONE 0xffff
 
 struct _pg_struct
 {
-  struct pg_point_struct list[PG_MAX_POINTS];
-  uint8_t cnt;
-  uint8_t is_min_y_not_flat;
-  pg_word_t total_scan_line_cnt;
-  struct pg_edge_struct pge[2];	/* left and right line draw structures */
+  u8g2_pg_point_t *list;		/* built_in or the buffer of u8g2_SetPolygonBuffer() */
+  uint16_t size;
+  uint16_t cnt;
+  uint16_t pending;		/* edges sorted by y1, which are not active yet */
+  uint16_t active;		/* active edges, sorted by current_x */
+  u8g2_pg_point_t built_in[PG_MAX_POINTS];
 };
 
 
@@ -66,39 +59,40 @@ struct _pg_struct
 
 #define PG_NOINLINE U8G2_NOINLINE
 
-static uint8_t pge_Next(struct pg_edge_struct *pge) PG_NOINLINE;
-static uint8_t pg_inc(pg_struct *pg, uint8_t i) PG_NOINLINE;
-static uint8_t pg_dec(pg_struct *pg, uint8_t i) PG_NOINLINE;
-static void pg_expand_min_y(pg_struct *pg, pg_word_t min_y, uint8_t pge_idx) PG_NOINLINE;
-static void pg_line_init(pg_struct * const pg, uint8_t pge_index) PG_NOINLINE;
+static void pge_Next(u8g2_pg_point_t *pge) PG_NOINLINE;
+static void pge_Skip(u8g2_pg_point_t *pge, pg_word_t y) PG_NOINLINE;
 
 /*===========================================*/
 /* line draw algorithm */
 
-static uint8_t pge_Next(struct pg_edge_struct *pge)
+static void pge_Next(u8g2_pg_point_t *pge)
 {
-  if ( pge->current_y >= pge->max_y )
-    return 0;
-  
   pge->current_x += pge->current_x_offset;
   pge->error += pge->error_offset;
   if ( pge->error > 0 )
   {
     pge->current_x += pge->x_direction;
     pge->error -= pge->height;
-  }  
-  
+  }
   pge->current_y++;
-  return 1;
 }
 
-/* assumes y2 > y1 */
-static void pge_Init(struct pg_edge_struct *pge, pg_word_t x1, pg_word_t y1, pg_word_t x2, pg_word_t y2)
+/* the edge from p to q, p->y != q->y */
+static void pge_Init(u8g2_pg_point_t *pge, const u8g2_pg_point_t *p, const u8g2_pg_point_t *q)
 {
-  pg_word_t dx = x2 - x1;
+  pg_word_t x1 = p->x, y1 = p->y, x2 = q->x, y2 = q->y;
+  pg_word_t dx;
   pg_word_t width;
 
+  if ( y1 > y2 )
+  {
+    x1 = q->x; y1 = q->y;
+    x2 = p->x; y2 = p->y;
+  }
+  dx = x2 - x1;
+
   pge->height = y2 - y1;
+  pge->min_y = y1;
   pge->max_y = y2;
   pge->current_y = y1;
   pge->current_x = x1;
@@ -115,182 +109,178 @@ static void pge_Init(struct pg_edge_struct *pge, pg_word_t x1, pg_word_t y1, pg_
     width = -dx;
     pge->error = 1 - pge->height;
   }
-  
+
   pge->current_x_offset = dx / pge->height;
   pge->error_offset = width % pge->height;
 }
 
-/*===========================================*/
-/* convex polygon algorithm */
-
-static uint8_t pg_inc(pg_struct *pg, uint8_t i)
+/* same as pge_Next() until current_y is y */
+static void pge_Skip(u8g2_pg_point_t *pge, pg_word_t y)
 {
-    i++;
-    if ( i >= pg->cnt )
-      i = 0;
-    return i;
+  int32_t k = y - pge->current_y;
+  int32_t e = pge->error + k * pge->error_offset;
+  int32_t n = 0;
+
+  /* the error stays within -height+1..0, each step subtracts height at most once */
+  if ( e > 0 )
+    n = (e + pge->height - 1) / pge->height;
+  pge->current_x += k * pge->current_x_offset + n * pge->x_direction;
+  pge->error = e - n * pge->height;
+  pge->current_y = y;
 }
 
-static uint8_t pg_dec(pg_struct *pg, uint8_t i)
+/*===========================================*/
+/* active edge table */
+
+/* insert edge i into the pending list, sorted by min_y */
+static void pg_add_pending(pg_struct *pg, uint16_t i)
 {
-    i--;
-    if ( i >= pg->cnt )
-      i = pg->cnt-1;
-    return i;
+  uint16_t *link = &(pg->pending);
+  while ( *link != PG_NONE && pg->list[*link].min_y <= pg->list[i].min_y )
+    link = &(pg->list[*link].next);
+  pg->list[i].next = *link;
+  *link = i;
 }
 
-static void pg_expand_min_y(pg_struct *pg, pg_word_t min_y, uint8_t pge_idx)
+/* insert edge i into the active list, sorted by current_x */
+static void pg_add_active(pg_struct *pg, uint16_t i)
 {
-  uint8_t i = pg->pge[pge_idx].curr_idx;
-  for(;;)
-  {
-    i = pg->pge[pge_idx].next_idx_fn(pg, i);
-    if ( pg->list[i].y != min_y )
-      break;	
-    pg->pge[pge_idx].curr_idx = i;
-  }
+  uint16_t *link = &(pg->active);
+  while ( *link != PG_NONE && pg->list[*link].current_x < pg->list[i].current_x )
+    link = &(pg->list[*link].next);
+  pg->list[i].next = *link;
+  *link = i;
 }
 
-static uint8_t pg_prepare(pg_struct *pg)
+/* the active edges are nearly sorted after each step, insertion sort */
+static void pg_sort_active(pg_struct *pg)
 {
-  pg_word_t max_y;
-  pg_word_t min_y;
-  uint8_t i;
-
-  /* setup the next index procedures */
-  pg->pge[PG_RIGHT].next_idx_fn = pg_inc;
-  pg->pge[PG_LEFT].next_idx_fn = pg_dec;
-  
-  /* search for highest and lowest point */
-  max_y = pg->list[0].y;
-  min_y = pg->list[0].y;
-  pg->pge[PG_LEFT].curr_idx = 0;
-  for( i = 1; i < pg->cnt; i++ )
-  {
-    if ( max_y < pg->list[i].y )
-    {
-      max_y = pg->list[i].y;
-    }
-    if ( min_y > pg->list[i].y )
-    {
-      pg->pge[PG_LEFT].curr_idx = i;
-      min_y = pg->list[i].y;
-    }
-  }
+  uint16_t i = pg->active;
+  uint16_t next;
 
-  /* calculate total number of scan lines */
-  pg->total_scan_line_cnt = max_y;
-  pg->total_scan_line_cnt -= min_y;
-  
-  /* exit if polygon height is zero */
-  if ( pg->total_scan_line_cnt == 0 )
-    return 0;
-  
-  /* if the minimum y side is flat, try to find the lowest and highest x points */
-  pg->pge[PG_RIGHT].curr_idx = pg->pge[PG_LEFT].curr_idx;  
-  pg_expand_min_y(pg, min_y, PG_RIGHT);
-  pg_expand_min_y(pg, min_y, PG_LEFT);
-  
-  /* check if the min side is really flat (depends on the x values) */
-  pg->is_min_y_not_flat = 1;
-  if ( pg->list[pg->pge[PG_LEFT].curr_idx].x != pg->list[pg->pge[PG_RIGHT].curr_idx].x )
+  /* usually still sorted, e.g. always for convex polygons */
+  while ( i != PG_NONE && pg->list[i].next != PG_NONE )
   {
-    pg->is_min_y_not_flat = 0;
+    if ( pg->list[i].current_x > pg->list[pg->list[i].next].current_x )
+      break;
+    i = pg->list[i].next;
   }
-  else
+  if ( i == PG_NONE || pg->list[i].next == PG_NONE )
+    return;
+
+  i = pg->active;
+  pg->active = PG_NONE;
+  while ( i != PG_NONE )
   {
-    pg->total_scan_line_cnt--;
-    if ( pg->total_scan_line_cnt == 0 )
-      return 0;
+    next = pg->list[i].next;
+    pg_add_active(pg, i);
+    i = next;
   }
-
-  return 1;
 }
 
-static void pg_hline(pg_struct *pg, u8g2_t *u8g2)
+static void pg_hline(u8g2_t *u8g2, pg_word_t x1, pg_word_t x2, pg_word_t y)
 {
-  pg_word_t x1, x2, y;
-  x1 = pg->pge[PG_LEFT].current_x;
-  x2 = pg->pge[PG_RIGHT].current_x;
-  y = pg->pge[PG_RIGHT].current_y;
-  
-  if ( y < 0 )
-    return;
-  if ( y >= u8g2_GetDisplayHeight(u8g2) )  // does not work for 256x64 display???
-    return;
+  if ( x1 < 0 )
+    x1 = 0;
+  if ( x2 > (pg_word_t)u8g2_GetDisplayWidth(u8g2) )
+    x2 = u8g2_GetDisplayWidth(u8g2);
   if ( x1 < x2 )
-  {
-    if ( x2 < 0 )
-      return;
-    if ( x1 >= u8g2_GetDisplayWidth(u8g2) )
-      return;
-    if ( x1 < 0 )
-      x1 = 0;
-    if ( x2 >= u8g2_GetDisplayWidth(u8g2) )
-      x2 = u8g2_GetDisplayWidth(u8g2);
     u8g2_DrawHLine(u8g2, x1, y, x2 - x1);
-  }
-  else
-  {
-    if ( x1 < 0 )
-      return;
-    if ( x2 >= u8g2_GetDisplayWidth(u8g2) )
-      return;
-    if ( x2 < 0 )
-      x1 = 0;
-    if ( x1 >= u8g2_GetDisplayWidth(u8g2) )
-      x1 = u8g2_GetDisplayWidth(u8g2);
-    u8g2_DrawHLine(u8g2, x2, y, x1 - x2);
-  }
-}
-
-static void pg_line_init(pg_struct * const pg, uint8_t pge_index)
-{
-  struct pg_edge_struct  *pge = pg->pge+pge_index;
-  uint8_t idx;  
-  pg_word_t x1;
-  pg_word_t y1;
-  pg_word_t x2;
-  pg_word_t y2;
-
-  idx = pge->curr_idx;  
-  y1 = pg->list[idx].y;
-  x1 = pg->list[idx].x;
-  idx = pge->next_idx_fn(pg, idx);
-  y2 = pg->list[idx].y;
-  x2 = pg->list[idx].x; 
-  pge->curr_idx = idx;
-  
-  pge_Init(pge, x1, y1, x2, y2);
 }
 
 static void pg_exec(pg_struct *pg, u8g2_t *u8g2)
 {
-  pg_word_t i = pg->total_scan_line_cnt;
+  pg_word_t min_x, max_x, min_y, max_y;
+  pg_word_t y, y_end, first;
+  uint16_t i, *link;
+  u8g2_pg_point_t *pge;
+
+  if ( pg->cnt < 3 )
+    return;
+
+  min_x = max_x = pg->list[0].x;
+  min_y = max_y = pg->list[0].y;
+  for( i = 1; i < pg->cnt; i++ )
+  {
+    if ( min_x > pg->list[i].x ) min_x = pg->list[i].x;
+    if ( max_x < pg->list[i].x ) max_x = pg->list[i].x;
+    if ( min_y > pg->list[i].y ) min_y = pg->list[i].y;
+    if ( max_y < pg->list[i].y ) max_y = pg->list[i].y;
+  }
+
+  /* scan lines min_y..max_y-1 within the display and the current page */
+  y = min_y;
+  if ( y < 0 )
+    y = 0;
+  if ( y < (pg_word_t)u8g2->user_y0 )
+    y = u8g2->user_y0;
+  y_end = max_y;
+  if ( y_end > (pg_word_t)u8g2_GetDisplayHeight(u8g2) )
+    y_end = u8g2_GetDisplayHeight(u8g2);
+  if ( y_end > (pg_word_t)u8g2->user_y1 )
+    y_end = u8g2->user_y1;
+  if ( y >= y_end )
+    return;
+  /* spans are within min_x..max_x-1 */
+  if ( max_x <= (pg_word_t)u8g2->user_x0 || min_x >= (pg_word_t)u8g2->user_x1 )
+    return;
 
-  /* first line is skipped if the min y line is not flat */
-  pg_line_init(pg, PG_LEFT);		
-  pg_line_init(pg, PG_RIGHT);
-  
-  if ( pg->is_min_y_not_flat != 0 )
+  pg->pending = PG_NONE;
+  pg->active = PG_NONE;
+  for( i = 0; i < pg->cnt; i++ )
   {
-    pge_Next(&(pg->pge[PG_LEFT])); 
-    pge_Next(&(pg->pge[PG_RIGHT]));
+    const u8g2_pg_point_t *q = pg->list + (i + 1 < pg->cnt ? i + 1 : 0);
+    /* horizontal edges and edges outside the scan lines are never active */
+    if ( pg->list[i].y == q->y )
+      continue;
+    if ( (pg->list[i].y < q->y ? q->y : pg->list[i].y) < y )
+      continue;
+    if ( (pg->list[i].y < q->y ? pg->list[i].y : q->y) >= y_end )
+      continue;
+    pge_Init(pg->list + i, pg->list + i, q);
+    pg_add_pending(pg, i);
   }
 
-  do
+  for( ; y < y_end; y++ )
   {
-    pg_hline(pg, u8g2);
-    while ( pge_Next(&(pg->pge[PG_LEFT])) == 0 )
+    /* activate the edges with y1 < y, or y1 == y on the first scan line */
+    while ( pg->pending != PG_NONE )
     {
-      pg_line_init(pg, PG_LEFT);
+      pge = pg->list + pg->pending;
+      first = pge->min_y == min_y ? pge->min_y : pge->min_y + 1;
+      if ( first > y )
+	break;
+      i = pg->pending;
+      pg->pending = pge->next;
+      if ( pge->max_y < y )
+	continue;
+      pge_Skip(pge, y);
+      pg_add_active(pg, i);
     }
-    while ( pge_Next(&(pg->pge[PG_RIGHT])) == 0 )
+
+    /* spans between pairs of active edges */
+    i = pg->active;
+    while ( i != PG_NONE && pg->list[i].next != PG_NONE )
     {
-      pg_line_init(pg, PG_RIGHT);
+      pg_hline(u8g2, pg->list[i].current_x, pg->list[pg->list[i].next].current_x, y);
+      i = pg->list[pg->list[i].next].next;
     }
-    i--;
-  } while( i > 0 );
+
+    /* remove edges which end on this scan line, advance the others */
+    link = &(pg->active);
+    while ( *link != PG_NONE )
+    {
+      pge = pg->list + *link;
+      if ( pge->current_y >= pge->max_y )
+      {
+	*link = pge->next;
+	continue;
+      }
+      pge_Next(pge);
+      link = &(pge->next);
+    }
+    pg_sort_active(pg);
+  }
 }
 
 /*===========================================*/
@@ -303,7 +293,12 @@ void pg_ClearPolygonXY(pg_struct *pg)
 
 void pg_AddPolygonXY(pg_struct *pg, int16_t x, int16_t y)
 {
-  if ( pg->cnt < PG_MAX_POINTS )
+  if ( pg->list == NULL )
+  {
+    pg->list = pg->built_in;
+    pg->size = PG_MAX_POINTS;
+  }
+  if ( pg->cnt < pg->size )
   {
     pg->list[pg->cnt].x = x;
     pg->list[pg->cnt].y = y;
@@ -313,13 +308,23 @@ void pg_AddPolygonXY(pg_struct *pg, int16_t x, int16_t y)
 
 void pg_DrawPolygon(pg_struct *pg, u8g2_t *u8g2)
 {
-  if ( pg_prepare(pg) == 0 )
-    return;
   pg_exec(pg, u8g2);
 }
 
 pg_struct u8g2_pg;
 
+void u8g2_SetPolygonBuffer(u8g2_pg_point_t *points, uint16_t size)
+{
+  u8g2_pg.list = points;
+  u8g2_pg.size = size;
+  if ( points == NULL || size == 0 )
+  {
+    u8g2_pg.list = u8g2_pg.built_in;
+    u8g2_pg.size = PG_MAX_POINTS;
+  }
+  u8g2_pg.cnt = 0;
+}
+
 void u8g2_ClearPolygonXY(void)
 {
   pg_ClearPolygonXY(&u8g2_pg);
@@ -343,4 +348,3 @@ void u8g2_DrawTriangle(u8g2_t *u8g2, int16_t x0, int16_t y0, int16_t x1, int16_t
   u8g2_AddPolygonXY(u8g2, x2, y2);
   u8g2_DrawPolygon(u8g2);
 }
-
@@ -60,6 +60,19 @@ void u8g2_SetupBuffer(u8g2_t *u8g2, uint8_t *buf, uint8_t tile_buf_height, u8g2_
   
   u8g2->draw_color = 1;
   u8g2->is_auto_page_clear = 1;
+
+#ifdef U8G2_WITH_SHADOW_BUFFER
+  u8g2->shadow_buf_ptr = NULL;
+  u8g2->is_shadow_valid = 0;
+#endif
+  u8g2->send_bytes = 0;
+  u8g2->send_runs = 0;
+#ifdef U8G2_WITH_GLYPH_CACHE
+  u8g2->glyph_cache = NULL;
+#endif
+#ifdef U8G2_WITH_FONT_INDEX
+  u8g2->font_index = NULL;
+#endif
   
   u8g2->cb = u8g2_cb;
   u8g2->cb->update(u8g2);
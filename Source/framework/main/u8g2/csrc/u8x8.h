@@ -104,6 +104,21 @@
 /* 26 May 2016: Obsolete */
 //#define U8X8_DEFAULT_FLIP_MODE 0
 
+/* Number of data bytes per I2C transfer of the ssd13xx/st75256 cad procedures. */
+/* Upstream uses 24 to fit the 32 byte Wire buffer of Arduino boards. */
+/* The ESP32 driver has no such limit, 128 moves a full tile row of a */
+/* 128 pixel wide display in one transfer. Must not exceed 255. */
+#ifndef U8X8_I2C_DATA_CHUNK
+#define U8X8_I2C_DATA_CHUNK 128
+#endif
+
+/* Define this for profiling counters, see u8x8_SetProfile() */
+/* With a u8x8_profile_t assigned, the drawing primitives (glyph, hvline, box, */
+/* bitmap) count their calls and the ticks spent, u8x8_cad_SendData() counts */
+/* the data bytes and all calls of the byte callback are timed as bus time. */
+/* Without this define the profiling code is not compiled at all. */
+//#define U8X8_WITH_PROFILE
+
 /*==========================================*/
 /* Includes */
 
@@ -313,6 +328,25 @@ struct u8x8_display_info_struct
 #define U8X8_PIN_NONE 255
 #endif
 
+#ifdef U8X8_WITH_PROFILE
+/* primitives of u8x8_profile_t, the ticks of a primitive include the */
+/* primitives it calls, e.g. the hvlines of a box or an uncached glyph */
+#define U8X8_PROFILE_GLYPH 0	/* u8g2 glyphs, cached or decoded */
+#define U8X8_PROFILE_HVLINE 1	/* u8g2_DrawHVLine() */
+#define U8X8_PROFILE_BOX 2	/* u8g2_DrawBox() */
+#define U8X8_PROFILE_BITMAP 3	/* u8g2_DrawBitmap(), u8g2_DrawXBM(), u8g2_DrawXBMP() */
+#define U8X8_PROFILE_BUS 4	/* calls of the byte callback */
+#define U8X8_PROFILE_CNT 5
+
+/* ticks are CPU cycles on the ESP32 and nanoseconds elsewhere, see u8x8_profile.c */
+typedef struct
+{
+  uint32_t count[U8X8_PROFILE_CNT];
+  uint32_t ticks[U8X8_PROFILE_CNT];
+  uint32_t data_bytes;		/* bytes passed to u8x8_cad_SendData() */
+} u8x8_profile_t;
+#endif
+
 struct u8x8_struct
 {
   const u8x8_display_info_t *display_info;
@@ -339,6 +373,10 @@ struct u8x8_struct
 #ifdef U8X8_WITH_USER_PTR
   void *user_ptr;
 #endif
+#ifdef U8X8_WITH_PROFILE
+  u8x8_profile_t *profile;	/* NULL: no profiling */
+  u8x8_msg_cb profile_byte_cb;	/* the byte callback while profiling */
+#endif
 #ifdef U8X8_USE_PINS 
   uint8_t pins[U8X8_PIN_CNT];	/* defines a pinlist: Mainly a list of pins for the Arduino Envionment, use U8X8_PIN_xxx to access */
 #endif
@@ -349,6 +387,24 @@ struct u8x8_struct
 #define u8x8_SetUserPtr(u8x8, p) ((u8x8)->user_ptr = (p))
 #endif
 
+/* u8x8_profile.c */
+#ifdef U8X8_WITH_PROFILE
+/* assign a profile after the setup of the display, NULL stops profiling */
+void u8x8_SetProfile(u8x8_t *u8x8, u8x8_profile_t *profile);
+/* clear the counters, e.g. before each frame */
+void u8x8_ResetProfile(u8x8_t *u8x8);
+uint32_t u8x8_profile_begin(u8x8_t *u8x8);
+void u8x8_profile_end(u8x8_t *u8x8, uint8_t id, uint32_t start);
+/* U8X8_PROFILE_VAR goes into the declarations of the profiled function */
+#define U8X8_PROFILE_VAR uint32_t u8x8_profile_start = 0;
+#define U8X8_PROFILE_BEGIN(u8x8) (u8x8_profile_start = u8x8_profile_begin(u8x8))
+#define U8X8_PROFILE_END(u8x8, id) u8x8_profile_end((u8x8), (id), u8x8_profile_start)
+#else
+#define U8X8_PROFILE_VAR
+#define U8X8_PROFILE_BEGIN(u8x8) ((void)0)
+#define U8X8_PROFILE_END(u8x8, id) ((void)0)
+#endif
+
 
 #define u8x8_GetCols(u8x8) ((u8x8)->display_info->tile_width)
 #define u8x8_GetRows(u8x8) ((u8x8)->display_info->tile_height)
@@ -107,6 +107,10 @@ uint8_t u8x8_cad_SendMultipleArg(u8x8_t *u8x8, uint8_t cnt, uint8_t arg)
 
 uint8_t u8x8_cad_SendData(u8x8_t *u8x8, uint8_t cnt, uint8_t *data)
 {
+#ifdef U8X8_WITH_PROFILE
+  if ( u8x8->profile != NULL )
+    u8x8->profile->data_bytes += cnt;
+#endif
   return u8x8->cad_cb(u8x8, U8X8_MSG_CAD_SEND_DATA, cnt, data);
 }
 
@@ -432,12 +436,13 @@ uint8_t u8x8_cad_ssd13xx_i2c(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *a
       /* Unfortunately, this can not be handled in the byte level drivers, */
       /* so this is done here. Even further, only 24 bytes will be sent, */
       /* because there will be another byte (DC) required during the transfer */
+      /* The chunk size is U8X8_I2C_DATA_CHUNK, see u8x8.h */
       p = arg_ptr;
-       while( arg_int > 24 )
+       while( arg_int > U8X8_I2C_DATA_CHUNK )
       {
-	u8x8_i2c_data_transfer(u8x8, 24, p);
-	arg_int-=24;
-	p+=24;
+	u8x8_i2c_data_transfer(u8x8, U8X8_I2C_DATA_CHUNK, p);
+	arg_int-=U8X8_I2C_DATA_CHUNK;
+	p+=U8X8_I2C_DATA_CHUNK;
       }
       u8x8_i2c_data_transfer(u8x8, arg_int, p);
       break;
@@ -478,11 +483,11 @@ uint8_t u8x8_cad_st75256_i2c(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *a
     case U8X8_MSG_CAD_SEND_DATA:
       /* see ssd13xx driver */
       p = arg_ptr;
-       while( arg_int > 24 )
+       while( arg_int > U8X8_I2C_DATA_CHUNK )
       {
-	u8x8_i2c_data_transfer(u8x8, 24, p);
-	arg_int-=24;
-	p+=24;
+	u8x8_i2c_data_transfer(u8x8, U8X8_I2C_DATA_CHUNK, p);
+	arg_int-=U8X8_I2C_DATA_CHUNK;
+	p+=U8X8_I2C_DATA_CHUNK;
       }
       u8x8_i2c_data_transfer(u8x8, arg_int, p);
       break;
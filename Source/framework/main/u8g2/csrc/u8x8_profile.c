@@ -0,0 +1,90 @@
+/*
+
+  u8x8_profile.c
+
+  Profiling counters, see U8X8_WITH_PROFILE in u8x8.h
+
+  The drawing primitives are wrapped with U8X8_PROFILE_BEGIN/END, which
+  add one call and the elapsed ticks to the assigned u8x8_profile_t. The
+  byte callback is replaced by u8x8_profile_byte_cb(), which times every
+  message to the original callback, so the bus time of all cad and
+  display procedures is included without touching them.
+
+  A tick is one CPU cycle on the ESP32 (CCOUNT register) and one
+  nanosecond on other targets, define U8X8_PROFILE_CLOCK() to use another
+  clock. The counters are 32 bit, reset them e.g. once per frame.
+
+*/
+
+#include "u8x8.h"
+#include <string.h>
+
+#ifdef U8X8_WITH_PROFILE
+
+#ifndef U8X8_PROFILE_CLOCK
+#if defined(__XTENSA__)
+#include <xtensa/hal.h>
+#define U8X8_PROFILE_CLOCK() xthal_get_ccount()
+#else
+#include <time.h>
+static uint32_t u8x8_profile_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000000UL + (uint32_t)ts.tv_nsec;
+}
+#define U8X8_PROFILE_CLOCK() u8x8_profile_clock()
+#endif
+#endif
+
+uint32_t u8x8_profile_begin(u8x8_t *u8x8)
+{
+  if ( u8x8->profile == NULL )
+    return 0;
+  return U8X8_PROFILE_CLOCK();
+}
+
+void u8x8_profile_end(u8x8_t *u8x8, uint8_t id, uint32_t start)
+{
+  if ( u8x8->profile == NULL )
+    return;
+  u8x8->profile->count[id]++;
+  u8x8->profile->ticks[id] += (uint32_t)(U8X8_PROFILE_CLOCK() - start);
+}
+
+static uint8_t u8x8_profile_byte_cb(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+  uint8_t result;
+  U8X8_PROFILE_VAR
+
+  U8X8_PROFILE_BEGIN(u8x8);
+  result = u8x8->profile_byte_cb(u8x8, msg, arg_int, arg_ptr);
+  U8X8_PROFILE_END(u8x8, U8X8_PROFILE_BUS);
+  return result;
+}
+
+void u8x8_SetProfile(u8x8_t *u8x8, u8x8_profile_t *profile)
+{
+  if ( profile != NULL )
+    memset(profile, 0, sizeof(u8x8_profile_t));
+
+  /* install or remove the timing wrapper around the byte callback */
+  if ( u8x8->profile == NULL && profile != NULL )
+  {
+    u8x8->profile_byte_cb = u8x8->byte_cb;
+    u8x8->byte_cb = u8x8_profile_byte_cb;
+  }
+  else if ( u8x8->profile != NULL && profile == NULL )
+  {
+    u8x8->byte_cb = u8x8->profile_byte_cb;
+  }
+  u8x8->profile = profile;
+}
+
+void u8x8_ResetProfile(u8x8_t *u8x8)
+{
+  if ( u8x8->profile != NULL )
+    memset(u8x8->profile, 0, sizeof(u8x8_profile_t));
+}
+
+#endif /* U8X8_WITH_PROFILE */
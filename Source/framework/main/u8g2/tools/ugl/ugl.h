@@ -33,6 +33,7 @@ void ugl_AddBytecode(uint8_t x);
 void ugl_ExecBytecode(void);
 void ugl_ResolveSymbols(void);
 void ugl_WriteBytecodeCArray(FILE *fp, const char *name);
+void ugl_WritePolicyImageHex(FILE *fp, const char *entry_proc);
 
 
 int ugl_GetLabel(const char *name);
@@ -244,4 +244,15 @@ void ugl_WriteBytecodeCArray(FILE *fp, const char *name)
     i++;
   }
   fprintf(fp, "\";\n\n"); 
-}
\ No newline at end of file
+}
+
+/* GridBallast policy image, see policy_vm.h: 'G' 'P' version 1 entry(16 bit) len(16 bit) code */
+void ugl_WritePolicyImageHex(FILE *fp, const char *entry_proc)
+{
+  uint16_t i;
+  uint16_t entry = ugl_GetLabelBytecodePos(ugl_GetLabel(entry_proc));
+  fprintf(fp, "4750%02x00%02x%02x%02x%02x", 1, entry>>8, entry&255, ugl_bytecode_len>>8, ugl_bytecode_len&255);
+  for( i = 0; i < ugl_bytecode_len; i++ )
+    fprintf(fp, "%02x", ugl_bytecode_array[i]);
+  fprintf(fp, "\n");
+}
@@ -398,6 +398,70 @@ void bc_fn_setItemPos(bc_t *bc)
 }
 
 
+/*======================================================*/
+/* GridBallast control policy builtins, see policy_vm.h */
+/* system state values are not available here, the getters return 0 */
+
+void bc_fn_sub(bc_t *bc)
+{
+  uint16_t v;
+  v = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, bc_pop_from_arg_stack(bc) - v);
+}
+
+void bc_fn_lt(bc_t *bc)
+{
+  uint16_t v;
+  v = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, bc_pop_from_arg_stack(bc) < v);
+}
+
+void bc_fn_gt(bc_t *bc)
+{
+  uint16_t v;
+  v = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, bc_pop_from_arg_stack(bc) > v);
+}
+
+void bc_fn_eq(bc_t *bc)
+{
+  uint16_t v;
+  v = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, bc_pop_from_arg_stack(bc) == v);
+}
+
+void bc_fn_and(bc_t *bc)
+{
+  uint16_t v, w;
+  v = bc_pop_from_arg_stack(bc);
+  w = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, v != 0 && w != 0);
+}
+
+void bc_fn_or(bc_t *bc)
+{
+  uint16_t v, w;
+  v = bc_pop_from_arg_stack(bc);
+  w = bc_pop_from_arg_stack(bc);
+  bc_push_on_arg_stack(bc, v != 0 || w != 0);
+}
+
+void bc_fn_not(bc_t *bc)
+{
+  bc_push_on_arg_stack(bc, bc_pop_from_arg_stack(bc) == 0);
+}
+
+void bc_fn_state(bc_t *bc)
+{
+  bc_push_on_arg_stack(bc, 0);
+}
+
+void bc_fn_actuate(bc_t *bc)
+{
+  bc_duplicate_arg_stack_top_value(bc);			/* goal is to leave a value on the stack */
+  printf("actuate %u\n", bc_pop_from_arg_stack(bc));
+}
+
 /*======================================================*/
 bc_buildin_fn bc_buildin_list[] = 
 {
@@ -409,6 +473,24 @@ bc_buildin_fn bc_buildin_list[] =
   /* 5 */ bc_fn_print,
   /* 6 */ bc_fn_setPos,	/* two args: x & y*/
   /* 7 */ bc_fn_setItemPos,	/* one args: item */
+  /* 8 */ bc_fn_sub,
+  /* 9 */ bc_fn_lt,
+  /* 10 */ bc_fn_gt,
+  /* 11 */ bc_fn_eq,
+  /* 12 */ bc_fn_and,
+  /* 13 */ bc_fn_or,
+  /* 14 */ bc_fn_not,
+  /* 15 */ bc_fn_state,	/* freq */
+  /* 16 */ bc_fn_state,	/* overFreq */
+  /* 17 */ bc_fn_state,	/* underFreq */
+  /* 18 */ bc_fn_state,	/* tempTop */
+  /* 19 */ bc_fn_state,	/* tempBottom */
+  /* 20 */ bc_fn_state,	/* setPoint */
+  /* 21 */ bc_fn_state,	/* mode */
+  /* 22 */ bc_fn_state,	/* heating */
+  /* 23 */ bc_fn_state,	/* power */
+  /* 24 */ bc_fn_actuate,	/* setSetPoint */
+  /* 25 */ bc_fn_actuate,	/* setMode */
 };
 
 
@@ -30,7 +30,7 @@ int ugl_read_filename(const char *name)
   ugl_input_fp = fopen(name, "r");
   if ( ugl_input_fp == NULL )
     return 0;
-  printf("file '%s'\n", name);
+  ugl_glog("file '%s'", name);
   if ( ugl_read_fp() == 0 )
     return fclose(ugl_input_fp), 0;
   fclose(ugl_input_fp);
@@ -44,12 +44,25 @@ void ugl_ExecBytecode(void)
   bc_exec(&bc, ugl_bytecode_array, 0);
 }
 
-int main(void)
+/*
+  ugl [file] [proc]
+  
+  file	source file, defaults to test.ugl
+  proc	if given, write a GridBallast policy image (hex) with "proc" as entry point
+*/
+int main(int argc, char **argv)
 {
+  if ( argc > 2 )
+    ugl_is_suppress_log = 1;
   ugl_InitBytecode();
-  ugl_read_filename("test.ugl");
+  ugl_read_filename(argc > 1 ? argv[1] : "test.ugl");
   ugl_ResolveSymbols();
+  if ( argc > 2 )
+  {
+    ugl_WritePolicyImageHex(stdout, argv[2]);
+    return 0;
+  }
   ugl_ExecBytecode();
   ugl_WriteBytecodeCArray(stdout, "code");
-  
+  return 0;
 }
\ No newline at end of file
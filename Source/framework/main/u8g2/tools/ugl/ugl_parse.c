@@ -58,6 +58,25 @@ struct ugl_buildin_cmd_struct ugl_buildin_cmd_list[] = {
   { /* code=*/ 5, 	/* name=*/ "print", 		/* args=*/ 1 },
   { /* code=*/ 6, 	/* name=*/ "setPos", 	/* args=*/ 2 },
   { /* code=*/ 7, 	/* name=*/ "setItemPos", /* args=*/ 1 },
+  /* GridBallast control policy builtins, see policy_vm.h */
+  { /* code=*/ 8, 	/* name=*/ "sub", 		/* args=*/ 2 },
+  { /* code=*/ 9, 	/* name=*/ "lt", 		/* args=*/ 2 },
+  { /* code=*/ 10, 	/* name=*/ "gt", 		/* args=*/ 2 },
+  { /* code=*/ 11, 	/* name=*/ "eq", 		/* args=*/ 2 },
+  { /* code=*/ 12, 	/* name=*/ "and", 		/* args=*/ 2 },
+  { /* code=*/ 13, 	/* name=*/ "or", 		/* args=*/ 2 },
+  { /* code=*/ 14, 	/* name=*/ "not", 		/* args=*/ 1 },
+  { /* code=*/ 15, 	/* name=*/ "freq", 		/* args=*/ 0 },
+  { /* code=*/ 16, 	/* name=*/ "overFreq", 	/* args=*/ 0 },
+  { /* code=*/ 17, 	/* name=*/ "underFreq", 	/* args=*/ 0 },
+  { /* code=*/ 18, 	/* name=*/ "tempTop", 	/* args=*/ 0 },
+  { /* code=*/ 19, 	/* name=*/ "tempBottom", 	/* args=*/ 0 },
+  { /* code=*/ 20, 	/* name=*/ "setPoint", 	/* args=*/ 0 },
+  { /* code=*/ 21, 	/* name=*/ "mode", 		/* args=*/ 0 },
+  { /* code=*/ 22, 	/* name=*/ "heating", 	/* args=*/ 0 },
+  { /* code=*/ 23, 	/* name=*/ "power", 		/* args=*/ 0 },
+  { /* code=*/ 24, 	/* name=*/ "setSetPoint", 	/* args=*/ 1 },
+  { /* code=*/ 25, 	/* name=*/ "setMode", 	/* args=*/ 1 },
 };
 
 
@@ -24,6 +24,8 @@
 #include "esp_request.h"
 #include "wifi_module.h"
 #include "util.h"
+#include "policy_vm.h"
+#include "rs_485_module.h"
 
 #define WIFI_SSID "CMU"
 #define WIFI_PASS ""
@@ -33,6 +35,13 @@
 #define TRANSDUCER_ID_TEMP_TOP    "5a01652df230cf7055615e57"
 #define TRANSDUCER_ID_GRID_FREQ   "5a9c8b4fa447657867c7a286"
 #define TRANSDUCER_ID_SET_POINT   "5a01655af230cf7055615e5b"
+/* define to download control policies (hex encoded policy images, see policy_vm.h) */
+//#define TRANSDUCER_ID_POLICY      "<transducer id>"
+/* define to upload the newest RS485 trace records (hex, see rs485_trace.h) */
+//#define TRANSDUCER_ID_RS485_TRACE "<transducer id>"
+
+/** @brief largest RS485 trace snapshot posted at once */
+#define RS485_TRACE_POST_SIZE 512
 
 const char * const wifi_task_name = "wifi_module_task";
 static const char *TAG = "wifi";
@@ -53,6 +62,10 @@ static const char * const USER_AGENT_HEADER = "User-Agent: gridballast1.1";
 
 static system_state_t system_state;
 
+/** @brief connection state for wifi_get_status() */
+static wifi_status_t wifi_status;
+static rwlock_t wifi_status_lock;
+
 /* Static function definitions */
 static void reset_transducer_response();
 
@@ -67,6 +80,11 @@ static esp_err_t event_handler(void *ctx, system_event_t *event) {
         break;
     case SYSTEM_EVENT_STA_GOT_IP:
         ESP_LOGI(TAG, "Got event got ip");
+        rwlock_writer_lock(&wifi_status_lock);
+        wifi_status.connected = 1;
+        snprintf(wifi_status.ip, sizeof(wifi_status.ip), IPSTR,
+                 IP2STR(&event->event_info.got_ip.ip_info.ip));
+        rwlock_writer_unlock(&wifi_status_lock);
         xEventGroupSetBits(wifi_event_group, CONNECTED_BIT);
         break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
@@ -75,6 +93,10 @@ static esp_err_t event_handler(void *ctx, system_event_t *event) {
            auto-reassociate. */
         esp_wifi_connect();
         xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
+        rwlock_writer_lock(&wifi_status_lock);
+        wifi_status.connected = 0;
+        wifi_status.ip[0] = '\0';
+        rwlock_writer_unlock(&wifi_status_lock);
         break;
     default:
         break;
@@ -86,6 +108,7 @@ static esp_err_t event_handler(void *ctx, system_event_t *event) {
  * @brief Initialize the wifi module
  */
 static void initialise_wifi(void) {
+    rwlock_init(&wifi_status_lock);
     tcpip_adapter_init();
     wifi_event_group = xEventGroupCreate();
     ESP_ERROR_CHECK( esp_event_loop_init(event_handler, NULL) );
@@ -110,6 +133,12 @@ static void initialise_wifi(void) {
                                                       mac[3], mac[4], mac[5]);
     ESP_LOGI(TAG, "My MAC Address: %s", mac_str);
 
+    rwlock_writer_lock(&wifi_status_lock);
+    strncpy(wifi_status.ssid, WIFI_SSID, sizeof(wifi_status.ssid) - 1);
+    strcpy(wifi_status.mac, mac_str);
+    wifi_status.started = 1;
+    rwlock_writer_unlock(&wifi_status_lock);
+
     ESP_ERROR_CHECK( esp_wifi_start() );
 
     reset_transducer_response();
@@ -234,14 +263,13 @@ static int parse_transducer_value(const char *response, const char *transducer_i
 }
 
 /**
- * @brief poll OpenChirp for the latest transducer value using the REST API
+ * @brief download the OpenChirp transducer index into transducer_response
  *
- * @param transducer_id OpenChirp transducer id
- * @param value         pointer that will be filled in with the latest numeric value
+ * @return 0 on success, -1 on request failure
  *
- * @return 0 on success, -1 on request or parse failure
+ * @note the caller must call reset_transducer_response() when done
  */
-static int get_transducer_value(const char *transducer_id, double *value) {
+static int fetch_transducers(void) {
     ESP_LOGI(TAG, "fetching transducers %s", BASE_URL);
     transducer_response = NULL;
     request_t *req = req_new(BASE_URL);
@@ -254,11 +282,23 @@ static int get_transducer_value(const char *transducer_id, double *value) {
     int status = req_perform(req);
     req_clean(req);
 
-    int ret = 0;
     if (status != 200) {
         ESP_LOGE(TAG, "Error receiving transducer value, received non-200 response: %d", status);
-        ret = -1;
+        return -1;
     }
+    return 0;
+}
+
+/**
+ * @brief poll OpenChirp for the latest transducer value using the REST API
+ *
+ * @param transducer_id OpenChirp transducer id
+ * @param value         pointer that will be filled in with the latest numeric value
+ *
+ * @return 0 on success, -1 on request or parse failure
+ */
+static int get_transducer_value(const char *transducer_id, double *value) {
+    int ret = fetch_transducers();
 
     if (ret == 0 && parse_transducer_value(transducer_response, transducer_id, value) != 0) {
         ESP_LOGE(TAG, "Error parsing transducer value");
@@ -273,6 +313,55 @@ static int get_transducer_value(const char *transducer_id, double *value) {
 
 }
 
+#ifdef TRANSDUCER_ID_POLICY
+/**
+ * @brief poll OpenChirp for a control policy and load it if it changed
+ *
+ * The policy transducer carries a hex encoded policy image. A new image is
+ * loaded into the policy interpreter and persisted to NVS so it survives
+ * a reboot without network access.
+ *
+ * @return 0 on success or if the policy is unchanged, -1 on failure
+ */
+static int update_policy(void) {
+    static char last_policy[2 * (POLICY_VM_IMAGE_HEADER_SIZE + POLICY_VM_MAX_CODE) + 1];
+    int ret = fetch_transducers();
+    cJSON *transducer_array = NULL;
+    const cJSON *transducer;
+
+    if (ret == 0) {
+        ret = -1;
+        transducer_array = cJSON_Parse(transducer_response);
+        cJSON_ArrayForEach(transducer, transducer_array) {
+            const cJSON *id_field = cJSON_GetObjectItemCaseSensitive(transducer, "_id");
+            const cJSON *value_field = cJSON_GetObjectItemCaseSensitive(transducer, "value");
+            if (id_field == NULL || value_field == NULL || !cJSON_IsString(value_field)) {
+                continue;
+            }
+            if (strcmp(id_field->valuestring, TRANSDUCER_ID_POLICY) != 0) {
+                continue;
+            }
+            ret = 0;
+            if (strcmp(value_field->valuestring, last_policy) == 0) {
+                break;
+            }
+            if (policy_vm_load_hex(value_field->valuestring) != POLICY_VM_SUCCESS) {
+                ESP_LOGE(TAG, "Rejected control policy");
+                ret = -1;
+                break;
+            }
+            strncpy(last_policy, value_field->valuestring, sizeof(last_policy) - 1);
+            policy_vm_store_nvs();
+            ESP_LOGI(TAG, "Loaded new control policy");
+            break;
+        }
+        cJSON_Delete(transducer_array);
+    }
+    reset_transducer_response();
+    return ret;
+}
+#endif /* TRANSDUCER_ID_POLICY */
+
 /**
  * @brief post a transducer value to OpenChirp using the REST API
  *
@@ -312,6 +401,33 @@ static int send_transducer_value(const char *transducer_id, const char *value) {
     return 0;
 }
 
+#ifdef TRANSDUCER_ID_RS485_TRACE
+/**
+ * @brief post the newest RS485 trace records to OpenChirp, hex encoded
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int send_rs485_trace(void) {
+    uint8_t snapshot[RS485_TRACE_POST_SIZE];
+    char *hex = malloc(2 * RS485_TRACE_POST_SIZE + 1);
+    size_t len;
+    int err;
+
+    if (hex == NULL) {
+        ESP_LOGE(TAG, "Malloc failed");
+        return -1;
+    }
+    len = rs485_get_trace(snapshot, sizeof(snapshot));
+    for (size_t i = 0; i < len; i++) {
+        sprintf(&hex[2 * i], "%02x", snapshot[i]);
+    }
+    hex[2 * len] = '\0';
+    err = send_transducer_value(TRANSDUCER_ID_RS485_TRACE, hex);
+    free(hex);
+    return err;
+}
+#endif /* TRANSDUCER_ID_RS485_TRACE */
+
 /**
  * @brief post data from system state to OpenChirp
  *
@@ -383,6 +499,14 @@ static void wifi_task_fn( void *pv_parameters ) {
             rwlock_reader_unlock(&system_state_lock);
         }
 
+#ifdef TRANSDUCER_ID_POLICY
+        update_policy();
+#endif
+
+#ifdef TRANSDUCER_ID_RS485_TRACE
+        send_rs485_trace();
+#endif
+
         for (int countdown = 9; countdown >= 0; countdown--) {
             ESP_LOGI(TAG, "%d... ", countdown);
             vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -395,6 +519,17 @@ static void wifi_task_fn( void *pv_parameters ) {
  *********** INTERFACE FUNCTIONS *********
  *****************************************/
 
+void wifi_get_status( wifi_status_t *dest ) {
+    /* the lock only exists once the module has been started */
+    if (!wifi_status.started) {
+        memset(dest, 0, sizeof(*dest));
+        return;
+    }
+    rwlock_reader_lock(&wifi_status_lock);
+    memcpy(dest, &wifi_status, sizeof(*dest));
+    rwlock_reader_unlock(&wifi_status_lock);
+}
+
 /**
  * @brief initialization task that starts all other threads
  *
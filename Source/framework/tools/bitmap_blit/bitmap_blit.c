@@ -0,0 +1,237 @@
+/**
+ * @file bitmap_blit.c
+ *
+ * @brief host validation and timing of the u8g2 bitmap blit engine
+ *
+ * Draws random bitmaps of many sizes at many positions, including partly
+ * or completely outside the display, with all draw colors, solid and
+ * transparent, onto random buffer contents, once with the blit engine
+ * (U8G2_BITMAP_SPEED_OPTIMIZATION) and once pixel by pixel, and the
+ * buffers have to be identical. This is done for u8g2_DrawXBM(),
+ * u8g2_DrawXBMP(), u8g2_DrawBitmap() and u8g2_DrawTileBitmap() with the
+ * XBM converted by u8g2_ConvertXBMToTileBitmap(), in the full buffer and
+ * in the one and two tile row page buffers of the SSD1309. The pixel by
+ * pixel procedures are selected by installing a wrapper around
+ * u8g2_ll_hvline_vertical_top_lsb, which the blit engine does not
+ * recognize. Then both are timed for a few typical bitmaps.
+ *
+ *   bitmap_blit [-s seed]
+ *
+ * Exit status is 1 if any bitmap differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+#define MAX_SIZE 40
+
+/** @brief a buffer of the SSD1309 */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+} layout_t;
+
+static const layout_t layouts[] = {
+  { "full buffer", u8g2_Setup_ssd1309_i2c_128x64_noname0_f },
+  { "page buffer 1", u8g2_Setup_ssd1309_i2c_128x64_noname0_1 },
+  { "page buffer 2", u8g2_Setup_ssd1309_i2c_128x64_noname0_2 },
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+#define FORMAT_XBM 0
+#define FORMAT_XBMP 1
+#define FORMAT_BITMAP 2
+#define FORMAT_TILE 3
+#define FORMATS 4
+static const char * const format_names[FORMATS] = { "xbm", "xbmp", "bitmap", "tile" };
+
+/* bitmap widths and heights, XBM and u8glib bitmaps use w rounded up to 8 for DrawBitmap */
+static const int sizes[] = { 1, 2, 3, 7, 8, 9, 15, 16, 17, 24, 33, 40 };
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+/* origins: inside, at the edges and wrapped around to the left or top */
+static const u8g2_uint_t xs[] = { 0, 5, 100, 250 };
+#define XS (sizeof(xs) / sizeof(xs[0]))
+static const u8g2_uint_t ys[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 15, 16, 17, 23, 31, 40, 47, 50, 55, 56, 60, 63, 70, 252 };
+#define YS (sizeof(ys) / sizeof(ys[0]))
+
+/* bitmaps to time: x, y, w, h */
+static const int timed[][4] = {
+  { 16, 16, 16, 16 }, { 13, 21, 16, 16 }, { 0, 0, 128, 64 }, { 3, 5, 122, 50 }
+};
+#define TIMED (sizeof(timed) / sizeof(timed[0]))
+
+static uint8_t xbm[MAX_SIZE * MAX_SIZE / 8 + MAX_SIZE];
+static uint8_t tiles[MAX_SIZE * MAX_SIZE / 8 + MAX_SIZE];
+static uint8_t big_xbm[WIDTH * HEIGHT / 8];
+static uint8_t big_tiles[WIDTH * HEIGHT / 8];
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+/* same pixels as u8g2_ll_hvline_vertical_top_lsb, but not taken for the blit engine */
+static void ref_ll_hvline( u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir ) {
+  u8g2_ll_hvline_vertical_top_lsb(u8g2, x, y, len, dir);
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void draw( u8g2_t *u8g2, int format, u8g2_uint_t x, u8g2_uint_t y, int w, int h,
+                  const uint8_t *xbm_data, const uint8_t *tile_data ) {
+  switch ( format ) {
+  case FORMAT_XBM:
+    u8g2_DrawXBM(u8g2, x, y, w, h, xbm_data);
+    break;
+  case FORMAT_XBMP:
+    u8g2_DrawXBMP(u8g2, x, y, w, h, xbm_data);
+    break;
+  case FORMAT_BITMAP:
+    u8g2_DrawBitmap(u8g2, x, y, (w + 7) / 8, h, xbm_data);
+    break;
+  default:
+    u8g2_DrawTileBitmap(u8g2, x, y, w, h, tile_data);
+    break;
+  }
+}
+
+/* draw the bitmap page by page over init, the result in frame */
+static void render( u8g2_t *u8g2, int blit, int format, u8g2_uint_t x, u8g2_uint_t y, int w, int h,
+                    const uint8_t *init, uint8_t *frame ) {
+  uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+  int rows, row;
+
+  u8g2->ll_hvline = blit ? u8g2_ll_hvline_vertical_top_lsb : ref_ll_hvline;
+  u8g2_FirstPage(u8g2);
+  do {
+    row = u8g2_GetBufferCurrTileRow(u8g2);
+    rows = u8g2_GetBufferTileHeight(u8g2);
+    if ( row + rows > HEIGHT / 8 ) {
+      rows = HEIGHT / 8 - row;
+    }
+    memcpy(buf, init + row * WIDTH, rows * WIDTH);
+    draw(u8g2, format, x, y, w, h, xbm, tiles);
+    memcpy(frame + row * WIDTH, buf, rows * WIDTH);
+  } while ( u8g2_NextPage(u8g2) );
+}
+
+/* every size at every position, returns the number of mismatches */
+static long validate( const layout_t *l, u8g2_t *u8g2 ) {
+  static uint8_t init[FRAME_SIZE], ref[FRAME_SIZE], blit[FRAME_SIZE];
+  long errors = 0;
+  long bitmaps = 0;
+  int wi, hi, xi, yi, w, h, i, format, color, transparent;
+
+  l->setup(u8g2, U8G2_R0, byte_cb, gpio_cb);
+  u8g2_SetAutoPageClear(u8g2, 0);
+  for ( wi = 0; wi < SIZES; wi++ ) {
+    for ( hi = 0; hi < SIZES; hi++ ) {
+      w = sizes[wi];
+      h = sizes[hi];
+      for ( i = 0; i < sizeof(xbm); i++ ) {
+        xbm[i] = rand();
+      }
+      for ( i = 0; i < FRAME_SIZE; i++ ) {
+        init[i] = rand();
+      }
+      for ( format = 0; format < FORMATS; format++ ) {
+        /* DrawBitmap draws whole bytes, the tile bitmap is converted from the XBM */
+        if ( format == FORMAT_BITMAP && w % 8 != 0 ) {
+          continue;
+        }
+        if ( format == FORMAT_TILE ) {
+          u8g2_ConvertXBMToTileBitmap(w, h, xbm, tiles);
+        }
+        for ( xi = 0; xi < XS; xi++ ) {
+          for ( yi = 0; yi < YS; yi++ ) {
+            for ( color = 0; color <= 2; color++ ) {
+              for ( transparent = 0; transparent <= 1; transparent++ ) {
+                u8g2_SetDrawColor(u8g2, color);
+                u8g2_SetBitmapMode(u8g2, transparent);
+                render(u8g2, 0, format == FORMAT_TILE ? FORMAT_XBM : format, xs[xi], ys[yi], w, h, init, ref);
+                render(u8g2, 1, format, xs[xi], ys[yi], w, h, init, blit);
+                if ( memcmp(ref, blit, FRAME_SIZE) != 0 ) {
+                  if ( errors < 10 ) {
+                    printf("%s: %s mismatch %dx%d x=%d y=%d color=%d transparent=%d\n",
+                           l->name, format_names[format], w, h, xs[xi], ys[yi], color, transparent);
+                  }
+                  errors++;
+                }
+                bitmaps++;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %ld bitmaps, %ld mismatches\n", l->name, bitmaps, errors);
+  return errors;
+}
+
+/* ns per bitmap */
+static double time_bitmap( u8g2_t *u8g2, int blit, int format, const int *b ) {
+  double start;
+  long n = 2000;
+  long i;
+
+  u8g2->ll_hvline = blit ? u8g2_ll_hvline_vertical_top_lsb : ref_ll_hvline;
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    draw(u8g2, format, b[0], b[1], b[2], b[3], big_xbm, big_tiles);
+  }
+  return (now_ns() - start) / n;
+}
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  long errors = 0;
+  double t_ref, t_xbm, t_tile;
+  int opt;
+  int i;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    errors += validate(&layouts[i], &u8g2);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  for ( i = 0; i < sizeof(big_xbm); i++ ) {
+    big_xbm[i] = rand();
+  }
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  for ( i = 0; i < TIMED; i++ ) {
+    u8g2_ConvertXBMToTileBitmap(timed[i][2], timed[i][3], big_xbm, big_tiles);
+    t_ref = time_bitmap(&u8g2, 0, FORMAT_XBM, timed[i]);
+    t_xbm = time_bitmap(&u8g2, 1, FORMAT_XBM, timed[i]);
+    t_tile = time_bitmap(&u8g2, 1, FORMAT_TILE, timed[i]);
+    printf("%dx%d at %d,%d: %.0f ns pixel by pixel, %.0f ns xbm blit (%.1fx), %.0f ns tile blit (%.1fx)\n",
+           timed[i][2], timed[i][3], timed[i][0], timed[i][1], t_ref, t_xbm, t_ref / t_xbm, t_tile, t_ref / t_tile);
+  }
+  return errors ? 1 : 0;
+}
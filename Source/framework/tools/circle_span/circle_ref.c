@@ -0,0 +1,19 @@
+/*
+
+  circle_ref.c
+
+  Reference for circle_span.c: u8g2_circle.c without
+  U8G2_CIRCLE_SPEED_OPTIMIZATION, the drawing procedures renamed to ref_*.
+
+*/
+
+#include "u8g2.h"
+
+#undef U8G2_CIRCLE_SPEED_OPTIMIZATION
+
+#define u8g2_DrawCircle ref_DrawCircle
+#define u8g2_DrawDisc ref_DrawDisc
+#define u8g2_DrawEllipse ref_DrawEllipse
+#define u8g2_DrawFilledEllipse ref_DrawFilledEllipse
+
+#include "u8g2_circle.c"
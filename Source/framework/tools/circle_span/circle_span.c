@@ -0,0 +1,217 @@
+/**
+ * @file circle_span.c
+ *
+ * @brief host validation and timing of the u8g2 circle and disc spans
+ *
+ * Draws circles and discs of every radius up to RAD_MAX and a few larger
+ * ones at many centers, including partly or completely outside the
+ * display and wrapped around to the left or top, with several quadrant
+ * options and all draw colors onto random buffer contents, once with
+ * u8g2_DrawCircle() and u8g2_DrawDisc() (U8G2_CIRCLE_SPEED_OPTIMIZATION)
+ * and once with the pixel and vline procedures built from the same
+ * source in circle_ref.c, and the buffers have to be identical. This is
+ * done with the full buffer and the one and two tile row page buffers of
+ * the SSD1309, with U8G2_R0, U8G2_R1 and U8G2_R2.
+ *
+ * Then both are timed for a few circles and discs, as a full frame and
+ * as a picture loop of 8 pages.
+ *
+ *   circle_span [-s seed]
+ *
+ * Exit status is 1 if any circle or disc differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+#define RAD_MAX 70
+
+void ref_DrawCircle(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option);
+void ref_DrawDisc(u8g2_t *u8g2, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option);
+
+/** @brief a buffer of the SSD1309 with a rotation */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+  const u8g2_cb_t *rotation;
+} layout_t;
+
+static const layout_t layouts[] = {
+  { "full buffer, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_f, U8G2_R0 },
+  { "page buffer 1, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R0 },
+  { "page buffer 2, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_2, U8G2_R0 },
+  { "full buffer, R1", u8g2_Setup_ssd1309_i2c_128x64_noname0_f, U8G2_R1 },
+  { "page buffer 1, R1", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R1 },
+  { "page buffer 1, R2", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R2 },
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+/* radii beyond RAD_MAX */
+static const u8g2_uint_t big_rads[] = { 90, 100, 127 };
+#define BIG_RADS (sizeof(big_rads) / sizeof(big_rads[0]))
+/* centers: inside, at the edges, outside and wrapped around to the left or top */
+static const u8g2_uint_t xs[] = { 0, 1, 5, 30, 64, 120, 127, 140, 200, 250 };
+#define XS (sizeof(xs) / sizeof(xs[0]))
+static const u8g2_uint_t ys[] = { 0, 3, 20, 32, 60, 63, 70, 250 };
+#define YS (sizeof(ys) / sizeof(ys[0]))
+static const uint8_t options[] = {
+  U8G2_DRAW_ALL, U8G2_DRAW_UPPER_RIGHT, U8G2_DRAW_UPPER_LEFT, U8G2_DRAW_LOWER_LEFT, U8G2_DRAW_LOWER_RIGHT,
+  U8G2_DRAW_UPPER_RIGHT | U8G2_DRAW_UPPER_LEFT, U8G2_DRAW_LOWER_RIGHT | U8G2_DRAW_LOWER_LEFT,
+  U8G2_DRAW_UPPER_RIGHT | U8G2_DRAW_LOWER_LEFT
+};
+#define OPTIONS (sizeof(options) / sizeof(options[0]))
+
+/* circles and discs to time: x0, y0, rad, option */
+static const int timed[][4] = {
+  { 64, 32, 10, U8G2_DRAW_ALL }, { 64, 32, 30, U8G2_DRAW_ALL },
+  { 64, 63, 60, U8G2_DRAW_UPPER_RIGHT | U8G2_DRAW_UPPER_LEFT }
+};
+#define TIMED (sizeof(timed) / sizeof(timed[0]))
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void draw( u8g2_t *u8g2, int span, int disc, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option ) {
+  if ( disc ) {
+    (span ? u8g2_DrawDisc : ref_DrawDisc)(u8g2, x0, y0, rad, option);
+  } else {
+    (span ? u8g2_DrawCircle : ref_DrawCircle)(u8g2, x0, y0, rad, option);
+  }
+}
+
+/* draw page by page over init, the result in frame */
+static void render( u8g2_t *u8g2, int span, int disc, u8g2_uint_t x0, u8g2_uint_t y0, u8g2_uint_t rad, uint8_t option,
+                    const uint8_t *init, uint8_t *frame ) {
+  uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+  int rows, row;
+
+  u8g2_FirstPage(u8g2);
+  do {
+    row = u8g2_GetBufferCurrTileRow(u8g2);
+    rows = u8g2_GetBufferTileHeight(u8g2);
+    if ( row + rows > HEIGHT / 8 ) {
+      rows = HEIGHT / 8 - row;
+    }
+    memcpy(buf, init + row * WIDTH, rows * WIDTH);
+    draw(u8g2, span, disc, x0, y0, rad, option);
+    memcpy(frame + row * WIDTH, buf, rows * WIDTH);
+  } while ( u8g2_NextPage(u8g2) );
+}
+
+/* every radius at every center, returns the number of mismatches */
+static long validate( const layout_t *l, u8g2_t *u8g2 ) {
+  static uint8_t init[FRAME_SIZE], ref[FRAME_SIZE], span[FRAME_SIZE];
+  long errors = 0;
+  long shapes = 0;
+  int r, xi, yi, o, i, color, disc;
+  u8g2_uint_t rad;
+
+  l->setup(u8g2, l->rotation, byte_cb, gpio_cb);
+  u8g2_SetAutoPageClear(u8g2, 0);
+  for ( r = 0; r <= RAD_MAX + BIG_RADS; r++ ) {
+    rad = r <= RAD_MAX ? r : big_rads[r - RAD_MAX - 1];
+    for ( i = 0; i < FRAME_SIZE; i++ ) {
+      init[i] = rand();
+    }
+    for ( xi = 0; xi < XS; xi++ ) {
+      for ( yi = 0; yi < YS; yi++ ) {
+        for ( o = 0; o < OPTIONS; o++ ) {
+          for ( color = 0; color <= 2; color++ ) {
+            for ( disc = 0; disc <= 1; disc++ ) {
+              u8g2_SetDrawColor(u8g2, color);
+              render(u8g2, 0, disc, xs[xi], ys[yi], rad, options[o], init, ref);
+              render(u8g2, 1, disc, xs[xi], ys[yi], rad, options[o], init, span);
+              if ( memcmp(ref, span, FRAME_SIZE) != 0 ) {
+                if ( errors < 10 ) {
+                  printf("%s: %s mismatch x0=%d y0=%d rad=%d option=0x%02x color=%d\n",
+                         l->name, disc ? "disc" : "circle", xs[xi], ys[yi], rad, options[o], color);
+                }
+                errors++;
+              }
+              shapes++;
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %ld circles and discs, %ld mismatches\n", l->name, shapes, errors);
+  return errors;
+}
+
+/* ns per picture loop */
+static double time_shape( u8g2_t *u8g2, int span, int disc, const int *c ) {
+  double start;
+  long n = 20000;
+  long i;
+
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    u8g2_FirstPage(u8g2);
+    do {
+      draw(u8g2, span, disc, c[0], c[1], c[2], c[3]);
+    } while ( u8g2_NextPage(u8g2) );
+  }
+  return (now_ns() - start) / n;
+}
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  long errors = 0;
+  double t_ref, t_span;
+  int opt;
+  int i, page, disc;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    errors += validate(&layouts[i], &u8g2);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  for ( page = 0; page <= 1; page++ ) {
+    if ( page ) {
+      u8g2_Setup_ssd1309_i2c_128x64_noname0_1(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+    } else {
+      u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+    }
+    for ( i = 0; i < TIMED; i++ ) {
+      for ( disc = 0; disc <= 1; disc++ ) {
+        t_ref = time_shape(&u8g2, 0, disc, timed[i]);
+        t_span = time_shape(&u8g2, 1, disc, timed[i]);
+        printf("%s r=%d option=0x%02x, %s: %.0f ns pixels and vlines, %.0f ns spans, %.1fx\n",
+               disc ? "disc" : "circle", timed[i][2], timed[i][3], page ? "8 pages" : "full buffer",
+               t_ref, t_span, t_ref / t_span);
+      }
+    }
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,447 @@
+/**
+ * @file cta2045_link_check.c
+ *
+ * @brief Host check of the CTA-2045 link layer with fragmented byte streams
+ *
+ * Feeds byte streams into cta2045_link_rx() whole and split at every
+ * possible boundary into two and three pieces, and checks the frames
+ * delivered, the bytes sent back (link ACK/NAK, resent messages), the
+ * send completions and the link counters against the expected ones for
+ * every split. The streams:
+ *   - a basic DR message
+ *   - a link ACK and a link NAK for a message waiting for its ACK
+ *   - messages merged back to back
+ *   - a message, its ACK and a vendor frame merged back to back
+ *   - a message with a bad Fletcher checksum, followed by a good one
+ * Then the inter-character timeout is checked with a gap before every
+ * byte of a message, and the retries and the ACK timeout with
+ * cta2045_link_poll().
+ *
+ *   cta2045_link_check
+ *
+ * Exit status is 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "cta2045_link.h"
+#include "cta2045_app.h"
+
+#define MAX_STREAM 96
+#define MAX_FRAMES 4
+#define MAX_TX 512
+
+/** @brief a frame delivered to the receive callback */
+typedef struct {
+  cta2045_frame_kind_t kind;
+  uint16_t msg_type;
+  uint16_t len;
+  uint8_t payload[CTA2045_MAX_FRAME];
+} rec_frame_t;
+
+/** @brief everything the link did */
+typedef struct {
+  int frame_cnt;
+  rec_frame_t frames[MAX_FRAMES];
+  uint8_t tx[MAX_TX];
+  size_t tx_len;
+  int done_cnt;
+  int done_result;
+} record_t;
+
+/** @brief a byte stream and what the link has to do with it */
+typedef struct {
+  const char *name;
+  uint8_t stream[MAX_STREAM];
+  size_t len;
+  int pending;                  /* a message waits for its ACK */
+  record_t expect;
+  cta2045_link_stats_t stats;
+} case_t;
+
+static const uint8_t shed[2] = { CTA2045_OP_SHED, 0x00 };
+static const uint8_t end_shed[2] = { CTA2045_OP_END_SHED, 0x00 };
+static const uint8_t oper_state_req[2] = { CTA2045_OP_OPER_STATE_REQ, 0x00 };
+static const uint8_t link_ack[2] = { CTA2045_LINK_ACK, 0x00 };
+static const uint8_t nak_checksum[2] = { CTA2045_LINK_NAK, CTA2045_NAK_CHECKSUM };
+static const uint8_t nak_timeout[2] = { CTA2045_LINK_NAK, CTA2045_NAK_TIMEOUT };
+static const uint8_t vendor_poll[2] = { 0x87, 0x00 };
+
+static long errors;
+static long runs;
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static void fail( const char *fmt, ... ) {
+  va_list ap;
+
+  if ( errors < 20 ) {
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+  }
+  errors++;
+}
+
+static void rec_tx( const uint8_t *data, size_t len, void *ctx ) {
+  record_t *r = ctx;
+
+  if ( r->tx_len + len <= MAX_TX ) {
+    memcpy(r->tx + r->tx_len, data, len);
+  }
+  r->tx_len += len;
+}
+
+static void rec_rx( const cta2045_frame_t *frame, void *ctx ) {
+  record_t *r = ctx;
+  rec_frame_t *f;
+
+  if ( r->frame_cnt < MAX_FRAMES ) {
+    f = &r->frames[r->frame_cnt];
+    f->kind = frame->kind;
+    f->msg_type = frame->msg_type;
+    f->len = frame->len;
+    memcpy(f->payload, frame->payload, frame->len);
+  }
+  r->frame_cnt++;
+}
+
+static void rec_done( int result, uint16_t msg_type, void *ctx ) {
+  record_t *r = ctx;
+
+  r->done_cnt++;
+  r->done_result = result;
+}
+
+static void add_bytes( uint8_t *dst, size_t *len, const uint8_t *data, size_t n ) {
+  memcpy(dst + *len, data, n);
+  *len += n;
+}
+
+/* append a basic DR message to the stream, returns its length */
+static size_t add_message( case_t *c, const uint8_t *payload, uint16_t len ) {
+  int n = cta2045_build_message(c->stream + c->len, MAX_STREAM - c->len, CTA2045_MSG_BASIC_DR, payload, len);
+
+  c->len += n;
+  return n;
+}
+
+static void expect_message( case_t *c, const uint8_t *payload, uint16_t len ) {
+  rec_frame_t *f = &c->expect.frames[c->expect.frame_cnt++];
+
+  f->kind = CTA2045_FRAME_MESSAGE;
+  f->msg_type = CTA2045_MSG_BASIC_DR;
+  f->len = len;
+  memcpy(f->payload, payload, len);
+}
+
+static void expect_vendor( case_t *c, const uint8_t *data, uint16_t len ) {
+  rec_frame_t *f = &c->expect.frames[c->expect.frame_cnt++];
+
+  f->kind = CTA2045_FRAME_VENDOR;
+  f->msg_type = 0;
+  f->len = len;
+  memcpy(f->payload, data, len);
+}
+
+static void expect_tx( case_t *c, const uint8_t *data, size_t len ) {
+  add_bytes(c->expect.tx, &c->expect.tx_len, data, len);
+}
+
+/* a link with the message shed waiting for its ACK, if pending */
+static void start_link( cta2045_link_t *link, record_t *r, int pending ) {
+  memset(r, 0, sizeof(*r));
+  cta2045_link_init(link, rec_tx, rec_rx, rec_done, r);
+  if ( pending ) {
+    cta2045_link_send(link, CTA2045_MSG_BASIC_DR, shed, sizeof(shed), 0);
+    r->tx_len = 0;
+  }
+}
+
+static int same_record( const record_t *a, const record_t *b ) {
+  int i;
+
+  if ( a->frame_cnt != b->frame_cnt || a->tx_len != b->tx_len ||
+       a->done_cnt != b->done_cnt || (a->done_cnt && a->done_result != b->done_result) ) {
+    return 0;
+  }
+  if ( memcmp(a->tx, b->tx, a->tx_len) != 0 ) {
+    return 0;
+  }
+  for ( i = 0; i < a->frame_cnt && i < MAX_FRAMES; i++ ) {
+    if ( a->frames[i].kind != b->frames[i].kind || a->frames[i].msg_type != b->frames[i].msg_type ||
+         a->frames[i].len != b->frames[i].len ||
+         memcmp(a->frames[i].payload, b->frames[i].payload, a->frames[i].len) != 0 ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* feed the stream in pieces ending at cuts[], 1 ms apart, then let the line go idle */
+static void run_split( const case_t *c, const size_t *cuts, int cut_cnt ) {
+  cta2045_link_t link;
+  cta2045_link_stats_t stats;
+  record_t got;
+  size_t pos = 0, end;
+  uint32_t t = 1;
+  int i;
+
+  start_link(&link, &got, c->pending);
+  for ( i = 0; i <= cut_cnt; i++ ) {
+    end = i < cut_cnt ? cuts[i] : c->len;
+    cta2045_link_rx(&link, c->stream + pos, end - pos, t++);
+    pos = end;
+  }
+  cta2045_link_poll(&link, t + CTA2045_VENDOR_GAP_MS);
+  cta2045_link_get_stats(&link, &stats);
+  runs++;
+
+  if ( !same_record(&got, &c->expect) || memcmp(&stats, &c->stats, sizeof(stats)) != 0 ) {
+    fail("%s: mismatch, split at %d %d: %d frames, %d tx bytes, %d done, %u messages, %u checksum errors",
+         c->name, cut_cnt > 0 ? (int)cuts[0] : -1, cut_cnt > 1 ? (int)cuts[1] : -1,
+         got.frame_cnt, (int)got.tx_len, got.done_cnt, stats.messages_rx, stats.checksum_errors);
+  }
+}
+
+/* the stream whole and split into two and three pieces at every boundary */
+static void run_case( const case_t *c ) {
+  size_t cuts[2] = { 0, 0 };
+  long before = errors;
+  long n = runs;
+
+  run_split(c, cuts, 0);
+  for ( cuts[0] = 1; cuts[0] < c->len; cuts[0]++ ) {
+    run_split(c, cuts, 1);
+    for ( cuts[1] = cuts[0] + 1; cuts[1] < c->len; cuts[1]++ ) {
+      run_split(c, cuts, 2);
+    }
+  }
+  printf("%s: %zu bytes, %ld splits, %s\n", c->name, c->len, runs - n, errors == before ? "ok" : "FAIL");
+}
+
+static void check_streams( void ) {
+  static case_t c;
+  uint8_t resent[CTA2045_MAX_FRAME];
+  size_t start;
+  int n;
+
+  memset(&c, 0, sizeof(c));
+  c.name = "basic DR message";
+  add_message(&c, shed, sizeof(shed));
+  expect_message(&c, shed, sizeof(shed));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  c.stats.messages_rx = 1;
+  run_case(&c);
+
+  memset(&c, 0, sizeof(c));
+  c.name = "link ACK";
+  c.pending = 1;
+  add_bytes(c.stream, &c.len, link_ack, sizeof(link_ack));
+  c.expect.done_cnt = 1;
+  c.expect.done_result = CTA2045_SUCCESS;
+  c.stats.messages_tx = 1;
+  c.stats.acks_rx = 1;
+  run_case(&c);
+
+  memset(&c, 0, sizeof(c));
+  c.name = "link NAK";
+  c.pending = 1;
+  add_bytes(c.stream, &c.len, nak_checksum, sizeof(nak_checksum));
+  n = cta2045_build_message(resent, sizeof(resent), CTA2045_MSG_BASIC_DR, shed, sizeof(shed));
+  expect_tx(&c, resent, n);
+  c.stats.messages_tx = 1;
+  c.stats.naks_rx = 1;
+  c.stats.retries = 1;
+  run_case(&c);
+
+  memset(&c, 0, sizeof(c));
+  c.name = "merged messages";
+  add_message(&c, shed, sizeof(shed));
+  add_message(&c, end_shed, sizeof(end_shed));
+  add_message(&c, oper_state_req, sizeof(oper_state_req));
+  expect_message(&c, shed, sizeof(shed));
+  expect_message(&c, end_shed, sizeof(end_shed));
+  expect_message(&c, oper_state_req, sizeof(oper_state_req));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  c.stats.messages_rx = 3;
+  run_case(&c);
+
+  memset(&c, 0, sizeof(c));
+  c.name = "message, ACK and vendor frame";
+  c.pending = 1;
+  add_message(&c, end_shed, sizeof(end_shed));
+  add_bytes(c.stream, &c.len, link_ack, sizeof(link_ack));
+  add_bytes(c.stream, &c.len, vendor_poll, sizeof(vendor_poll));
+  expect_message(&c, end_shed, sizeof(end_shed));
+  expect_vendor(&c, vendor_poll, sizeof(vendor_poll));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  c.expect.done_cnt = 1;
+  c.expect.done_result = CTA2045_SUCCESS;
+  c.stats.messages_rx = 1;
+  c.stats.vendor_frames_rx = 1;
+  c.stats.messages_tx = 1;
+  c.stats.acks_rx = 1;
+  run_case(&c);
+
+  memset(&c, 0, sizeof(c));
+  c.name = "bad checksum";
+  start = c.len;
+  n = add_message(&c, shed, sizeof(shed));
+  c.stream[start + n - 1] ^= 0x01;
+  add_message(&c, end_shed, sizeof(end_shed));
+  expect_message(&c, end_shed, sizeof(end_shed));
+  expect_tx(&c, nak_checksum, sizeof(nak_checksum));
+  expect_tx(&c, link_ack, sizeof(link_ack));
+  c.stats.checksum_errors = 1;
+  c.stats.messages_rx = 1;
+  run_case(&c);
+}
+
+/* a gap of CTA2045_INTERCHAR_TIMEOUT_MS before every byte of a message, then one just below */
+static void check_interchar( void ) {
+  cta2045_link_t link;
+  cta2045_link_stats_t stats;
+  record_t got;
+  uint8_t msg[CTA2045_MAX_FRAME];
+  long before = errors;
+  int n, k, i;
+
+  n = cta2045_build_message(msg, sizeof(msg), CTA2045_MSG_BASIC_DR, shed, sizeof(shed));
+  for ( k = 1; k < n; k++ ) {
+    start_link(&link, &got, 0);
+    cta2045_link_rx(&link, msg, k, 0);
+    cta2045_link_rx(&link, msg + k, n - k, CTA2045_INTERCHAR_TIMEOUT_MS);
+    /* whatever the rest started is over by now */
+    cta2045_link_poll(&link, 500);
+    cta2045_link_rx(&link, msg, n, 1000);
+    cta2045_link_get_stats(&link, &stats);
+    runs++;
+    if ( stats.interchar_timeouts < 1 || got.tx_len < 2 || memcmp(got.tx, nak_timeout, 2) != 0 ) {
+      fail("inter-character timeout at byte %d: %u timeouts, no NAK", k, stats.interchar_timeouts);
+    }
+    if ( stats.messages_rx != 1 || got.frame_cnt < 1 ||
+         got.frames[got.frame_cnt - 1].kind != CTA2045_FRAME_MESSAGE ||
+         memcmp(got.frames[got.frame_cnt - 1].payload, shed, sizeof(shed)) != 0 ) {
+      fail("inter-character timeout at byte %d: %u messages, the next message was lost", k, stats.messages_rx);
+    }
+  }
+
+  start_link(&link, &got, 0);
+  for ( i = 0; i < n; i++ ) {
+    cta2045_link_rx(&link, msg + i, 1, i * (CTA2045_INTERCHAR_TIMEOUT_MS - 1));
+  }
+  cta2045_link_get_stats(&link, &stats);
+  runs++;
+  if ( stats.interchar_timeouts != 0 || stats.messages_rx != 1 || got.frame_cnt != 1 ) {
+    fail("gaps below the inter-character timeout: %u timeouts, %u messages",
+         stats.interchar_timeouts, stats.messages_rx);
+  }
+  printf("inter-character timeout: %d gaps, %s\n", n, errors == before ? "ok" : "FAIL");
+}
+
+/* number of copies of the pending message sent so far */
+static int sent_copies( const record_t *r, int msg_len ) {
+  return r->tx_len / msg_len;
+}
+
+static void check_retries( void ) {
+  cta2045_link_t link;
+  cta2045_link_stats_t stats;
+  record_t got;
+  uint8_t msg[CTA2045_MAX_FRAME];
+  long before = errors;
+  int n, attempt, k;
+  uint32_t t;
+
+  n = cta2045_build_message(msg, sizeof(msg), CTA2045_MSG_BASIC_DR, shed, sizeof(shed));
+
+  /* no ACK at all: resent on every ACK timeout, then failed */
+  memset(&got, 0, sizeof(got));
+  cta2045_link_init(&link, rec_tx, rec_rx, rec_done, &got);
+  cta2045_link_send(&link, CTA2045_MSG_BASIC_DR, shed, sizeof(shed), 0);
+  if ( cta2045_link_send(&link, CTA2045_MSG_BASIC_DR, end_shed, sizeof(end_shed), 1) != CTA2045_ERR_BUSY ) {
+    fail("ACK timeout: second message not refused while busy");
+  }
+  for ( attempt = 1; attempt <= CTA2045_MAX_RETRIES + 1; attempt++ ) {
+    t = attempt * CTA2045_ACK_TIMEOUT_MS;
+    cta2045_link_poll(&link, t - 1);
+    if ( sent_copies(&got, n) != attempt || got.done_cnt != 0 ) {
+      fail("ACK timeout: %d copies before timeout %d", sent_copies(&got, n), attempt);
+    }
+    cta2045_link_poll(&link, t);
+  }
+  cta2045_link_poll(&link, 10 * CTA2045_ACK_TIMEOUT_MS);
+  cta2045_link_get_stats(&link, &stats);
+  runs++;
+  if ( sent_copies(&got, n) != CTA2045_MAX_RETRIES + 1 || memcmp(got.tx, msg, n) != 0 ||
+       got.done_cnt != 1 || got.done_result != CTA2045_ERR_TIMEOUT ||
+       stats.messages_tx != 1 || stats.retries != CTA2045_MAX_RETRIES || stats.tx_failed != 1 ||
+       cta2045_link_busy(&link) ) {
+    fail("ACK timeout: %d copies, %d done (%d), %u retries, %u failed",
+         sent_copies(&got, n), got.done_cnt, got.done_result, stats.retries, stats.tx_failed);
+  }
+
+  /* NAKed on every attempt, the NAK split in two */
+  for ( k = 0; k <= 1; k++ ) {
+    start_link(&link, &got, 1);
+    for ( attempt = 1, t = 10; attempt <= CTA2045_MAX_RETRIES + 1; attempt++, t += 10 ) {
+      cta2045_link_rx(&link, nak_checksum, k ? 1 : 2, t);
+      if ( k ) {
+        cta2045_link_rx(&link, nak_checksum + 1, 1, t + 1);
+      }
+    }
+    cta2045_link_get_stats(&link, &stats);
+    runs++;
+    if ( sent_copies(&got, n) != CTA2045_MAX_RETRIES || got.done_cnt != 1 ||
+         got.done_result != CTA2045_ERR_NAK || stats.naks_rx != CTA2045_MAX_RETRIES + 1 ||
+         stats.retries != CTA2045_MAX_RETRIES || stats.tx_failed != 1 ) {
+      fail("NAK: %d resent, %d done (%d), %u NAKs, %u retries, %u failed",
+           sent_copies(&got, n), got.done_cnt, got.done_result, stats.naks_rx, stats.retries, stats.tx_failed);
+    }
+  }
+
+  /* one ACK timeout, then the ACK in two pieces */
+  start_link(&link, &got, 1);
+  cta2045_link_poll(&link, CTA2045_ACK_TIMEOUT_MS);
+  cta2045_link_rx(&link, link_ack, 1, CTA2045_ACK_TIMEOUT_MS + 50);
+  cta2045_link_rx(&link, link_ack + 1, 1, CTA2045_ACK_TIMEOUT_MS + 51);
+  cta2045_link_poll(&link, 10 * CTA2045_ACK_TIMEOUT_MS);
+  cta2045_link_get_stats(&link, &stats);
+  runs++;
+  if ( sent_copies(&got, n) != 1 || got.done_cnt != 1 || got.done_result != CTA2045_SUCCESS ||
+       stats.retries != 1 || stats.acks_rx != 1 || stats.tx_failed != 0 || cta2045_link_busy(&link) ) {
+    fail("ACK after a timeout: %d resent, %d done (%d), %u retries", sent_copies(&got, n),
+         got.done_cnt, got.done_result, stats.retries);
+  }
+
+  /* an ACK nobody waits for */
+  start_link(&link, &got, 0);
+  cta2045_link_rx(&link, link_ack, sizeof(link_ack), 1);
+  cta2045_link_get_stats(&link, &stats);
+  runs++;
+  if ( stats.stray_acks != 1 || got.done_cnt != 0 || got.tx_len != 0 ) {
+    fail("stray ACK: %u counted", stats.stray_acks);
+  }
+  printf("retries and ACK timeout: %s\n", errors == before ? "ok" : "FAIL");
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int main( int argc, char **argv ) {
+  check_streams();
+  check_interchar();
+  check_retries();
+  printf("%ld runs, %ld failures\n", runs, errors);
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,643 @@
+/**
+ * @file ec100_emu.c
+ *
+ * @brief Host side EC-100 thermostat emulator and parser benchmark
+ *
+ * Emulates the thermostat end of the RS485 link: it sends polls and
+ * mtype1 (heating status) / mtype2 (temperatures) telemetry at a given
+ * rate, optionally corrupted, and checks the set point frames sent back.
+ * The controller end is the firmware's link layer (main/cta2045_link.c)
+ * with the same frame matching as rs_485_module.c.
+ *
+ *   ec100_emu thermostat [-d tty] [options]
+ *       thermostat only, on tty (e.g. a USB RS485 adapter wired to a
+ *       board) or on a new pty whose path is printed
+ *   ec100_emu pty [options]
+ *       thermostat and controller over a pty pair, the controller reads
+ *       the line like the firmware does (idle gap ends a vendor frame)
+ *   ec100_emu parse [options]
+ *       frames fed straight into the parser with simulated 19200 baud
+ *       timing, to measure how many frames per second it sustains
+ *   ec100_emu fuzz [options]
+ *       random and mutated input, then checks the parser still decodes
+ *       clean frames
+ *
+ * options:
+ *   -n frames     frames to send (default 1000, parse/fuzz 1000000)
+ *   -r rate       frames per second (default 20, thermostat/pty only)
+ *   -p every      a poll every this many frames (default 3)
+ *   -c percent    frames to corrupt (default 0)
+ *   -s seed       random seed (default 1)
+ *
+ * Every telemetry frame carries a sequence number at offset 4 from which
+ * its values are derived, so the controller can tell when a corrupted
+ * frame was accepted as good data. Frames end with the additive checksum
+ * used by the set point frame; the firmware does not check it on receive
+ * and the report counts how many corrupted frames got through.
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "cta2045_link.h"
+
+/* frame layouts, as matched by rs_485_module.c */
+#define MTYPE2_TEMP_TOP 15
+#define MTYPE2_TEMP_BOTTOM 16
+#define MTYPE1_HEATING 14
+#define FRAME_SEQ 4
+#define MTYPE1_LEN (MTYPE1_HEATING + 2)
+#define MTYPE2_LEN (MTYPE2_TEMP_BOTTOM + 2)
+#define SET_POINT_LEN 6
+
+/** @brief line idle time that ends a frame on the pty */
+#define IDLE_MS 2
+/** @brief character time at 19200 baud, 8E1 = 11 bits per character */
+#define CHAR_US (11 * 1000000 / 19200)
+
+static const uint8_t msg_poll[2] = { 0x87, 0x00 };
+static const uint8_t mtype2[4] = { 0x40, 0x09, 0x14, 0x00 };
+static const uint8_t mtype1[4] = { 0x40, 0x0B, 0x0A, 0x01 };
+
+typedef enum {
+  FRAME_POLL = 0,
+  FRAME_MTYPE1,
+  FRAME_MTYPE2
+} frame_kind_t;
+
+/* corruptions */
+#define CORRUPT_BITFLIP 0    /* one bit of one byte */
+#define CORRUPT_TRUNCATE 1   /* frame cut short */
+#define CORRUPT_GARBAGE 2    /* random bytes appended */
+#define CORRUPT_NO_GAP 3     /* no idle gap before the next frame */
+#define CORRUPT_CTA 4        /* first byte turned into a CTA-2045 type */
+#define CORRUPT_CNT 5
+
+typedef struct {
+  long frames;
+  int rate;
+  int poll_every;
+  int corrupt_pct;
+  unsigned seed;
+} options_t;
+
+/** @brief thermostat side counters */
+typedef struct {
+  long sent;
+  long polls;
+  long corrupted[CORRUPT_CNT];
+  long responses;
+  long bad_responses;
+  long late_responses;  /* answered after the next frame went out */
+  long other_bytes;     /* not part of a set point frame, e.g. link NAKs */
+  uint64_t total_latency_us;
+  uint32_t max_latency_us;
+} thermostat_stats_t;
+
+/** @brief controller side counters */
+typedef struct {
+  long frames;
+  long polls;
+  long mtype1;
+  long mtype2;
+  long unknown;
+  long bad_sum;          /* accepted by the firmware match, checksum wrong */
+  long bad_values;       /* values do not follow from the sequence number */
+  long responses;
+} controller_stats_t;
+
+static options_t opts = { 0, 20, 3, 0, 1 };
+static controller_stats_t ctl;
+static cta2045_link_t link_;
+static int ctl_fd = -1;
+static uint8_t set_point = 120;
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static uint64_t now_us( void ) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t additive_sum( const uint8_t *buf, size_t len ) {
+  uint8_t sum = 0;
+
+  while ( len-- ) {
+    sum += *buf++;
+  }
+  return sum;
+}
+
+/* telemetry values derived from the sequence number */
+static uint8_t seq_top( uint8_t seq ) { return 100 + seq % 50; }
+static uint8_t seq_bottom( uint8_t seq ) { return 60 + (seq * 7) % 40; }
+static uint8_t seq_heating( uint8_t seq ) { return seq & 1; }
+
+/**
+ * @brief build the n-th frame the thermostat sends
+ *
+ * @return frame length
+ */
+static size_t build_frame( long n, uint8_t *buf, frame_kind_t *kind ) {
+  uint8_t seq = n & 0xff;
+  size_t len;
+
+  if ( opts.poll_every > 0 && n % opts.poll_every == 0 ) {
+    *kind = FRAME_POLL;
+    memcpy(buf, msg_poll, sizeof(msg_poll));
+    return sizeof(msg_poll);
+  }
+  if ( n & 1 ) {
+    *kind = FRAME_MTYPE2;
+    len = MTYPE2_LEN;
+    memset(buf, 0, len);
+    memcpy(buf, mtype2, sizeof(mtype2));
+    buf[MTYPE2_TEMP_TOP] = seq_top(seq);
+    buf[MTYPE2_TEMP_BOTTOM] = seq_bottom(seq);
+  } else {
+    *kind = FRAME_MTYPE1;
+    len = MTYPE1_LEN;
+    memset(buf, 0, len);
+    memcpy(buf, mtype1, sizeof(mtype1));
+    buf[MTYPE1_HEATING] = seq_heating(seq);
+  }
+  buf[FRAME_SEQ] = seq;
+  buf[len - 1] = additive_sum(buf, len - 1);
+  return len;
+}
+
+/**
+ * @brief corrupt a frame in place
+ *
+ * @return the corruption applied (CORRUPT_*), the new length in *len
+ */
+static int corrupt_frame( uint8_t *buf, size_t *len, size_t size ) {
+  int how = rand() % CORRUPT_CNT;
+  size_t extra, i;
+
+  switch ( how ) {
+    case CORRUPT_BITFLIP:
+      buf[rand() % *len] ^= 1 << (rand() % 8);
+      break;
+    case CORRUPT_TRUNCATE:
+      *len = *len > 1 ? 1 + rand() % (*len - 1) : *len;
+      break;
+    case CORRUPT_GARBAGE:
+      extra = 1 + rand() % 16;
+      for ( i = 0; i < extra && *len < size; i++ ) {
+        buf[(*len)++] = rand();
+      }
+      break;
+    case CORRUPT_CTA:
+      buf[0] = CTA2045_MSG_TYPE1_DR;
+      break;
+    default:
+      break;
+  }
+  return how;
+}
+
+/**
+ * @brief controller side: frame matching as in rs485_handle_frame()
+ */
+static void ctl_rx( const cta2045_frame_t *frame, void *ctx ) {
+  const uint8_t *p = frame->payload;
+  uint8_t rsp[SET_POINT_LEN];
+  int sum_ok;
+
+  if ( frame->kind != CTA2045_FRAME_VENDOR ) {
+    return;
+  }
+  ctl.frames++;
+  sum_ok = frame->len > 1 && additive_sum(p, frame->len - 1) == p[frame->len - 1];
+
+  if ( frame->len >= sizeof(msg_poll) && memcmp(p, msg_poll, sizeof(msg_poll)) == 0 ) {
+    ctl.polls++;
+    rsp[0] = 0x87;
+    rsp[1] = 0x09;
+    rsp[2] = 0x03;
+    rsp[3] = set_point;
+    rsp[4] = set_point;
+    rsp[5] = additive_sum(rsp, 5);
+    cta2045_link_send_raw(&link_, rsp, sizeof(rsp));
+    ctl.responses++;
+    return;
+  }
+  if ( frame->len >= MTYPE2_TEMP_BOTTOM + 1 && memcmp(p, mtype2, sizeof(mtype2)) == 0 ) {
+    ctl.mtype2++;
+    ctl.bad_sum += !sum_ok;
+    ctl.bad_values += p[MTYPE2_TEMP_TOP] != seq_top(p[FRAME_SEQ]) ||
+                      p[MTYPE2_TEMP_BOTTOM] != seq_bottom(p[FRAME_SEQ]);
+    return;
+  }
+  if ( frame->len >= MTYPE1_HEATING + 1 && memcmp(p, mtype1, sizeof(mtype1)) == 0 ) {
+    ctl.mtype1++;
+    ctl.bad_sum += !sum_ok;
+    ctl.bad_values += p[MTYPE1_HEATING] != seq_heating(p[FRAME_SEQ]);
+    return;
+  }
+  ctl.unknown++;
+}
+
+static void ctl_tx( const uint8_t *data, size_t len, void *ctx ) {
+  if ( ctl_fd >= 0 && write(ctl_fd, data, len) != (ssize_t)len ) {
+    perror("write");
+  }
+}
+
+static void ctl_init( void ) {
+  memset(&ctl, 0, sizeof(ctl));
+  cta2045_link_init(&link_, ctl_tx, ctl_rx, NULL, NULL);
+}
+
+static void print_controller( void ) {
+  cta2045_link_stats_t s;
+
+  cta2045_link_get_stats(&link_, &s);
+  printf("controller: %ld frames (%ld polls, %ld mtype1, %ld mtype2, %ld unknown), %ld responses\n",
+         ctl.frames, ctl.polls, ctl.mtype1, ctl.mtype2, ctl.unknown, ctl.responses);
+  printf("controller: accepted with bad checksum %ld, with wrong values %ld\n",
+         ctl.bad_sum, ctl.bad_values);
+  printf("link: messages %u, checksum errors %u, interchar timeouts %u, overflows %u, unsupported %u, stray acks %u\n",
+         s.messages_rx, s.checksum_errors, s.interchar_timeouts, s.overflows, s.unsupported,
+         s.stray_acks);
+}
+
+static void print_thermostat( const thermostat_stats_t *t ) {
+  printf("thermostat: sent %ld (%ld polls), corrupted: bit flip %ld, truncated %ld, garbage %ld, no gap %ld, cta type %ld\n",
+         t->sent, t->polls, t->corrupted[CORRUPT_BITFLIP], t->corrupted[CORRUPT_TRUNCATE],
+         t->corrupted[CORRUPT_GARBAGE], t->corrupted[CORRUPT_NO_GAP], t->corrupted[CORRUPT_CTA]);
+  printf("thermostat: responses %ld, bad %ld, late %ld, other bytes %ld, latency avg %.3f ms max %.3f ms\n",
+         t->responses, t->bad_responses, t->late_responses, t->other_bytes,
+         t->responses ? (double)t->total_latency_us / t->responses / 1000.0 : 0.0,
+         t->max_latency_us / 1000.0);
+}
+
+static void raw_mode( int fd ) {
+  struct termios t;
+
+  if ( tcgetattr(fd, &t) == 0 ) {
+    cfmakeraw(&t);
+    cfsetispeed(&t, B19200);
+    cfsetospeed(&t, B19200);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+}
+
+static int open_pty( void ) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ( fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ) {
+    perror("pty");
+    exit(1);
+  }
+  raw_mode(fd);
+  return fd;
+}
+
+static int open_tty( const char *path ) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+
+  if ( fd < 0 ) {
+    perror(path);
+    exit(1);
+  }
+  raw_mode(fd);
+  return fd;
+}
+
+/**
+ * @brief collect set point responses until the deadline
+ */
+static void thermostat_listen( int fd, uint64_t until_us, uint64_t poll_us, int *waiting,
+                               thermostat_stats_t *t ) {
+  struct pollfd p = { fd, POLLIN, 0 };
+  uint8_t buf[64];
+  static uint8_t rsp[SET_POINT_LEN];
+  static size_t rsp_len;
+  uint64_t now;
+  ssize_t n;
+  ssize_t i;
+  int wait_ms;
+
+  for ( ;; ) {
+    now = now_us();
+    if ( now >= until_us ) {
+      return;
+    }
+    wait_ms = (until_us - now + 999) / 1000;
+    if ( poll(&p, 1, wait_ms) <= 0 ) {
+      continue;
+    }
+    n = read(fd, buf, sizeof(buf));
+    if ( n <= 0 ) {
+      return;
+    }
+    for ( i = 0; i < n; i++ ) {
+      /* link NAKs for mangled frames are skipped, resync on 0x87 */
+      if ( rsp_len == 0 && buf[i] != 0x87 ) {
+        t->other_bytes++;
+        continue;
+      }
+      rsp[rsp_len++] = buf[i];
+      if ( rsp_len < SET_POINT_LEN ) {
+        continue;
+      }
+      rsp_len = 0;
+      if ( rsp[0] != 0x87 || rsp[1] != 0x09 || additive_sum(rsp, 5) != rsp[5] ) {
+        t->bad_responses++;
+        continue;
+      }
+      t->responses++;
+      if ( *waiting ) {
+        now = now_us() - poll_us;
+        t->total_latency_us += now;
+        if ( now > t->max_latency_us ) {
+          t->max_latency_us = now;
+        }
+        *waiting = 0;
+      } else {
+        t->late_responses++;
+      }
+    }
+  }
+}
+
+/**
+ * @brief send opts.frames frames at opts.rate on fd
+ */
+static void run_thermostat( int fd, thermostat_stats_t *t ) {
+  uint8_t buf[64];
+  frame_kind_t kind;
+  uint64_t next = now_us();
+  uint64_t period = 1000000 / (opts.rate > 0 ? opts.rate : 1);
+  uint64_t poll_us = 0;
+  int waiting = 0;
+  int no_gap = 0;
+  size_t len;
+  long n;
+  int how;
+
+  memset(t, 0, sizeof(*t));
+  srand(opts.seed);
+  for ( n = 0; n < opts.frames; n++ ) {
+    len = build_frame(n, buf, &kind);
+    how = -1;
+    if ( rand() % 100 < opts.corrupt_pct ) {
+      how = corrupt_frame(buf, &len, sizeof(buf));
+      t->corrupted[how]++;
+    }
+    if ( write(fd, buf, len) != (ssize_t)len ) {
+      perror("write");
+      return;
+    }
+    t->sent++;
+    if ( kind == FRAME_POLL ) {
+      t->polls++;
+      poll_us = now_us();
+      waiting = 1;
+    } else if ( waiting ) {
+      waiting = 0;   /* a response that comes now is late */
+    }
+    /* no gap: the next frame follows right away */
+    no_gap = how == CORRUPT_NO_GAP;
+    next += period;
+    thermostat_listen(fd, no_gap ? now_us() : next, poll_us, &waiting, t);
+  }
+  thermostat_listen(fd, now_us() + 100000, poll_us, &waiting, t);
+}
+
+/**
+ * @brief controller side of the pty mode: read like the UART driver, an
+ *        idle gap posts the bytes received so far and ends a vendor frame
+ */
+static void run_controller( int fd, volatile sig_atomic_t *stop ) {
+  struct pollfd p = { fd, POLLIN, 0 };
+  uint8_t buf[256];
+  int pending = 0;
+  ssize_t n;
+
+  ctl_fd = fd;
+  while ( !*stop ) {
+    if ( poll(&p, 1, IDLE_MS) > 0 ) {
+      n = read(fd, buf, sizeof(buf));
+      if ( n <= 0 ) {
+        break;
+      }
+      cta2045_link_rx(&link_, buf, n, now_us() / 1000);
+      pending = 1;
+    } else if ( pending ) {
+      cta2045_link_idle(&link_);
+      pending = 0;
+    }
+    cta2045_link_poll(&link_, now_us() / 1000);
+  }
+}
+
+static volatile sig_atomic_t stop_flag;
+
+static void on_signal( int sig ) {
+  stop_flag = 1;
+}
+
+static int mode_pty( void ) {
+  thermostat_stats_t t;
+  int master = open_pty();
+  int slave = open_tty(ptsname(master));
+  int status;
+  pid_t pid;
+
+  pid = fork();
+  if ( pid == 0 ) {
+    close(master);
+    signal(SIGTERM, on_signal);
+    ctl_init();
+    run_controller(slave, &stop_flag);
+    print_controller();
+    fflush(stdout);
+    _exit(0);
+  }
+  close(slave);
+  run_thermostat(master, &t);
+  print_thermostat(&t);
+  fflush(stdout);
+  kill(pid, SIGTERM);
+  waitpid(pid, &status, 0);
+  return 0;
+}
+
+/**
+ * @brief feed frames straight into the parser, time advancing as if they
+ *        were on the wire at 19200 baud
+ */
+static int mode_parse( void ) {
+  uint8_t buf[64];
+  frame_kind_t kind;
+  uint64_t start, elapsed;
+  uint64_t bytes = 0;
+  uint32_t wire_ms = 0;
+  size_t len;
+  long n, clean = 0;
+  int how;
+
+  ctl_init();
+  srand(opts.seed);
+  start = now_us();
+  for ( n = 0; n < opts.frames; n++ ) {
+    len = build_frame(n, buf, &kind);
+    how = -1;
+    if ( rand() % 100 < opts.corrupt_pct ) {
+      how = corrupt_frame(buf, &len, sizeof(buf));
+    } else {
+      clean++;
+    }
+    wire_ms += (len * CHAR_US) / 1000;
+    cta2045_link_rx(&link_, buf, len, wire_ms);
+    if ( how != CORRUPT_NO_GAP ) {
+      /* the UART receive timeout, then the thermostat's pause */
+      cta2045_link_idle(&link_);
+      wire_ms += CTA2045_VENDOR_GAP_MS;
+      cta2045_link_poll(&link_, wire_ms);
+    }
+    bytes += len;
+  }
+  elapsed = now_us() - start;
+
+  print_controller();
+  printf("parse: %ld frames (%ld clean), %llu bytes in %.3f ms: %.0f frames/s, %.1f ns/byte\n",
+         opts.frames, clean, (unsigned long long)bytes, elapsed / 1000.0,
+         elapsed ? opts.frames * 1e6 / elapsed : 0.0, bytes ? elapsed * 1000.0 / bytes : 0.0);
+  printf("parse: the line carries at most %.0f frames/s of this mix\n",
+         opts.frames * 1000.0 / (wire_ms ? wire_ms : 1));
+  return 0;
+}
+
+/**
+ * @brief random and mutated input, then clean frames that must all decode
+ */
+static int mode_fuzz( void ) {
+  uint8_t buf[512];
+  frame_kind_t kind;
+  uint32_t t_ms = 0;
+  size_t len, i;
+  long n, before;
+  int failed = 0;
+
+  ctl_init();
+  srand(opts.seed);
+  for ( n = 0; n < opts.frames; n++ ) {
+    if ( rand() & 1 ) {
+      len = rand() % sizeof(buf);
+      for ( i = 0; i < len; i++ ) {
+        buf[i] = rand();
+      }
+    } else {
+      len = build_frame(n, buf, &kind);
+      corrupt_frame(buf, &len, sizeof(buf));
+    }
+    cta2045_link_rx(&link_, buf, len, t_ms);
+    switch ( rand() % 3 ) {
+      case 0:
+        cta2045_link_idle(&link_);
+        break;
+      case 1:
+        t_ms += rand() % (2 * CTA2045_INTERCHAR_TIMEOUT_MS);
+        cta2045_link_poll(&link_, t_ms);
+        break;
+      default:
+        break;   /* more bytes right away */
+    }
+  }
+
+  /* after the line has been quiet every clean frame must decode */
+  t_ms += CTA2045_INTERCHAR_TIMEOUT_MS;
+  cta2045_link_poll(&link_, t_ms);
+  cta2045_link_idle(&link_);
+  before = ctl.mtype1 + ctl.mtype2 + ctl.polls;
+  for ( n = 0; n < 100; n++ ) {
+    len = build_frame(n, buf, &kind);
+    cta2045_link_rx(&link_, buf, len, t_ms);
+    cta2045_link_idle(&link_);
+    t_ms += CTA2045_VENDOR_GAP_MS;
+    cta2045_link_poll(&link_, t_ms);
+  }
+  failed = ctl.mtype1 + ctl.mtype2 + ctl.polls - before != 100;
+
+  print_controller();
+  printf("fuzz: %ld inputs, recovery %s\n", opts.frames, failed ? "FAILED" : "ok");
+  return failed;
+}
+
+static void usage( void ) {
+  fprintf(stderr, "usage: ec100_emu thermostat|pty|parse|fuzz [-d tty] [-n frames] [-r rate] "
+                  "[-p poll_every] [-c corrupt_pct] [-s seed]\n");
+  exit(2);
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int main( int argc, char **argv ) {
+  thermostat_stats_t t;
+  const char *mode, *tty = NULL;
+  int fd, c;
+
+  if ( argc < 2 ) {
+    usage();
+  }
+  mode = argv[1];
+  optind = 2;
+  while ( (c = getopt(argc, argv, "d:n:r:p:c:s:")) != -1 ) {
+    switch ( c ) {
+      case 'd': tty = optarg; break;
+      case 'n': opts.frames = atol(optarg); break;
+      case 'r': opts.rate = atoi(optarg); break;
+      case 'p': opts.poll_every = atoi(optarg); break;
+      case 'c': opts.corrupt_pct = atoi(optarg); break;
+      case 's': opts.seed = atoi(optarg); break;
+      default: usage();
+    }
+  }
+
+  if ( strcmp(mode, "parse") == 0 || strcmp(mode, "fuzz") == 0 ) {
+    if ( opts.frames == 0 ) {
+      opts.frames = 1000000;
+    }
+    return mode[0] == 'p' ? mode_parse() : mode_fuzz();
+  }
+
+  if ( opts.frames == 0 ) {
+    opts.frames = 1000;
+  }
+  if ( strcmp(mode, "pty") == 0 ) {
+    return mode_pty();
+  }
+  if ( strcmp(mode, "thermostat") == 0 ) {
+    if ( tty != NULL ) {
+      fd = open_tty(tty);
+    } else {
+      fd = open_pty();
+      printf("%s\n", ptsname(fd));
+      fflush(stdout);
+    }
+    run_thermostat(fd, &t);
+    print_thermostat(&t);
+    return 0;
+  }
+  usage();
+  return 2;
+}
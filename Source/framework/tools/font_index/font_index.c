@@ -0,0 +1,170 @@
+/**
+ * @file font_index.c
+ *
+ * @brief host validation and timing of the u8g2 font index
+ *
+ * Looks up every encoding 0..65535 of a few fonts, from small ASCII fonts
+ * to the CJK unifont subsets, through a font index of several sizes and
+ * compares the glyph data with the linear search of
+ * u8g2_font_get_glyph_data() without an index. The index is rebuilt by
+ * u8g2_SetFont() while switching between the fonts. Then lookups of
+ * random glyphs of each font are timed with and without the index.
+ *
+ *   font_index [-s seed]
+ *
+ * The linear search on the host keeps the last Unicode glyph found
+ * (__unix__ only), which the firmware does not. Exit status is 1 if any
+ * lookup differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define ENCODINGS 0x10000
+#define MAX_ENTRIES 4096
+
+/** @brief a font to check */
+typedef struct {
+  const char *name;
+  const uint8_t *font;
+} font_t;
+
+static const font_t fonts[] = {
+  { "t0_13_te", u8g2_font_t0_13_te },
+  { "helvB08_tr", u8g2_font_helvB08_tr },
+  { "unifont_t_symbols", u8g2_font_unifont_t_symbols },
+  { "unifont_t_chinese2", u8g2_font_unifont_t_chinese2 },
+  { "unifont_t_japanese2", u8g2_font_unifont_t_japanese2 },
+};
+#define FONTS (sizeof(fonts) / sizeof(fonts[0]))
+
+/* Unicode entries of the index: none (ASCII only), sparse, one per glyph */
+static const uint16_t sizes[] = { 0, 1, 16, 64, 256, MAX_ENTRIES };
+#define SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static u8g2_font_index_t font_index;
+static u8g2_font_index_entry_t entries[MAX_ENTRIES];
+static const uint8_t *linear[FONTS][ENCODINGS];
+static uint16_t present[FONTS][ENCODINGS];
+static int present_cnt[FONTS];
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* glyph data of every encoding by the linear search */
+static void load_linear( u8g2_t *u8g2 ) {
+  int f, e;
+
+  u8g2_SetFontIndex(u8g2, NULL, NULL, 0);
+  for ( f = 0; f < FONTS; f++ ) {
+    u8g2_SetFont(u8g2, fonts[f].font);
+    present_cnt[f] = 0;
+    for ( e = 0; e < ENCODINGS; e++ ) {
+      linear[f][e] = u8g2_font_get_glyph_data(u8g2, e);
+      if ( linear[f][e] != NULL ) {
+        present[f][present_cnt[f]++] = e;
+      }
+    }
+  }
+}
+
+/* every encoding of every font through an index of size entries, returns the number of mismatches */
+static long validate( u8g2_t *u8g2, uint16_t size ) {
+  long errors = 0;
+  const uint8_t *data;
+  int f, e;
+
+  u8g2_SetFontIndex(u8g2, &font_index, size ? entries : NULL, size);
+  for ( f = 0; f < FONTS; f++ ) {
+    u8g2_SetFont(u8g2, fonts[f].font);
+    if ( font_index.font != fonts[f].font ) {
+      printf("%s, %u entries: index not rebuilt\n", fonts[f].name, size);
+      errors++;
+      continue;
+    }
+    for ( e = 0; e < ENCODINGS; e++ ) {
+      data = u8g2_font_get_glyph_data(u8g2, e);
+      if ( data != linear[f][e] ) {
+        if ( errors < 10 ) {
+          printf("%s, %u entries: mismatch at encoding %d\n", fonts[f].name, size, e);
+        }
+        errors++;
+      }
+    }
+  }
+  printf("index with %u Unicode entries: %ld mismatches\n", size, errors);
+  return errors;
+}
+
+/* ns per lookup of random glyphs of font f */
+static double time_lookup( u8g2_t *u8g2, int f ) {
+  const uint8_t *sum = NULL;
+  double start;
+  long n = 200000;
+  long i;
+
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    sum += (size_t)u8g2_font_get_glyph_data(u8g2, present[f][rand() % present_cnt[f]]) & 1;
+  }
+  if ( sum == (const uint8_t *)1 ) {
+    printf(" ");   /* keep the lookups */
+  }
+  return (now_ns() - start) / n;
+}
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  long errors = 0;
+  double t_linear, t_full, t_sparse;
+  int opt;
+  int i, f;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  load_linear(&u8g2);
+  for ( i = 0; i < SIZES; i++ ) {
+    errors += validate(&u8g2, sizes[i]);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  for ( f = 0; f < FONTS; f++ ) {
+    u8g2_SetFontIndex(&u8g2, NULL, NULL, 0);
+    u8g2_SetFont(&u8g2, fonts[f].font);
+    t_linear = time_lookup(&u8g2, f);
+    u8g2_SetFontIndex(&u8g2, &font_index, entries, MAX_ENTRIES);
+    t_full = time_lookup(&u8g2, f);
+    u8g2_SetFontIndex(&u8g2, &font_index, entries, 64);
+    t_sparse = time_lookup(&u8g2, f);
+    printf("%s: %d glyphs (%u Unicode), %.1f ns linear, %.1f ns indexed, %.1f ns with 64 entries (step %u)\n",
+           fonts[f].name, present_cnt[f], font_index.unicode_glyphs, t_linear, t_full, t_sparse,
+           font_index.unicode_step);
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file glyph_cache.c
+ *
+ * @brief host benchmark of the u8g2 glyph cache
+ *
+ * Draws the strings of the LCD screen into an SSD1309 full frame buffer,
+ * with and without the glyph cache, and reports glyphs/s for both. Before
+ * timing, the output of both paths is compared byte by byte for all draw
+ * colors, solid and transparent font mode, random positions (including
+ * glyphs clipped at the display border) and the page buffer mode.
+ *
+ *   glyph_cache [-n frames]
+ *
+ * Built with "make PROFILE=1" it also prints the u8g2 profiling counters
+ * (U8X8_WITH_PROFILE) of one frame with and without the cache.
+ *
+ * Exit status is 1 if the cached output differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define FRAME_SIZE (128 * 64 / 8)
+
+static const char *screen[] = {
+  "Freq: 60.0012Hz", "Power: 4512.25", "Heat:1", "Ts:120F", "Mode:0 ", "Tt:118F", "Tb:104F"
+};
+static const int screen_xy[][2] = {
+  { 10, 10 }, { 10, 25 }, { 70, 25 }, { 10, 40 }, { 70, 40 }, { 10, 60 }, { 70, 60 }
+};
+#define SCREEN_STRINGS (sizeof(screen) / sizeof(screen[0]))
+
+static u8g2_glyph_cache_t cache;
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_s( void ) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int draw_screen( u8g2_t *u8g2 ) {
+  int glyphs = 0;
+  size_t i;
+
+  u8g2_SetFont(u8g2, u8g2_font_t0_13_te);
+  for ( i = 0; i < SCREEN_STRINGS; i++ ) {
+    u8g2_DrawStr(u8g2, screen_xy[i][0], screen_xy[i][1], screen[i]);
+    glyphs += strlen(screen[i]);
+  }
+  return glyphs;
+}
+
+/* random strings at random places, same seed for both runs */
+static void draw_random( u8g2_t *u8g2, unsigned seed ) {
+  char str[12];
+  int i, j;
+
+  srand(seed);
+  u8g2_SetFont(u8g2, u8g2_font_t0_13_te);
+  for ( i = 0; i < 20; i++ ) {
+    for ( j = 0; j < (int)sizeof(str) - 1; j++ ) {
+      str[j] = 32 + rand() % 95;
+    }
+    str[j] = 0;
+    u8g2_SetDrawColor(u8g2, rand() % 3);
+    u8g2_SetFontMode(u8g2, rand() % 2);
+    u8g2_DrawStr(u8g2, rand() % 140 - 6, rand() % 80 - 4, str);
+  }
+}
+
+/* compare a full buffer and a page buffer setup, cache off and on */
+static int validate( void ) {
+  static uint8_t ref[FRAME_SIZE];
+  static uint8_t out[FRAME_SIZE];
+  u8g2_t u8g2;
+  unsigned seed;
+  int page_mode, cached, row, errors = 0;
+
+  for ( seed = 1; seed <= 500; seed++ ) {
+    for ( page_mode = 0; page_mode <= 1; page_mode++ ) {
+      for ( cached = 0; cached <= 1; cached++ ) {
+        uint8_t *dst = cached ? out : ref;
+
+        if ( page_mode ) {
+          u8g2_Setup_ssd1309_i2c_128x64_noname0_1(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+        } else {
+          u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+        }
+        u8g2_SetGlyphCache(&u8g2, cached ? &cache : NULL);
+
+        /* one tile row at a time in page mode, like the picture loop */
+        for ( row = 0; row < 8; row += u8g2_GetBufferTileHeight(&u8g2) ) {
+          u8g2_SetBufferCurrTileRow(&u8g2, row);
+          memset(u8g2_GetBufferPtr(&u8g2), (seed & 1) ? 0x5a : 0, u8g2_GetBufferTileHeight(&u8g2) * 128);
+          draw_random(&u8g2, seed);
+          memcpy(dst + row * 128, u8g2_GetBufferPtr(&u8g2), u8g2_GetBufferTileHeight(&u8g2) * 128);
+        }
+      }
+      if ( memcmp(ref, out, FRAME_SIZE) != 0 ) {
+        if ( errors++ < 5 ) {
+          fprintf(stderr, "mismatch: seed %u, %s buffer\n", seed, page_mode ? "page" : "full");
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+static double bench( u8g2_t *u8g2, int frames, int *glyphs ) {
+  double start;
+  int i;
+
+  *glyphs = 0;
+  start = now_s();
+  for ( i = 0; i < frames; i++ ) {
+    u8g2_ClearBuffer(u8g2);
+    *glyphs += draw_screen(u8g2);
+  }
+  return now_s() - start;
+}
+
+#ifdef U8X8_WITH_PROFILE
+/* draw one frame with the profiling counters assigned, ticks are ns here */
+static void profile_frame( u8g2_t *u8g2, const char *name ) {
+  static const char * const names[U8X8_PROFILE_CNT] = { "glyph", "hvline", "box", "bitmap", "bus" };
+  u8x8_profile_t profile;
+  int i;
+
+  u8x8_SetProfile(u8g2_GetU8x8(u8g2), &profile);
+  u8g2_ClearBuffer(u8g2);
+  draw_screen(u8g2);
+  u8g2_SendBuffer(u8g2);
+  u8x8_SetProfile(u8g2_GetU8x8(u8g2), NULL);
+
+  printf("profile %s:", name);
+  for ( i = 0; i < U8X8_PROFILE_CNT; i++ )
+    printf(" %s %u/%u ns", names[i], profile.count[i], profile.ticks[i]);
+  printf(", %u data bytes\n", profile.data_bytes);
+}
+#endif
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  int frames = 100000;
+  int errors;
+  int glyphs;
+  int opt;
+  double t_off, t_on;
+
+  while ( (opt = getopt(argc, argv, "n:")) != -1 ) {
+    switch ( opt ) {
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n frames]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  errors = validate();
+  printf("validation: %s (%d mismatches)\n", errors ? "FAIL" : "ok", errors);
+
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+
+  u8g2_SetGlyphCache(&u8g2, NULL);
+  t_off = bench(&u8g2, frames, &glyphs);
+  printf("cache off: %d frames, %.0f glyphs/s, %.2f us/frame\n",
+         frames, glyphs / t_off, t_off * 1e6 / frames);
+
+  u8g2_SetGlyphCache(&u8g2, &cache);
+  t_on = bench(&u8g2, frames, &glyphs);
+  printf("cache on:  %d frames, %.0f glyphs/s, %.2f us/frame (%u hits, %u misses, %u bypassed)\n",
+         frames, glyphs / t_on, t_on * 1e6 / frames, cache.hits, cache.misses, cache.bypassed);
+  printf("speedup: %.2fx\n", t_off / t_on);
+
+#ifdef U8X8_WITH_PROFILE
+  u8g2_SetGlyphCache(&u8g2, NULL);
+  profile_frame(&u8g2, "cache off");
+  u8g2_SetGlyphCache(&u8g2, &cache);
+  profile_frame(&u8g2, "cache on");
+#endif
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file glyph_span.c
+ *
+ * @brief host validation and timing of the u8g2 span glyph decoder
+ *
+ * Draws every glyph 0..255 of a few fonts at many positions, including
+ * partly or completely outside the display, with all draw colors, solid
+ * and transparent, onto random buffer contents, once with the span
+ * decoder (U8G2_FONT_SPEED_OPTIMIZATION) and once with the
+ * u8g2_DrawHVLine() decoder, and the buffers have to be identical. This
+ * is done for the full buffer and for the one and two tile row page
+ * buffers of the SSD1309. The u8g2_DrawHVLine() decoder is selected by
+ * installing a wrapper around u8g2_ll_hvline_vertical_top_lsb, which the
+ * span decoder does not recognize. Then the glyph throughput of both
+ * decoders is timed for a line of text in each font.
+ *
+ *   glyph_span [-s seed]
+ *
+ * Exit status is 1 if any glyph differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+
+/** @brief a buffer of the SSD1309 */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+} layout_t;
+
+static const layout_t layouts[] = {
+  { "full buffer", u8g2_Setup_ssd1309_i2c_128x64_noname0_f },
+  { "page buffer 1", u8g2_Setup_ssd1309_i2c_128x64_noname0_1 },
+  { "page buffer 2", u8g2_Setup_ssd1309_i2c_128x64_noname0_2 },
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+/** @brief a font to check */
+typedef struct {
+  const char *name;
+  const uint8_t *font;
+} font_t;
+
+static const font_t fonts[] = {
+  { "t0_13_te", u8g2_font_t0_13_te },
+  { "helvB08_tr", u8g2_font_helvB08_tr },
+  { "ncenB14_tr", u8g2_font_ncenB14_tr },
+  { "inb16_mr", u8g2_font_inb16_mr },
+  { "logisoso32_tn", u8g2_font_logisoso32_tn },
+};
+#define FONTS (sizeof(fonts) / sizeof(fonts[0]))
+
+/* glyph origins: inside, at the edges and wrapped around to the left */
+static const u8g2_uint_t xs[] = { 0, 5, 121, 250 };
+#define XS (sizeof(xs) / sizeof(xs[0]))
+#define Y_MAX 80
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+/* same pixels as u8g2_ll_hvline_vertical_top_lsb, but not taken for the span decoder */
+static void ref_ll_hvline( u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir ) {
+  u8g2_ll_hvline_vertical_top_lsb(u8g2, x, y, len, dir);
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* draw a glyph page by page over init, the result in frame */
+static void render( u8g2_t *u8g2, int span, uint16_t encoding, u8g2_uint_t x, u8g2_uint_t y,
+                    const uint8_t *init, uint8_t *frame ) {
+  uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+  int rows, row;
+
+  u8g2->ll_hvline = span ? u8g2_ll_hvline_vertical_top_lsb : ref_ll_hvline;
+  u8g2_FirstPage(u8g2);
+  do {
+    row = u8g2_GetBufferCurrTileRow(u8g2);
+    rows = u8g2_GetBufferTileHeight(u8g2);
+    if ( row + rows > HEIGHT / 8 ) {
+      rows = HEIGHT / 8 - row;
+    }
+    memcpy(buf, init + row * WIDTH, rows * WIDTH);
+    u8g2_DrawGlyph(u8g2, x, y, encoding);
+    memcpy(frame + row * WIDTH, buf, rows * WIDTH);
+  } while ( u8g2_NextPage(u8g2) );
+}
+
+/* every glyph of every font, returns the number of mismatches */
+static long validate( const layout_t *l, u8g2_t *u8g2 ) {
+  static uint8_t init[FRAME_SIZE], ref[FRAME_SIZE], span[FRAME_SIZE];
+  long errors = 0;
+  long glyphs = 0;
+  int f, e, i, y, color, transparent;
+
+  l->setup(u8g2, U8G2_R0, byte_cb, gpio_cb);
+  u8g2_SetAutoPageClear(u8g2, 0);
+  for ( f = 0; f < FONTS; f++ ) {
+    u8g2_SetFont(u8g2, fonts[f].font);
+    for ( e = 0; e < 256; e++ ) {
+      if ( u8g2_IsGlyph(u8g2, e) == 0 ) {
+        continue;
+      }
+      for ( i = 0; i < FRAME_SIZE; i++ ) {
+        init[i] = rand();
+      }
+      for ( i = 0; i < XS; i++ ) {
+        for ( y = 0; y <= Y_MAX; y++ ) {
+          for ( color = 0; color <= 2; color++ ) {
+            for ( transparent = 0; transparent <= 1; transparent++ ) {
+              u8g2_SetDrawColor(u8g2, color);
+              u8g2_SetFontMode(u8g2, transparent);
+              render(u8g2, 0, e, xs[i], y, init, ref);
+              render(u8g2, 1, e, xs[i], y, init, span);
+              if ( memcmp(ref, span, FRAME_SIZE) != 0 ) {
+                if ( errors < 10 ) {
+                  printf("%s: %s mismatch glyph=%d x=%d y=%d color=%d transparent=%d\n",
+                         l->name, fonts[f].name, e, xs[i], y, color, transparent);
+                }
+                errors++;
+              }
+              glyphs++;
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %ld glyphs, %ld mismatches\n", l->name, glyphs, errors);
+  return errors;
+}
+
+/* ns per glyph of a line of text */
+static double time_text( u8g2_t *u8g2, int span, const char *text ) {
+  double start;
+  long n = 20000;
+  long i;
+
+  u8g2->ll_hvline = span ? u8g2_ll_hvline_vertical_top_lsb : ref_ll_hvline;
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    u8g2_DrawStr(u8g2, 0, 40, text);
+  }
+  return (now_ns() - start) / n / strlen(text);
+}
+
+int main( int argc, char **argv ) {
+  static const char text[] = "Grid 60.00 Hz";
+  static const char digits[] = "60.0012";
+  u8g2_t u8g2;
+  long errors = 0;
+  double t_ref, t_span;
+  const char *s;
+  int opt;
+  int i;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    errors += validate(&layouts[i], &u8g2);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  for ( i = 0; i < FONTS; i++ ) {
+    u8g2_SetFont(&u8g2, fonts[i].font);
+    s = fonts[i].font == u8g2_font_logisoso32_tn ? digits : text;
+    t_ref = time_text(&u8g2, 0, s);
+    t_span = time_text(&u8g2, 1, s);
+    printf("%s: %.1f ns per glyph with hvlines, %.1f ns spans, %.2fx\n",
+           fonts[i].name, t_ref, t_span, t_ref / t_span);
+  }
+  return errors ? 1 : 0;
+}
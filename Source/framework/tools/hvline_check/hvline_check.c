@@ -0,0 +1,168 @@
+/**
+ * @file hvline_check.c
+ *
+ * @brief host validation of the u8g2 hvline span kernels
+ *
+ * Compares u8g2_ll_hvline_vertical_top_lsb (SSD13xx) and
+ * u8g2_ll_hvline_horizontal_right_lsb (ST7920) as built with
+ * U8G2_HVLINE_SPEED_OPTIMIZATION against the pixel by pixel versions of
+ * u8g2_ll_hvline.c, which this file compiles a second time without the
+ * optimization. Every position, length and direction within a 128x64
+ * buffer is drawn with all three draw colors onto random buffer contents,
+ * and the buffers have to be identical. Then both versions are timed
+ * for a few typical lines.
+ *
+ *   hvline_check [-s seed]
+ *
+ * Exit status is 1 if any line differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+/* the reference: u8g2_ll_hvline.c without U8G2_HVLINE_SPEED_OPTIMIZATION */
+#undef U8G2_HVLINE_SPEED_OPTIMIZATION
+#define u8g2_ll_hvline_vertical_top_lsb ref_ll_hvline_vertical_top_lsb
+#define u8g2_ll_hvline_horizontal_right_lsb ref_ll_hvline_horizontal_right_lsb
+#include "u8g2_ll_hvline.c"
+#undef u8g2_ll_hvline_vertical_top_lsb
+#undef u8g2_ll_hvline_horizontal_right_lsb
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+
+typedef void (*hvline_fn)(u8g2_t *u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t len, uint8_t dir);
+
+/** @brief a buffer layout: the display it is set up with and both versions */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+  hvline_fn ref;
+  hvline_fn opt;
+} layout_t;
+
+static const layout_t layouts[] = {
+  { "vertical_top_lsb", u8g2_Setup_ssd1309_i2c_128x64_noname0_f,
+    ref_ll_hvline_vertical_top_lsb, u8g2_ll_hvline_vertical_top_lsb },
+  { "horizontal_right_lsb", u8g2_Setup_st7920_s_128x64_f,
+    ref_ll_hvline_horizontal_right_lsb, u8g2_ll_hvline_horizontal_right_lsb },
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+/* lines to time: x, y, len, dir */
+static const int timed[][4] = {
+  { 3, 5, 1, 0 }, { 3, 5, 6, 0 }, { 10, 16, 118, 0 }, { 0, 0, 128, 0 },
+  { 3, 5, 6, 1 }, { 13, 3, 58, 1 }, { 0, 0, 64, 1 }
+};
+#define TIMED (sizeof(timed) / sizeof(timed[0]))
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* every line on random contents, returns the number of mismatches */
+static long validate( const layout_t *l, u8g2_t *u8g2 ) {
+  static uint8_t init[FRAME_SIZE], ref[FRAME_SIZE], opt[FRAME_SIZE];
+  uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+  long errors = 0;
+  long lines = 0;
+  int x, y, len, dir, color, max;
+  int i;
+
+  for ( dir = 0; dir <= 1; dir++ ) {
+    for ( y = 0; y < HEIGHT; y++ ) {
+      for ( x = 0; x < WIDTH; x++ ) {
+        max = dir == 0 ? WIDTH - x : HEIGHT - y;
+        for ( i = 0; i < FRAME_SIZE; i++ ) {
+          init[i] = rand();
+        }
+        for ( len = 1; len <= max; len++ ) {
+          for ( color = 0; color <= 2; color++ ) {
+            u8g2->draw_color = color;
+            memcpy(buf, init, FRAME_SIZE);
+            l->ref(u8g2, x, y, len, dir);
+            memcpy(ref, buf, FRAME_SIZE);
+            memcpy(buf, init, FRAME_SIZE);
+            l->opt(u8g2, x, y, len, dir);
+            memcpy(opt, buf, FRAME_SIZE);
+            if ( memcmp(ref, opt, FRAME_SIZE) != 0 ) {
+              if ( errors < 10 ) {
+                printf("%s: mismatch x=%d y=%d len=%d dir=%d color=%d\n", l->name, x, y, len, dir, color);
+              }
+              errors++;
+            }
+            lines++;
+          }
+        }
+      }
+    }
+  }
+  printf("%s: %ld lines, %ld mismatches\n", l->name, lines, errors);
+  return errors;
+}
+
+static double time_line( u8g2_t *u8g2, hvline_fn fn, const int *line ) {
+  double start;
+  long n = 200000;
+  long i;
+
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    u8g2->draw_color = i % 3;
+    fn(u8g2, line[0], line[1], line[2], line[3]);
+  }
+  return (now_ns() - start) / n;
+}
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  long errors = 0;
+  double t_ref, t_opt;
+  int opt;
+  int i, j;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    layouts[i].setup(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+    errors += validate(&layouts[i], &u8g2);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    layouts[i].setup(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+    for ( j = 0; j < TIMED; j++ ) {
+      t_ref = time_line(&u8g2, layouts[i].ref, timed[j]);
+      t_opt = time_line(&u8g2, layouts[i].opt, timed[j]);
+      printf("%s x=%d y=%d len=%d dir=%d: %.1f ns per pixel, %.1f ns spans, %.2fx\n",
+             layouts[i].name, timed[j][0], timed[j][1], timed[j][2], timed[j][3],
+             t_ref, t_opt, t_ref / t_opt);
+    }
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file lcd_golden.c
+ *
+ * @brief golden image regression test of the LCD screens
+ *
+ * Renders every screen of lcd_screens.c for a set of system state and wifi
+ * fixtures with the firmware's widget code and u8g2 copy, the way
+ * lcd_module.c draws them (SSD1309 full frame buffer, U8G2_R0), and
+ * compares each frame pixel by pixel with a golden image in golden/.
+ *
+ * Every case is rendered four ways, which all have to match the golden
+ * image: with and without the glyph cache, each once onto a cleared
+ * buffer and once as a partial redraw over the frame of the previous
+ * fixture, as on the device.
+ *
+ *   lcd_golden [-d golden dir] [-u]
+ *
+ * -u writes the golden images instead of comparing. A mismatching frame
+ * is written to <case>.out.pbm in the current directory. Images are plain
+ * PBM (P1) files, one text line per pixel row.
+ *
+ * Exit status is 1 if any frame differs from its golden image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "u8g2.h"
+#include "lcd_screens.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+
+/** @brief a system state and wifi status to render */
+typedef struct {
+  const char *name;
+  float grid_freq;
+  float power;
+  int heating_status;
+  int set_point;
+  int mode;
+  int temp_top;
+  int temp_bottom;
+  float threshold_overfrq;
+  float threshold_underfrq;
+  int connected;
+  const char *ssid;
+  const char *ip;
+  const char *mac;
+} fixture_t;
+
+static const fixture_t fixtures[] = {
+  /* as set up by init_task, before any sensor or the wifi reported */
+  { "boot", 0, 0, 0, 100, 0, 0, 0, 60.01, 59.99, 0, "", "", "" },
+  { "nominal", 60.0012, 4512.25, 1, 120, 1, 118, 104, 60.01, 59.99,
+    1, "gridballast", "192.168.1.23", "24:0a:c4:00:12:ab" },
+  /* widest values: long SSID and address, negative and three digit numbers */
+  { "extremes", 59.9512, -12.5, 0, 200, 0, -4, 212, 60.99, 59.01,
+    1, "a-very-long-network-name-32-char", "255.255.255.255", "ff:ff:ff:ff:ff:ff" },
+};
+#define FIXTURES (sizeof(fixtures) / sizeof(fixtures[0]))
+
+/** @brief what is rendered: a fixture on a screen, with the list cursor on a row */
+typedef struct {
+  int fixture;
+  int screen;
+  int cursor;
+} render_case_t;
+
+static const char * const screen_names[LCD_SCREENS] = { "vitals", "options", "network" };
+
+static u8g2_glyph_cache_t cache;
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static void load_fixture( const fixture_t *f, lcd_ui_model_t *model ) {
+  memset(model, 0, sizeof(*model));
+  model->state.grid_freq = f->grid_freq;
+  model->state.power = f->power;
+  model->state.heating_status = f->heating_status;
+  model->state.set_point = f->set_point;
+  model->state.mode = f->mode;
+  model->state.temp_top = f->temp_top;
+  model->state.temp_bottom = f->temp_bottom;
+  model->state.threshold_overfrq = f->threshold_overfrq;
+  model->state.threshold_underfrq = f->threshold_underfrq;
+  model->net.started = 1;
+  model->net.connected = f->connected;
+  snprintf(model->net.ssid, sizeof(model->net.ssid), "%s", f->ssid);
+  snprintf(model->net.ip, sizeof(model->net.ip), "%s", f->ip);
+  snprintf(model->net.mac, sizeof(model->net.mac), "%s", f->mac);
+}
+
+/**
+ * @brief render a case into frame
+ *
+ * @param c - the case
+ * @param use_cache - draw with the glyph cache, as the device does
+ * @param partial - first draw the previous fixture, then redraw the changes
+ * @param frame - FRAME_SIZE bytes, the u8g2 buffer layout
+ */
+static void render( const render_case_t *c, int use_cache, int partial, uint8_t *frame ) {
+  u8g2_t u8g2;
+  lcd_ui_t ui;
+  lcd_ui_model_t model;
+  int i;
+
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  u8g2_SetGlyphCache(&u8g2, use_cache ? &cache : NULL);
+  memset(u8g2_GetBufferPtr(&u8g2), 0x55, FRAME_SIZE);   /* must be cleared by the UI */
+
+  lcd_screens_init(&ui);
+  load_fixture(&fixtures[partial ? (c->fixture + FIXTURES - 1) % FIXTURES : c->fixture], &model);
+  for ( i = 0; i < c->screen; i++ ) {
+    lcd_ui_key(&ui, LCD_UI_KEY_MENU, &model);
+  }
+  for ( i = 0; i < c->cursor; i++ ) {
+    lcd_ui_key(&ui, LCD_UI_KEY_SELECT, &model);
+  }
+  lcd_ui_update(&ui, &model);
+  lcd_ui_draw(&ui, &u8g2, 0);
+
+  if ( partial ) {
+    load_fixture(&fixtures[c->fixture], &model);
+    lcd_ui_update(&ui, &model);
+    lcd_ui_draw(&ui, &u8g2, 0);
+  }
+  memcpy(frame, u8g2_GetBufferPtr(&u8g2), FRAME_SIZE);
+}
+
+static int get_pixel( const uint8_t *frame, int x, int y ) {
+  return (frame[(y / 8) * WIDTH + x] >> (y & 7)) & 1;
+}
+
+static int write_pbm( const char *path, const uint8_t *frame ) {
+  FILE *f;
+  int x, y;
+
+  f = fopen(path, "w");
+  if ( f == NULL ) {
+    perror(path);
+    return -1;
+  }
+  fprintf(f, "P1\n%d %d\n", WIDTH, HEIGHT);
+  for ( y = 0; y < HEIGHT; y++ ) {
+    for ( x = 0; x < WIDTH; x++ ) {
+      fputc('0' + get_pixel(frame, x, y), f);
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+  return 0;
+}
+
+static int read_pbm( const char *path, uint8_t *frame ) {
+  FILE *f;
+  int w, h, c;
+  int n = 0;
+
+  f = fopen(path, "r");
+  if ( f == NULL ) {
+    perror(path);
+    return -1;
+  }
+  if ( fscanf(f, "P1 %d %d", &w, &h) != 2 || w != WIDTH || h != HEIGHT ) {
+    fprintf(stderr, "%s: not a %dx%d plain PBM\n", path, WIDTH, HEIGHT);
+    fclose(f);
+    return -1;
+  }
+  memset(frame, 0, FRAME_SIZE);
+  while ( n < WIDTH * HEIGHT && (c = fgetc(f)) != EOF ) {
+    if ( c == '0' || c == '1' ) {
+      frame[(n / WIDTH / 8) * WIDTH + n % WIDTH] |= (c - '0') << ((n / WIDTH) & 7);
+      n++;
+    }
+  }
+  fclose(f);
+  if ( n != WIDTH * HEIGHT ) {
+    fprintf(stderr, "%s: short image\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/* number of differing pixels, with their bounding box */
+static int compare( const uint8_t *a, const uint8_t *b, int box[4] ) {
+  int x, y;
+  int diffs = 0;
+
+  box[0] = WIDTH; box[1] = HEIGHT; box[2] = -1; box[3] = -1;
+  for ( y = 0; y < HEIGHT; y++ ) {
+    for ( x = 0; x < WIDTH; x++ ) {
+      if ( get_pixel(a, x, y) != get_pixel(b, x, y) ) {
+        diffs++;
+        if ( x < box[0] ) box[0] = x;
+        if ( y < box[1] ) box[1] = y;
+        if ( x > box[2] ) box[2] = x;
+        if ( y > box[3] ) box[3] = y;
+      }
+    }
+  }
+  return diffs;
+}
+
+int main( int argc, char **argv ) {
+  static const char * const way_names[4] = { "full", "full, cached", "partial", "partial, cached" };
+  const char *dir = "golden";
+  render_case_t cases[FIXTURES * LCD_SCREENS + 3];
+  uint8_t golden[FRAME_SIZE];
+  uint8_t frame[FRAME_SIZE];
+  char name[64];
+  char path[256];
+  int ncases = 0;
+  int update = 0;
+  int failed = 0;
+  int box[4];
+  int diffs;
+  int opt;
+  int i, way;
+
+  while ( (opt = getopt(argc, argv, "d:u")) != -1 ) {
+    switch ( opt ) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'u':
+      update = 1;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-d golden dir] [-u]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  /* every screen for every fixture, and the other rows of the options list */
+  for ( i = 0; i < FIXTURES * LCD_SCREENS; i++ ) {
+    cases[ncases].fixture = i / LCD_SCREENS;
+    cases[ncases].screen = i % LCD_SCREENS;
+    cases[ncases].cursor = 0;
+    ncases++;
+  }
+  for ( i = 1; i <= 3; i++ ) {
+    cases[ncases].fixture = 1;
+    cases[ncases].screen = LCD_SCREEN_OPTIONS;
+    cases[ncases].cursor = i;
+    ncases++;
+  }
+
+  for ( i = 0; i < ncases; i++ ) {
+    snprintf(name, sizeof(name), "%s_%s", fixtures[cases[i].fixture].name, screen_names[cases[i].screen]);
+    if ( cases[i].cursor != 0 ) {
+      snprintf(name + strlen(name), sizeof(name) - strlen(name), "_row%d", cases[i].cursor);
+    }
+    snprintf(path, sizeof(path), "%s/%s.pbm", dir, name);
+
+    if ( update ) {
+      render(&cases[i], 1, 0, frame);
+      if ( write_pbm(path, frame) != 0 ) {
+        return 1;
+      }
+      printf("%s: written\n", path);
+      continue;
+    }
+
+    if ( read_pbm(path, golden) != 0 ) {
+      failed++;
+      continue;
+    }
+    for ( way = 0; way < 4; way++ ) {
+      render(&cases[i], way & 1, way >> 1, frame);
+      diffs = compare(golden, frame, box);
+      if ( diffs != 0 ) {
+        printf("%s (%s): FAIL, %d pixels differ in %d,%d..%d,%d\n",
+               name, way_names[way], diffs, box[0], box[1], box[2], box[3]);
+        snprintf(path, sizeof(path), "%s.out.pbm", name);
+        write_pbm(path, frame);
+        failed++;
+        break;
+      }
+    }
+    if ( way == 4 ) {
+      printf("%s: ok\n", name);
+    }
+  }
+
+  if ( !update ) {
+    printf("%d of %d cases failed\n", failed, ncases);
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+/**
+ * @file modbus_emu.c
+ *
+ * @brief Host side Modbus RTU slave emulator and master exerciser
+ *
+ * Runs the firmware's Modbus master (main/modbus_rtu.c) against an
+ * emulated slave over a pseudo terminal, so the framing, CRC, pipelining
+ * and register mapping can be checked without an appliance on the bench.
+ *
+ *   modbus_emu slave [address]        serve a register file on a new pty
+ *                                     and print its path
+ *   modbus_emu poll <tty> [address] [transactions]
+ *                                     poll a slave (the emulator or a real
+ *                                     one behind a USB adapter) and print
+ *                                     the decoded state and counters
+ *   modbus_emu self [transactions]    both of the above over one pty pair,
+ *                                     with injected CRC errors and silence
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "modbus_rtu.h"
+
+/** @brief silence that ends a frame, generous for pty scheduling jitter */
+#define EMU_GAP_MS 5
+#define EMU_REGS 256
+
+static const modbus_block_t emu_blocks[] = {
+  { 1, MODBUS_READ_INPUT, 0, 4 },
+  { 1, MODBUS_READ_HOLDING, 100, 2 },
+};
+
+static const modbus_map_t emu_map[] = {
+  { 1, MODBUS_READ_INPUT, 0, MODBUS_FIELD_TEMP_TOP, 1, 9, 50, 32 },
+  { 1, MODBUS_READ_INPUT, 1, MODBUS_FIELD_TEMP_BOTTOM, 1, 9, 50, 32 },
+  { 1, MODBUS_READ_INPUT, 2, MODBUS_FIELD_HEATING, 0, 1, 1, 0 },
+  { 1, MODBUS_READ_INPUT, 3, MODBUS_FIELD_POWER, 0, 1, 1, 0 },
+  { 1, MODBUS_READ_HOLDING, 100, MODBUS_FIELD_SET_POINT, 0, 1, 1, 0 },
+};
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static uint32_t now_ms( void ) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void raw_mode( int fd ) {
+  struct termios t;
+
+  if ( tcgetattr(fd, &t) == 0 ) {
+    cfmakeraw(&t);
+    cfsetispeed(&t, B19200);
+    cfsetospeed(&t, B19200);
+    tcsetattr(fd, TCSANOW, &t);
+  }
+}
+
+/**
+ * @brief read one frame: bytes until EMU_GAP_MS of silence
+ *
+ * @return frame length, 0 if nothing arrived within wait_ms, -1 on error
+ */
+static int read_frame( int fd, uint8_t *buf, size_t size, int wait_ms ) {
+  struct pollfd p = { fd, POLLIN, 0 };
+  size_t len = 0;
+  ssize_t n;
+  int r;
+
+  r = poll(&p, 1, wait_ms);
+  while ( r > 0 ) {
+    n = read(fd, buf + len, size - len);
+    if ( n <= 0 ) {
+      return len > 0 ? (int)len : -1;
+    }
+    len += n;
+    if ( len == size ) {
+      break;
+    }
+    r = poll(&p, 1, EMU_GAP_MS);
+  }
+  return r < 0 ? -1 : (int)len;
+}
+
+static void put_u16( uint8_t *p, uint16_t v ) {
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+}
+
+static size_t add_crc( uint8_t *frame, size_t len ) {
+  uint16_t crc = modbus_crc16(frame, len);
+
+  frame[len] = crc & 0xFF;
+  frame[len + 1] = crc >> 8;
+  return len + 2;
+}
+
+/**
+ * @brief answer requests for one address until the line closes
+ *
+ * Every fault_every-th request is answered with a corrupted CRC and the
+ * one after it not at all (0 disables the faults).
+ */
+static void serve( int fd, uint8_t address, int fault_every ) {
+  uint16_t holding[EMU_REGS];
+  uint16_t input[EMU_REGS];
+  uint8_t req[MODBUS_MAX_FRAME];
+  uint8_t rsp[MODBUS_MAX_FRAME];
+  uint16_t start, count, *regs;
+  unsigned served = 0;
+  size_t len;
+  int n, i;
+
+  memset(holding, 0, sizeof(holding));
+  memset(input, 0, sizeof(input));
+  input[0] = 512;       /* 51.2 C top */
+  input[1] = 384;       /* 38.4 C bottom */
+  input[2] = 1;         /* heating */
+  input[3] = 4500;      /* W */
+  holding[100] = 125;   /* set point F */
+
+  for ( ;; ) {
+    n = read_frame(fd, req, sizeof(req), -1);
+    if ( n < 0 ) {
+      return;
+    }
+    if ( n < 8 || req[0] != address || modbus_crc16(req, n - 2) != (req[n - 2] | req[n - 1] << 8) ) {
+      continue;   /* not ours or damaged: a slave stays silent */
+    }
+    served++;
+    if ( fault_every > 0 && served % fault_every == 1 && served > 1 ) {
+      continue;
+    }
+
+    start = req[2] << 8 | req[3];
+    count = req[4] << 8 | req[5];
+    rsp[0] = address;
+    rsp[1] = req[1];
+    switch ( req[1] ) {
+      case MODBUS_READ_HOLDING:
+      case MODBUS_READ_INPUT:
+        regs = req[1] == MODBUS_READ_HOLDING ? holding : input;
+        if ( count == 0 || count > MODBUS_MAX_REGS || start + count > EMU_REGS ) {
+          rsp[1] |= 0x80;
+          rsp[2] = 0x02;  /* illegal data address */
+          len = 3;
+          break;
+        }
+        rsp[2] = count * 2;
+        for ( i = 0; i < count; i++ ) {
+          put_u16(&rsp[3 + 2 * i], regs[start + i]);
+        }
+        len = 3 + count * 2;
+        input[0] += 1;  /* keep the temperature moving */
+        break;
+      case MODBUS_WRITE_SINGLE:
+        if ( start >= EMU_REGS ) {
+          rsp[1] |= 0x80;
+          rsp[2] = 0x02;
+          len = 3;
+          break;
+        }
+        holding[start] = count;
+        memcpy(rsp, req, 6);
+        len = 6;
+        break;
+      default:
+        rsp[1] |= 0x80;
+        rsp[2] = 0x01;    /* illegal function */
+        len = 3;
+        break;
+    }
+    len = add_crc(rsp, len);
+    if ( fault_every > 0 && served % fault_every == 0 ) {
+      rsp[len - 1] ^= 0xFF;
+    }
+    if ( write(fd, rsp, len) != (ssize_t)len ) {
+      return;
+    }
+  }
+}
+
+static void master_tx( const uint8_t *data, size_t len, void *ctx ) {
+  int fd = *(int *)ctx;
+
+  if ( write(fd, data, len) != (ssize_t)len ) {
+    perror("write");
+  }
+}
+
+static system_state_t state;
+
+static void master_block( const modbus_block_t *block, const uint16_t *regs, void *ctx ) {
+  modbus_map_apply(emu_map, sizeof(emu_map) / sizeof(emu_map[0]), block, regs, &state);
+}
+
+/**
+ * @brief run transactions against a slave and print the results
+ *
+ * @return number of failed transactions
+ */
+static int run_master( int fd, uint8_t address, int transactions, modbus_stats_t *out ) {
+  modbus_master_t m;
+  modbus_stats_t stats;
+  modbus_block_t blocks[sizeof(emu_blocks) / sizeof(emu_blocks[0])];
+  uint8_t frame[MODBUS_MAX_FRAME];
+  uint32_t last_rx = now_ms();
+  uint32_t begin = now_ms();
+  int failed = 0;
+  int result;
+  int done = 0;
+  int n, i;
+
+  for ( i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++ ) {
+    blocks[i] = emu_blocks[i];
+    blocks[i].slave = address;
+  }
+  memset(&state, 0, sizeof(state));
+  modbus_master_init(&m, blocks, sizeof(blocks) / sizeof(blocks[0]), MODBUS_MAX_FRAME,
+                     master_tx, master_block, &fd);
+
+  while ( done < transactions ) {
+    if ( !m.active && modbus_master_start(&m, address, now_ms()) != MODBUS_SUCCESS ) {
+      fprintf(stderr, "no blocks for slave %u\n", address);
+      return transactions;
+    }
+    n = read_frame(fd, frame, sizeof(frame), 1);
+    if ( n < 0 ) {
+      perror("read");
+      return transactions;
+    }
+    if ( n > 0 ) {
+      last_rx = now_ms();
+      modbus_master_rx(&m, frame, n, last_rx);
+    }
+    modbus_master_poll(&m, now_ms() - last_rx >= EMU_GAP_MS, now_ms());
+    if ( modbus_master_done(&m, &result) ) {
+      done++;
+      if ( result != MODBUS_SUCCESS ) {
+        failed++;
+      }
+    }
+  }
+
+  modbus_master_get_stats(&m, &stats);
+  printf("state: top %d F, bottom %d F, set point %d F, heating %d, power %.0f W\n",
+         state.temp_top, state.temp_bottom, state.set_point, state.heating_status, state.power);
+  printf("transactions %d, failed %d, %u ms\n", transactions, failed, now_ms() - begin);
+  printf("requests %u, responses %u, crc %u, length %u, unexpected %u, exceptions %u, timeouts %u\n",
+         stats.requests, stats.responses, stats.crc_errors, stats.length_errors,
+         stats.unexpected, stats.exceptions, stats.timeouts);
+  printf("latency last %u ms, max %u ms, avg %u ms\n", stats.last_latency_ms, stats.max_latency_ms,
+         stats.responses ? (unsigned)(stats.total_latency_ms / stats.responses) : 0);
+  if ( out ) {
+    *out = stats;
+  }
+  return failed;
+}
+
+static int open_pty( void ) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if ( fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ) {
+    perror("pty");
+    exit(1);
+  }
+  raw_mode(fd);
+  return fd;
+}
+
+static int open_tty( const char *path ) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+
+  if ( fd < 0 ) {
+    perror(path);
+    exit(1);
+  }
+  raw_mode(fd);
+  return fd;
+}
+
+static void usage( void ) {
+  fprintf(stderr, "usage: modbus_emu slave [address]\n"
+                  "       modbus_emu poll <tty> [address] [transactions]\n"
+                  "       modbus_emu self [transactions]\n");
+  exit(2);
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int main( int argc, char **argv ) {
+  int master, slave, failed;
+  int transactions;
+  modbus_stats_t stats;
+  pid_t pid;
+
+  if ( argc < 2 ) {
+    usage();
+  }
+
+  if ( strcmp(argv[1], "slave") == 0 ) {
+    master = open_pty();
+    printf("%s\n", ptsname(master));
+    fflush(stdout);
+    serve(master, argc > 2 ? atoi(argv[2]) : 1, 0);
+    return 0;
+  }
+
+  if ( strcmp(argv[1], "poll") == 0 ) {
+    if ( argc < 3 ) {
+      usage();
+    }
+    slave = open_tty(argv[2]);
+    return run_master(slave, argc > 3 ? atoi(argv[3]) : 1, argc > 4 ? atoi(argv[4]) : 10, NULL) != 0;
+  }
+
+  if ( strcmp(argv[1], "self") == 0 ) {
+    transactions = argc > 2 ? atoi(argv[2]) : 100;
+    master = open_pty();
+    slave = open_tty(ptsname(master));
+    pid = fork();
+    if ( pid == 0 ) {
+      close(slave);
+      serve(master, 1, 7);
+      _exit(0);
+    }
+    close(master);
+    run_master(slave, 1, transactions, &stats);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    /* only the injected faults may fail: every 7th response has a bad CRC
+     * and the request after it goes unanswered */
+    failed = stats.length_errors + stats.unexpected + stats.exceptions;
+    failed += stats.responses + stats.crc_errors + stats.timeouts != stats.requests;
+    failed += stats.crc_errors != stats.requests / 7;
+    failed += state.set_point != 125 || state.power != 4500;
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed != 0;
+  }
+
+  usage();
+  return 2;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file policy_bench.c
+ *
+ * @brief host benchmark of compiled control policies
+ *
+ * Loads policy images written by 'ugl file policy' (hex, as sent through
+ * OpenChirp) with the firmware's policy_vm.c and runs each of them for a
+ * number of tick events over a spread of grid frequencies, tank
+ * temperatures and modes, like the controller task does every 500 ms.
+ * Reports the cost per event from policy_vm_get_stats() and the wall clock
+ * time of the whole run, which is finer than the us resolution of the
+ * per-run counters.
+ *
+ *   policy_bench [-n events] [-s seed] image.hex...
+ *
+ * Exit status is 1 if an image does not load or a run fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "policy_vm.h"
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* read the hex image, trailing white space removed */
+static char *read_hex( const char *name ) {
+  static char hex[2 * (POLICY_VM_IMAGE_HEADER_SIZE + POLICY_VM_MAX_CODE) + 2];
+  FILE *fp;
+  size_t len;
+
+  fp = fopen(name, "r");
+  if ( fp == NULL ) {
+    return NULL;
+  }
+  len = fread(hex, 1, sizeof(hex) - 1, fp);
+  fclose(fp);
+  while ( len > 0 && (hex[len - 1] == '\n' || hex[len - 1] == '\r' || hex[len - 1] == ' ') ) {
+    len--;
+  }
+  hex[len] = '\0';
+  return hex;
+}
+
+/* a system state around the frequency thresholds */
+static void random_state( system_state_t *state ) {
+  memset(state, 0, sizeof(*state));
+  state->grid_freq = 59.9f + (rand() % 2001) / 10000.0f;
+  state->threshold_overfrq = 60.05f;
+  state->threshold_underfrq = 59.95f;
+  state->temp_top = 90 + rand() % 71;
+  state->temp_bottom = state->temp_top - rand() % 20;
+  state->set_point = 120;
+  state->heating_status = rand() % 2;
+  state->power = rand() % 4500;
+  state->mode = rand() % 4 != 0;
+}
+
+/* run one image, returns the number of failed runs or -1 */
+static long bench( const char *name, long events ) {
+  system_state_t state;
+  policy_vm_output_t out;
+  policy_vm_stats_t stats;
+  const char *hex;
+  unsigned long long instructions = 0;
+  long set_points = 0;
+  long errors = 0;
+  double start, elapsed;
+  long i;
+
+  hex = read_hex(name);
+  if ( hex == NULL || policy_vm_load_hex(hex) != POLICY_VM_SUCCESS ) {
+    printf("%s: can not load the policy image\n", name);
+    return -1;
+  }
+
+  start = now_ns();
+  for ( i = 0; i < events; i++ ) {
+    random_state(&state);
+    if ( policy_vm_run(POLICY_EVENT_TICK, &state, &out) != POLICY_VM_SUCCESS ) {
+      errors++;
+    }
+    policy_vm_get_stats(&stats);
+    instructions += stats.last_instructions;
+    set_points += out.set_point_valid;
+  }
+  elapsed = now_ns() - start;
+
+  policy_vm_get_stats(&stats);
+  printf("%s: %u events, %ld set point requests, %u errors (budget %u)\n",
+         name, stats.runs, set_points, stats.errors, stats.budget_exceeded);
+  printf("%s: %.1f instructions per event (max %u), %.3f us per event (max %u us), %.0f ns per event wall clock\n",
+         name, (double)instructions / events, stats.max_instructions,
+         (double)stats.total_us / stats.runs, stats.max_us, elapsed / events);
+  return errors;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int main( int argc, char **argv ) {
+  long events = 100000;
+  long errors = 0;
+  long r;
+  int opt;
+  int i;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "n:s:")) != -1 ) {
+    switch ( opt ) {
+    case 'n':
+      events = atol(optarg);
+      break;
+    case 's':
+      srand(atoi(optarg));
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if ( optind >= argc || events <= 0 ) {
+    fprintf(stderr, "usage: %s [-n events] [-s seed] image.hex...\n", argv[0]);
+    return 2;
+  }
+
+  policy_vm_init();
+  for ( i = optind; i < argc; i++ ) {
+    r = bench(argv[i], events);
+    errors += r < 0 ? 1 : r;
+  }
+  return errors ? 1 : 0;
+}
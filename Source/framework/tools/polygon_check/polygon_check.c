@@ -0,0 +1,366 @@
+/**
+ * @file polygon_check.c
+ *
+ * @brief host validation and timing of the u8g2 polygon rasterizer
+ *
+ * Convex polygons of up to 6 points, random in size, position (also
+ * partly or completely outside the display), orientation and starting
+ * point, and with many flat and collinear edges, are drawn with
+ * u8g2_DrawPolygon() and with the former convex polygon procedure in
+ * pg_convex_ref.c, and the frames have to be identical. Then polygons of
+ * up to MAX_POINTS arbitrary points, concave and self-intersecting, are
+ * compared with a slow scan line fill of the same rules, which steps
+ * every edge from its top on every scan line. Both are done with the full
+ * buffer and the one and two tile row page buffers of the SSD1309, with
+ * U8G2_R0, U8G2_R1 and U8G2_R2.
+ *
+ * Then both procedures are timed for a hexagon, as a full frame and as
+ * a picture loop of 8 pages, which the rasterizer skips except for the
+ * pages with the polygon.
+ *
+ *   polygon_check [-s seed] [-n polygons]
+ *
+ * Exit status is 1 if any polygon differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define FRAME_SIZE (WIDTH * HEIGHT / 8)
+#define MAX_POINTS 40
+
+void ref_DrawConvexPolygon(u8g2_t *u8g2, const int16_t *xy, uint8_t cnt);
+
+/** @brief a buffer of the SSD1309 with a rotation */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2, const u8g2_cb_t *rotation, u8x8_msg_cb byte_cb, u8x8_msg_cb gpio_and_delay_cb);
+  const u8g2_cb_t *rotation;
+} layout_t;
+
+static const layout_t layouts[] = {
+  { "full buffer, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_f, U8G2_R0 },
+  { "page buffer 1, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R0 },
+  { "page buffer 2, R0", u8g2_Setup_ssd1309_i2c_128x64_noname0_2, U8G2_R0 },
+  { "full buffer, R1", u8g2_Setup_ssd1309_i2c_128x64_noname0_f, U8G2_R1 },
+  { "page buffer 1, R1", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R1 },
+  { "page buffer 1, R2", u8g2_Setup_ssd1309_i2c_128x64_noname0_1, U8G2_R2 },
+};
+#define LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
+/* procedures to compare */
+#define DRAW_RASTERIZER 0
+#define DRAW_CONVEX_REF 1
+#define DRAW_SLOW_REF 2
+
+static u8g2_pg_point_t points[MAX_POINTS];
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int rnd( int lo, int hi ) {
+  return lo + rand() % (hi - lo + 1);
+}
+
+/* x of the edge from (x1,y1) down to (x2,y2) on scan line y, the line algorithm of u8g2_polygon.c */
+static int edge_x( int x1, int y1, int x2, int y2, int y ) {
+  int dx = x2 - x1;
+  int h = y2 - y1;
+  int dir = dx >= 0 ? 1 : -1;
+  int error = dx >= 0 ? 0 : 1 - h;
+  int x = x1;
+  int k;
+
+  for ( k = y1; k < y; k++ ) {
+    x += dx / h;
+    error += abs(dx) % h;
+    if ( error > 0 ) {
+      x += dir;
+      error -= h;
+    }
+  }
+  return x;
+}
+
+static int cmp_int( const void *a, const void *b ) {
+  return *(const int *)a - *(const int *)b;
+}
+
+/* even-odd scan line fill with the rules of u8g2_polygon.c, every edge on every scan line */
+static void slow_fill( u8g2_t *u8g2, const int16_t *xy, int cnt ) {
+  int xs[MAX_POINTS];
+  int min_y = xy[1], max_y = xy[1];
+  int i, n, y, x1, x2, ya, yb;
+
+  for ( i = 1; i < cnt; i++ ) {
+    if ( xy[2 * i + 1] < min_y ) min_y = xy[2 * i + 1];
+    if ( xy[2 * i + 1] > max_y ) max_y = xy[2 * i + 1];
+  }
+  for ( y = min_y; y < max_y; y++ ) {
+    if ( y < 0 || y >= u8g2_GetDisplayHeight(u8g2) ) {
+      continue;
+    }
+    n = 0;
+    for ( i = 0; i < cnt; i++ ) {
+      const int16_t *p = xy + 2 * i;
+      const int16_t *q = xy + 2 * ((i + 1) % cnt);
+      if ( p[1] == q[1] ) {
+        continue;
+      }
+      if ( p[1] > q[1] ) {
+        const int16_t *t = p;
+        p = q;
+        q = t;
+      }
+      ya = p[1];
+      yb = q[1];
+      if ( (ya < y && y <= yb) || (ya == y && y == min_y) ) {
+        xs[n++] = edge_x(p[0], ya, q[0], yb, y);
+      }
+    }
+    qsort(xs, n, sizeof(int), cmp_int);
+    for ( i = 0; i + 1 < n; i += 2 ) {
+      x1 = xs[i] < 0 ? 0 : xs[i];
+      x2 = xs[i + 1] > u8g2_GetDisplayWidth(u8g2) ? u8g2_GetDisplayWidth(u8g2) : xs[i + 1];
+      if ( x1 < x2 ) {
+        u8g2_DrawHLine(u8g2, x1, y, x2 - x1);
+      }
+    }
+  }
+}
+
+static void draw( u8g2_t *u8g2, int how, const int16_t *xy, int cnt ) {
+  int i;
+
+  switch ( how ) {
+  case DRAW_RASTERIZER:
+    u8g2_ClearPolygonXY();
+    for ( i = 0; i < cnt; i++ ) {
+      u8g2_AddPolygonXY(u8g2, xy[2 * i], xy[2 * i + 1]);
+    }
+    u8g2_DrawPolygon(u8g2);
+    break;
+  case DRAW_CONVEX_REF:
+    ref_DrawConvexPolygon(u8g2, xy, cnt);
+    break;
+  default:
+    slow_fill(u8g2, xy, cnt);
+    break;
+  }
+}
+
+/* picture loop over a cleared frame, the result in frame */
+static void render( u8g2_t *u8g2, int how, const int16_t *xy, int cnt, uint8_t *frame ) {
+  uint8_t *buf = u8g2_GetBufferPtr(u8g2);
+  int rows, row;
+
+  u8g2_FirstPage(u8g2);
+  do {
+    row = u8g2_GetBufferCurrTileRow(u8g2);
+    rows = u8g2_GetBufferTileHeight(u8g2);
+    if ( row + rows > HEIGHT / 8 ) {
+      rows = HEIGHT / 8 - row;
+    }
+    draw(u8g2, how, xy, cnt);
+    memcpy(frame + row * WIDTH, buf, rows * WIDTH);
+  } while ( u8g2_NextPage(u8g2) );
+}
+
+/* convex hull of the points (monotone chain), returns the number of hull points */
+static int cross( const int16_t *o, const int16_t *a, const int16_t *b ) {
+  return (a[0] - o[0]) * (b[1] - o[1]) - (a[1] - o[1]) * (b[0] - o[0]);
+}
+
+static int cmp_point( const void *a, const void *b ) {
+  const int16_t *p = a, *q = b;
+  return p[0] != q[0] ? p[0] - q[0] : p[1] - q[1];
+}
+
+static int hull( int16_t *xy, int cnt, int16_t *out ) {
+  int k = 0;
+  int i, t;
+
+  qsort(xy, cnt, 2 * sizeof(int16_t), cmp_point);
+  for ( i = 0; i < cnt; i++ ) {
+    while ( k >= 2 && cross(out + 2 * (k - 2), out + 2 * (k - 1), xy + 2 * i) <= 0 ) k--;
+    out[2 * k] = xy[2 * i]; out[2 * k + 1] = xy[2 * i + 1]; k++;
+  }
+  for ( i = cnt - 2, t = k + 1; i >= 0; i-- ) {
+    while ( k >= t && cross(out + 2 * (k - 2), out + 2 * (k - 1), xy + 2 * i) <= 0 ) k--;
+    out[2 * k] = xy[2 * i]; out[2 * k + 1] = xy[2 * i + 1]; k++;
+  }
+  return k - 1;
+}
+
+/* a random convex polygon of 3..6 points, 0 if the points are collinear */
+static int random_convex( int16_t *xy ) {
+  int16_t pts[2 * 12], h[2 * 26];
+  int x0, y0, size, n, cnt, i, start, reverse;
+
+  switch ( rand() % 3 ) {
+  case 0:		/* small, many flat and collinear edges */
+    size = rnd(1, 12);
+    break;
+  case 1:
+    size = rnd(10, 80);
+    break;
+  default:		/* large, mostly clipped */
+    size = rnd(80, 400);
+    break;
+  }
+  x0 = rnd(-size, WIDTH + 10);
+  y0 = rnd(-size, HEIGHT + 10);
+  n = rnd(3, 12);
+  for ( i = 0; i < n; i++ ) {
+    pts[2 * i] = x0 + rnd(0, size);
+    pts[2 * i + 1] = y0 + rnd(0, size);
+  }
+  cnt = hull(pts, n, h);
+  if ( cnt < 3 ) {
+    return 0;
+  }
+  if ( cnt > 6 ) {
+    cnt = 6;
+  }
+  start = rand() % cnt;
+  reverse = rand() & 1;
+  for ( i = 0; i < cnt; i++ ) {
+    int j = reverse ? (start + cnt - i) % cnt : (start + i) % cnt;
+    xy[2 * i] = h[2 * j];
+    xy[2 * i + 1] = h[2 * j + 1];
+  }
+  /* cutting the hull to 6 points keeps it convex: a subset of the hull points in order */
+  return cnt;
+}
+
+/* a random polygon of 3..MAX_POINTS points, any shape */
+static int random_polygon( int16_t *xy ) {
+  int cnt = rnd(3, MAX_POINTS);
+  int size = rnd(4, 200);
+  int x0 = rnd(-size / 2, WIDTH);
+  int y0 = rnd(-size / 2, HEIGHT);
+  int i;
+
+  for ( i = 0; i < cnt; i++ ) {
+    xy[2 * i] = x0 + rnd(0, size);
+    xy[2 * i + 1] = y0 + rnd(0, size);
+  }
+  return cnt;
+}
+
+/* returns the number of mismatches */
+static long validate( const layout_t *l, u8g2_t *u8g2, long n ) {
+  static uint8_t ref[FRAME_SIZE], out[FRAME_SIZE];
+  int16_t xy[2 * MAX_POINTS];
+  long errors = 0;
+  long convex = 0, other = 0;
+  int cnt, pass, i;
+  long k;
+
+  l->setup(u8g2, l->rotation, byte_cb, gpio_cb);
+  for ( pass = 0; pass < 2; pass++ ) {
+    for ( k = 0; k < n; k++ ) {
+      cnt = pass == 0 ? random_convex(xy) : random_polygon(xy);
+      if ( cnt == 0 ) {
+        continue;
+      }
+      render(u8g2, pass == 0 ? DRAW_CONVEX_REF : DRAW_SLOW_REF, xy, cnt, ref);
+      render(u8g2, DRAW_RASTERIZER, xy, cnt, out);
+      if ( memcmp(ref, out, FRAME_SIZE) != 0 ) {
+        if ( errors < 5 ) {
+          printf("%s: %s mismatch:", l->name, pass == 0 ? "convex" : "polygon");
+          for ( i = 0; i < cnt; i++ ) {
+            printf(" %d,%d", xy[2 * i], xy[2 * i + 1]);
+          }
+          printf("\n");
+        }
+        errors++;
+      }
+      if ( pass == 0 ) {
+        convex++;
+      } else {
+        other++;
+      }
+    }
+  }
+  printf("%s: %ld convex, %ld other polygons, %ld mismatches\n", l->name, convex, other, errors);
+  return errors;
+}
+
+/* ns per picture loop */
+static double time_polygon( u8g2_t *u8g2, int how, const int16_t *xy, int cnt ) {
+  double start;
+  long n = 20000;
+  long i;
+
+  start = now_ns();
+  for ( i = 0; i < n; i++ ) {
+    u8g2_FirstPage(u8g2);
+    do {
+      draw(u8g2, how, xy, cnt);
+    } while ( u8g2_NextPage(u8g2) );
+  }
+  return (now_ns() - start) / n;
+}
+
+int main( int argc, char **argv ) {
+  static const int16_t hexagon[] = { 64, 8, 100, 20, 100, 44, 64, 56, 28, 44, 28, 20 };
+  static const int16_t small_hexagon[] = { 20, 10, 30, 14, 30, 22, 20, 26, 10, 22, 10, 14 };
+  u8g2_t u8g2;
+  long errors = 0;
+  long n = 20000;
+  double t_ref, t_new;
+  int opt;
+  int i;
+
+  srand(1);
+  while ( (opt = getopt(argc, argv, "s:n:")) != -1 ) {
+    switch ( opt ) {
+    case 's':
+      srand(atoi(optarg));
+      break;
+    case 'n':
+      n = atol(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-n polygons]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  u8g2_SetPolygonBuffer(points, MAX_POINTS);
+  for ( i = 0; i < LAYOUTS; i++ ) {
+    errors += validate(&layouts[i], &u8g2, n);
+  }
+  printf("validation: %s\n", errors ? "FAIL" : "ok");
+
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  t_ref = time_polygon(&u8g2, DRAW_CONVEX_REF, hexagon, 6);
+  t_new = time_polygon(&u8g2, DRAW_RASTERIZER, hexagon, 6);
+  printf("hexagon, full buffer: %.0f ns convex procedure, %.0f ns rasterizer\n", t_ref, t_new);
+  u8g2_Setup_ssd1309_i2c_128x64_noname0_1(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+  t_ref = time_polygon(&u8g2, DRAW_CONVEX_REF, hexagon, 6);
+  t_new = time_polygon(&u8g2, DRAW_RASTERIZER, hexagon, 6);
+  printf("hexagon, 8 pages: %.0f ns convex procedure, %.0f ns rasterizer\n", t_ref, t_new);
+  t_ref = time_polygon(&u8g2, DRAW_CONVEX_REF, small_hexagon, 6);
+  t_new = time_polygon(&u8g2, DRAW_RASTERIZER, small_hexagon, 6);
+  printf("small hexagon, 8 pages: %.0f ns convex procedure, %.0f ns rasterizer\n", t_ref, t_new);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,497 @@
+/**
+ * @file rs485_trace.c
+ *
+ * @brief Host side decoder for RS485 protocol traces
+ *
+ * Reads a trace captured by the firmware (see main/include/rs485_trace.h)
+ * and prints every frame with its timestamp and a CTA-2045, EC-100 or
+ * Modbus annotation, followed by timing statistics.
+ *
+ *   rs485_trace [-g gap_ms] [file]
+ *
+ * The input may be a console log containing rs485_trace_print() output
+ * (the last dump in the log is decoded), the hex string posted to the
+ * RS485 trace transducer, or a raw binary snapshot.
+ *
+ * Receive records are chunks as the UART driver delivered them, stamped
+ * when the firmware dequeued the UART event; chunks less than gap_ms apart
+ * (default 10, the vendor frame gap) are joined into one frame. Transmit
+ * records are stamped when the frame was handed to the driver.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cta2045_link.h"
+#include "cta2045_app.h"
+#include "modbus_rtu.h"
+#include "rs485_trace.h"
+
+#define MAX_INPUT (1 << 20)
+#define MAX_RECORDS 8192
+#define MAX_JOINED 1024
+
+typedef struct {
+  uint32_t t_us;
+  uint8_t dir;
+  uint16_t len;
+  const uint8_t *data;
+} record_t;
+
+/** @brief running min/avg/max of a latency in microseconds */
+typedef struct {
+  const char *name;
+  uint32_t n;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+} timing_t;
+
+static timing_t turnaround = { "RX to TX turnaround" };
+static timing_t link_ack = { "message to link ACK/NAK" };
+static timing_t app_ack = { "DR command to application ACK" };
+static timing_t poll_period = { "EC-100 poll period" };
+static timing_t modbus_rsp = { "Modbus request to response" };
+
+/* state carried between frames for the timing statistics */
+static int have_rx;
+static uint32_t last_rx_us;
+static int waiting_ack;
+static uint32_t message_tx_us;
+static int waiting_app_ack;
+static uint8_t app_opcode;
+static uint32_t command_tx_us;
+static int have_poll;
+static uint32_t last_poll_us;
+static int waiting_modbus;
+static uint32_t modbus_tx_us;
+
+static unsigned frames_rx, frames_tx, bad_checksums, events;
+
+/*****************************************
+ ************ MODULE FUNCTIONS ***********
+ *****************************************/
+
+static void timing_add( timing_t *t, uint32_t us ) {
+  if ( t->n == 0 || us < t->min ) {
+    t->min = us;
+  }
+  if ( us > t->max ) {
+    t->max = us;
+  }
+  t->sum += us;
+  t->n++;
+}
+
+static void timing_print( const timing_t *t ) {
+  if ( t->n == 0 ) {
+    printf("  %-32s -\n", t->name);
+    return;
+  }
+  printf("  %-32s n %u, min %.3f ms, avg %.3f ms, max %.3f ms\n", t->name, t->n,
+         t->min / 1000.0, (double)t->sum / t->n / 1000.0, t->max / 1000.0);
+}
+
+static const char *nak_reason( uint8_t reason ) {
+  switch ( reason ) {
+    case CTA2045_NAK_NO_REASON: return "no reason";
+    case CTA2045_NAK_TIMEOUT: return "timeout";
+    case CTA2045_NAK_TOO_LONG: return "message too long";
+    case CTA2045_NAK_CHECKSUM: return "checksum";
+    case CTA2045_NAK_UNSUPPORTED: return "unsupported";
+    default: return "unknown";
+  }
+}
+
+static const char *dr_opcode( uint8_t opcode ) {
+  switch ( opcode ) {
+    case CTA2045_OP_SHED: return "shed";
+    case CTA2045_OP_END_SHED: return "end shed";
+    case CTA2045_OP_APP_ACK: return "application ACK";
+    case CTA2045_OP_APP_NAK: return "application NAK";
+    case CTA2045_OP_CRITICAL_PEAK: return "critical peak";
+    case CTA2045_OP_GRID_EMERGENCY: return "grid emergency";
+    case CTA2045_OP_OUTSIDE_COMM: return "outside comm status";
+    case CTA2045_OP_OPER_STATE_REQ: return "operational state request";
+    case CTA2045_OP_OPER_STATE: return "operational state";
+    case CTA2045_OP_LOAD_UP: return "load up";
+    default: return "unknown opcode";
+  }
+}
+
+static const char *event_name( uint8_t event ) {
+  switch ( event ) {
+    case RS485_TRACE_EV_FIFO_OVF: return "RX FIFO overflow";
+    case RS485_TRACE_EV_BUFFER_FULL: return "RX ring buffer full";
+    case RS485_TRACE_EV_PARITY: return "parity error";
+    case RS485_TRACE_EV_FRAME: return "framing error";
+    default: return "unknown event";
+  }
+}
+
+static void print_bytes( const uint8_t *data, size_t len ) {
+  size_t i;
+
+  for ( i = 0; i < len && i < 24; i++ ) {
+    printf(" %02x", data[i]);
+  }
+  if ( len > 24 ) {
+    printf(" ... (%zu bytes)", len);
+  }
+}
+
+static int modbus_crc_ok( const uint8_t *data, size_t len ) {
+  return len >= 4 && modbus_crc16(data, len - 2) == (data[len - 2] | data[len - 1] << 8);
+}
+
+/**
+ * @brief annotate a CTA-2045 message and update the DR command timings
+ */
+static void annotate_message( const uint8_t *data, size_t len, int tx, uint32_t t_us ) {
+  uint16_t type = data[0] << 8 | data[1];
+  uint16_t payload_len = data[2] << 8 | data[3];
+  uint16_t check = cta2045_checksum(data, len - CTA2045_CHECKSUM_SIZE);
+  int ok = data[len - 2] == (check >> 8) && data[len - 1] == (check & 0xff);
+  const uint8_t *payload = data + CTA2045_HEADER_SIZE;
+
+  bad_checksums += !ok;
+  if ( type == CTA2045_MSG_BASIC_DR && payload_len >= 2 ) {
+    printf("basic DR: %s", dr_opcode(payload[0]));
+    if ( payload[0] == CTA2045_OP_APP_ACK || payload[0] == CTA2045_OP_APP_NAK ) {
+      printf(" of %s", dr_opcode(payload[1]));
+    } else {
+      printf(", arg %u", payload[1]);
+    }
+  } else if ( type == CTA2045_MSG_INTERMEDIATE_DR ) {
+    printf("intermediate DR, %u bytes", payload_len);
+  } else if ( type == CTA2045_MSG_DATA_LINK ) {
+    printf("data link, %u bytes", payload_len);
+  } else {
+    printf("message type 0x%04x, %u bytes", type, payload_len);
+  }
+  printf("%s", ok ? "" : " [BAD CHECKSUM]");
+
+  if ( tx ) {
+    waiting_ack = 1;
+    message_tx_us = t_us;
+    if ( type == CTA2045_MSG_BASIC_DR && payload_len >= 2 &&
+         payload[0] != CTA2045_OP_APP_ACK && payload[0] != CTA2045_OP_APP_NAK ) {
+      waiting_app_ack = 1;
+      app_opcode = payload[0];
+      command_tx_us = t_us;
+    }
+  } else if ( waiting_app_ack && type == CTA2045_MSG_BASIC_DR && payload_len >= 2 &&
+              (payload[0] == CTA2045_OP_APP_ACK || payload[0] == CTA2045_OP_APP_NAK) &&
+              payload[1] == app_opcode ) {
+    timing_add(&app_ack, t_us - command_tx_us);
+    waiting_app_ack = 0;
+  }
+}
+
+/**
+ * @brief annotate a frame that is not CTA-2045: EC-100 vendor or Modbus
+ */
+static void annotate_other( const uint8_t *data, size_t len, int tx, uint32_t t_us ) {
+  if ( len == 2 && data[0] == 0x87 && data[1] == 0x00 ) {
+    printf("EC-100 poll");
+    if ( !tx ) {
+      if ( have_poll ) {
+        timing_add(&poll_period, t_us - last_poll_us);
+      }
+      have_poll = 1;
+      last_poll_us = t_us;
+    }
+  } else if ( len >= 5 && data[0] == 0x87 && data[1] == 0x09 && data[2] == 0x03 ) {
+    printf("EC-100 set point %u F", data[3]);
+  } else if ( len >= 17 && data[0] == 0x40 && data[1] == 0x09 && data[2] == 0x14 ) {
+    printf("EC-100 temperatures: top %u F, bottom %u F", data[15], data[16]);
+  } else if ( len >= 15 && data[0] == 0x40 && data[1] == 0x0B && data[2] == 0x0A ) {
+    printf("EC-100 status: heating %u", data[14]);
+  } else if ( modbus_crc_ok(data, len) ) {
+    if ( data[1] & 0x80 ) {
+      printf("Modbus slave %u exception 0x%02x to function 0x%02x", data[0], data[2], data[1] & 0x7f);
+    } else if ( tx && len == 8 ) {
+      printf("Modbus slave %u function 0x%02x, register %u, %s %u", data[0], data[1],
+             data[2] << 8 | data[3], data[1] == MODBUS_WRITE_SINGLE ? "value" : "count",
+             data[4] << 8 | data[5]);
+    } else {
+      printf("Modbus slave %u function 0x%02x response, %zu bytes", data[0], data[1], len);
+    }
+    if ( tx ) {
+      waiting_modbus = 1;
+      modbus_tx_us = t_us;
+    } else if ( waiting_modbus ) {
+      timing_add(&modbus_rsp, t_us - modbus_tx_us);
+      waiting_modbus = 0;
+    }
+  } else {
+    printf("vendor frame");
+  }
+}
+
+/**
+ * @brief split a joined buffer into frames and print each one
+ *
+ * A frame is stamped with the time of the chunk holding its last byte:
+ * chunk_end[i] is the offset just past chunk i, chunk_us[i] its time.
+ */
+static void decode_frames( const uint8_t *data, size_t len, int tx, const size_t *chunk_end,
+                           const uint32_t *chunk_us, uint32_t t0 ) {
+  size_t off = 0;
+  uint32_t t_us = 0;
+  size_t n;
+  int c = 0;
+
+  while ( len > 0 ) {
+    if ( (data[0] == CTA2045_LINK_ACK || data[0] == CTA2045_LINK_NAK) && len >= 2 ) {
+      n = 2;
+    } else if ( data[0] == CTA2045_MSG_TYPE1_DR && len >= CTA2045_HEADER_SIZE + CTA2045_CHECKSUM_SIZE &&
+                CTA2045_HEADER_SIZE + (data[2] << 8 | data[3]) + CTA2045_CHECKSUM_SIZE <= len ) {
+      n = CTA2045_HEADER_SIZE + (data[2] << 8 | data[3]) + CTA2045_CHECKSUM_SIZE;
+    } else {
+      n = len;
+    }
+    while ( chunk_end[c] < off + n ) {
+      c++;
+    }
+    t_us = chunk_us[c];
+
+    printf("%12.3f ms  %s ", (t_us - t0) / 1000.0, tx ? "TX" : "RX");
+    print_bytes(data, n);
+    printf("\n%19s", "");
+
+    if ( tx ) {
+      frames_tx++;
+      if ( have_rx ) {
+        timing_add(&turnaround, t_us - last_rx_us);
+        have_rx = 0;
+      }
+    } else {
+      frames_rx++;
+    }
+
+    if ( n == 2 && data[0] == CTA2045_LINK_ACK ) {
+      printf("link ACK");
+    } else if ( n == 2 && data[0] == CTA2045_LINK_NAK ) {
+      printf("link NAK: %s", nak_reason(data[1]));
+    } else if ( data[0] == CTA2045_MSG_TYPE1_DR && n >= CTA2045_HEADER_SIZE + CTA2045_CHECKSUM_SIZE &&
+                CTA2045_HEADER_SIZE + (data[2] << 8 | data[3]) + CTA2045_CHECKSUM_SIZE == n ) {
+      annotate_message(data, n, tx, t_us);
+    } else {
+      annotate_other(data, n, tx, t_us);
+    }
+    if ( !tx && n == 2 && waiting_ack ) {
+      timing_add(&link_ack, t_us - message_tx_us);
+      waiting_ack = 0;
+    }
+    printf("\n");
+
+    data += n;
+    off += n;
+    len -= n;
+  }
+  if ( !tx ) {
+    have_rx = 1;
+    last_rx_us = t_us;
+  }
+}
+
+static int hex_value( int c ) {
+  if ( c >= '0' && c <= '9' ) {
+    return c - '0';
+  }
+  c = tolower(c);
+  if ( c >= 'a' && c <= 'f' ) {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+/**
+ * @brief append the hex digits of a string to a buffer
+ *
+ * @return number of bytes appended
+ */
+static size_t hex_append( const char *s, uint8_t *dst, size_t size ) {
+  size_t n = 0;
+  int hi, lo;
+
+  while ( *s && n < size ) {
+    hi = hex_value(s[0]);
+    lo = hi < 0 ? -1 : hex_value(s[1]);
+    if ( hi < 0 || lo < 0 ) {
+      s++;
+      continue;
+    }
+    dst[n++] = hi << 4 | lo;
+    s += 2;
+  }
+  return n;
+}
+
+/**
+ * @brief turn the input (console log, hex string or binary) into a snapshot
+ *
+ * @return snapshot length, 0 if no trace was found
+ */
+static size_t load( const uint8_t *in, size_t in_len, uint8_t *out, size_t size ) {
+  static const char prefix[] = "rs485 trace: ";
+  const char *line, *end, *p;
+  char buf[1024];
+  char *text;
+  size_t len = 0;
+  size_t n;
+  int found = 0;
+
+  if ( in_len >= RS485_TRACE_MAGIC_SIZE && memcmp(in, RS485_TRACE_MAGIC, RS485_TRACE_MAGIC_SIZE) == 0 ) {
+    n = in_len < size ? in_len : size;
+    memcpy(out, in, n);
+    return n;
+  }
+
+  for ( line = (const char *)in; line < (const char *)in + in_len; line = end + 1 ) {
+    end = memchr(line, '\n', (const char *)in + in_len - line);
+    if ( end == NULL ) {
+      end = (const char *)in + in_len;
+    }
+    n = end - line < sizeof(buf) - 1 ? end - line : sizeof(buf) - 1;
+    memcpy(buf, line, n);
+    buf[n] = '\0';
+    p = strstr(buf, prefix);
+    if ( p == NULL ) {
+      continue;
+    }
+    found = 1;
+    p += sizeof(prefix) - 1;
+    if ( strncmp(p, "begin", 5) == 0 ) {
+      len = 0;   /* keep the last dump only */
+    } else if ( strncmp(p, "end", 3) != 0 ) {
+      len += hex_append(p, out + len, size - len);
+    }
+  }
+
+  /* a bare hex string, as posted over WiFi */
+  if ( !found ) {
+    text = malloc(in_len + 1);
+    if ( text == NULL ) {
+      return 0;
+    }
+    memcpy(text, in, in_len);
+    text[in_len] = '\0';
+    len = hex_append(text, out, size);
+    free(text);
+  }
+
+  if ( len < RS485_TRACE_MAGIC_SIZE || memcmp(out, RS485_TRACE_MAGIC, RS485_TRACE_MAGIC_SIZE) != 0 ) {
+    return 0;
+  }
+  return len;
+}
+
+/**
+ * @brief split a snapshot into records
+ *
+ * @return number of records, -1 if the snapshot is truncated
+ */
+static int parse( const uint8_t *snap, size_t len, record_t *rec, int max ) {
+  size_t pos = RS485_TRACE_MAGIC_SIZE;
+  int n = 0;
+
+  while ( pos < len && n < max ) {
+    if ( pos + RS485_TRACE_HEADER_SIZE > len || pos + RS485_TRACE_HEADER_SIZE + snap[pos + 5] > len ) {
+      return -1;
+    }
+    rec[n].t_us = snap[pos] | snap[pos + 1] << 8 | snap[pos + 2] << 16 | (uint32_t)snap[pos + 3] << 24;
+    rec[n].dir = snap[pos + 4];
+    rec[n].len = snap[pos + 5];
+    rec[n].data = &snap[pos + RS485_TRACE_HEADER_SIZE];
+    pos += RS485_TRACE_HEADER_SIZE + rec[n].len;
+    n++;
+  }
+  return n;
+}
+
+/*****************************************
+ *********** INTERFACE FUNCTIONS *********
+ *****************************************/
+
+int main( int argc, char **argv ) {
+  static uint8_t in[MAX_INPUT];
+  static uint8_t snap[MAX_INPUT];
+  static record_t rec[MAX_RECORDS];
+  uint8_t joined[MAX_JOINED];
+  size_t chunk_end[MAX_JOINED];
+  uint32_t chunk_us[MAX_JOINED];
+  uint32_t gap_us = CTA2045_VENDOR_GAP_MS * 1000;
+  size_t in_len, snap_len, len;
+  uint32_t t0, t_end;
+  FILE *f = stdin;
+  int n, i, j, c;
+
+  for ( i = 1; i < argc; i++ ) {
+    if ( strcmp(argv[i], "-g") == 0 && i + 1 < argc ) {
+      gap_us = atoi(argv[++i]) * 1000;
+    } else if ( argv[i][0] == '-' ) {
+      fprintf(stderr, "usage: rs485_trace [-g gap_ms] [file]\n");
+      return 2;
+    } else if ( (f = fopen(argv[i], "rb")) == NULL ) {
+      perror(argv[i]);
+      return 1;
+    }
+  }
+
+  in_len = fread(in, 1, sizeof(in), f);
+  snap_len = load(in, in_len, snap, sizeof(snap));
+  if ( snap_len == 0 ) {
+    fprintf(stderr, "no RS485 trace found\n");
+    return 1;
+  }
+  n = parse(snap, snap_len, rec, MAX_RECORDS);
+  if ( n < 0 ) {
+    fprintf(stderr, "truncated trace\n");
+    return 1;
+  }
+  if ( n == 0 ) {
+    printf("empty trace\n");
+    return 0;
+  }
+
+  t0 = rec[0].t_us;
+  for ( i = 0; i < n; i = j ) {
+    if ( rec[i].dir == RS485_TRACE_EVENT ) {
+      printf("%12.3f ms  !! %s\n", (rec[i].t_us - t0) / 1000.0,
+             rec[i].len ? event_name(rec[i].data[0]) : "event");
+      events++;
+      j = i + 1;
+      continue;
+    }
+
+    /* transmit records are whole frames, received chunks less than the
+     * gap apart are joined */
+    len = 0;
+    c = 0;
+    t_end = rec[i].t_us;
+    for ( j = i; j < n && rec[j].dir == rec[i].dir && rec[j].t_us - t_end < gap_us &&
+                 len + rec[j].len <= sizeof(joined) &&
+                 (j == i || rec[j].dir == RS485_TRACE_RX); j++ ) {
+      memcpy(joined + len, rec[j].data, rec[j].len);
+      len += rec[j].len;
+      t_end = rec[j].t_us;
+      chunk_end[c] = len;
+      chunk_us[c++] = t_end;
+    }
+    if ( len > 0 ) {
+      decode_frames(joined, len, rec[i].dir == RS485_TRACE_TX, chunk_end, chunk_us, t0);
+    }
+  }
+
+  printf("\n%d records over %.3f ms: %u frames received, %u sent, %u bad checksums, %u line events\n",
+         n, (rec[n - 1].t_us - t0) / 1000.0, frames_rx, frames_tx, bad_checksums, events);
+  timing_print(&turnaround);
+  timing_print(&link_ack);
+  timing_print(&app_ack);
+  timing_print(&poll_period);
+  timing_print(&modbus_rsp);
+  return 0;
+}
@@ -0,0 +1,321 @@
+/**
+ * @file u8g2_bench.c
+ *
+ * @brief host microbenchmarks of the u8g2 rendering engine
+ *
+ * Times representative u8g2 operations on the firmware's u8g2 copy, set up
+ * as in lcd_module.c (SSD1309 128x64 full frame buffer) with a byte
+ * callback that discards the data, so only the rendering code is measured.
+ *
+ *   u8g2_bench [-t ms] [-r runs] [-f filter]
+ *
+ * Each benchmark is calibrated to take at least -t milliseconds per run
+ * (default 20) and run -r times (default 5). Benchmarks whose name does not
+ * contain the -f filter are skipped. The results go to stdout as CSV,
+ * one line per benchmark, after a header line; lines starting with '#'
+ * are comments:
+ *
+ *   bench,iterations,runs,ns_min,ns_median,ops_per_s
+ *
+ * ns_min and ns_median are the time of one operation, ops_per_s is based
+ * on ns_min. Compare two result files to spot regressions in csrc/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "u8g2.h"
+#include "lcd_screens.h"
+
+#define WIDTH 128
+#define HEIGHT 64
+#define MAX_RUNS 32
+
+extern const uint8_t u8g2_font_t0_13_te[];
+extern const uint8_t u8g2_font_helvB08_tr[];
+extern const uint8_t u8g2_font_ncenB14_tr[];
+extern const uint8_t u8g2_font_inb16_mr[];
+extern const uint8_t u8g2_font_logisoso32_tn[];
+
+/** @brief a benchmark: setup runs once before timing, op is timed */
+typedef struct {
+  const char *name;
+  void (*setup)(u8g2_t *u8g2);
+  void (*op)(u8g2_t *u8g2);
+} bench_t;
+
+static u8g2_glyph_cache_t cache;
+static uint8_t shadow[WIDTH * HEIGHT / 8];
+static lcd_ui_t ui;
+static lcd_ui_model_t model;
+
+/* 16x16 XBM: a framed cross */
+static const uint8_t xbm16[] = {
+  0xff, 0xff, 0x01, 0x80, 0x05, 0xa0, 0x09, 0x90, 0x11, 0x88, 0x21, 0x84,
+  0x41, 0x82, 0x81, 0x81, 0x81, 0x81, 0x41, 0x82, 0x21, 0x84, 0x11, 0x88,
+  0x09, 0x90, 0x05, 0xa0, 0x01, 0x80, 0xff, 0xff
+};
+/* full screen XBM, filled in main() */
+static uint8_t xbm_full[WIDTH / 8 * HEIGHT];
+/* both as tile bitmaps, converted in main() */
+static uint8_t tile16[16 * 16 / 8];
+static uint8_t tile_full[WIDTH * HEIGHT / 8];
+
+static uint8_t byte_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static uint8_t gpio_cb( u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr ) {
+  return 1;
+}
+
+static double now_ns( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*****************************************
+ ************* BENCHMARKS ****************
+ *****************************************/
+
+static void setup_font( u8g2_t *u8g2, const uint8_t *font, uint8_t dir ) {
+  u8g2_SetFont(u8g2, font);
+  u8g2_SetFontDirection(u8g2, dir);
+  u8g2_SetFontMode(u8g2, 0);
+  u8g2_SetDrawColor(u8g2, 1);
+}
+
+static void setup_t0_dir0( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_t0_13_te, 0); }
+static void setup_t0_dir1( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_t0_13_te, 1); }
+static void setup_t0_dir2( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_t0_13_te, 2); }
+static void setup_t0_dir3( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_t0_13_te, 3); }
+static void setup_t0_cached( u8g2_t *u8g2 ) {
+  setup_t0_dir0(u8g2);
+  u8g2_SetGlyphCache(u8g2, &cache);
+}
+static void setup_helvB08( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_helvB08_tr, 0); }
+static void setup_ncenB14( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_ncenB14_tr, 0); }
+static void setup_inb16( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_inb16_mr, 0); }
+static void setup_logisoso32( u8g2_t *u8g2 ) { setup_font(u8g2, u8g2_font_logisoso32_tn, 0); }
+
+/* the text of the vitals screen, from the middle of the display for all directions */
+static void op_str( u8g2_t *u8g2 ) { u8g2_DrawStr(u8g2, 64, 32, "Freq: 60.0012Hz"); }
+static void op_str_left( u8g2_t *u8g2 ) { u8g2_DrawStr(u8g2, 0, 40, "Freq: 60.0012Hz"); }
+static void op_digits( u8g2_t *u8g2 ) { u8g2_DrawStr(u8g2, 0, 48, "60.001"); }
+
+static void op_clear( u8g2_t *u8g2 ) { u8g2_ClearBuffer(u8g2); }
+static void op_box_small( u8g2_t *u8g2 ) { u8g2_DrawBox(u8g2, 13, 21, 10, 10); }
+static void op_box_row( u8g2_t *u8g2 ) { u8g2_DrawBox(u8g2, 10, 16, 118, 14); }
+static void op_box_full( u8g2_t *u8g2 ) { u8g2_DrawBox(u8g2, 0, 0, WIDTH, HEIGHT); }
+static void op_frame_small( u8g2_t *u8g2 ) { u8g2_DrawFrame(u8g2, 13, 21, 10, 10); }
+static void op_frame_full( u8g2_t *u8g2 ) { u8g2_DrawFrame(u8g2, 0, 0, WIDTH, HEIGHT); }
+static void op_disc_r10( u8g2_t *u8g2 ) { u8g2_DrawDisc(u8g2, 64, 32, 10, U8G2_DRAW_ALL); }
+static void op_disc_r30( u8g2_t *u8g2 ) { u8g2_DrawDisc(u8g2, 64, 32, 30, U8G2_DRAW_ALL); }
+static void op_circle_r10( u8g2_t *u8g2 ) { u8g2_DrawCircle(u8g2, 64, 32, 10, U8G2_DRAW_ALL); }
+static void op_circle_r30( u8g2_t *u8g2 ) { u8g2_DrawCircle(u8g2, 64, 32, 30, U8G2_DRAW_ALL); }
+static void op_triangle( u8g2_t *u8g2 ) { u8g2_DrawTriangle(u8g2, 10, 60, 64, 4, 118, 50); }
+
+static void op_polygon_hex( u8g2_t *u8g2 ) {
+  static const int16_t hex[6][2] = {
+    { 40, 4 }, { 88, 4 }, { 112, 32 }, { 88, 60 }, { 40, 60 }, { 16, 32 }
+  };
+  int i;
+
+  u8g2_ClearPolygonXY();
+  for ( i = 0; i < 6; i++ ) {
+    u8g2_AddPolygonXY(u8g2, hex[i][0], hex[i][1]);
+  }
+  u8g2_DrawPolygon(u8g2);
+}
+
+/* concave, more than the 6 points of the built-in polygon buffer */
+static void op_polygon_star10( u8g2_t *u8g2 ) {
+  static const int16_t star[10][2] = {
+    { 64, 2 }, { 72, 22 }, { 94, 23 }, { 77, 37 }, { 83, 59 },
+    { 64, 47 }, { 45, 59 }, { 51, 37 }, { 34, 23 }, { 56, 22 }
+  };
+  static u8g2_pg_point_t points[10];
+  int i;
+
+  u8g2_SetPolygonBuffer(points, 10);
+  for ( i = 0; i < 10; i++ ) {
+    u8g2_AddPolygonXY(u8g2, star[i][0], star[i][1]);
+  }
+  u8g2_DrawPolygon(u8g2);
+  u8g2_SetPolygonBuffer(NULL, 0);
+}
+
+static void op_xbm16_aligned( u8g2_t *u8g2 ) { u8g2_DrawXBM(u8g2, 16, 16, 16, 16, xbm16); }
+static void op_xbm16_unaligned( u8g2_t *u8g2 ) { u8g2_DrawXBM(u8g2, 13, 21, 16, 16, xbm16); }
+static void op_xbm_full( u8g2_t *u8g2 ) { u8g2_DrawXBM(u8g2, 0, 0, WIDTH, HEIGHT, xbm_full); }
+static void op_tile16_aligned( u8g2_t *u8g2 ) { u8g2_DrawTileBitmap(u8g2, 16, 16, 16, 16, tile16); }
+static void op_tile16_unaligned( u8g2_t *u8g2 ) { u8g2_DrawTileBitmap(u8g2, 13, 21, 16, 16, tile16); }
+static void op_tile_full( u8g2_t *u8g2 ) { u8g2_DrawTileBitmap(u8g2, 0, 0, WIDTH, HEIGHT, tile_full); }
+
+/* lcd_module: the vitals screen drawn from scratch, as after a screen change */
+static void setup_lcd( u8g2_t *u8g2 ) {
+  memset(&model, 0, sizeof(model));
+  model.state.grid_freq = 60.0012;
+  model.state.power = 4512.25;
+  model.state.heating_status = 1;
+  model.state.set_point = 120;
+  model.state.mode = 1;
+  model.state.temp_top = 118;
+  model.state.temp_bottom = 104;
+  u8g2_SetGlyphCache(u8g2, &cache);
+  lcd_screens_init(&ui);
+}
+
+static void op_lcd_frame_full( u8g2_t *u8g2 ) {
+  lcd_screens_init(&ui);
+  lcd_ui_update(&ui, &model);
+  lcd_ui_draw(&ui, u8g2, 0);
+}
+
+/* lcd_module: one changed value, the usual frame */
+static void op_lcd_frame_partial( u8g2_t *u8g2 ) {
+  model.state.grid_freq = model.state.grid_freq == 60.0012f ? 59.9987f : 60.0012f;
+  lcd_ui_update(&ui, &model);
+  lcd_ui_draw(&ui, u8g2, 0);
+}
+
+/* lcd_module transfer: all tiles, and none with the shadow up to date */
+static void setup_send( u8g2_t *u8g2 ) {
+  op_lcd_frame_full(u8g2);
+  u8g2_SetShadowBuffer(u8g2, shadow);
+}
+static void op_send_full( u8g2_t *u8g2 ) {
+  u8g2_InvalidateShadowBuffer(u8g2);
+  u8g2_SendBuffer(u8g2);
+}
+static void op_send_unchanged( u8g2_t *u8g2 ) { u8g2_SendBuffer(u8g2); }
+
+static const bench_t benches[] = {
+  { "clear_buffer", NULL, op_clear },
+  { "str_t0_13_dir0", setup_t0_dir0, op_str_left },
+  { "str_t0_13_dir1", setup_t0_dir1, op_str },
+  { "str_t0_13_dir2", setup_t0_dir2, op_str },
+  { "str_t0_13_dir3", setup_t0_dir3, op_str },
+  { "str_t0_13_cached", setup_t0_cached, op_str_left },
+  { "str_helvB08", setup_helvB08, op_str_left },
+  { "str_ncenB14", setup_ncenB14, op_str_left },
+  { "str_inb16", setup_inb16, op_str_left },
+  { "str_logisoso32_digits", setup_logisoso32, op_digits },
+  { "box_10x10", NULL, op_box_small },
+  { "box_118x14", NULL, op_box_row },
+  { "box_full", NULL, op_box_full },
+  { "frame_10x10", NULL, op_frame_small },
+  { "frame_full", NULL, op_frame_full },
+  { "disc_r10", NULL, op_disc_r10 },
+  { "disc_r30", NULL, op_disc_r30 },
+  { "circle_r10", NULL, op_circle_r10 },
+  { "circle_r30", NULL, op_circle_r30 },
+  { "triangle", NULL, op_triangle },
+  { "polygon_hex6", NULL, op_polygon_hex },
+  { "polygon_star10", NULL, op_polygon_star10 },
+  { "xbm_16x16_aligned", NULL, op_xbm16_aligned },
+  { "xbm_16x16_unaligned", NULL, op_xbm16_unaligned },
+  { "xbm_full", NULL, op_xbm_full },
+  { "tile_16x16_aligned", NULL, op_tile16_aligned },
+  { "tile_16x16_unaligned", NULL, op_tile16_unaligned },
+  { "tile_full", NULL, op_tile_full },
+  { "lcd_frame_full", setup_lcd, op_lcd_frame_full },
+  { "lcd_frame_partial", setup_lcd, op_lcd_frame_partial },
+  { "lcd_send_full", setup_send, op_send_full },
+  { "lcd_send_unchanged", setup_send, op_send_unchanged },
+};
+#define BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+/*****************************************
+ *************** RUNNER ******************
+ *****************************************/
+
+static double run( u8g2_t *u8g2, const bench_t *b, long iterations ) {
+  double start;
+  long i;
+
+  start = now_ns();
+  for ( i = 0; i < iterations; i++ ) {
+    b->op(u8g2);
+  }
+  return now_ns() - start;
+}
+
+static int cmp_double( const void *a, const void *b ) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main( int argc, char **argv ) {
+  u8g2_t u8g2;
+  const char *filter = NULL;
+  double run_ns = 20e6;
+  double ns[MAX_RUNS];
+  long iterations;
+  int runs = 5;
+  int opt;
+  int i, r;
+
+  while ( (opt = getopt(argc, argv, "t:r:f:")) != -1 ) {
+    switch ( opt ) {
+    case 't':
+      run_ns = atof(optarg) * 1e6;
+      break;
+    case 'r':
+      runs = atoi(optarg);
+      break;
+    case 'f':
+      filter = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-t ms] [-r runs] [-f filter]\n", argv[0]);
+      return 2;
+    }
+  }
+  if ( runs < 1 || runs > MAX_RUNS ) {
+    fprintf(stderr, "runs must be 1..%d\n", MAX_RUNS);
+    return 2;
+  }
+
+  for ( i = 0; i < sizeof(xbm_full); i++ ) {
+    xbm_full[i] = (i / (WIDTH / 8)) & 1 ? 0xaa : 0x55;
+  }
+  u8g2_ConvertXBMToTileBitmap(16, 16, xbm16, tile16);
+  u8g2_ConvertXBMToTileBitmap(WIDTH, HEIGHT, xbm_full, tile_full);
+
+  printf("# u8g2_bench: ssd1309 128x64 full buffer, U8G2_R0\n");
+  printf("bench,iterations,runs,ns_min,ns_median,ops_per_s\n");
+
+  for ( i = 0; i < BENCHES; i++ ) {
+    if ( filter != NULL && strstr(benches[i].name, filter) == NULL ) {
+      continue;
+    }
+
+    /* a fresh display for each benchmark, as lcd_module draws it */
+    u8g2_Setup_ssd1309_i2c_128x64_noname0_f(&u8g2, U8G2_R0, byte_cb, gpio_cb);
+    u8g2_ClearBuffer(&u8g2);
+    if ( benches[i].setup != NULL ) {
+      benches[i].setup(&u8g2);
+    }
+
+    /* calibrate: double the iterations until a run takes long enough */
+    iterations = 1;
+    while ( run(&u8g2, &benches[i], iterations) < run_ns && iterations < (1L << 30) ) {
+      iterations *= 2;
+    }
+
+    for ( r = 0; r < runs; r++ ) {
+      ns[r] = run(&u8g2, &benches[i], iterations) / iterations;
+    }
+    qsort(ns, runs, sizeof(ns[0]), cmp_double);
+
+    printf("%s,%ld,%d,%.1f,%.1f,%.0f\n", benches[i].name, iterations, runs,
+           ns[0], ns[runs / 2], 1e9 / ns[0]);
+    fflush(stdout);
+  }
+  return 0;
+}